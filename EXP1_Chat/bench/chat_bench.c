@@ -0,0 +1,546 @@
+/**
+ * 聊天服务端的压力测试
+ *
+ * 在一个进程中用 epoll 打开大量并发连接，模拟许多客户端：
+ *   1. 所有连接完成握手（发送名字，可选进入指定房间），等服务端的入场通知发完
+ *   2. 其中 senders 个连接按总速率 rate 轮流发送消息，持续 duration 秒，
+ *      消息内容中带有发送时间
+ *   3. 停止发送后继续接收一段时间，等在途的消息到达
+ * 指定 --stalled N 时最后 N 个连接握手后不再读取（接收缓冲区也设得很小），模拟卡住的客户端，
+ * 用来检查它们不会拖慢其他人的广播：其余连接的送达率和延迟应与没有卡住的连接时相同。
+ * 每个连接收到测试消息时用当前时间减去消息中的发送时间，得到端到端的广播延迟。
+ * 指定 --nodes N 时连接轮流分配到 port、port+1、……、port+N-1 上的 N 个集群节点，
+ * 发送者也分布在各节点上，用来测量节点间转发的吞吐和延迟。
+ * 结果以 JSON 输出到标准输出（进度信息输出到标准错误），便于比较不同的服务端模式。
+ *
+ * 用法：chat_bench [选项]，选项见 print_usage
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../src/packet.h"
+
+// 测试消息的前缀，后面是发送时间（微秒）和填充字节
+#define BENCH_TAG "BENCH "
+// 客户端允许接收的最大消息长度
+#define BENCH_MAX_MESSAGE (1024 * 1024)
+// 握手后等待入场通知发完：连续这么久没有收到消息即认为已经安静下来
+#define SETTLE_QUIET_US 500000
+#define SETTLE_MAX_US 30000000
+// 停止发送后最多继续接收多久
+#define DRAIN_MAX_US 5000000
+// 延迟直方图：小于 64 微秒的值精确记录，更大的值每个 2 的幂区间分 64 个桶（误差不超过 1.6%）
+#define HIST_SUB_BUCKETS 64
+#define HIST_BUCKETS (HIST_SUB_BUCKETS * 40)
+
+struct bench_options
+{
+    const char *host;
+    int port;
+    int nodes;         // 集群节点数，节点的端口从 port 开始连续
+    const char *label; // 写入结果的标签，如服务端模式名
+    const char *room;  // 握手后进入的房间，NULL 表示留在默认房间
+    size_t clients;
+    size_t senders;
+    size_t stalled;    // 握手后不再读取的连接数（最后 stalled 个连接）
+    double rate;       // 所有发送者合计每秒发送的消息数
+    double duration;   // 发送持续的秒数
+    size_t size;       // 消息内容长度
+};
+
+struct bench_conn
+{
+    int fd;
+    bool connected;
+    bool writing;      // 是否在等待 EPOLLOUT
+    bool stalled;      // 握手后不再读取
+    struct frame_reader reader;
+    char *out;         // 尚未发出的数据
+    size_t out_len;
+    size_t out_sent;
+    size_t out_capacity;
+};
+
+static struct
+{
+    struct bench_options options;
+    int epfd;
+    struct bench_conn *conns;
+    size_t connected;
+    size_t closed;
+    bool measuring;             // 只统计发送阶段开始之后发出的消息
+    unsigned long long scheduled; // 按速率已轮到的发送次数，包括发送者已断开、没有发出的
+    unsigned long long sent;
+    unsigned long long delivered;
+    unsigned long long other;   // 收到的其他消息（通知、提示等）
+    unsigned long long errors;
+    unsigned long long hist[HIST_BUCKETS];
+    unsigned long long latency_max;
+    double latency_sum;
+    uint64_t last_receive;
+} bench;
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t hist_index(uint64_t value)
+{
+    if (value < HIST_SUB_BUCKETS) {
+        return value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    size_t index = (size_t)(exponent - 5) * HIST_SUB_BUCKETS + ((value >> (exponent - 6)) & (HIST_SUB_BUCKETS - 1));
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+// 桶的下界
+static uint64_t hist_value(size_t index)
+{
+    if (index < HIST_SUB_BUCKETS) {
+        return index;
+    }
+    int exponent = (int)(index / HIST_SUB_BUCKETS) + 5;
+    return (uint64_t)(HIST_SUB_BUCKETS + index % HIST_SUB_BUCKETS) << (exponent - 6);
+}
+
+static uint64_t hist_percentile(double p)
+{
+    if (bench.delivered == 0) {
+        return 0;
+    }
+    unsigned long long target = (unsigned long long)(p * bench.delivered);
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; i++) {
+        seen += bench.hist[i];
+        if (seen > target) {
+            return hist_value(i);
+        }
+    }
+    return bench.latency_max;
+}
+
+static void conn_update_events(struct bench_conn *c, bool writing)
+{
+    if (c->writing == writing) {
+        return;
+    }
+    struct epoll_event ev = { .events = (c->stalled ? 0 : EPOLLIN) | (writing ? EPOLLOUT : 0), .data.ptr = c };
+    epoll_ctl(bench.epfd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->writing = writing;
+}
+
+static void conn_close(struct bench_conn *c)
+{
+    if (c->fd < 0) {
+        return;
+    }
+    epoll_ctl(bench.epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    frame_reader_destroy(&c->reader);
+    bench.closed++;
+}
+
+// 尽量写出缓冲区中的数据，写不完时等待 EPOLLOUT
+static void conn_flush(struct bench_conn *c)
+{
+    while (c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                bench.errors++;
+                conn_close(c);
+                return;
+            }
+            break;
+        }
+        c->out_sent += n;
+    }
+    if (c->out_sent == c->out_len) {
+        c->out_sent = 0;
+        c->out_len = 0;
+    }
+    conn_update_events(c, c->out_len > 0);
+}
+
+// 把一帧放进发送缓冲区
+static void conn_queue(struct bench_conn *c, const char *msg, size_t len)
+{
+    size_t need = c->out_len + 4 + len;
+    if (need > c->out_capacity) {
+        // 先丢掉已发出的部分
+        memmove(c->out, c->out + c->out_sent, c->out_len - c->out_sent);
+        c->out_len -= c->out_sent;
+        c->out_sent = 0;
+        need = c->out_len + 4 + len;
+        if (need > c->out_capacity) {
+            size_t capacity = c->out_capacity == 0 ? 4096 : c->out_capacity;
+            while (capacity < need) {
+                capacity *= 2;
+            }
+            c->out = realloc(c->out, capacity);
+            c->out_capacity = capacity;
+        }
+    }
+    uint32_t net_len = htonl((uint32_t)len);
+    memcpy(c->out + c->out_len, &net_len, 4);
+    memcpy(c->out + c->out_len + 4, msg, len);
+    c->out_len += 4 + len;
+}
+
+static void handle_message(const char *msg, size_t len)
+{
+    uint64_t now = now_us();
+    bench.last_receive = now;
+    // 服务端转发的消息为 "[名字] 内容\n"
+    const char *body = memchr(msg, ']', len);
+    if (body == NULL || (size_t)(msg + len - body) < 2 + strlen(BENCH_TAG)
+        || memcmp(body + 2, BENCH_TAG, strlen(BENCH_TAG)) != 0) {
+        bench.other++;
+        return;
+    }
+    uint64_t sent_at = strtoull(body + 2 + strlen(BENCH_TAG), NULL, 10);
+    if (!bench.measuring || sent_at > now) {
+        bench.other++;
+        return;
+    }
+    uint64_t latency = now - sent_at;
+    bench.delivered++;
+    bench.hist[hist_index(latency)]++;
+    bench.latency_sum += latency;
+    if (latency > bench.latency_max) {
+        bench.latency_max = latency;
+    }
+}
+
+static void handle_readable(struct bench_conn *c)
+{
+    ssize_t n = frame_reader_fill(&c->reader);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        if (n < 0) {
+            bench.errors++;
+        }
+        conn_close(c);
+        return;
+    }
+    char *msg;
+    size_t len;
+    int ret;
+    while ((ret = frame_reader_next(&c->reader, &msg, &len)) > 0) {
+        handle_message(msg, len);
+    }
+    if (ret < 0) {
+        bench.errors++;
+        conn_close(c);
+    }
+}
+
+// 连接建立后发送名字，需要时进入指定房间
+static void handle_connected(struct bench_conn *c)
+{
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0) {
+        bench.errors++;
+        conn_close(c);
+        return;
+    }
+    c->connected = true;
+    bench.connected++;
+
+    char text[64];
+    int len = snprintf(text, sizeof(text), "bench%zu", (size_t)(c - bench.conns));
+    conn_queue(c, text, len);
+    if (bench.options.room != NULL) {
+        char join[128];
+        len = snprintf(join, sizeof(join), "/join %s", bench.options.room);
+        conn_queue(c, join, len);
+    }
+    conn_flush(c);
+}
+
+// 处理一轮事件，最多等待 timeout_ms 毫秒
+static void poll_events(int timeout_ms)
+{
+    struct epoll_event events[256];
+    int n = epoll_wait(bench.epfd, events, 256, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        struct bench_conn *c = events[i].data.ptr;
+        if (c->fd < 0) {
+            continue;
+        }
+        if (!c->connected) {
+            handle_connected(c);
+            continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+            handle_readable(c);
+        }
+        if (c->fd >= 0 && (events[i].events & EPOLLOUT)) {
+            conn_flush(c);
+        }
+    }
+}
+
+static bool open_connections()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, bench.options.host, &addr.sin_addr) != 1) {
+        fprintf(stderr, "无效的服务端地址 %s\n", bench.options.host);
+        return false;
+    }
+
+    for (size_t i = 0; i < bench.options.clients; i++) {
+        struct bench_conn *c = &bench.conns[i];
+        c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (c->fd < 0) {
+            perror("socket");
+            return false;
+        }
+        int one = 1;
+        setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (i >= bench.options.clients - bench.options.stalled) {
+            // 在连接前设置才能缩小 TCP 窗口，让服务端尽快写不进去
+            int rcvbuf = 4096;
+            setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        }
+        frame_reader_init(&c->reader, c->fd, BENCH_MAX_MESSAGE);
+        addr.sin_port = htons(bench.options.port + (int)(i % bench.options.nodes));
+        if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            perror("connect");
+            return false;
+        }
+        // 连接完成时可写
+        struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = c };
+        epoll_ctl(bench.epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        c->writing = true;
+        // 不要一次积压太多未完成的连接，服务端的 listen 队列可能很短
+        if (i - bench.connected - bench.closed >= 128) {
+            poll_events(1);
+        }
+    }
+    return true;
+}
+
+// 发送一条测试消息
+static void send_message(size_t sender)
+{
+    struct bench_conn *c = &bench.conns[sender];
+    if (c->fd < 0) {
+        return;
+    }
+    static char *text = NULL;
+    if (text == NULL) {
+        text = malloc(bench.options.size + 64);
+    }
+    int len = snprintf(text, 64, BENCH_TAG "%llu ", (unsigned long long)now_us());
+    // 用填充字节补齐到指定长度
+    size_t total = bench.options.size > (size_t)len ? bench.options.size : (size_t)len;
+    memset(text + len, 'x', total - len);
+    conn_queue(c, text, total);
+    conn_flush(c);
+    bench.sent++;
+}
+
+// 最后 stalled 个连接不再读取，服务端发给它们的数据会积压在 socket 缓冲区和发送队列中
+static size_t stall_connections()
+{
+    size_t stalled = 0;
+    for (size_t i = bench.options.clients - bench.options.stalled; i < bench.options.clients; i++) {
+        struct bench_conn *c = &bench.conns[i];
+        if (c->fd < 0) {
+            continue;
+        }
+        c->stalled = true;
+        struct epoll_event ev = { .events = c->writing ? EPOLLOUT : 0, .data.ptr = c };
+        epoll_ctl(bench.epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        stalled++;
+    }
+    return stalled;
+}
+
+static void raise_fd_limit(size_t need)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < need + 64) {
+        limit.rlim_cur = limit.rlim_max < need + 64 ? limit.rlim_max : need + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static void print_results(double connect_seconds, double send_seconds, size_t members, size_t stalled)
+{
+    // 服务端把消息广播给房间中的所有人，包括发送者自己；不读取的连接不计入
+    unsigned long long expected = bench.sent * members;
+    printf("{\n");
+    printf("  \"label\": \"%s\",\n", bench.options.label);
+    printf("  \"host\": \"%s\",\n", bench.options.host);
+    printf("  \"port\": %d,\n", bench.options.port);
+    printf("  \"nodes\": %d,\n", bench.options.nodes);
+    printf("  \"clients\": %zu,\n", bench.options.clients);
+    printf("  \"connected\": %zu,\n", bench.connected);
+    printf("  \"closed\": %zu,\n", bench.closed);
+    printf("  \"senders\": %zu,\n", bench.options.senders);
+    printf("  \"stalled\": %zu,\n", stalled);
+    printf("  \"message_size\": %zu,\n", bench.options.size);
+    printf("  \"target_rate\": %.1f,\n", bench.options.rate);
+    printf("  \"duration_s\": %.3f,\n", send_seconds);
+    printf("  \"connect_s\": %.3f,\n", connect_seconds);
+    printf("  \"sent\": %llu,\n", bench.sent);
+    printf("  \"send_rate\": %.1f,\n", bench.sent / send_seconds);
+    printf("  \"delivered\": %llu,\n", bench.delivered);
+    printf("  \"expected\": %llu,\n", expected);
+    printf("  \"delivered_per_s\": %.1f,\n", bench.delivered / send_seconds);
+    printf("  \"delivery_ratio\": %.4f,\n", expected > 0 ? (double)bench.delivered / expected : 0.0);
+    printf("  \"other_messages\": %llu,\n", bench.other);
+    printf("  \"errors\": %llu,\n", bench.errors);
+    printf("  \"latency_us\": {\"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}\n",
+           bench.delivered > 0 ? bench.latency_sum / bench.delivered : 0.0,
+           (unsigned long long)hist_percentile(0.5), (unsigned long long)hist_percentile(0.9),
+           (unsigned long long)hist_percentile(0.99), (unsigned long long)hist_percentile(0.999), bench.latency_max);
+    printf("}\n");
+}
+
+static void print_usage(const char *name)
+{
+    fprintf(stderr, "用法：%s [选项]\n", name);
+    fprintf(stderr, "  --host 地址\t\t服务端 IPv4 地址（默认 127.0.0.1）\n");
+    fprintf(stderr, "  --port 端口\t\t服务端端口（默认 10010）\n");
+    fprintf(stderr, "  --nodes 数量\t\t集群节点数，连接轮流分配到从 --port 开始的连续端口（默认 1）\n");
+    fprintf(stderr, "  --clients 数量\t并发连接数（默认 100）\n");
+    fprintf(stderr, "  --senders 数量\t其中发送消息的连接数（默认 10）\n");
+    fprintf(stderr, "  --stalled 数量\t其中握手后不再读取消息的连接数，不能与发送者重叠（默认 0）\n");
+    fprintf(stderr, "  --rate 条数\t\t所有发送者合计每秒发送的消息数（默认 1000）\n");
+    fprintf(stderr, "  --duration 秒\t\t发送持续时间（默认 10）\n");
+    fprintf(stderr, "  --size 字节数\t\t消息内容长度（默认 64）\n");
+    fprintf(stderr, "  --room 房间名\t\t握手后进入该房间（默认留在大厅）\n");
+    fprintf(stderr, "  --label 标签\t\t写入结果的标签，如服务端模式（默认 chat）\n");
+}
+
+static bool parse_args(int argc, char **argv)
+{
+    struct bench_options *o = &bench.options;
+    *o = (struct bench_options){ "127.0.0.1", 10010, 1, "chat", NULL, 100, 10, 0, 1000, 10, 64 };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char *option = argv[i];
+        const char *value = argv[++i];
+        if (strcmp(option, "--host") == 0) {
+            o->host = value;
+        } else if (strcmp(option, "--port") == 0) {
+            o->port = atoi(value);
+        } else if (strcmp(option, "--nodes") == 0) {
+            o->nodes = atoi(value);
+        } else if (strcmp(option, "--clients") == 0) {
+            o->clients = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--senders") == 0) {
+            o->senders = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--stalled") == 0) {
+            o->stalled = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--rate") == 0) {
+            o->rate = atof(value);
+        } else if (strcmp(option, "--duration") == 0) {
+            o->duration = atof(value);
+        } else if (strcmp(option, "--size") == 0) {
+            o->size = strtoul(value, NULL, 10);
+        } else if (strcmp(option, "--room") == 0) {
+            o->room = value;
+        } else if (strcmp(option, "--label") == 0) {
+            o->label = value;
+        } else {
+            return false;
+        }
+    }
+    if (o->senders > o->clients) {
+        o->senders = o->clients;
+    }
+    return o->clients > 0 && o->senders > 0 && o->stalled <= o->clients - o->senders && o->rate > 0 && o->duration > 0 && o->port > 0
+           && o->nodes > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (!parse_args(argc, argv)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    raise_fd_limit(bench.options.clients);
+    bench.epfd = epoll_create1(0);
+    bench.conns = calloc(bench.options.clients, sizeof(struct bench_conn));
+
+    // 1. 建立连接并握手
+    uint64_t start = now_us();
+    if (!open_connections()) {
+        return 1;
+    }
+    while (bench.connected + bench.closed < bench.options.clients && now_us() - start < SETTLE_MAX_US) {
+        poll_events(10);
+    }
+    double connect_seconds = (now_us() - start) / 1e6;
+    fprintf(stderr, "已连接 %zu/%zu，用时 %.2f 秒，等待入场通知发完\n", bench.connected, bench.options.clients,
+            connect_seconds);
+    bench.last_receive = now_us();
+    uint64_t settle_start = now_us();
+    while (now_us() - bench.last_receive < SETTLE_QUIET_US && now_us() - settle_start < SETTLE_MAX_US) {
+        poll_events(10);
+    }
+    size_t stalled = stall_connections();
+    size_t members = bench.connected - bench.closed - stalled;
+
+    // 2. 按目标速率轮流由各发送者发送
+    fprintf(stderr, "开始发送：%zu 个发送者，每秒 %.0f 条，持续 %.1f 秒\n", bench.options.senders, bench.options.rate,
+            bench.options.duration);
+    bench.measuring = true;
+    start = now_us();
+    uint64_t end = start + (uint64_t)(bench.options.duration * 1e6);
+    uint64_t now;
+    while ((now = now_us()) < end) {
+        unsigned long long due = (unsigned long long)((now - start) / 1e6 * bench.options.rate);
+        while (bench.scheduled < due) {
+            send_message(bench.scheduled++ % bench.options.senders);
+        }
+        poll_events(1);
+    }
+    double send_seconds = (now_us() - start) / 1e6;
+
+    // 3. 接收在途的消息
+    uint64_t drain_start = now_us();
+    bench.last_receive = drain_start;
+    while (bench.delivered < bench.sent * members && now_us() - drain_start < DRAIN_MAX_US
+           && now_us() - bench.last_receive < SETTLE_QUIET_US * 2) {
+        poll_events(10);
+    }
+
+    print_results(connect_seconds, send_seconds, members, stalled);
+    for (size_t i = 0; i < bench.options.clients; i++) {
+        conn_close(&bench.conns[i]);
+        free(bench.conns[i].out);
+    }
+    free(bench.conns);
+    close(bench.epfd);
+    return 0;
+}
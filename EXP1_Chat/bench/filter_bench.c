@@ -0,0 +1,170 @@
+/**
+ * 违禁词过滤（filter）的基准测试
+ *
+ * 生成中英文混合的聊天消息，用不同数量的随机关键词编译过滤器，测每秒能检查的消息字节数：
+ *   预过滤：filter_match，SIMD 预过滤找到候选位置后才运行自动机
+ *   自动机：filter_match_dfa，每个字节都查一次状态转移表
+ * 两种方式命中的消息数必须相同。关键词是随机的，大部分消息不会命中，与实际的聊天内容相近。
+ *
+ * 用法：filter_bench [文本 MB] [消息长度]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "../src/filter.h"
+
+// 依次测试的关键词个数
+static const size_t pattern_counts[] = { 1, 10, 100, 1000, 10000 };
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+static uint64_t rng()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 写入一个随机的常用汉字（UTF-8 三字节），返回写入的字节数
+static size_t put_hanzi(char *out)
+{
+    uint32_t code = 0x4e00 + rng() % 0x51a6;
+    out[0] = (char)(0xe0 | code >> 12);
+    out[1] = (char)(0x80 | (code >> 6 & 0x3f));
+    out[2] = (char)(0x80 | (code & 0x3f));
+    return 3;
+}
+
+// 写入一个随机的英文单词（3 到 8 个小写字母，偶尔首字母大写），返回写入的字节数
+static size_t put_word(char *out)
+{
+    size_t len = 3 + rng() % 6;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (char)('a' + rng() % 26);
+    }
+    if (rng() % 8 == 0) {
+        out[0] -= 'a' - 'A';
+    }
+    return len;
+}
+
+// 生成一段消息内容：汉字和英文单词混合，长度不超过 len
+static void fill_message(char *out, size_t len)
+{
+    size_t n = 0;
+    while (n + 9 <= len) {
+        if (rng() % 4 == 0) {
+            n += put_word(out + n);
+            out[n++] = ' ';
+        } else {
+            n += put_hanzi(out + n);
+        }
+    }
+    memset(out + n, ' ', len - n);
+}
+
+// 生成一个关键词：一半是 2 到 4 个汉字，一半是 4 到 8 个字母的单词
+static size_t make_pattern(char *out)
+{
+    if (rng() % 2 == 0) {
+        size_t n = 0;
+        size_t chars = 2 + rng() % 3;
+        for (size_t i = 0; i < chars; i++) {
+            n += put_hanzi(out + n);
+        }
+        return n;
+    }
+    size_t len = 4 + rng() % 5;
+    for (size_t i = 0; i < len; i++) {
+        out[i] = (char)('a' + rng() % 26);
+    }
+    return len;
+}
+
+// 检查所有消息，返回命中的条数，*mb_per_sec 为吞吐
+static size_t run(const struct filter *filter, bool (*match)(const struct filter *, const char *, size_t),
+                  const char *text, size_t count, size_t len, double *mb_per_sec)
+{
+    size_t hits = 0;
+    double start = now_sec();
+    for (size_t i = 0; i < count; i++) {
+        hits += match(filter, text + i * len, len);
+    }
+    double elapsed = now_sec() - start;
+    *mb_per_sec = count * len / elapsed / (1024 * 1024);
+    return hits;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+    size_t len = argc > 2 ? strtoul(argv[2], NULL, 10) : 256;
+    if (mb == 0 || len < 16) {
+        printf("用法：%s [文本 MB] [消息长度（至少 16）]\n", argv[0]);
+        return 1;
+    }
+    size_t count = mb * 1024 * 1024 / len;
+    char *text = malloc(count * len);
+    if (text == NULL) {
+        printf("内存不足\n");
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fill_message(text + i * len, len);
+    }
+
+    size_t max_patterns = pattern_counts[sizeof(pattern_counts) / sizeof(pattern_counts[0]) - 1];
+    char *storage = malloc(max_patterns * 16);
+    const char **patterns = malloc(max_patterns * sizeof(char *));
+    size_t *lens = malloc(max_patterns * sizeof(size_t));
+    for (size_t i = 0; i < max_patterns; i++) {
+        patterns[i] = storage + i * 16;
+        lens[i] = make_pattern(storage + i * 16);
+    }
+
+    printf("%zu 条消息，每条 %zu 字节，共 %zu MB\n", count, len, mb);
+    printf("%-8s %10s %12s %14s %14s %8s\n", "关键词", "总字节", "编译(ms)", "预过滤(MB/s)", "自动机(MB/s)",
+           "命中");
+    for (size_t k = 0; k < sizeof(pattern_counts) / sizeof(pattern_counts[0]); k++) {
+        size_t n = pattern_counts[k];
+        double start = now_sec();
+        struct filter *filter = filter_create(patterns, lens, n);
+        double build_ms = (now_sec() - start) * 1000;
+        if (filter == NULL) {
+            printf("内存不足\n");
+            return 1;
+        }
+        size_t bytes = 0;
+        for (size_t i = 0; i < n; i++) {
+            bytes += lens[i];
+        }
+
+        double fast;
+        double slow;
+        size_t hits = run(filter, filter_match, text, count, len, &fast);
+        size_t dfa_hits = run(filter, filter_match_dfa, text, count, len, &slow);
+        if (hits != dfa_hits) {
+            printf("结果不一致：预过滤命中 %zu 条，自动机命中 %zu 条\n", hits, dfa_hits);
+            return 1;
+        }
+        printf("%-8zu %10zu %12.2f %14.0f %14.0f %8zu\n", n, bytes, build_ms, fast, slow, hits);
+        filter_free(filter);
+    }
+
+    free(text);
+    free(storage);
+    free(patterns);
+    free(lens);
+    return 0;
+}
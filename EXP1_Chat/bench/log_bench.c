@@ -0,0 +1,129 @@
+/**
+ * 聊天记录（chat_log）的基准测试
+ *
+ * 多个线程并发追加消息，测不同同步策略下的：
+ *   吞吐：每秒追加并持久化的消息数
+ *   追加耗时：chat_log_append 本身的耗时（广播路径上的开销）
+ *   持久化延迟：从追加到 fdatasync 完成的时间（p50/p99）
+ * 每个追加线程追加一条后等待它持久化再追加下一条，相当于每条消息都要求落盘，
+ * 组提交把同时等待的多条消息合并为一次 fdatasync。
+ *
+ * 用法：log_bench 目录 [每线程消息数] [消息长度] [线程数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "../src/chat_log.h"
+
+// 依次测试的 sync_batch
+static const size_t sync_batches[] = { 1, 8, 64, 256 };
+
+struct append_args
+{
+    struct msgbuf *buf;
+    size_t count;
+    double *append_us;  // 每条消息的追加耗时
+    double *durable_us; // 每条消息的持久化延迟
+};
+
+static double now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void *append_thread(void *arg)
+{
+    struct append_args *args = arg;
+    for (size_t i = 0; i < args->count; i++) {
+        double start = now_us();
+        uint64_t seq = chat_log_append("bench", args->buf);
+        args->append_us[i] = now_us() - start;
+        chat_log_wait_durable(seq);
+        args->durable_us[i] = now_us() - start;
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(double *values, size_t count, double p)
+{
+    return values[(size_t)(p * (count - 1))];
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        printf("用法：%s 目录 [每线程消息数] [消息长度] [线程数]\n", argv[0]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000;
+    size_t len = argc > 3 ? strtoul(argv[3], NULL, 10) : 64;
+    size_t threads = argc > 4 ? strtoul(argv[4], NULL, 10) : 16;
+    if (count == 0 || len == 0 || threads == 0) {
+        printf("用法：%s 目录 [每线程消息数] [消息长度] [线程数]\n", argv[0]);
+        return 1;
+    }
+
+    char *text = malloc(len);
+    memset(text, 'x', len);
+    struct msgbuf *buf = msgbuf_create(text, len);
+    size_t total = count * threads;
+    double *append_us = malloc(total * sizeof(double));
+    double *durable_us = malloc(total * sizeof(double));
+    struct append_args *args = malloc(threads * sizeof(struct append_args));
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+
+    printf("每线程 %zu 条，%zu 个线程，消息长度 %zu 字节\n", count, threads, len);
+    printf("%-10s %12s %10s %14s %14s %14s\n", "sync_batch", "条/秒", "同步次数", "追加 p50(us)", "持久化p50(us)",
+           "持久化p99(us)");
+    for (size_t b = 0; b < sizeof(sync_batches) / sizeof(sync_batches[0]); b++) {
+        // 每个同步策略用一个新段，各自从空日志开始
+        struct chat_log_options options = { dir, 64 * 1024 * 1024, sync_batches[b], 2, 1 };
+        if (chat_log_open(&options) != 0) {
+            return 1;
+        }
+        struct chat_log_stats before;
+        chat_log_get_stats(&before);
+
+        double start = now_us();
+        for (size_t i = 0; i < threads; i++) {
+            args[i] = (struct append_args){ buf, count, append_us + i * count, durable_us + i * count };
+            pthread_create(&ids[i], NULL, append_thread, &args[i]);
+        }
+        for (size_t i = 0; i < threads; i++) {
+            pthread_join(ids[i], NULL);
+        }
+        double elapsed = now_us() - start;
+
+        struct chat_log_stats after;
+        chat_log_get_stats(&after);
+        chat_log_close();
+
+        qsort(append_us, total, sizeof(double), compare_double);
+        qsort(durable_us, total, sizeof(double), compare_double);
+        printf("%-10zu %12.0f %10llu %14.1f %14.1f %14.1f\n", sync_batches[b], total / elapsed * 1e6,
+               after.syncs - before.syncs, percentile(append_us, total, 0.5), percentile(durable_us, total, 0.5),
+               percentile(durable_us, total, 0.99));
+    }
+
+    msgbuf_unref(buf);
+    free(text);
+    free(append_us);
+    free(durable_us);
+    free(args);
+    free(ids);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * send_msg 的微基准测试
+ *
+ * 在本机回环 TCP 连接上比较三种发送方式（Nagle 算法保持默认开启）：
+ *   legacy      旧实现：先 send 4 字节长度，再 send 消息内容
+ *   send_msg    单条消息一次 writev
+ *   send_frames 多条消息合并为一次 writev
+ * 每种方式测两项：
+ *   单向吞吐：接收线程只管读，统计每秒发送的消息数
+ *   请求应答：发一条消息、等对方回一条消息后再发下一条，统计每秒往返次数，
+ *             旧实现在这里会遇到 Nagle 与延迟确认叠加的等待
+ *
+ * 用法：packet_bench [消息数] [消息长度] [往返次数]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../src/packet.h"
+
+// send_frames 方式每次合并的消息数
+#define BENCH_BATCH 32
+
+enum send_mode
+{
+    MODE_LEGACY,
+    MODE_SEND_MSG,
+    MODE_SEND_FRAMES
+};
+
+static const char *mode_names[] = { "legacy", "send_msg", "send_frames" };
+
+// 旧版 send_msg：长度和内容分两次 send，短写按失败处理
+static ssize_t legacy_send_msg(int sock, const char *buf, size_t len)
+{
+    uint32_t net_len = htonl((uint32_t)len);
+    if (send(sock, &net_len, sizeof(net_len), 0) != sizeof(net_len)) {
+        return -1;
+    }
+    if (send(sock, buf, len, 0) != (ssize_t)len) {
+        return -1;
+    }
+    return len;
+}
+
+static ssize_t send_one(enum send_mode mode, int sock, const char *buf, size_t len)
+{
+    if (mode == MODE_LEGACY) {
+        return legacy_send_msg(sock, buf, len);
+    }
+    return send_msg(sock, buf, len);
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 建立一对回环 TCP 连接
+static int connect_pair(int fds[2])
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(listener, 1) < 0 || getsockname(listener, (struct sockaddr *)&addr, &addr_len) < 0) {
+        perror("listen");
+        return -1;
+    }
+    fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fds[0], (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return -1;
+    }
+    fds[1] = accept(listener, NULL, NULL);
+    close(listener);
+    return fds[1] < 0 ? -1 : 0;
+}
+
+struct drain_args
+{
+    int sock;
+    size_t expected;
+};
+
+// 单向吞吐测试的接收端：读到预期的字节数为止
+static void *drain_thread(void *arg)
+{
+    struct drain_args *args = arg;
+    char buf[64 * 1024];
+    size_t got = 0;
+    while (got < args->expected) {
+        ssize_t n = recv(args->sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    return NULL;
+}
+
+static double bench_throughput(enum send_mode mode, size_t count, size_t len)
+{
+    int fds[2];
+    if (connect_pair(fds) < 0) {
+        return 0;
+    }
+    char *msg = malloc(len);
+    memset(msg, 'x', len);
+
+    struct drain_args args = { fds[1], count * (sizeof(uint32_t) + len) };
+    pthread_t thread;
+    pthread_create(&thread, NULL, drain_thread, &args);
+
+    struct frame_out frames[BENCH_BATCH];
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        frames[i].buf = msg;
+        frames[i].len = len;
+    }
+
+    double start = now_seconds();
+    size_t sent = 0;
+    while (sent < count) {
+        if (mode == MODE_SEND_FRAMES) {
+            size_t batch = count - sent < BENCH_BATCH ? count - sent : BENCH_BATCH;
+            if (send_frames(fds[0], frames, batch) < 0) {
+                break;
+            }
+            sent += batch;
+        } else {
+            if (send_one(mode, fds[0], msg, len) < 0) {
+                break;
+            }
+            sent++;
+        }
+    }
+    pthread_join(thread, NULL);
+    double elapsed = now_seconds() - start;
+
+    close(fds[0]);
+    close(fds[1]);
+    free(msg);
+    return sent / elapsed;
+}
+
+struct echo_args
+{
+    enum send_mode mode;
+    int sock;
+    size_t len;
+};
+
+// 请求应答测试的对端：每收到一条消息就用同样的发送方式回一条
+static void *echo_thread(void *arg)
+{
+    struct echo_args *args = arg;
+    char *buf = malloc(args->len + 1);
+    while (recv_msg(args->sock, buf, args->len) > 0) {
+        if (send_one(args->mode, args->sock, buf, args->len) < 0) {
+            break;
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+static double bench_roundtrip(enum send_mode mode, size_t rounds, size_t len)
+{
+    int fds[2];
+    if (connect_pair(fds) < 0) {
+        return 0;
+    }
+    char *msg = malloc(len + 1);
+    memset(msg, 'x', len);
+
+    struct echo_args args = { mode, fds[1], len };
+    pthread_t thread;
+    pthread_create(&thread, NULL, echo_thread, &args);
+
+    double start = now_seconds();
+    size_t done = 0;
+    for (; done < rounds; done++) {
+        if (send_one(mode, fds[0], msg, len) < 0 || recv_msg(fds[0], msg, len) <= 0) {
+            break;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    shutdown(fds[0], SHUT_RDWR);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    close(fds[1]);
+    free(msg);
+    return done / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t len = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+    size_t rounds = argc > 3 ? strtoul(argv[3], NULL, 10) : 200;
+    if (count == 0 || len == 0 || rounds == 0) {
+        printf("用法：%s [消息数] [消息长度] [往返次数]\n", argv[0]);
+        return 1;
+    }
+
+    printf("消息数 %zu，消息长度 %zu 字节，往返次数 %zu\n", count, len, rounds);
+    printf("%-12s %16s %16s\n", "方式", "吞吐（条/秒）", "往返（次/秒）");
+    for (int mode = MODE_LEGACY; mode <= MODE_SEND_FRAMES; mode++) {
+        double throughput = bench_throughput(mode, count, len);
+        // send_frames 只用于批量发送，请求应答时与 send_msg 相同
+        double roundtrip = mode == MODE_SEND_FRAMES ? 0 : bench_roundtrip(mode, rounds, len);
+        if (mode == MODE_SEND_FRAMES) {
+            printf("%-12s %16.0f %16s\n", mode_names[mode], throughput, "-");
+        } else {
+            printf("%-12s %16.0f %16.0f\n", mode_names[mode], throughput, roundtrip);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,1059 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "chat_log.h"
+
+// 一次 writev 最多写出的记录数（每条记录 3 个 iovec）
+#define LOG_WRITE_BATCH 256
+// 待写列表的最大长度，磁盘跟不上时丢弃新的记录并计数，不阻塞广播，也避免内存无限增长
+#define LOG_MAX_PENDING 65536
+// 写入失败（例如磁盘已满）后重试的间隔
+#define LOG_RETRY_INTERVAL_MS 1000
+// 段文件名：20 位序号 + 扩展名
+#define SEGMENT_NAME_LEN 20
+
+// 待写入的一条记录
+struct log_entry
+{
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint16_t room_len;
+    char room[64];
+    struct msgbuf *buf;
+};
+
+static struct
+{
+    bool enabled;
+    struct chat_log_options options;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty; // 有新记录或要求关闭
+    pthread_cond_t durable;   // durable_seq 前进
+    struct log_entry *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    uint64_t next_seq;
+    uint64_t durable_seq;
+    bool closing;
+    bool stopped;             // 日志线程已退出，放弃的记录不会再变为 durable
+
+    // 以下只由日志线程访问
+    int dir_fd;
+    int fd;                   // 当前段，-1 表示还没有打开
+    int index_fd;
+    uint64_t segment_first_seq;
+    size_t segment_bytes;     // 当前段中完整写入的字节数
+    size_t index_bytes;       // 当前段的索引文件中完整写入的字节数
+    size_t next_index_offset; // 当前段写到这个偏移之后再记下一项索引
+    uint64_t *segments;       // 所有段的第一个序号，从旧到新
+    size_t segment_count;
+    uint64_t written_seq;     // 已写入文件的最大序号，之前的记录都已完整写入
+    bool failed;              // 关闭时仍无法写入，之后的记录不再写出，written_seq 不再前进
+    uint64_t synced_seq;      // 已 fdatasync 的最大序号
+    size_t unsynced;          // 已写入但未同步的记录数
+    uint64_t unsynced_since;  // 最早一条未同步记录的写入时间（单调时钟，微秒）
+} chat_log = {.fd = -1, .index_fd = -1, .dir_fd = -1};
+
+static struct
+{
+    atomic_ullong appended;
+    atomic_ullong dropped;
+    atomic_ullong written;
+    atomic_ullong bytes;
+    atomic_ullong writes;
+    atomic_ullong syncs;
+    atomic_ullong segments_removed;
+} stats;
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init()
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// 记录头中 crc 之后的部分，加上房间名和消息内容
+static uint32_t record_crc(const struct chat_log_header *header, const char *room, const char *payload)
+{
+    uint32_t crc = crc_update(0, (const char *)header + sizeof(header->crc), sizeof(*header) - sizeof(header->crc));
+    crc = crc_update(crc, room, header->room_len);
+    return crc_update(crc, payload, header->payload_len);
+}
+
+static uint64_t now_us(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void segment_path(char *path, size_t size, const char *dir, uint64_t first_seq, const char *ext)
+{
+    snprintf(path, size, "%s/%0*llu.%s", dir, SEGMENT_NAME_LEN, (unsigned long long)first_seq, ext);
+}
+
+static int compare_seq(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 列出目录中的所有段，按第一个序号排序
+static int list_segments(const char *dir, uint64_t **out, size_t *count)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+    {
+        return -1;
+    }
+    uint64_t *segments = NULL;
+    size_t n = 0;
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        const char *name = entry->d_name;
+        if (strlen(name) != SEGMENT_NAME_LEN + 4 || strcmp(name + SEGMENT_NAME_LEN, ".log") != 0
+            || strspn(name, "0123456789") != SEGMENT_NAME_LEN)
+        {
+            continue;
+        }
+        if (n == capacity)
+        {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            uint64_t *bigger = realloc(segments, capacity * sizeof(uint64_t));
+            if (bigger == NULL)
+            {
+                free(segments);
+                closedir(d);
+                return -1;
+            }
+            segments = bigger;
+        }
+        segments[n++] = strtoull(name, NULL, 10);
+    }
+    closedir(d);
+    qsort(segments, n, sizeof(uint64_t), compare_seq);
+    *out = segments;
+    *count = n;
+    return 0;
+}
+
+/**
+ * 解析 offset 处的一条记录，记录不完整或校验失败时返回 false
+ */
+static bool parse_record(const char *map, size_t size, size_t offset, struct chat_log_record *record, size_t *next)
+{
+    if (size - offset < sizeof(struct chat_log_header))
+    {
+        return false;
+    }
+    struct chat_log_header header;
+    memcpy(&header, map + offset, sizeof(header));
+    size_t total = sizeof(header) + header.room_len + (size_t)header.payload_len;
+    if (size - offset < total)
+    {
+        return false;
+    }
+    const char *room = map + offset + sizeof(header);
+    const char *payload = room + header.room_len;
+    if (record_crc(&header, room, payload) != header.crc)
+    {
+        return false;
+    }
+    record->seq = header.seq;
+    record->timestamp_us = header.timestamp_us;
+    record->room = room;
+    record->room_len = header.room_len;
+    record->payload = payload;
+    record->payload_len = header.payload_len;
+    *next = offset + total;
+    return true;
+}
+
+// 映射整个段文件，空文件时 *map 为 NULL
+static int map_segment(const char *path, char **map, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    *map = NULL;
+    if (*size > 0)
+    {
+        void *p = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+        *map = p;
+    }
+    close(fd);
+    return 0;
+}
+
+static bool write_full(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool writev_full(int fd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        size_t written = n;
+        while (iovcnt > 0 && written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+
+// 同步当前段，之前写入的记录都已持久化
+static void sync_segment()
+{
+    if (chat_log.fd >= 0 && chat_log.unsynced > 0)
+    {
+        if (fdatasync(chat_log.fd) < 0)
+        {
+            printf("聊天记录同步失败：%s\n", strerror(errno));
+        }
+        atomic_fetch_add_explicit(&stats.syncs, 1, memory_order_relaxed);
+    }
+    chat_log.synced_seq = chat_log.written_seq;
+    chat_log.unsynced = 0;
+}
+
+// 按保留策略删除最旧的段
+static void apply_retention()
+{
+    size_t keep = chat_log.options.retention_segments;
+    while (keep > 0 && chat_log.segment_count > keep)
+    {
+        char path[4096];
+        segment_path(path, sizeof(path), chat_log.options.dir, chat_log.segments[0], "log");
+        unlink(path);
+        segment_path(path, sizeof(path), chat_log.options.dir, chat_log.segments[0], "idx");
+        unlink(path);
+        memmove(chat_log.segments, chat_log.segments + 1, (chat_log.segment_count - 1) * sizeof(uint64_t));
+        chat_log.segment_count--;
+        atomic_fetch_add_explicit(&stats.segments_removed, 1, memory_order_relaxed);
+    }
+}
+
+// 封存当前段，以 first_seq 为名开始新段
+static bool roll_segment(uint64_t first_seq)
+{
+    if (chat_log.fd >= 0)
+    {
+        sync_segment();
+        close(chat_log.fd);
+        close(chat_log.index_fd);
+        chat_log.fd = -1;
+        chat_log.index_fd = -1;
+    }
+
+    uint64_t *bigger = realloc(chat_log.segments, (chat_log.segment_count + 1) * sizeof(uint64_t));
+    if (bigger == NULL)
+    {
+        return false;
+    }
+    chat_log.segments = bigger;
+
+    char path[4096];
+    segment_path(path, sizeof(path), chat_log.options.dir, first_seq, "log");
+    chat_log.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    segment_path(path, sizeof(path), chat_log.options.dir, first_seq, "idx");
+    chat_log.index_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (chat_log.fd < 0 || chat_log.index_fd < 0)
+    {
+        printf("无法创建聊天记录段 %s：%s\n", path, strerror(errno));
+        if (chat_log.fd >= 0)
+        {
+            close(chat_log.fd);
+            chat_log.fd = -1;
+        }
+        if (chat_log.index_fd >= 0)
+        {
+            close(chat_log.index_fd);
+            chat_log.index_fd = -1;
+        }
+        return false;
+    }
+    // 新文件的目录项也要持久化
+    fsync(chat_log.dir_fd);
+
+    chat_log.segments[chat_log.segment_count++] = first_seq;
+    chat_log.segment_first_seq = first_seq;
+    chat_log.segment_bytes = 0;
+    chat_log.index_bytes = 0;
+    chat_log.next_index_offset = 0;
+    apply_retention();
+    return true;
+}
+
+static bool closing_requested()
+{
+    pthread_mutex_lock(&chat_log.lock);
+    bool closing = chat_log.closing;
+    pthread_mutex_unlock(&chat_log.lock);
+    return closing;
+}
+
+/**
+ * 写入失败后调用：把段文件和索引截回上一次完整写入的位置，之后的记录不会追加在写了一半的记录后面
+ * 截断也失败时封存当前段（恢复时在残缺的记录处结束该段），从 next_seq 开始新段
+ */
+static void discard_partial_write(uint64_t next_seq)
+{
+    if (chat_log.fd < 0)
+    {
+        return;
+    }
+    if (ftruncate(chat_log.fd, chat_log.segment_bytes) == 0 && ftruncate(chat_log.index_fd, chat_log.index_bytes) == 0)
+    {
+        return;
+    }
+    printf("聊天记录截断失败：%s，换用新段\n", strerror(errno));
+    if (chat_log.segment_bytes == 0)
+    {
+        // 当前段没有完整的记录，新段与它同名，删掉后重建
+        close(chat_log.fd);
+        close(chat_log.index_fd);
+        chat_log.fd = -1;
+        chat_log.index_fd = -1;
+        chat_log.segment_count--;
+        char path[4096];
+        segment_path(path, sizeof(path), chat_log.options.dir, chat_log.segment_first_seq, "log");
+        unlink(path);
+        segment_path(path, sizeof(path), chat_log.options.dir, chat_log.segment_first_seq, "idx");
+        unlink(path);
+        return;
+    }
+    roll_segment(next_seq);
+}
+
+/**
+ * 写出一组记录，必要时换段
+ * 写入失败时丢弃写了一半的数据，隔一段时间重试同一批记录，written_seq 只在记录完整写入后前进；
+ * 关闭时仍然失败则放弃剩余的记录，并且不再写出之后的记录，避免序号出现空洞
+ */
+static void write_entries(struct log_entry *entries, size_t count)
+{
+    struct chat_log_header headers[LOG_WRITE_BATCH];
+    struct iovec iov[LOG_WRITE_BATCH * 3];
+    struct chat_log_index_entry index[LOG_WRITE_BATCH];
+    size_t i = 0;
+
+    while (i < count && !chat_log.failed)
+    {
+        size_t first = i;
+        size_t saved_next_index_offset = chat_log.next_index_offset;
+        size_t n = 0;
+        size_t index_count = 0;
+        size_t bytes = 0;
+        bool ok = true;
+        while (i < count && n < LOG_WRITE_BATCH)
+        {
+            struct log_entry *entry = &entries[i];
+            size_t payload_len = entry->buf->len;
+            size_t total = sizeof(struct chat_log_header) + entry->room_len + payload_len;
+            // 当前段放不下时换段；空段总能放下一条记录，即使它比段大小还大
+            if (chat_log.fd < 0 || (chat_log.segment_bytes + bytes > 0
+                                    && chat_log.segment_bytes + bytes + total > chat_log.options.segment_size))
+            {
+                if (n > 0)
+                {
+                    break;
+                }
+                if (!roll_segment(entry->seq))
+                {
+                    ok = false;
+                    break;
+                }
+                saved_next_index_offset = chat_log.next_index_offset;
+            }
+
+            size_t offset = chat_log.segment_bytes + bytes;
+            if (offset >= chat_log.next_index_offset)
+            {
+                index[index_count++] = (struct chat_log_index_entry){entry->seq, entry->timestamp_us, offset};
+                chat_log.next_index_offset = offset + CHAT_LOG_INDEX_INTERVAL;
+            }
+
+            struct chat_log_header *header = &headers[n];
+            memset(header, 0, sizeof(*header));
+            header->payload_len = (uint32_t)payload_len;
+            header->seq = entry->seq;
+            header->timestamp_us = entry->timestamp_us;
+            header->room_len = entry->room_len;
+            header->crc = record_crc(header, entry->room, msgbuf_payload(entry->buf));
+
+            iov[n * 3] = (struct iovec){header, sizeof(*header)};
+            iov[n * 3 + 1] = (struct iovec){entry->room, entry->room_len};
+            iov[n * 3 + 2] = (struct iovec){(void *)msgbuf_payload(entry->buf), payload_len};
+            bytes += total;
+            n++;
+            i++;
+        }
+
+        if (ok && (!writev_full(chat_log.fd, iov, (int)n * 3)
+                   || !write_full(chat_log.index_fd, index, index_count * sizeof(index[0]))))
+        {
+            printf("聊天记录写入失败：%s\n", strerror(errno));
+            chat_log.next_index_offset = saved_next_index_offset;
+            discard_partial_write(entries[first].seq);
+            ok = false;
+        }
+        if (!ok)
+        {
+            i = first;
+            if (closing_requested())
+            {
+                printf("正在关闭，放弃序号 %llu 起未写入的聊天记录\n", (unsigned long long)entries[first].seq);
+                chat_log.failed = true;
+                return;
+            }
+            struct timespec pause = {LOG_RETRY_INTERVAL_MS / 1000, LOG_RETRY_INTERVAL_MS % 1000 * 1000000};
+            nanosleep(&pause, NULL);
+            continue;
+        }
+        if (chat_log.unsynced == 0)
+        {
+            chat_log.unsynced_since = now_us(CLOCK_MONOTONIC);
+        }
+        chat_log.segment_bytes += bytes;
+        chat_log.index_bytes += index_count * sizeof(index[0]);
+        chat_log.written_seq = entries[i - 1].seq;
+        chat_log.unsynced += n;
+        atomic_fetch_add_explicit(&stats.written, n, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats.bytes, bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats.writes, 1, memory_order_relaxed);
+    }
+}
+
+// 是否应该同步：未同步的条数或等待时间达到上限，或者正在关闭
+static bool should_sync(bool closing)
+{
+    if (chat_log.unsynced == 0)
+    {
+        return false;
+    }
+    if (closing)
+    {
+        return true;
+    }
+    if (chat_log.options.sync_batch > 0 && chat_log.unsynced >= chat_log.options.sync_batch)
+    {
+        return true;
+    }
+    return chat_log.options.sync_interval_ms > 0
+           && now_us(CLOCK_MONOTONIC) - chat_log.unsynced_since >= chat_log.options.sync_interval_ms * 1000ull;
+}
+
+static void *chat_log_thread(void *arg)
+{
+    (void)arg;
+    struct log_entry *batch = NULL;
+    size_t batch_capacity = 0;
+
+    pthread_mutex_lock(&chat_log.lock);
+    while (1)
+    {
+        // 等待新记录；有未同步的记录时最多等到同步期限
+        while (chat_log.pending_count == 0 && !chat_log.closing)
+        {
+            if (chat_log.unsynced == 0 || chat_log.options.sync_interval_ms == 0)
+            {
+                pthread_cond_wait(&chat_log.not_empty, &chat_log.lock);
+                continue;
+            }
+            uint64_t deadline = chat_log.unsynced_since + chat_log.options.sync_interval_ms * 1000ull;
+            struct timespec ts = {deadline / 1000000, (deadline % 1000000) * 1000};
+            if (pthread_cond_timedwait(&chat_log.not_empty, &chat_log.lock, &ts) == ETIMEDOUT)
+            {
+                break;
+            }
+        }
+
+        // 取走全部待写记录（交换两个数组），追加者可以继续写入
+        struct log_entry *entries = chat_log.pending;
+        size_t entries_capacity = chat_log.pending_capacity;
+        size_t count = chat_log.pending_count;
+        chat_log.pending = batch;
+        chat_log.pending_capacity = batch_capacity;
+        chat_log.pending_count = 0;
+        batch = entries;
+        batch_capacity = entries_capacity;
+        bool closing = chat_log.closing;
+        pthread_mutex_unlock(&chat_log.lock);
+
+        if (count > 0)
+        {
+            write_entries(entries, count);
+            for (size_t i = 0; i < count; i++)
+            {
+                msgbuf_unref(entries[i].buf);
+            }
+        }
+        if (should_sync(closing))
+        {
+            sync_segment();
+        }
+
+        pthread_mutex_lock(&chat_log.lock);
+        // 不主动同步时，写出即视为完成
+        bool never_sync = chat_log.options.sync_batch == 0 && chat_log.options.sync_interval_ms == 0;
+        chat_log.durable_seq = never_sync ? chat_log.written_seq : chat_log.synced_seq;
+        pthread_cond_broadcast(&chat_log.durable);
+        if (closing && chat_log.pending_count == 0)
+        {
+            break;
+        }
+    }
+    chat_log.stopped = true;
+    pthread_cond_broadcast(&chat_log.durable);
+    pthread_mutex_unlock(&chat_log.lock);
+    free(batch);
+    return NULL;
+}
+
+/**
+ * 恢复最后一段：找到最后一条完整的记录，截掉写了一半的尾部，重建该段的索引
+ * 返回段中最后一条记录的序号，段为空时返回 first_seq - 1
+ */
+static int recover_segment(uint64_t first_seq, uint64_t *last_seq)
+{
+    char path[4096];
+    segment_path(path, sizeof(path), chat_log.options.dir, first_seq, "log");
+    char *map;
+    size_t size;
+    if (map_segment(path, &map, &size) < 0)
+    {
+        return -1;
+    }
+
+    char index_path[4096];
+    segment_path(index_path, sizeof(index_path), chat_log.options.dir, first_seq, "idx");
+    chat_log.index_fd = open(index_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (chat_log.index_fd < 0)
+    {
+        if (map != NULL)
+        {
+            munmap(map, size);
+        }
+        return -1;
+    }
+
+    size_t offset = 0;
+    size_t next_index_offset = 0;
+    size_t index_bytes = 0;
+    *last_seq = first_seq - 1;
+    struct chat_log_record record;
+    size_t next;
+    while (offset < size && parse_record(map, size, offset, &record, &next))
+    {
+        if (offset >= next_index_offset)
+        {
+            struct chat_log_index_entry entry = {record.seq, record.timestamp_us, offset};
+            write_full(chat_log.index_fd, &entry, sizeof(entry));
+            index_bytes += sizeof(entry);
+            next_index_offset = offset + CHAT_LOG_INDEX_INTERVAL;
+        }
+        *last_seq = record.seq;
+        offset = next;
+    }
+    if (map != NULL)
+    {
+        munmap(map, size);
+    }
+
+    chat_log.fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (chat_log.fd < 0)
+    {
+        return -1;
+    }
+    if (offset < size)
+    {
+        printf("聊天记录 %s 末尾有 %zu 字节不完整的数据，已截断\n", path, size - offset);
+        if (ftruncate(chat_log.fd, offset) < 0)
+        {
+            return -1;
+        }
+        fdatasync(chat_log.fd);
+    }
+    chat_log.segment_first_seq = first_seq;
+    chat_log.segment_bytes = offset;
+    chat_log.index_bytes = index_bytes;
+    chat_log.next_index_offset = next_index_offset;
+    return 0;
+}
+
+int chat_log_open(const struct chat_log_options *options)
+{
+    pthread_once(&crc_once, crc_init);
+    chat_log.options = *options;
+    chat_log.options.dir = strdup(options->dir);
+    if (mkdir(options->dir, 0755) < 0 && errno != EEXIST)
+    {
+        printf("无法创建聊天记录目录 %s：%s\n", options->dir, strerror(errno));
+        return -1;
+    }
+    chat_log.dir_fd = open(options->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (chat_log.dir_fd < 0 || list_segments(options->dir, &chat_log.segments, &chat_log.segment_count) < 0)
+    {
+        printf("无法打开聊天记录目录 %s：%s\n", options->dir, strerror(errno));
+        return -1;
+    }
+
+    chat_log.next_seq = 1;
+    if (chat_log.segment_count > 0)
+    {
+        uint64_t last_seq;
+        if (recover_segment(chat_log.segments[chat_log.segment_count - 1], &last_seq) < 0)
+        {
+            printf("无法恢复聊天记录：%s\n", strerror(errno));
+            return -1;
+        }
+        chat_log.next_seq = last_seq + 1;
+    }
+    chat_log.written_seq = chat_log.next_seq - 1;
+    chat_log.synced_seq = chat_log.written_seq;
+    chat_log.durable_seq = chat_log.written_seq;
+
+    pthread_mutex_init(&chat_log.lock, NULL);
+    pthread_cond_init(&chat_log.durable, NULL);
+    // 定时同步用单调时钟计时
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&chat_log.not_empty, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&chat_log.thread, NULL, chat_log_thread, NULL) != 0)
+    {
+        return -1;
+    }
+    chat_log.enabled = true;
+    printf("聊天记录目录：%s，下一条记录序号 %llu\n", options->dir, (unsigned long long)chat_log.next_seq);
+    return 0;
+}
+
+bool chat_log_enabled()
+{
+    return chat_log.enabled;
+}
+
+uint64_t chat_log_append(const char *room, struct msgbuf *buf)
+{
+    if (!chat_log.enabled || buf == NULL)
+    {
+        return 0;
+    }
+    uint64_t timestamp = now_us(CLOCK_REALTIME);
+
+    pthread_mutex_lock(&chat_log.lock);
+    if (chat_log.pending_count >= LOG_MAX_PENDING)
+    {
+        pthread_mutex_unlock(&chat_log.lock);
+        atomic_fetch_add_explicit(&stats.dropped, 1, memory_order_relaxed);
+        return 0;
+    }
+    if (chat_log.pending_count == chat_log.pending_capacity)
+    {
+        size_t capacity = chat_log.pending_capacity == 0 ? 256 : chat_log.pending_capacity * 2;
+        struct log_entry *bigger = realloc(chat_log.pending, capacity * sizeof(struct log_entry));
+        if (bigger == NULL)
+        {
+            pthread_mutex_unlock(&chat_log.lock);
+            return 0;
+        }
+        chat_log.pending = bigger;
+        chat_log.pending_capacity = capacity;
+    }
+
+    struct log_entry *entry = &chat_log.pending[chat_log.pending_count++];
+    entry->seq = chat_log.next_seq++;
+    entry->timestamp_us = timestamp;
+    size_t room_len = strnlen(room, sizeof(entry->room));
+    memcpy(entry->room, room, room_len);
+    entry->room_len = (uint16_t)room_len;
+    entry->buf = msgbuf_ref(buf);
+    uint64_t seq = entry->seq;
+    // 日志线程正在写上一批时不需要唤醒，它写完会再来取
+    if (chat_log.pending_count == 1)
+    {
+        pthread_cond_signal(&chat_log.not_empty);
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+
+    atomic_fetch_add_explicit(&stats.appended, 1, memory_order_relaxed);
+    return seq;
+}
+
+void chat_log_wait_durable(uint64_t seq)
+{
+    if (!chat_log.enabled)
+    {
+        return;
+    }
+    pthread_mutex_lock(&chat_log.lock);
+    while (chat_log.durable_seq < seq && !chat_log.stopped)
+    {
+        pthread_cond_wait(&chat_log.durable, &chat_log.lock);
+    }
+    pthread_mutex_unlock(&chat_log.lock);
+}
+
+void chat_log_close()
+{
+    if (!chat_log.enabled)
+    {
+        return;
+    }
+    pthread_mutex_lock(&chat_log.lock);
+    chat_log.closing = true;
+    pthread_cond_signal(&chat_log.not_empty);
+    pthread_mutex_unlock(&chat_log.lock);
+    pthread_join(chat_log.thread, NULL);
+
+    chat_log.enabled = false;
+    if (chat_log.fd >= 0)
+    {
+        close(chat_log.fd);
+        close(chat_log.index_fd);
+        chat_log.fd = -1;
+        chat_log.index_fd = -1;
+    }
+    close(chat_log.dir_fd);
+    chat_log.dir_fd = -1;
+    free(chat_log.segments);
+    chat_log.segments = NULL;
+    chat_log.segment_count = 0;
+    free(chat_log.pending);
+    chat_log.pending = NULL;
+    chat_log.pending_count = 0;
+    chat_log.pending_capacity = 0;
+    chat_log.closing = false;
+    chat_log.stopped = false;
+    chat_log.failed = false;
+    free((char *)chat_log.options.dir);
+}
+
+void chat_log_get_stats(struct chat_log_stats *out)
+{
+    out->appended = atomic_load_explicit(&stats.appended, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&stats.dropped, memory_order_relaxed);
+    out->written = atomic_load_explicit(&stats.written, memory_order_relaxed);
+    out->bytes = atomic_load_explicit(&stats.bytes, memory_order_relaxed);
+    out->writes = atomic_load_explicit(&stats.writes, memory_order_relaxed);
+    out->syncs = atomic_load_explicit(&stats.syncs, memory_order_relaxed);
+    out->segments_removed = atomic_load_explicit(&stats.segments_removed, memory_order_relaxed);
+}
+
+// 读入一个段的索引文件，文件不存在时索引为空（查找时从段首扫描）
+static void load_index(const char *dir, struct chat_log_segment *segment)
+{
+    char path[4096];
+    segment_path(path, sizeof(path), dir, segment->first_seq, "idx");
+    segment->index = NULL;
+    segment->index_count = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct chat_log_index_entry))
+    {
+        size_t count = st.st_size / sizeof(struct chat_log_index_entry);
+        segment->index = malloc(count * sizeof(struct chat_log_index_entry));
+        if (segment->index != NULL)
+        {
+            ssize_t n = pread(fd, segment->index, count * sizeof(struct chat_log_index_entry), 0);
+            segment->index_count = n > 0 ? n / sizeof(struct chat_log_index_entry) : 0;
+        }
+    }
+    close(fd);
+}
+
+int chat_log_reader_open(struct chat_log_reader *reader, const char *dir)
+{
+    pthread_once(&crc_once, crc_init);
+    memset(reader, 0, sizeof(*reader));
+    uint64_t *firsts;
+    size_t count;
+    if (list_segments(dir, &firsts, &count) < 0)
+    {
+        return -1;
+    }
+    reader->dir = strdup(dir);
+    reader->segments = calloc(count > 0 ? count : 1, sizeof(struct chat_log_segment));
+    reader->segment_count = count;
+    for (size_t i = 0; i < count; i++)
+    {
+        reader->segments[i].first_seq = firsts[i];
+        load_index(dir, &reader->segments[i]);
+    }
+    free(firsts);
+    return 0;
+}
+
+static void reader_unmap(struct chat_log_reader *reader)
+{
+    if (reader->map != NULL)
+    {
+        munmap(reader->map, reader->map_size);
+        reader->map = NULL;
+    }
+    reader->map_size = 0;
+}
+
+void chat_log_reader_close(struct chat_log_reader *reader)
+{
+    reader_unmap(reader);
+    for (size_t i = 0; i < reader->segment_count; i++)
+    {
+        free(reader->segments[i].index);
+    }
+    free(reader->segments);
+    free(reader->dir);
+}
+
+// 切换到第 i 段，从 offset 开始读
+static bool reader_open_segment(struct chat_log_reader *reader, size_t i, size_t offset)
+{
+    reader_unmap(reader);
+    reader->current = i;
+    reader->offset = offset;
+    if (i >= reader->segment_count)
+    {
+        return false;
+    }
+    char path[4096];
+    segment_path(path, sizeof(path), reader->dir, reader->segments[i].first_seq, "log");
+    return map_segment(path, &reader->map, &reader->map_size) == 0;
+}
+
+int chat_log_reader_next(struct chat_log_reader *reader, struct chat_log_record *record)
+{
+    while (reader->current < reader->segment_count)
+    {
+        if (reader->map == NULL && reader->map_size == 0 && reader->offset == 0)
+        {
+            if (!reader_open_segment(reader, reader->current, 0))
+            {
+                return -1;
+            }
+        }
+        size_t next;
+        if (reader->map != NULL && reader->offset < reader->map_size
+            && parse_record(reader->map, reader->map_size, reader->offset, record, &next))
+        {
+            reader->offset = next;
+            return 1;
+        }
+        // 本段读完，进入下一段
+        reader_unmap(reader);
+        reader->current++;
+        reader->offset = 0;
+    }
+    return 0;
+}
+
+/**
+ * 在第 i 段中定位：先用索引找到不晚于目标的最后一项，再向后扫描
+ * by_time 为 true 时按时间比较，否则按序号
+ */
+static bool reader_seek_in_segment(struct chat_log_reader *reader, size_t i, uint64_t target, bool by_time)
+{
+    struct chat_log_segment *segment = &reader->segments[i];
+    size_t low = 0;
+    size_t high = segment->index_count;
+    while (low < high)
+    {
+        size_t mid = (low + high) / 2;
+        uint64_t key = by_time ? segment->index[mid].timestamp_us : segment->index[mid].seq;
+        if (key <= target)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    size_t offset = low > 0 ? segment->index[low - 1].offset : 0;
+    if (!reader_open_segment(reader, i, offset))
+    {
+        return false;
+    }
+
+    struct chat_log_record record;
+    size_t next;
+    while (reader->offset < reader->map_size
+           && parse_record(reader->map, reader->map_size, reader->offset, &record, &next))
+    {
+        uint64_t key = by_time ? record.timestamp_us : record.seq;
+        if (key >= target)
+        {
+            return true;
+        }
+        reader->offset = next;
+    }
+    // 本段中没有，从下一段开头读
+    reader_unmap(reader);
+    reader->current = i + 1;
+    reader->offset = 0;
+    return true;
+}
+
+bool chat_log_reader_seek_seq(struct chat_log_reader *reader, uint64_t seq)
+{
+    if (reader->segment_count == 0)
+    {
+        return false;
+    }
+    // 找到第一个序号不大于 seq 的最后一段
+    size_t i = 0;
+    while (i + 1 < reader->segment_count && reader->segments[i + 1].first_seq <= seq)
+    {
+        i++;
+    }
+    return reader_seek_in_segment(reader, i, seq, false);
+}
+
+bool chat_log_reader_seek_time(struct chat_log_reader *reader, uint64_t timestamp_us)
+{
+    if (reader->segment_count == 0)
+    {
+        return false;
+    }
+    // 每段索引的第一项是段中第一条记录，找到开始时间不晚于目标的最后一段
+    size_t i = 0;
+    while (i + 1 < reader->segment_count && reader->segments[i + 1].index_count > 0
+           && reader->segments[i + 1].index[0].timestamp_us <= timestamp_us)
+    {
+        i++;
+    }
+    return reader_seek_in_segment(reader, i, timestamp_us, true);
+}
+
+int chat_log_dump(const char *dir, const char *from)
+{
+    struct chat_log_reader reader;
+    if (chat_log_reader_open(&reader, dir) < 0)
+    {
+        printf("无法打开聊天记录目录 %s：%s\n", dir, strerror(errno));
+        return 1;
+    }
+    if (from != NULL)
+    {
+        char *end;
+        bool by_time = from[0] == '@';
+        unsigned long long value = strtoull(by_time ? from + 1 : from, &end, 10);
+        if (*end != '\0')
+        {
+            printf("无效的起始位置 %s\n", from);
+            chat_log_reader_close(&reader);
+            return 1;
+        }
+        if (by_time)
+        {
+            chat_log_reader_seek_time(&reader, value * 1000000);
+        }
+        else
+        {
+            chat_log_reader_seek_seq(&reader, value);
+        }
+    }
+
+    struct chat_log_record record;
+    int ret;
+    while ((ret = chat_log_reader_next(&reader, &record)) > 0)
+    {
+        time_t seconds = record.timestamp_us / 1000000;
+        struct tm tm;
+        char time_str[32];
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime_r(&seconds, &tm));
+        // 消息内容以换行结尾
+        printf("#%llu %s.%03u [%.*s] %.*s", (unsigned long long)record.seq, time_str,
+               (unsigned)(record.timestamp_us % 1000000 / 1000), (int)record.room_len, record.room,
+               (int)record.payload_len, record.payload);
+    }
+    chat_log_reader_close(&reader);
+    return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "msgbuf.h"
+
+/**
+ * 只追加的持久化聊天记录（预写日志）
+ *
+ * 日志目录中是一组段文件，文件名为段中第一条记录的序号（如 00000000000000000001.log），
+ * 段写满 segment_size 字节后换新段。每条记录为：
+ *   [记录头 chat_log_header] + [房间名] + [消息内容]
+ * 记录头中有 CRC32，启动时从最后一段中找到第一条损坏（写了一半）的记录并截断。
+ * 记录头按本机字节序存放，日志只在写入它的机器上读取。
+ *
+ * 每个段有一个稀疏索引文件（同名 .idx），大约每 CHAT_LOG_INDEX_INTERVAL 字节记一项
+ * （序号、时间、偏移），按序号或时间查找时先二分查索引，再从该偏移向后顺序扫描。
+ *
+ * 写入由单独的日志线程完成：广播路径上的 chat_log_append 只把 msgbuf 的引用放进待写列表，
+ * 不做系统调用。日志线程把积累的所有记录用 writev 一次写出（组提交），
+ * 未同步的记录达到 sync_batch 条或最早一条等待超过 sync_interval_ms 时调用一次 fdatasync。
+ * 保留策略按整段删除最旧的段。
+ */
+
+// 稀疏索引的间隔（字节）
+#define CHAT_LOG_INDEX_INTERVAL 4096
+
+struct chat_log_options
+{
+    const char *dir;
+    size_t segment_size;       // 段文件大小上限（字节）
+    size_t sync_batch;         // 每积累多少条未同步的记录 fdatasync 一次，0 表示不主动同步
+    unsigned sync_interval_ms; // 未同步的记录最多等待多久就同步，0 表示只按条数
+    size_t retention_segments; // 最多保留的段数，0 表示不删除
+};
+
+/**
+ * 记录头，紧跟着 room_len 字节的房间名和 payload_len 字节的消息内容
+ */
+struct chat_log_header
+{
+    uint32_t crc;          // 从 seq 开始到消息内容结束的 CRC32
+    uint32_t payload_len;
+    uint64_t seq;
+    uint64_t timestamp_us; // 写入时间（UNIX 时间，微秒）
+    uint16_t room_len;
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+struct chat_log_stats
+{
+    unsigned long long appended;  // 追加的记录数
+    unsigned long long dropped;   // 待写列表已满时丢弃的记录数
+    unsigned long long written;   // 已写入文件的记录数
+    unsigned long long bytes;     // 已写入的字节数
+    unsigned long long writes;    // writev 次数
+    unsigned long long syncs;     // fdatasync 次数
+    unsigned long long segments_removed;
+};
+
+/**
+ * 打开（不存在时创建）日志目录，恢复最后一段，启动日志线程
+ * 返回 0 表示成功
+ */
+int chat_log_open(const struct chat_log_options *options);
+// 日志是否已打开
+bool chat_log_enabled();
+/**
+ * 追加一条聊天记录（增加 buf 的引用，写出后释放），返回分配的序号
+ * 日志未打开时什么也不做，返回 0；磁盘跟不上、待写的记录过多时丢弃这条记录并计数，同样返回 0
+ */
+uint64_t chat_log_append(const char *room, struct msgbuf *buf);
+// 等待序号不大于 seq 的记录都已 fdatasync（不主动同步时等到写出为止），日志线程已退出时直接返回
+void chat_log_wait_durable(uint64_t seq);
+// 写出并同步所有记录，停止日志线程
+void chat_log_close();
+void chat_log_get_stats(struct chat_log_stats *stats);
+
+/**
+ * 读取时得到的一条记录，指针指向 mmap 的段文件，下一次 chat_log_reader_next 前有效
+ */
+struct chat_log_record
+{
+    uint64_t seq;
+    uint64_t timestamp_us;
+    const char *room;
+    size_t room_len;
+    const char *payload;
+    size_t payload_len;
+};
+
+struct chat_log_index_entry
+{
+    uint64_t seq;
+    uint64_t timestamp_us;
+    uint64_t offset;
+};
+
+struct chat_log_segment
+{
+    uint64_t first_seq;
+    struct chat_log_index_entry *index;
+    size_t index_count;
+};
+
+/**
+ * 日志读取器，按序号或时间定位后顺序读取，段文件用 mmap 读取
+ */
+struct chat_log_reader
+{
+    char *dir;
+    struct chat_log_segment *segments;
+    size_t segment_count;
+    size_t current;  // 当前段
+    char *map;       // 当前段的映射
+    size_t map_size;
+    size_t offset;   // 下一条记录在当前段中的偏移
+};
+
+int chat_log_reader_open(struct chat_log_reader *reader, const char *dir);
+void chat_log_reader_close(struct chat_log_reader *reader);
+// 定位到第一条序号不小于 seq 的记录
+bool chat_log_reader_seek_seq(struct chat_log_reader *reader, uint64_t seq);
+// 定位到第一条时间不早于 timestamp_us 的记录
+bool chat_log_reader_seek_time(struct chat_log_reader *reader, uint64_t timestamp_us);
+/**
+ * 读取下一条记录
+ * 返回 1 表示读到一条，0 表示已到末尾，-1 表示读取失败
+ */
+int chat_log_reader_next(struct chat_log_reader *reader, struct chat_log_record *record);
+
+/**
+ * 把日志内容打印到标准输出
+ * from 为 NULL 时从头开始，为数字时从该序号开始，为 @ 加 UNIX 时间（秒）时从该时间开始
+ */
+int chat_log_dump(const char *dir, const char *from);
+
+#endif // CHAT_LOG_H
@@ -0,0 +1,426 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include "config.h"
+#include "packet.h"
+#include "msgbuf.h"
+#include "send_queue.h"
+#include "room.h"
+#include "protocol.h"
+#include "presence.h"
+#include "stats.h"
+#include "logger.h"
+#include "compress.h"
+#include "moderation.h"
+#include "chat_session.h"
+
+// 固定提示语的帧，启动时创建一次，之后所有会话共享，不再释放
+static struct
+{
+    struct msgbuf *welcome;
+    struct msgbuf *name_prompt;
+    struct msgbuf *name_too_long;
+    struct msgbuf *name_is_empty;
+    struct msgbuf *successful;
+    struct msgbuf *message_too_long;
+    struct msgbuf *bad_room_name;
+    struct msgbuf *join_failed;
+    struct msgbuf *unknown_command;
+    struct msgbuf *hello;
+    struct msgbuf *compression;
+    struct msgbuf *filtered;
+    struct msgbuf *bad_frame;
+} prompts;
+
+void chat_session_prompts_init()
+{
+    prompts.welcome = msgbuf_printf(MAX_PROMPT_LEN, "\n欢迎来到聊天室！\n");
+    prompts.name_prompt = msgbuf_printf(MAX_PROMPT_LEN, "请输入你的名字：");
+    prompts.name_too_long = msgbuf_printf(MAX_PROMPT_LEN, "名字过长，请重新输入\n");
+    prompts.name_is_empty = msgbuf_printf(MAX_PROMPT_LEN, "名字不能为空\n");
+    prompts.successful = msgbuf_printf(MAX_PROMPT_LEN, "设置成功！\n");
+    prompts.message_too_long = msgbuf_printf(MAX_PROMPT_LEN, "消息过长（上限 %zu 字节），已丢弃\n",
+                                             config.max_message_size);
+    prompts.bad_room_name = msgbuf_printf(MAX_PROMPT_LEN, "房间名不能为空、不能含空白字符，且不能超过 %d 字节\n",
+                                          MAX_ROOM_NAME_LEN - 1);
+    prompts.join_failed = msgbuf_printf(MAX_PROMPT_LEN, "进入房间失败\n");
+    prompts.unknown_command = msgbuf_printf(MAX_PROMPT_LEN,
+                                            "未知命令，可用的命令：/join 房间名 [序号]、/leave、/rooms、/history [序号]、/stats、/quit\n");
+    prompts.hello = msgbuf_create(PROTO_HELLO, PROTO_HELLO_LEN);
+    const char algorithm = COMPRESS_DEFLATE;
+    prompts.compression = proto_message(PROTO_COMPRESSION, 0, &algorithm, 1);
+    prompts.filtered = msgbuf_printf(MAX_PROMPT_LEN, "消息包含违禁内容，未发送\n");
+    prompts.bad_frame = msgbuf_printf(MAX_PROMPT_LEN, "无法识别的消息，已忽略\n");
+}
+
+void chat_session_init(struct chat_session *session, const struct chat_session_ops *ops, int fd, uint32_t id,
+                       struct send_queue *queue)
+{
+    memset(session, 0, sizeof(*session));
+    session->ops = ops;
+    session->fd = fd;
+    session->id = id;
+    session->version = PACKET_V1;
+    session->queue = queue;
+    session->member.queue = queue;
+}
+
+// 判断字符串是否全为空白字符
+static bool is_blank(const char *str, size_t buff_max_size)
+{
+    size_t len = strnlen(str, buff_max_size);
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!isblank(str[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 消息进入会话的发送队列，由发送线程异步发出
+void chat_session_send(struct chat_session *session, struct msgbuf *buf)
+{
+    if (buf != NULL && send_queue_push(session->queue, buf))
+    {
+        send_flusher_wake();
+    }
+}
+
+// 格式化一条只发给一个会话的提示
+static void session_send_printf(struct chat_session *session, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void session_send_printf(struct chat_session *session, const char *format, ...)
+{
+    char text[MAX_PROMPT_LEN];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (len < 0)
+    {
+        return;
+    }
+    struct msgbuf *buf = msgbuf_create(text, (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1);
+    chat_session_send(session, buf);
+    msgbuf_unref(buf);
+}
+
+void chat_session_start(struct chat_session *session)
+{
+    chat_session_send(session, prompts.welcome);
+    chat_session_send(session, prompts.name_prompt);
+}
+
+void chat_session_message_too_long(struct chat_session *session)
+{
+    chat_session_send(session, prompts.message_too_long);
+}
+
+// 发送补发历史消息的说明
+static void session_send_replay_notice(struct chat_session *session, const struct room_replay *replay, uint64_t since)
+{
+    struct msgbuf *notice = room_replay_notice(replay, since);
+    chat_session_send(session, notice);
+    msgbuf_unref(notice);
+}
+
+// 进入名为 room_name 的房间，补发序号 since 之后的历史消息，并通知房间成员
+// 调用前会话不在任何房间中
+static void session_enter_room(struct chat_session *session, const char *room_name, uint64_t since)
+{
+    struct room_replay replay;
+    session->room = room_join(session->ops->rooms, room_name, &session->member, since, &replay);
+    if (session->room == NULL)
+    {
+        chat_session_send(session, prompts.join_failed);
+        // 回到大厅，保证用户总在某个房间中
+        since = 0;
+        session->room = room_join(session->ops->rooms, DEFAULT_ROOM, &session->member, since, &replay);
+        if (session->room == NULL)
+        {
+            return;
+        }
+    }
+    session_send_replay_notice(session, &replay, since);
+    presence_post(session->room, PRESENCE_JOIN, session->name);
+}
+
+void chat_session_leave_room(struct chat_session *session)
+{
+    if (session->room == NULL)
+    {
+        return;
+    }
+    // 摘要持有房间的引用，离开后最后一个成员的房间被移除也不影响
+    presence_post(session->room, PRESENCE_LEAVE, session->name);
+    room_leave(session->ops->rooms, session->room, &session->member);
+    session->room = NULL;
+}
+
+// 换到名为 room_name 的房间（房间名已检查过）
+static void session_join(struct chat_session *session, const char *room_name, uint64_t since)
+{
+    if (session->room != NULL && strcmp(session->room->name, room_name) == 0)
+    {
+        session_send_printf(session, "你已经在房间 %s 中，可以用 /history 序号 查看历史消息\n", room_name);
+        return;
+    }
+    chat_session_leave_room(session);
+    session_enter_room(session, room_name, since);
+}
+
+// 回到大厅
+static void session_return_to_lobby(struct chat_session *session)
+{
+    if (session->room != NULL && strcmp(session->room->name, DEFAULT_ROOM) == 0)
+    {
+        session_send_printf(session, "你已经在%s中\n", DEFAULT_ROOM);
+        return;
+    }
+    chat_session_leave_room(session);
+    session_enter_room(session, DEFAULT_ROOM, 0);
+}
+
+// 处理以 / 开头的命令，不是已知命令时返回 false
+static bool session_handle_command(struct chat_session *session, const char *msg)
+{
+    if (strncmp(msg, "/join", 5) == 0 && (msg[5] == ' ' || msg[5] == '\0'))
+    {
+        // /join 房间名 [序号]：重连时带上之前看到的最新序号，只补发之后的消息
+        char room_name[MAX_ROOM_NAME_LEN] = {0};
+        uint64_t since;
+        if (!room_parse_args(msg + 5, room_name, &since) || room_name[0] == '\0')
+        {
+            chat_session_send(session, prompts.bad_room_name);
+        }
+        else
+        {
+            session_join(session, room_name, since);
+        }
+        return true;
+    }
+    if (strncmp(msg, "/history", 8) == 0 && (msg[8] == ' ' || msg[8] == '\0'))
+    {
+        // /history [序号]：补发当前房间中该序号之后的历史消息
+        uint64_t since;
+        if (!room_parse_seq(msg + 8, &since))
+        {
+            chat_session_send(session, prompts.unknown_command);
+        }
+        else if (session->room != NULL)
+        {
+            struct room_replay replay;
+            room_replay_history(session->room, &session->member, since, &replay);
+            if (replay.count == 0 && since == 0)
+            {
+                session_send_printf(session, "房间 %s 还没有历史消息\n", session->room->name);
+            }
+            session_send_replay_notice(session, &replay, since);
+        }
+        return true;
+    }
+    if (strcmp(msg, "/leave") == 0)
+    {
+        session_return_to_lobby(session);
+        return true;
+    }
+    if (strcmp(msg, "/rooms") == 0)
+    {
+        struct msgbuf *list = room_list(session->ops->rooms, ROOM_LIST_LIMIT);
+        chat_session_send(session, list);
+        msgbuf_unref(list);
+        return true;
+    }
+    if (strcmp(msg, "/stats") == 0)
+    {
+        struct msgbuf *report = stats_report();
+        chat_session_send(session, report);
+        msgbuf_unref(report);
+        return true;
+    }
+    return false;
+}
+
+// 设置名字并进入大厅，名字无效时提示重新输入
+static void session_set_name(struct chat_session *session, const char *msg)
+{
+    // 名字过长
+    if (strnlen(msg, MAX_NAME_LEN) > MAX_NAME_LEN - 1)
+    {
+        chat_session_send(session, prompts.name_too_long);
+        chat_session_send(session, prompts.name_prompt);
+        return;
+    }
+    // 名字字符串全为空白字符
+    if (is_blank(msg, MAX_NAME_LEN))
+    {
+        chat_session_send(session, prompts.name_is_empty);
+        chat_session_send(session, prompts.name_prompt);
+        return;
+    }
+    strncpy(session->name, msg, MAX_NAME_LEN - 1);
+    session->name[MAX_NAME_LEN - 1] = '\0';
+    session->named = true;
+    if (session->ops->name_set != NULL)
+    {
+        session->ops->name_set(session);
+    }
+    log_debug("客户端 %d 设置了名字 %s", session->fd, session->name);
+    chat_session_send(session, prompts.successful);
+    if (session->version == PACKET_V2)
+    {
+        // v2 客户端据此知道名字已被接受，之后的输入不再作为名字发送
+        struct msgbuf *confirm = proto_message(PROTO_NAME, 0, session->name, strlen(session->name));
+        chat_session_send(session, confirm);
+        msgbuf_unref(confirm);
+    }
+    // 进入大厅（补发大厅的历史消息），并在下一次在线状态摘要中通知大厅的成员
+    struct room_replay replay;
+    session->room = room_join(session->ops->rooms, DEFAULT_ROOM, &session->member, 0, &replay);
+    if (session->room != NULL)
+    {
+        session_send_replay_notice(session, &replay, 0);
+        presence_post(session->room, PRESENCE_JOIN, session->name);
+    }
+}
+
+// 处理已设置名字的用户发来的命令或聊天内容，msg 以 '\0' 结尾
+static void session_handle_text(struct chat_session *session, const char *msg, size_t len)
+{
+    if (msg[0] == '/')
+    {
+        if (!session_handle_command(session, msg))
+        {
+            chat_session_send(session, prompts.unknown_command);
+        }
+        return;
+    }
+    if (session->room == NULL)
+    {
+        chat_session_send(session, prompts.join_failed);
+        return;
+    }
+
+    // 过长的消息只记录开头
+    log_debug("客户端 %d 昵称 %s 在房间 %s 发送消息：%.*s%s", session->fd, session->name, session->room->name,
+              (int)(len < MAX_LOG_MESSAGE_LEN ? len : MAX_LOG_MESSAGE_LEN), msg,
+              len > MAX_LOG_MESSAGE_LEN ? "……" : "");
+    if (!moderation_allows(msg, len))
+    {
+        chat_session_send(session, prompts.filtered);
+        return;
+    }
+
+    // 向所在房间广播消息：内容原样放进 v2 聊天消息，v1 接收者的 "[用户名] 内容\n" 只在需要时格式化一次
+    session->ops->publish(session->room, proto_chat(session->id, session->name, session->room->name, msg, len));
+}
+
+// 处理 v2 会话收到的一帧，msg 以 '\0' 结尾
+static void session_handle_frame(struct chat_session *session, const char *msg, size_t len)
+{
+    struct proto_frame frame;
+    if (!proto_decode(msg, len, &frame))
+    {
+        chat_session_send(session, prompts.bad_frame);
+        return;
+    }
+    if (frame.type == PROTO_PONG)
+    {
+        // 收到数据时已经更新了最后收到数据的时刻
+        return;
+    }
+    if (frame.type == PROTO_PING)
+    {
+        struct msgbuf *pong = proto_message(PROTO_PONG, frame.seq, NULL, 0);
+        chat_session_send(session, pong);
+        msgbuf_unref(pong);
+        return;
+    }
+    if (frame.type == PROTO_COMPRESSION)
+    {
+        // 只在设置名字之前（还没有进入房间）接受；服务端不压缩或不认识算法时不确认，客户端照常工作
+        if (!session->named && config.compress_min > 0 && frame.text_len == 1 && frame.text[0] == COMPRESS_DEFLATE)
+        {
+            send_queue_set_compression(session->queue, true);
+            chat_session_send(session, prompts.compression);
+        }
+        return;
+    }
+    if (frame.type == PROTO_NAME)
+    {
+        if (session->named)
+        {
+            session_send_printf(session, "你的名字已经是 %s\n", session->name);
+        }
+        else
+        {
+            session_set_name(session, frame.text);
+        }
+        return;
+    }
+    if (!session->named)
+    {
+        chat_session_send(session, prompts.name_prompt);
+        return;
+    }
+    switch (frame.type)
+    {
+    case PROTO_TEXT:
+        session_handle_text(session, frame.text, frame.text_len);
+        break;
+    case PROTO_JOIN:
+        if (!room_name_valid(frame.text))
+        {
+            chat_session_send(session, prompts.bad_room_name);
+        }
+        else
+        {
+            session_join(session, frame.text, frame.seq);
+        }
+        break;
+    case PROTO_LEAVE:
+        session_return_to_lobby(session);
+        break;
+    case PROTO_TYPING:
+        if (session->room != NULL)
+        {
+            presence_post(session->room, PRESENCE_TYPING, session->name);
+        }
+        break;
+    default:
+        chat_session_send(session, prompts.bad_frame);
+        break;
+    }
+}
+
+void chat_session_handle_message(struct chat_session *session, char *msg, size_t len)
+{
+    stats_add(STAT_MESSAGES_IN, 1);
+    stats_add(STAT_BYTES_IN, len);
+    if (session->version == PACKET_V2)
+    {
+        session_handle_frame(session, msg, len);
+        return;
+    }
+    // v1：设置名字之前可以协商使用 v2，先用 v1 帧应答，之后的收发都使用 v2 帧
+    if (!session->named && proto_is_hello(msg, len))
+    {
+        chat_session_send(session, prompts.hello);
+        send_queue_set_version(session->queue, PACKET_V2);
+        session->version = PACKET_V2;
+        session->ops->upgraded(session);
+        return;
+    }
+    // 还没有设置名字时，收到的字符串就是用户名
+    if (!session->named)
+    {
+        session_set_name(session, msg);
+        return;
+    }
+    session_handle_text(session, msg, len);
+}
@@ -0,0 +1,65 @@
+#ifndef CHAT_SESSION_H
+#define CHAT_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "msgbuf.h"
+#include "send_queue.h"
+#include "room.h"
+
+/**
+ * 聊天会话的协议和命令处理，线程模式（server.c）和事件驱动模式（event_server.c）共用
+ *
+ * 两种模式只负责 I/O：把从 socket 拼出的完整消息交给 chat_session_handle_message，
+ * 发给客户端的帧都放进会话的发送队列，由发送线程写出。
+ * 协商 v2、设置名字、进出房间、命令和聊天消息都在这里处理，
+ * 两种模式的差异（房间表、聊天消息怎样广播、切换到 v2 之后怎样拼帧和开始心跳检查）由 chat_session_ops 提供。
+ */
+
+struct chat_session;
+
+struct chat_session_ops
+{
+    struct room_registry *rooms;
+    // 发送本节点用户的聊天消息，释放调用者持有的 buf 引用
+    void (*publish)(struct room *room, struct msgbuf *buf);
+    // 会话协商改用 v2 帧之后调用：之后的消息按 v2 格式拼帧，开始心跳检查
+    void (*upgraded)(struct chat_session *session);
+    // 会话设置了名字之后调用，可以为 NULL
+    void (*name_set)(struct chat_session *session);
+};
+
+struct chat_session
+{
+    const struct chat_session_ops *ops;
+    int fd;      // 连接的 socket，用于日志和会话表，不在这里读写
+    uint32_t id; // 会话编号，v2 聊天消息中的发送者
+    int version; // 帧格式，协商后可能切换为 PACKET_V2
+    bool named;  // 是否已设置名字
+    // 用户名，设置后不再变化
+    char name[MAX_NAME_LEN];
+    struct send_queue *queue;
+    // 当前所在的房间，设置名字前为 NULL
+    struct room *room;
+    struct room_member member;
+};
+
+// 创建固定提示语的帧，服务端启动时调用一次
+void chat_session_prompts_init();
+// 初始化会话（v1 帧格式，未设置名字，不在任何房间中）
+void chat_session_init(struct chat_session *session, const struct chat_session_ops *ops, int fd, uint32_t id,
+                       struct send_queue *queue);
+// 向会话发送一帧，不释放 buf
+void chat_session_send(struct chat_session *session, struct msgbuf *buf);
+// 连接建立后发送欢迎语和输入名字的提示
+void chat_session_start(struct chat_session *session);
+// 处理会话收到的一条完整消息，msg 以 '\0' 结尾
+void chat_session_handle_message(struct chat_session *session, char *msg, size_t len);
+// 提示客户端刚才的消息过长，已被丢弃
+void chat_session_message_too_long(struct chat_session *session);
+// 离开当前房间并通知其余成员，连接关闭时调用
+void chat_session_leave_room(struct chat_session *session);
+
+#endif // CHAT_SESSION_H
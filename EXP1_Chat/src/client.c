@@ -2,89 +2,485 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <pthread.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "config.h"
 #include "packet.h"
-
-static char recv_buf[MAX_BUFF_SIZE] = {0};
+#include "protocol.h"
+#include "compress.h"
+#include "room.h"
 
 int client_sock = -1;
+// 与服务端协商后使用的协议版本，接收线程收到协商应答时切换
+static atomic_int protocol_version = PACKET_V1;
+// 协商应答、名字的应答到达时通知主线程
+static pthread_mutex_t negotiate_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t negotiate_done = PTHREAD_COND_INITIALIZER;
+// 等待协商应答、名字应答的最长时间，旧服务端不会应答
+#define NEGOTIATE_TIMEOUT_MS 1000
+// v2：服务端是否已经接受了名字，接受之前输入的内容作为名字发送
+static atomic_bool name_accepted = false;
+// v2：已发出名字，还没有被接受
+static atomic_bool name_pending = false;
+// v2 帧由主线程（输入）和接收线程（心跳应答）发送，用锁保证一帧完整写出后再写下一帧
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+// 开始输入一行时通知服务端正在输入，两次通知至少间隔这么久
+#define TYPING_INTERVAL_MS 3000
+static struct timespec last_typing;
+// 输出缓冲区积累到这么多字节时先写出一次，不再等 socket 中的数据读完
+#define RENDER_BATCH_BYTES (64 * 1024)
+// 连接状态等提示的输出位置，管道模式下是标准错误，标准输出只有收到的消息
+static FILE *status_out;
+
+/**
+ * 接收线程的输出缓冲区
+ * 一次唤醒读到的所有消息都渲染到这里，socket 中暂时没有更多数据时用一次 write 写到标准输出，
+ * 不为每条消息各调用一次 printf 和 fflush；终端输出跟不上时，整批消息的渲染代价也只有一次系统调用
+ */
+static struct
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+} out;
+
+// 把缓冲区中的内容写到标准输出
+static void out_flush()
+{
+    size_t done = 0;
+    while (done < out.len)
+    {
+        ssize_t written = write(STDOUT_FILENO, out.data + done, out.len - done);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        done += written;
+    }
+    out.len = 0;
+}
+
+static void out_append(const char *text, size_t len)
+{
+    if (out.len + len > out.capacity)
+    {
+        size_t capacity = out.capacity == 0 ? RENDER_BATCH_BYTES : out.capacity;
+        while (capacity < out.len + len)
+        {
+            capacity *= 2;
+        }
+        char *data = realloc(out.data, capacity);
+        if (data == NULL)
+        {
+            // 内存不足时先写出已有的内容，再直接写出这一段
+            out_flush();
+            ssize_t written = write(STDOUT_FILENO, text, len);
+            (void)written;
+            return;
+        }
+        out.data = data;
+        out.capacity = capacity;
+    }
+    memcpy(out.data + out.len, text, len);
+    out.len += len;
+}
+
+// 解压 PROTO_DEFLATE 帧的缓冲区，只在接收线程中使用，按需扩大
+static struct
+{
+    char *data;
+    size_t capacity;
+} inflated;
+
+// 通知主线程名字已被接受
+static void name_answered()
+{
+    pthread_mutex_lock(&negotiate_lock);
+    atomic_store(&name_accepted, true);
+    atomic_store(&name_pending, false);
+    pthread_cond_signal(&negotiate_done);
+    pthread_mutex_unlock(&negotiate_lock);
+}
+
+// 发送一个 v2 帧，可以在任何线程调用
+static void send_frame(const char *frame, size_t len)
+{
+    pthread_mutex_lock(&send_lock);
+    send_msg_v2(client_sock, frame, len);
+    pthread_mutex_unlock(&send_lock);
+}
+
+// 渲染一条 v2 消息
+static void render_frame(const char *body, size_t len)
+{
+    struct proto_frame frame;
+    if (!proto_decode(body, len, &frame))
+    {
+        return;
+    }
+    switch (frame.type)
+    {
+    case PROTO_TEXT:
+        out_append(frame.text, frame.text_len);
+        break;
+    case PROTO_CHAT:
+        out_append("[", 1);
+        out_append(frame.name, frame.name_len);
+        out_append("] ", 2);
+        out_append(frame.text, frame.text_len);
+        out_append("\n", 1);
+        break;
+    case PROTO_NAME:
+        name_answered();
+        break;
+    case PROTO_PING:
+    {
+        // 服务端的心跳，原样回复令牌
+        char pong[PROTO_MAX_OVERHEAD];
+        send_frame(pong, proto_encode(pong, PROTO_PONG, frame.seq, NULL, 0));
+        break;
+    }
+    case PROTO_PRESENCE:
+    {
+        char text[PROTO_PRESENCE_TEXT_LEN];
+        out_append(text, proto_presence_text(&frame, true, text));
+        break;
+    }
+    case PROTO_DEFLATE:
+    {
+        // 解压后按原帧显示，原帧长度与未压缩时的帧一样受读缓冲区上限约束；压缩帧中不会再嵌套压缩帧
+        if (frame.count == 0 || frame.count > config.max_message_size + PROTO_CHAT_OVERHEAD)
+        {
+            break;
+        }
+        if (frame.count > inflated.capacity)
+        {
+            char *data = realloc(inflated.data, frame.count);
+            if (data == NULL)
+            {
+                break;
+            }
+            inflated.data = data;
+            inflated.capacity = frame.count;
+        }
+        if (compress_inflate(frame.text, frame.text_len, inflated.data, frame.count) && inflated.data[0] != PROTO_DEFLATE)
+        {
+            render_frame(inflated.data, frame.count);
+        }
+        break;
+    }
+    case PROTO_BATCH:
+    {
+        const char *p = frame.text;
+        const char *end = frame.text + frame.text_len;
+        const char *item;
+        size_t item_len;
+        for (uint64_t i = 0; i < frame.count && proto_batch_next(&p, end, &item, &item_len); i++)
+        {
+            // 批量消息中不会再嵌套批量消息
+            if (item_len > 0 && item[0] != PROTO_BATCH)
+            {
+                render_frame(item, item_len);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// 按协商的协议发送一行输入
+static void send_line(const char *line, size_t len, char *frame_buf)
+{
+    if (atomic_load(&protocol_version) == PACKET_V1)
+    {
+        send_msg(client_sock, line, len);
+        return;
+    }
+
+    uint8_t type = PROTO_TEXT;
+    uint64_t since = 0;
+    char room_name[MAX_ROOM_NAME_LEN] = {0};
+    if (!atomic_load(&name_accepted))
+    {
+        type = PROTO_NAME;
+        atomic_store(&name_pending, true);
+    }
+    else if (strncmp(line, "/join ", 6) == 0 && room_parse_args(line + 5, room_name, &since) && room_name[0] != '\0')
+    {
+        type = PROTO_JOIN;
+        line = room_name;
+        len = strlen(room_name);
+    }
+    else if (strcmp(line, "/leave") == 0)
+    {
+        type = PROTO_LEAVE;
+        len = 0;
+    }
+    send_frame(frame_buf, proto_encode(frame_buf, type, since, line, len));
+
+    if (type == PROTO_NAME)
+    {
+        // 等服务端接受名字后再发送下一行，否则下一行也会被当作名字（管道模式中各行是连续到达的）
+        // 名字无效时服务端只回复提示，等到超时后下一行仍作为名字发送
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += NEGOTIATE_TIMEOUT_MS / 1000;
+        pthread_mutex_lock(&negotiate_lock);
+        while (atomic_load(&name_pending)
+               && pthread_cond_timedwait(&negotiate_done, &negotiate_lock, &deadline) == 0)
+        {
+        }
+        pthread_mutex_unlock(&negotiate_lock);
+    }
+}
+
+// readline 读取字符的函数：在一行的第一个字符处发送 PROTO_TYPING
+// readline 只在主线程中调用它，与 send_line 不会同时发送
+static int typing_getc(FILE *stream)
+{
+    int c = rl_getc(stream);
+    if (c == EOF || c == '\n' || c == '\r' || rl_end != 0 || !atomic_load(&name_accepted))
+    {
+        return c;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed_ms = (now.tv_sec - last_typing.tv_sec) * 1000 + (now.tv_nsec - last_typing.tv_nsec) / 1000000;
+    if (last_typing.tv_sec == 0 || elapsed_ms >= TYPING_INTERVAL_MS)
+    {
+        char frame[1];
+        send_frame(frame, proto_encode(frame, PROTO_TYPING, 0, NULL, 0));
+        last_typing = now;
+    }
+    return c;
+}
 
 // 消息接收线程
 void* recv_thread(void* arg)
 {
+    struct frame_reader reader;
+    // 服务端转发时会在消息前后加上用户名等内容
+    if (!frame_reader_init(&reader, client_sock, config.max_message_size + PROTO_CHAT_OVERHEAD))
+    {
+        fprintf(status_out, "读缓冲区分配失败\n");
+        exit(1);
+    }
+
     while (1)
     {
-        ssize_t recv_len;
-        recv_len = recv_msg(client_sock, recv_buf, MAX_BUFF_SIZE - 1);
+        // 一次 recv 可能读到多条消息，全部渲染到输出缓冲区
+        ssize_t received = frame_reader_fill(&reader);
+        if (received == 0)
+        {
+            out_flush();
+            fprintf(status_out, "服务端关闭连接，连接终止\n");
+            exit(0);
+        }
+        if (received < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            out_flush();
+            fprintf(status_out, "数据接收失败，连接终止\n");
+            exit(1);
+        }
 
-        if (recv_len == -1)
+        char *msg;
+        size_t len;
+        int ret;
+        while ((ret = frame_reader_next(&reader, &msg, &len)) > 0)
         {
-            printf("数据接收失败\n");
+            if (reader.version == PACKET_V2)
+            {
+                render_frame(msg, len);
+            }
+            else if (proto_is_hello(msg, len))
+            {
+                // 服务端同意使用 v2，之后的消息都是 v2 帧
+                reader.version = PACKET_V2;
+                pthread_mutex_lock(&negotiate_lock);
+                atomic_store(&protocol_version, PACKET_V2);
+                pthread_cond_signal(&negotiate_done);
+                pthread_mutex_unlock(&negotiate_lock);
+            }
+            else
+            {
+                out_append(msg, len);
+            }
         }
-        else if (recv_len == 0)
+        if (ret < 0)
         {
-            printf("服务端关闭连接，连接终止\n");
-            exit(0);
+            out_flush();
+            fprintf(status_out, ret == -3 ? "内存不足，连接终止\n" : "收到的消息过长，连接终止\n");
+            exit(1);
+        }
+        // socket 中还有已到达的数据时接着读（不会阻塞），读完或攒够一批再写出
+        int pending = 0;
+        if (out.len < RENDER_BATCH_BYTES && ioctl(client_sock, FIONREAD, &pending) == 0 && pending > 0)
+        {
+            continue;
         }
-        recv_buf[recv_len] = '\0';
-        printf("%s", recv_buf);
-        fflush(stdout);
+        out_flush();
     }
 }
 
+// 读取一行输入（不含换行符），输入结束时返回 NULL，返回的字符串由调用者释放
+// 交互模式使用 readline；管道模式直接从标准输入逐行读取，不回显、不处理编辑键
+static char *read_input()
+{
+    if (!config.client_pipe)
+    {
+        return readline("");
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t len = getline(&line, &capacity, stdin);
+    if (len < 0)
+    {
+        free(line);
+        return NULL;
+    }
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+    {
+        line[--len] = '\0';
+    }
+    return line;
+}
+
 int client_main()
 {
     struct sockaddr_in server_addr;
+    struct sockaddr_un unix_addr;
+    struct sockaddr *addr = (struct sockaddr *)&server_addr;
+    socklen_t addr_len = sizeof(server_addr);
+    status_out = config.client_pipe ? stderr : stdout;
 
-    // 1. 创建 socket
-    client_sock = socket(AF_INET, SOCK_STREAM, 0);
+    // 1. 创建 socket：配置了 --unix-socket 时连接服务端的本机 socket，不经过 TCP 协议栈
+    client_sock = socket(config.unix_socket != NULL ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
     if (client_sock == -1)
     {
-        printf("sock 创建失败\n");
+        fprintf(status_out, "sock 创建失败\n");
         exit(1);
     }
 
     // 2. 初始化地址
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (config.unix_socket != NULL)
+    {
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        if (strlen(config.unix_socket) >= sizeof(unix_addr.sun_path))
+        {
+            fprintf(status_out, "本机 socket 路径 %s 过长\n", config.unix_socket);
+            exit(1);
+        }
+        strcpy(unix_addr.sun_path, config.unix_socket);
+        addr = (struct sockaddr *)&unix_addr;
+        addr_len = sizeof(unix_addr);
+    }
+    else
+    {
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_port = htons(config.port);
+        server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (config.host != NULL && inet_pton(AF_INET, config.host, &server_addr.sin_addr) != 1)
+        {
+            fprintf(status_out, "无效的服务端地址 %s\n", config.host);
+            exit(1);
+        }
+    }
 
     // 3. 连接
-    if (connect(client_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    if (connect(client_sock, addr, addr_len) < 0)
     {
-        printf("连接失败！\n");
+        fprintf(status_out, "连接失败！\n");
         exit(2);
     }
-    printf("连接成功\n要关闭连接，请输入 /quit。\n");
+    fprintf(status_out, "连接成功\n要关闭连接，请输入 /quit。\n");
 
     // 创建消息接收线程
     pthread_t recv_thread_handle;
     if (pthread_create(&recv_thread_handle, NULL, recv_thread, NULL) != 0)
     {
-        printf("消息接收线程创建失败\n");
+        fprintf(status_out, "消息接收线程创建失败\n");
         close(client_sock);
         exit(3);
     }
-    pthread_detach(recv_thread_handle);
+    if (!config.client_pipe)
+    {
+        pthread_detach(recv_thread_handle);
+    }
+
+    // 请求使用协议 v2，服务端不支持时会把它当作空名字，提示后继续使用 v1
+    // 服务端切换格式后不能再收到 v1 帧，因此等协商有了结果再读取输入
+    if (config.protocol_version == PACKET_V2)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += NEGOTIATE_TIMEOUT_MS / 1000;
+        pthread_mutex_lock(&negotiate_lock);
+        send_msg(client_sock, PROTO_HELLO, PROTO_HELLO_LEN);
+        while (atomic_load(&protocol_version) == PACKET_V1
+               && pthread_cond_timedwait(&negotiate_done, &negotiate_lock, &deadline) == 0)
+        {
+        }
+        pthread_mutex_unlock(&negotiate_lock);
+    }
+    if (atomic_load(&protocol_version) == PACKET_V2 && config.compress_min > 0)
+    {
+        // 请求接收压缩帧，不需要等确认：确认之前服务端发来的都是普通帧
+        char request[PROTO_MAX_OVERHEAD];
+        const char algorithm = COMPRESS_DEFLATE;
+        send_frame(request, proto_encode(request, PROTO_COMPRESSION, 0, &algorithm, 1));
+    }
+    if (atomic_load(&protocol_version) == PACKET_V2 && !config.client_pipe)
+    {
+        rl_getc_function = typing_getc;
+    }
+    char *frame_buf = malloc(config.max_message_size + PROTO_MAX_OVERHEAD);
+    if (frame_buf == NULL)
+    {
+        fprintf(status_out, "发送缓冲区分配失败\n");
+        exit(1);
+    }
 
-    // 使用 readline 读取输入
     char* input_line = NULL;
 
     while (1)
     {
-        // 使用 readline 读取输入，input_line 在使用完后需要手动释放
-        input_line = readline("");
+        // input_line 在使用完后需要手动释放
+        input_line = read_input();
 
         if (input_line == NULL)
         {
-            printf("\n");
+            if (config.client_pipe)
+            {
+                // 输入结束后不再发送，服务端处理完已发出的消息后关闭连接，期间收到的消息照常输出
+                shutdown(client_sock, SHUT_WR);
+                pthread_join(recv_thread_handle, NULL);
+            }
+            else
+            {
+                fprintf(status_out, "\n");
+            }
             break;
         }
 
@@ -104,14 +500,25 @@ int client_main()
             break;
         }
 
+        if (len > config.max_message_size)
+        {
+            fprintf(status_out, "消息过长（上限 %zu 字节），未发送\n", config.max_message_size);
+            free(input_line);
+            continue;
+        }
+
         // 发送消息
-        send_msg(client_sock, input_line, len);
+        send_line(input_line, len, frame_buf);
 
         // 添加到历史记录
-        add_history(input_line);
+        if (!config.client_pipe)
+        {
+            add_history(input_line);
+        }
 
         free(input_line);
     }
 
+    free(frame_buf);
     return 0;
 }
\ No newline at end of file
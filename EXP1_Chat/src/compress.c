@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "config.h"
+#include "packet.h"
+#include "protocol.h"
+#include "stats.h"
+#include "compress.h"
+
+// deflate 的压缩级别和窗口（raw deflate，不带 zlib 头和校验，帧长度已由外层保证）
+#define COMPRESS_LEVEL 6
+#define COMPRESS_WINDOW_BITS 15
+#define COMPRESS_MEM_LEVEL 8
+// 保留的空闲压缩状态数，每个约 260 KB；同时压缩的线程更多时临时创建
+#define COMPRESS_POOL_SIZE 8
+
+/**
+ * 预置字典：deflate 可以从第一个字节起就引用其中的内容，越常见的放在越后面（距离越短）
+ * 客户端和服务端必须完全一致，修改后需要换一个 COMPRESS_* 算法编号
+ */
+static const char dictionary[] =
+    "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\nint main(int argc, char **argv)\n{\n"
+    "    return 0;\n}\n    if (\n    for (int i = 0; i < \n    while (\n    } else {\n"
+    "Traceback (most recent call last):\n  File \"\", line \n    def __init__(self, \n"
+    "ERROR WARN INFO DEBUG Exception: error: warning: at \n"
+    "https://github.com/ https://www. http:// .com/ .html\n"
+    " the and that this with have from what will would there their about which when your "
+    "you are was for not but can just like know think good thanks please sorry yes okay lol "
+    "哈哈哈哈哈哈，谢谢，好的，没问题，收到，辛苦了，大家好，早上好，晚安，明天见，不好意思，"
+    "我们你们他们这个那个什么怎么为什么因为所以但是如果可以已经现在今天明天昨天时候问题知道觉得一下没有还是就是"
+    "。，！？、：；“”（）……——\n"
+    "正在输入……\n离开房间：\n进入房间：\n房间 大厅 有 人在线\n"
+    "设置成功！\n请输入你的名字：\n欢迎来到聊天室！\n大厅";
+
+static struct
+{
+    pthread_mutex_t lock;
+    z_stream *idle[COMPRESS_POOL_SIZE];
+    size_t count;
+} pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 取一个空闲的压缩状态，没有时创建，失败返回 NULL
+static z_stream *take_stream()
+{
+    pthread_mutex_lock(&pool.lock);
+    if (pool.count > 0)
+    {
+        z_stream *stream = pool.idle[--pool.count];
+        pthread_mutex_unlock(&pool.lock);
+        return stream;
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    z_stream *stream = calloc(1, sizeof(z_stream));
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+    if (deflateInit2(stream, COMPRESS_LEVEL, Z_DEFLATED, -COMPRESS_WINDOW_BITS, COMPRESS_MEM_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+static void return_stream(z_stream *stream)
+{
+    pthread_mutex_lock(&pool.lock);
+    if (pool.count < COMPRESS_POOL_SIZE)
+    {
+        pool.idle[pool.count++] = stream;
+        pthread_mutex_unlock(&pool.lock);
+        return;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    deflateEnd(stream);
+    free(stream);
+}
+
+// 把 buf 压缩为 PROTO_DEFLATE 帧，压缩后没有变小或失败时返回 NULL
+static struct msgbuf *deflate_frame(const struct msgbuf *buf)
+{
+    char header[1 + VARINT_MAX_LEN];
+    header[0] = PROTO_DEFLATE;
+    size_t header_len = 1 + varint_encode(buf->len, header + 1);
+    if (buf->len <= header_len + 1)
+    {
+        return NULL;
+    }
+    // 输出空间只留到比原帧少 1 字节，放不下说明压缩没有效果，不必压缩完
+    size_t limit = buf->len - header_len - 1;
+    char *data = malloc(limit);
+    z_stream *stream = data != NULL ? take_stream() : NULL;
+    if (stream == NULL)
+    {
+        free(data);
+        return NULL;
+    }
+
+    deflateReset(stream);
+    deflateSetDictionary(stream, (const Bytef *)dictionary, sizeof(dictionary) - 1);
+    stream->next_in = (Bytef *)msgbuf_payload(buf);
+    stream->avail_in = (uInt)buf->len;
+    stream->next_out = (Bytef *)data;
+    stream->avail_out = (uInt)limit;
+    int ret = deflate(stream, Z_FINISH);
+    size_t data_len = limit - stream->avail_out;
+    return_stream(stream);
+
+    struct msgbuf *compressed = NULL;
+    if (ret == Z_STREAM_END)
+    {
+        compressed = msgbuf_alloc(PACKET_V2, header_len + data_len);
+    }
+    if (compressed != NULL)
+    {
+        memcpy(msgbuf_data(compressed), header, header_len);
+        memcpy(msgbuf_data(compressed) + header_len, data, data_len);
+        // 压缩帧不会再被压缩
+        atomic_store_explicit(&compressed->compressed, compressed, memory_order_relaxed);
+    }
+    free(data);
+    return compressed;
+}
+
+struct msgbuf *compress_encoding(struct msgbuf *buf)
+{
+    struct msgbuf *cached = atomic_load_explicit(&buf->compressed, memory_order_acquire);
+    if (cached != NULL)
+    {
+        return cached;
+    }
+    if (buf->version != PACKET_V2 || config.compress_min == 0 || buf->len < config.compress_min)
+    {
+        return buf;
+    }
+
+    uint64_t start = now_ns();
+    struct msgbuf *compressed = deflate_frame(buf);
+    stats_add(STAT_COMPRESS_NS, now_ns() - start);
+    stats_add(STAT_COMPRESSED, 1);
+    stats_add(STAT_COMPRESS_BYTES_IN, buf->len);
+    stats_add(STAT_COMPRESS_BYTES_OUT, compressed != NULL ? compressed->len : buf->len);
+
+    // 没有压缩效果时记为 buf 本身（不持有引用），之后直接按原样发送
+    struct msgbuf *result = compressed != NULL ? compressed : buf;
+    // 多个线程同时压缩时只保留先完成的一个
+    struct msgbuf *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&buf->compressed, &expected, result, memory_order_acq_rel,
+                                                 memory_order_acquire))
+    {
+        msgbuf_unref(compressed);
+        return expected;
+    }
+    return result;
+}
+
+bool compress_inflate(const char *data, size_t len, char *out, size_t out_len)
+{
+    static z_stream stream;
+    static bool ready = false;
+    if (!ready)
+    {
+        if (inflateInit2(&stream, -COMPRESS_WINDOW_BITS) != Z_OK)
+        {
+            return false;
+        }
+        ready = true;
+    }
+    else
+    {
+        inflateReset(&stream);
+    }
+    // raw deflate 没有字典校验，开始解压之前设置字典
+    if (inflateSetDictionary(&stream, (const Bytef *)dictionary, sizeof(dictionary) - 1) != Z_OK)
+    {
+        return false;
+    }
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)len;
+    stream.next_out = (Bytef *)out;
+    stream.avail_out = (uInt)out_len;
+    return inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.avail_out == 0;
+}
@@ -0,0 +1,36 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "msgbuf.h"
+
+/**
+ * 消息压缩
+ *
+ * 粘贴一大段文本时，服务端要把同样的内容发给房间里的每个成员，出口流量是消息大小乘以人数。
+ * v2 客户端在协商之后、设置名字之前发送 PROTO_COMPRESSION 请求接收压缩帧，服务端用同样的帧确认。
+ * 之后发给它的 v2 帧内容达到 config.compress_min 字节时，改为发送 PROTO_DEFLATE 帧：
+ * varint 原帧内容长度 + 原帧内容（类型和字段）的 raw deflate 数据。
+ * 压缩时使用双方内置的预置字典（常见的提示语和聊天用语），较短的消息也能引用字典中的内容。
+ *
+ * 压缩结果像格式转换一样缓存在原消息的 msgbuf 上（compressed），一条广播消息只压缩一次，
+ * 所有接收压缩帧的成员共享；压缩后没有变小的消息也记下来，按原样发送，不再重复尝试。
+ * 压缩的帧数、压缩前后的字节数和耗时计入运行统计（见 stats.h）。
+ */
+
+// PROTO_COMPRESSION 中的算法编号：raw deflate + 内置字典
+#define COMPRESS_DEFLATE 1
+
+/**
+ * 取得 v2 帧 buf 发给接收压缩帧的连接时使用的帧：需要压缩时返回（必要时创建）压缩结果，否则返回 buf 本身
+ * 返回的指针不增加引用，在 buf 释放前有效
+ */
+struct msgbuf *compress_encoding(struct msgbuf *buf);
+/**
+ * 解压 PROTO_DEFLATE 帧中的数据，out 为 out_len（原帧内容长度）字节
+ * 数据损坏或解压后长度不符时返回 false；使用同一个解压状态，只能在一个线程中调用（客户端的接收线程）
+ */
+bool compress_inflate(const char *data, size_t len, char *out, size_t out_len);
+
+#endif // COMPRESS_H
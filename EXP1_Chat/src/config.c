@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "config.h"
+#include "logger.h"
+
+struct chat_config config = {
+    .host = NULL,
+    .protocol_version = 2,
+    .client_pipe = false,
+    .port = SERVER_PORT,
+    .unix_socket = NULL,
+    .max_message_size = DEFAULT_MAX_MESSAGE_SIZE,
+    .send_queue_capacity = SEND_QUEUE_CAPACITY,
+    .history_size = ROOM_HISTORY_SIZE,
+    .disconnect_slow_clients = DISCONNECT_SLOW_CLIENTS,
+    .disconnect_oversize = DISCONNECT_OVERSIZE,
+    .presence_interval_ms = PRESENCE_INTERVAL_MS,
+    .heartbeat_interval_ms = HEARTBEAT_INTERVAL_MS,
+    .heartbeat_timeout_ms = HEARTBEAT_TIMEOUT_MS,
+    .firehose_path = NULL,
+    .firehose_size = FIREHOSE_SIZE,
+    .filter_path = NULL,
+    .compress_min = COMPRESS_MIN_SIZE,
+    .node_id = 0,
+    .link_port = 0,
+    .peer_count = 0,
+    .log_dir = NULL,
+    .log_segment_size = LOG_SEGMENT_SIZE,
+    .log_sync_batch = LOG_SYNC_BATCH,
+    .log_sync_interval_ms = LOG_SYNC_INTERVAL_MS,
+    .log_retention_segments = 0,
+    .log_level = LOG_LEVEL_INFO,
+};
+
+// 长度帧的长度前缀为 32 位，消息内容加上服务端添加的部分不能超过它
+#define MAX_MESSAGE_SIZE_LIMIT (UINT32_MAX - MESSAGE_OVERHEAD)
+
+// 解析带可选单位（K、M）的字节数，失败返回 false
+static bool parse_size(const char *str, size_t *out)
+{
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str)
+    {
+        return false;
+    }
+    if (*end == 'K' || *end == 'k')
+    {
+        value *= 1024;
+        end++;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        value *= 1024 * 1024;
+        end++;
+    }
+    if (*end != '\0' || value == 0)
+    {
+        return false;
+    }
+    *out = (size_t)value;
+    return true;
+}
+
+// 解析可以为 0 的整数
+static bool parse_count(const char *str, size_t *out)
+{
+    char *end;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str || *end != '\0')
+    {
+        return false;
+    }
+    *out = (size_t)value;
+    return true;
+}
+
+// 解析 drop/disconnect 形式的策略选项
+static bool parse_policy(const char *str, const char *keep, bool *disconnect)
+{
+    if (strcmp(str, "disconnect") == 0)
+    {
+        *disconnect = true;
+        return true;
+    }
+    if (strcmp(str, keep) == 0)
+    {
+        *disconnect = false;
+        return true;
+    }
+    return false;
+}
+
+bool config_parse_args(int argc, char **argv, int first)
+{
+    for (int i = first; i < argc; i++)
+    {
+        const char *option = argv[i];
+        if (i + 1 >= argc)
+        {
+            printf("选项 %s 缺少参数\n", option);
+            return false;
+        }
+        const char *value = argv[++i];
+        bool ok;
+
+        if (strcmp(option, "--host") == 0)
+        {
+            config.host = value;
+            ok = *value != '\0';
+        }
+        else if (strcmp(option, "--protocol") == 0)
+        {
+            ok = strcmp(value, "1") == 0 || strcmp(value, "2") == 0;
+            config.protocol_version = value[0] - '0';
+        }
+        else if (strcmp(option, "--client-mode") == 0)
+        {
+            ok = strcmp(value, "interactive") == 0 || strcmp(value, "pipe") == 0;
+            config.client_pipe = strcmp(value, "pipe") == 0;
+        }
+        else if (strcmp(option, "--port") == 0)
+        {
+            size_t port;
+            ok = parse_size(value, &port) && port <= 65535;
+            config.port = (int)port;
+        }
+        else if (strcmp(option, "--max-message-size") == 0)
+        {
+            ok = parse_size(value, &config.max_message_size) && config.max_message_size <= MAX_MESSAGE_SIZE_LIMIT;
+        }
+        else if (strcmp(option, "--queue-capacity") == 0)
+        {
+            ok = parse_size(value, &config.send_queue_capacity);
+        }
+        else if (strcmp(option, "--history") == 0)
+        {
+            // 允许为 0（不保存历史），不能用 parse_size
+            ok = parse_count(value, &config.history_size);
+        }
+        else if (strcmp(option, "--slow-client") == 0)
+        {
+            ok = parse_policy(value, "drop", &config.disconnect_slow_clients);
+        }
+        else if (strcmp(option, "--oversize") == 0)
+        {
+            ok = parse_policy(value, "skip", &config.disconnect_oversize);
+        }
+        else if (strcmp(option, "--presence-interval") == 0)
+        {
+            size_t interval = 0;
+            ok = parse_size(value, &interval) && interval <= 10000;
+            config.presence_interval_ms = (unsigned)interval;
+        }
+        else if (strcmp(option, "--heartbeat-interval") == 0)
+        {
+            // 允许为 0（不启用心跳）
+            size_t interval = 0;
+            ok = parse_count(value, &interval) && interval <= 3600000;
+            config.heartbeat_interval_ms = (unsigned)interval;
+        }
+        else if (strcmp(option, "--heartbeat-timeout") == 0)
+        {
+            size_t timeout = 0;
+            ok = parse_size(value, &timeout) && timeout <= 3600000;
+            config.heartbeat_timeout_ms = (unsigned)timeout;
+        }
+        else if (strcmp(option, "--unix-socket") == 0)
+        {
+            config.unix_socket = value;
+            ok = *value != '\0';
+        }
+        else if (strcmp(option, "--firehose") == 0)
+        {
+            config.firehose_path = value;
+            ok = *value != '\0';
+        }
+        else if (strcmp(option, "--firehose-size") == 0)
+        {
+            ok = parse_size(value, &config.firehose_size) && config.firehose_size <= 1024 * 1024 * 1024;
+        }
+        else if (strcmp(option, "--filter") == 0)
+        {
+            config.filter_path = value;
+            ok = *value != '\0';
+        }
+        else if (strcmp(option, "--compress-min") == 0)
+        {
+            // 允许为 0（不压缩）
+            ok = parse_count(value, &config.compress_min);
+        }
+        else if (strcmp(option, "--node-id") == 0)
+        {
+            size_t id;
+            ok = parse_size(value, &id) && id <= UINT32_MAX;
+            config.node_id = (uint32_t)id;
+        }
+        else if (strcmp(option, "--link-port") == 0)
+        {
+            size_t port;
+            ok = parse_size(value, &port) && port <= 65535;
+            config.link_port = (int)port;
+        }
+        else if (strcmp(option, "--peer") == 0)
+        {
+            // 可以重复，每次添加一个节点
+            const char *colon = strrchr(value, ':');
+            size_t port;
+            ok = colon != NULL && colon != value && parse_size(colon + 1, &port) && port <= 65535
+                 && config.peer_count < MAX_PEERS;
+            if (ok)
+            {
+                config.peers[config.peer_count++] = value;
+            }
+        }
+        else if (strcmp(option, "--log-dir") == 0)
+        {
+            config.log_dir = value;
+            ok = *value != '\0';
+        }
+        else if (strcmp(option, "--log-segment-size") == 0)
+        {
+            ok = parse_size(value, &config.log_segment_size);
+        }
+        else if (strcmp(option, "--log-sync-batch") == 0)
+        {
+            ok = parse_count(value, &config.log_sync_batch);
+        }
+        else if (strcmp(option, "--log-sync-interval") == 0)
+        {
+            size_t interval = 0;
+            ok = parse_count(value, &interval) && interval <= 60000;
+            config.log_sync_interval_ms = (unsigned)interval;
+        }
+        else if (strcmp(option, "--log-retention") == 0)
+        {
+            ok = parse_count(value, &config.log_retention_segments);
+        }
+        else if (strcmp(option, "--log-level") == 0)
+        {
+            ok = logger_parse_level(value, &config.log_level);
+        }
+        else
+        {
+            printf("未知选项 %s\n", option);
+            return false;
+        }
+
+        if (!ok)
+        {
+            printf("选项 %s 的参数 %s 无效\n", option, value);
+            return false;
+        }
+    }
+    if (config.heartbeat_interval_ms != 0 && config.heartbeat_timeout_ms <= config.heartbeat_interval_ms)
+    {
+        printf("--heartbeat-timeout 必须大于 --heartbeat-interval\n");
+        return false;
+    }
+    return true;
+}
+
+void config_print_usage()
+{
+    printf("选项：\n");
+    printf("  --host 地址\t\t\t客户端连接的服务端 IPv4 地址（默认本机）\n");
+    printf("  --protocol 1|2\t\t客户端使用的协议版本，服务端不支持 2 时自动使用 1（默认 2）\n");
+    printf("  --client-mode interactive|pipe\t客户端用 readline 交互输入，或从标准输入逐行读取（默认 interactive）\n");
+    printf("  --port 端口\t\t\t服务端端口（默认 %d）\n", SERVER_PORT);
+    printf("  --max-message-size 字节数\t单条消息的最大长度，可带 K、M 单位（默认 %dM）\n",
+           DEFAULT_MAX_MESSAGE_SIZE / (1024 * 1024));
+    printf("  --queue-capacity 条数\t\t服务端每个会话的发送队列长度（默认 %d）\n", SEND_QUEUE_CAPACITY);
+    printf("  --history 条数\t\t\t服务端每个房间保存的历史消息条数，0 表示不保存（默认 %d）\n", ROOM_HISTORY_SIZE);
+    printf("  --slow-client drop|disconnect\t发送队列满时丢弃消息或断开连接（默认 %s）\n",
+           DISCONNECT_SLOW_CLIENTS ? "disconnect" : "drop");
+    printf("  --oversize skip|disconnect\t收到过长的消息时跳过该消息或断开连接（默认 %s）\n",
+           DISCONNECT_OVERSIZE ? "disconnect" : "skip");
+    printf("  --presence-interval 毫秒\t进出房间等通知合并为摘要发送的间隔（默认 %d）\n", PRESENCE_INTERVAL_MS);
+    printf("  --heartbeat-interval 毫秒\t连接空闲多久后发送心跳并开始 TCP keepalive 探测，0 表示不启用（默认 %d）\n",
+           HEARTBEAT_INTERVAL_MS);
+    printf("  --heartbeat-timeout 毫秒\t连接多久没有收到数据、发出的数据多久没有确认时断开（默认 %d）\n",
+           HEARTBEAT_TIMEOUT_MS);
+    printf("  --unix-socket 路径\t\t服务端同时在这个本机 socket 上监听，客户端改为连接它（默认只用 TCP）\n");
+    printf("  --firehose 路径\t\t服务端把所有聊天消息写入这个共享内存文件，供本机程序用 --firehose-tail 读取（默认不启用）\n");
+    printf("  --firehose-size 字节数\t共享内存消息流的大小，可带 K、M 单位（默认 %dM）\n", FIREHOSE_SIZE / (1024 * 1024));
+    printf("  --filter 文件\t\t\t违禁词表（每行一个），命中的消息不发送，文件修改后自动重新加载（默认不过滤）\n");
+    printf("  --compress-min 字节数\t服务端压缩发给客户端的帧的最小长度，0 表示不压缩；客户端为 0 时不请求压缩（默认 %d）\n",
+           COMPRESS_MIN_SIZE);
+    printf("  --node-id 编号\t\t\t本节点在集群中的编号，各节点不能相同（默认使用端口号）\n");
+    printf("  --link-port 端口\t\t接受其他节点连接的端口（默认不接受）\n");
+    printf("  --peer 地址:端口\t\t连接另一个节点的 --link-port，可以重复，最多 %d 个\n", MAX_PEERS);
+    printf("  --log-dir 目录\t\t\t把聊天消息追加写入该目录下的日志文件（默认不记录）\n");
+    printf("  --log-segment-size 字节数\t每个日志段文件的大小上限，可带 K、M 单位（默认 %dM）\n",
+           LOG_SEGMENT_SIZE / (1024 * 1024));
+    printf("  --log-sync-batch 条数\t\t每写入多少条记录同步一次磁盘，0 表示不按条数同步（默认 %d）\n", LOG_SYNC_BATCH);
+    printf("  --log-sync-interval 毫秒\t记录写入后最多多久同步磁盘，0 表示不按时间同步（默认 %d）\n",
+           LOG_SYNC_INTERVAL_MS);
+    printf("  --log-retention 段数\t\t最多保留的日志段数，0 表示全部保留（默认 0）\n");
+    printf("  --log-level debug|info|warn|error\t服务端运行日志的级别，debug 会输出每条消息（默认 info）\n");
+}
@@ -1,8 +1,99 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 以下为默认值，运行时可以用命令行选项修改（见 config_parse_args）
 #define SERVER_PORT 10010
-#define MAX_BUFF_SIZE 160
+// 单条消息内容的默认最大字节数
+#define DEFAULT_MAX_MESSAGE_SIZE (4 * 1024 * 1024)
 #define MAX_NAME_LEN 32
+#define MAX_ROOM_NAME_LEN 32
+// 用户设置名字后自动进入的房间
+#define DEFAULT_ROOM "大厅"
+// /rooms 命令最多列出的房间数
+#define ROOM_LIST_LIMIT 100
+// 每个房间保存的历史消息条数
+#define ROOM_HISTORY_SIZE 100
+// 每个房间历史消息最多占用的字节数，超过时丢弃最旧的（至少保留最新一条）
+#define ROOM_HISTORY_MAX_BYTES (8 * 1024 * 1024)
+// 服务端转发消息时在内容前后添加的内容（"[用户名] " 和 "\n"）的最大长度
+#define MESSAGE_OVERHEAD (MAX_NAME_LEN + 4)
+// 服务端固定提示语的最大长度
+#define MAX_PROMPT_LEN 256
+// 服务端日志中每条消息最多打印的字节数
+#define MAX_LOG_MESSAGE_LEN 256
+// 每个会话的发送队列最多容纳的消息数
+#define SEND_QUEUE_CAPACITY 1024
+// 发送队列已满（客户端接收过慢）时的处理：1 断开连接，0 丢弃新消息
+#define DISCONNECT_SLOW_CLIENTS 1
+// 收到超过长度上限的消息时的处理：1 断开连接，0 丢弃这条消息并继续接收后面的消息
+#define DISCONNECT_OVERSIZE 0
+// 进出房间、正在输入等在线状态事件合并为摘要发送的间隔
+#define PRESENCE_INTERVAL_MS 100
+// 在线状态摘要的每个名字列表最多列出的名字数，其余只给出人数
+#define PRESENCE_MAX_NAMES 20
+// 连接超过这么久没有收到数据时发送心跳，0 表示不启用心跳
+#define HEARTBEAT_INTERVAL_MS 30000
+// 连接超过这么久没有收到数据（包括心跳应答）时断开
+#define HEARTBEAT_TIMEOUT_MS 90000
+// 内容达到这么多字节的 v2 帧才压缩后发给请求了压缩的客户端，0 表示不压缩
+#define COMPRESS_MIN_SIZE 256
+// 共享内存消息流的默认大小
+#define FIREHOSE_SIZE (64 * 1024 * 1024)
+// 最多可以配置的对等节点数
+#define MAX_PEERS 16
+// 聊天记录每个段文件的大小上限
+#define LOG_SEGMENT_SIZE (64 * 1024 * 1024)
+// 聊天记录每积累多少条未同步的记录 fdatasync 一次
+#define LOG_SYNC_BATCH 64
+// 未同步的聊天记录最多等待多少毫秒就同步
+#define LOG_SYNC_INTERVAL_MS 10
+
+/**
+ * 运行时配置
+ */
+struct chat_config
+{
+    const char *host;            // 客户端连接的服务端 IPv4 地址，NULL 表示本机
+    int protocol_version;        // 客户端希望使用的协议版本（1 或 2），服务端不支持 2 时回退到 1
+    bool client_pipe;            // 客户端不使用 readline，从标准输入逐行读取，供脚本使用
+    int port;
+    const char *unix_socket;     // 服务端同时监听、客户端改为连接的本机 socket 路径，NULL 表示只用 TCP
+    size_t max_message_size;     // 单条消息内容的最大字节数
+    size_t send_queue_capacity;  // 每个会话的发送队列最多容纳的消息数
+    size_t history_size;         // 每个房间保存的历史消息条数，0 表示不保存
+    bool disconnect_slow_clients;
+    bool disconnect_oversize;
+    unsigned presence_interval_ms; // 在线状态摘要的发送间隔
+    unsigned heartbeat_interval_ms; // 空闲多久后发送心跳，0 表示不启用
+    unsigned heartbeat_timeout_ms;  // 空闲多久后断开连接，大于 heartbeat_interval_ms
+    const char *firehose_path;   // 共享内存消息流的文件，NULL 表示不启用
+    size_t firehose_size;        // 共享内存消息流的大小（向上取整为 2 的幂）
+    const char *filter_path;     // 违禁词表文件，NULL 表示不过滤
+    size_t compress_min;         // 服务端压缩的最小帧内容长度，0 表示不压缩；客户端为 0 时不请求压缩
+    uint32_t node_id;            // 本节点在集群中的编号，0 表示使用端口号
+    int link_port;               // 接受其他节点连接的端口，0 表示不接受
+    const char *peers[MAX_PEERS]; // 主动连接的其他节点，"地址:端口"
+    size_t peer_count;
+    const char *log_dir;         // 聊天记录目录，NULL 表示不记录
+    size_t log_segment_size;
+    size_t log_sync_batch;
+    unsigned log_sync_interval_ms;
+    size_t log_retention_segments; // 最多保留的段数，0 表示不删除
+    int log_level;               // 服务端运行日志的最低级别（enum log_level，见 logger.h）
+};
+
+extern struct chat_config config;
+
+/**
+ * 解析 argv[first] 开始的选项，修改 config
+ * 选项有误时打印原因并返回 false
+ */
+bool config_parse_args(int argc, char **argv, int first);
+// 打印选项说明
+void config_print_usage();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,758 @@
+/**
+ * 基于 epoll 的事件驱动服务端
+ *
+ * 与 server.c 的"每个连接一个线程"不同，这里所有连接都由一个事件循环线程处理：
+ * socket 设为非阻塞，每个连接有一个拼帧状态机，协议和命令的处理与线程模式共用（见 chat_session.h），
+ * 收到的数据按会话协商的版本增量拼帧（v1 为 [4字节长度] + [消息内容]，v2 为 varint 长度前缀），
+ * 不会因为 TCP 拆包而阻塞。
+ * 消息只在所在房间内广播，只在事件循环中格式化一次（msgbuf），然后无论房间大小都交给
+ * EVENT_WORKER_COUNT 个广播线程，每个线程固定负责一个分片的成员（fd % EVENT_WORKER_COUNT），
+ * 因此同一个成员收到的消息保持发送顺序。
+ * 广播线程的任务队列积压时，事件循环暂停读取产生消息的连接，等队列排空后再恢复，从不等待条件变量。
+ * 发送队列由发送线程批量写出（见 send_queue.h）。
+ * 空闲连接只占用一个 conn 结构体，没有线程栈的开销。
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include "config.h"
+#include "server.h"
+#include "event_server.h"
+#include "msgbuf.h"
+#include "send_queue.h"
+#include "room.h"
+#include "chat_log.h"
+#include "protocol.h"
+#include "presence.h"
+#include "federation.h"
+#include "stats.h"
+#include "logger.h"
+#include "timer_wheel.h"
+#include "heartbeat.h"
+#include "firehose.h"
+#include "moderation.h"
+#include "chat_session.h"
+
+// 广播线程数
+#define EVENT_WORKER_COUNT 4
+#if EVENT_WORKER_COUNT > ROOM_MAX_SHARDS
+#error "EVENT_WORKER_COUNT 不能超过 ROOM_MAX_SHARDS"
+#endif
+// 每次 epoll_wait 最多取出的事件数
+#define EPOLL_BATCH 256
+// 每个广播线程的任务队列长度
+#define JOB_QUEUE_SIZE 1024
+// 任一广播线程的任务数达到这个值时，事件循环暂停读取客户端，剩余的空位留给已经读到的消息
+#define JOB_QUEUE_HIGH_WATER (JOB_QUEUE_SIZE * 3 / 4)
+// 所有广播线程的任务数都降到这个值以下时恢复读取
+#define JOB_QUEUE_LOW_WATER (JOB_QUEUE_SIZE / 4)
+// 暂停读取期间检查广播线程是否追上的间隔（毫秒）
+#define BACKLOG_POLL_MS 1
+// 一次可读事件最多读取的字节数，避免单个连接占满事件循环
+#define MAX_READ_PER_EVENT (256 * 1024)
+
+struct conn
+{
+    int fd;
+    // 协议和命令的处理状态：帧格式、名字、所在房间和发送队列
+    struct chat_session session;
+
+    // 输入：增量拼帧（帧格式为 session.version）
+    char header[VARINT_MAX_LEN];
+    uint32_t header_got; // 已收到的长度前缀字节数
+    bool header_done;    // 长度前缀已收完，正在接收消息内容
+    uint32_t body_len;
+    uint32_t body_got;
+    char *body;      // 按消息长度分配，消息处理完后释放
+    bool discarding; // 当前消息过长，只计数跳过，不保存内容
+
+    // 心跳：v2 连接的下一次检查挂在 ev.wheel 上
+    struct timer heartbeat;
+    uint64_t last_recv_ms; // 最后一次收到数据的时刻
+
+    // 广播线程积压时暂停读取，挂在 ev.paused 链表上
+    bool paused;
+    struct conn *paused_prev;
+    struct conn *paused_next;
+};
+
+// 一次广播：房间和消息，各持有一个引用
+struct broadcast_job
+{
+    struct room *room;
+    struct msgbuf *buf;
+    uint64_t seq; // 聊天消息在房间历史中的序号，提示消息为 0
+};
+
+struct broadcast_worker
+{
+    pthread_t thread;
+    int index;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    struct broadcast_job jobs[JOB_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+};
+
+static struct
+{
+    int epoll_fd;
+    int listen_fd;
+    int unix_fd;      // 本机 socket 的监听描述符，-1 表示未启用
+    // 按 fd 索引的连接表，只由事件循环访问
+    struct conn **conns;
+    int conns_size;
+    // 房间表，房间成员只由事件循环增删，广播线程持有房间的读锁遍历成员
+    struct room_registry rooms;
+    struct broadcast_worker workers[EVENT_WORKER_COUNT];
+    // 下一个连接编号
+    uint32_t next_conn_id;
+    // 心跳检查的时间轮，只由事件循环访问
+    struct timer_wheel wheel;
+    // 本轮 epoll_wait 返回的时刻，同一轮中的事件共用
+    uint64_t now_ms;
+    // 有广播线程的任务数超过高水位，在降到低水位之前不再读取客户端的数据
+    bool backlogged;
+    // 因此暂停读取的连接
+    struct conn *paused;
+} ev;
+
+// 广播线程：把消息放入房间中由自己负责的成员（member.shard == index）的发送队列
+static void *broadcast_worker_thread(void *arg)
+{
+    struct broadcast_worker *worker = arg;
+    while (1)
+    {
+        pthread_mutex_lock(&worker->lock);
+        while (worker->count == 0)
+        {
+            pthread_cond_wait(&worker->not_empty, &worker->lock);
+        }
+        struct broadcast_job job = worker->jobs[worker->head];
+        worker->head = (worker->head + 1) % JOB_QUEUE_SIZE;
+        worker->count--;
+        pthread_mutex_unlock(&worker->lock);
+
+        if (room_broadcast_shard(job.room, job.buf, job.seq, worker->index))
+        {
+            send_flusher_wake();
+        }
+        msgbuf_unref(job.buf);
+        room_unref(job.room);
+    }
+    return NULL;
+}
+
+// 向房间广播序号为 seq 的消息，并释放调用者持有的 buf 引用
+// 每个成员固定由一个广播线程负责（按 fd 划分），所有房间的广播都经过广播线程，成员收到的消息保持发送顺序；
+// 只通知房间中有成员的线程，小房间不会唤醒所有广播线程。
+// 在事件循环中调用，不能等待广播线程：任务数超过高水位时标记积压，让事件循环暂停读取客户端，
+// 高水位以上的空位用完时丢弃这次广播中该线程负责的部分并计入统计
+static void broadcast_seq(struct room *room, struct msgbuf *buf, uint64_t seq)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+    if (room == NULL)
+    {
+        msgbuf_unref(buf);
+        return;
+    }
+    for (int i = 0; i < EVENT_WORKER_COUNT; i++)
+    {
+        // 成员只由事件循环增删，这里读取成员数不需要加锁
+        if (room->shard_members[i] == 0)
+        {
+            continue;
+        }
+        struct broadcast_worker *worker = &ev.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        if (worker->count == JOB_QUEUE_SIZE)
+        {
+            pthread_mutex_unlock(&worker->lock);
+            stats_add(STAT_BROADCAST_DROPPED, 1);
+            continue;
+        }
+        if (worker->count + 1 >= JOB_QUEUE_HIGH_WATER)
+        {
+            ev.backlogged = true;
+        }
+        struct broadcast_job *job = &worker->jobs[(worker->head + worker->count) % JOB_QUEUE_SIZE];
+        job->room = room_ref(room);
+        job->buf = msgbuf_ref(buf);
+        job->seq = seq;
+        worker->count++;
+        pthread_cond_signal(&worker->not_empty);
+        pthread_mutex_unlock(&worker->lock);
+    }
+    msgbuf_unref(buf);
+}
+
+// 广播不记入历史的提示消息
+static void broadcast(struct room *room, struct msgbuf *buf)
+{
+    broadcast_seq(room, buf, 0);
+}
+
+// 发送聊天消息：先记入房间历史得到序号，再广播
+// 记入历史之后、广播线程处理之前加入房间的成员会在补发历史时收到它，广播时按序号跳过
+// 其他节点转发来的消息也由它发给本节点的用户（federation_poll 在事件循环中调用）
+static void deliver(struct room *room, struct msgbuf *buf)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+    // 聊天记录和共享内存消息流保存 v1 格式的文本
+    struct msgbuf *text = proto_encoding(buf, PACKET_V1);
+    chat_log_append(room->name, text);
+    firehose_publish(room->name, text);
+    broadcast_seq(room, buf, room_record(room, buf));
+}
+
+// 发送本节点用户的聊天消息：转发给订阅了该房间的其他节点，再发给本节点的用户
+static void publish(struct room *room, struct msgbuf *buf)
+{
+    if (buf != NULL)
+    {
+        federation_forward(room, buf);
+    }
+    deliver(room, buf);
+}
+
+// 协商改用 v2 帧：conn_feed 之后按 v2 格式拼帧；v2 客户端会回复 PING，开始心跳检查
+static void conn_upgraded(struct chat_session *session)
+{
+    struct conn *c = (struct conn *)((char *)session - offsetof(struct conn, session));
+    if (config.heartbeat_interval_ms != 0)
+    {
+        timer_wheel_schedule(&ev.wheel, &c->heartbeat, c->last_recv_ms + config.heartbeat_interval_ms);
+    }
+}
+
+static const struct chat_session_ops conn_ops = {
+    .rooms = &ev.rooms,
+    .publish = publish,
+    .upgraded = conn_upgraded,
+};
+
+// 把收到的数据送入拼帧状态机，每拼出一条完整的消息就处理一次
+// 消息过长且配置为断开连接，或内存不足时返回 false，连接应关闭
+static bool conn_feed(struct conn *c, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        if (!c->header_done)
+        {
+            // 长度前缀逐字节收取（v1 为 4 字节，v2 为 varint），收完才知道消息长度
+            size_t header_len;
+            size_t msg_len;
+            int ret = 0;
+            while (len > 0 && ret == 0)
+            {
+                c->header[c->header_got++] = *data++;
+                len--;
+                ret = frame_header_parse(c->session.version, c->header, c->header_got, &header_len, &msg_len);
+            }
+            if (ret < 0)
+            {
+                log_warn("客户端 %d 发送的数据格式错误，连接终止", c->fd);
+                return false;
+            }
+            if (ret == 0)
+            {
+                break;
+            }
+            c->header_done = true;
+            c->body_len = (uint32_t)msg_len;
+            c->body_got = 0;
+            if (c->body_len > config.max_message_size)
+            {
+                if (config.disconnect_oversize)
+                {
+                    log_info("客户端 %d 发送的消息过长，连接终止", c->fd);
+                    return false;
+                }
+                // 丢弃这条消息，内容到达时只计数，数据流从下一条消息处继续
+                log_info("客户端 %d 发送的消息过长（%u 字节），已丢弃", c->fd, c->body_len);
+                c->discarding = true;
+            }
+            else if (c->body_len > 0)
+            {
+                c->body = malloc(c->body_len + 1);
+                if (c->body == NULL)
+                {
+                    log_error("内存不足，无法接收客户端 %d 的消息（%u 字节），连接终止", c->fd, c->body_len);
+                    return false;
+                }
+            }
+        }
+
+        size_t n = c->body_len - c->body_got;
+        if (n > len)
+        {
+            n = len;
+        }
+        if (!c->discarding)
+        {
+            memcpy(c->body + c->body_got, data, n);
+        }
+        c->body_got += n;
+        data += n;
+        len -= n;
+        if (c->body_got == c->body_len)
+        {
+            c->header_got = 0;
+            c->header_done = false;
+            if (c->discarding)
+            {
+                c->discarding = false;
+                chat_session_message_too_long(&c->session);
+            }
+            else if (c->body_len > 0)
+            {
+                c->body[c->body_len] = '\0';
+                chat_session_handle_message(&c->session, c->body, c->body_len);
+                free(c->body);
+                c->body = NULL;
+            }
+        }
+    }
+    return true;
+}
+
+// 暂停读取连接的数据，直到广播线程追上（见 resume_paused_connections）
+static void conn_pause(struct conn *c)
+{
+    if (c->paused)
+    {
+        return;
+    }
+    struct epoll_event event;
+    event.events = 0;
+    event.data.fd = c->fd;
+    epoll_ctl(ev.epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+    c->paused = true;
+    c->paused_prev = NULL;
+    c->paused_next = ev.paused;
+    if (ev.paused != NULL)
+    {
+        ev.paused->paused_prev = c;
+    }
+    ev.paused = c;
+}
+
+static void conn_unlink_paused(struct conn *c)
+{
+    if (c->paused_prev != NULL)
+    {
+        c->paused_prev->paused_next = c->paused_next;
+    }
+    else
+    {
+        ev.paused = c->paused_next;
+    }
+    if (c->paused_next != NULL)
+    {
+        c->paused_next->paused_prev = c->paused_prev;
+    }
+    c->paused = false;
+}
+
+// 所有广播线程的任务数都降到低水位以下时，恢复读取暂停的连接（socket 中积压的数据会再次触发 EPOLLIN）
+static void resume_paused_connections()
+{
+    for (int i = 0; i < EVENT_WORKER_COUNT; i++)
+    {
+        struct broadcast_worker *worker = &ev.workers[i];
+        pthread_mutex_lock(&worker->lock);
+        bool drained = worker->count < JOB_QUEUE_LOW_WATER;
+        pthread_mutex_unlock(&worker->lock);
+        if (!drained)
+        {
+            return;
+        }
+    }
+    ev.backlogged = false;
+    while (ev.paused != NULL)
+    {
+        struct conn *c = ev.paused;
+        conn_unlink_paused(c);
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = c->fd;
+        epoll_ctl(ev.epoll_fd, EPOLL_CTL_MOD, c->fd, &event);
+    }
+}
+
+static void conn_close(struct conn *c)
+{
+    int fd = c->fd;
+    stats_add(STAT_DISCONNECTS, 1);
+    timer_wheel_cancel(&ev.wheel, &c->heartbeat);
+    // 离开房间后，不会再有广播线程访问该连接的发送队列
+    chat_session_leave_room(&c->session);
+    ev.conns[fd] = NULL;
+    if (c->paused)
+    {
+        conn_unlink_paused(c);
+    }
+
+    epoll_ctl(ev.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    // socket 由发送队列在最后一个引用释放时关闭
+    send_queue_close(c->session.queue);
+    free(c->body);
+    free(c);
+}
+
+// 连接的心跳检查到期：发送 PING 或断开长时间没有数据的连接
+static void conn_heartbeat(struct timer *timer)
+{
+    struct conn *c = (struct conn *)((char *)timer - offsetof(struct conn, heartbeat));
+    uint64_t next_ms;
+    switch (heartbeat_check(c->last_recv_ms, ev.now_ms, &next_ms))
+    {
+    case HEARTBEAT_EVICT:
+        log_info("客户端 %d 超过 %u 毫秒没有响应，断开连接", c->fd, config.heartbeat_timeout_ms);
+        stats_add(STAT_EVICTIONS, 1);
+        conn_close(c);
+        return;
+    case HEARTBEAT_PING:
+    {
+        struct msgbuf *ping = heartbeat_ping(ev.now_ms);
+        chat_session_send(&c->session, ping);
+        msgbuf_unref(ping);
+        break;
+    }
+    case HEARTBEAT_WAIT:
+        break;
+    }
+    timer_wheel_schedule(&ev.wheel, timer, next_ms);
+}
+
+static void accept_connections(int listen_fd)
+{
+    while (1)
+    {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                log_error("accept 失败：%s", strerror(errno));
+            }
+            return;
+        }
+        if (fd >= ev.conns_size)
+        {
+            log_warn("连接数超过上限，拒绝连接 %d", fd);
+            close(fd);
+            continue;
+        }
+
+        struct conn *c = calloc(1, sizeof(struct conn));
+        if (c == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        heartbeat_set_socket_options(fd);
+        struct send_queue *queue = send_queue_create(fd, config.send_queue_capacity,
+                                                     config.disconnect_slow_clients ? SLOW_CLIENT_DISCONNECT : SLOW_CLIENT_DROP);
+        if (queue == NULL)
+        {
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->last_recv_ms = ev.now_ms;
+        chat_session_init(&c->session, &conn_ops, fd, ev.next_conn_id++, queue);
+        c->session.member.shard = fd % EVENT_WORKER_COUNT;
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(ev.epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            send_queue_close(c->session.queue);
+            free(c);
+            continue;
+        }
+
+        ev.conns[fd] = c;
+
+        log_debug("已接受连接 %d", fd);
+        stats_add(STAT_CONNECTIONS, 1);
+        chat_session_start(&c->session);
+    }
+}
+
+static void handle_readable(struct conn *c)
+{
+    static char recv_buf[64 * 1024];
+    size_t total = 0;
+    while (total < MAX_READ_PER_EVENT)
+    {
+        // 广播线程积压时不再读取新的消息，数据留在 socket 中，由 TCP 流量控制让客户端放慢
+        if (ev.backlogged)
+        {
+            conn_pause(c);
+            return;
+        }
+        ssize_t n = recv(c->fd, recv_buf, sizeof(recv_buf), 0);
+        if (n > 0)
+        {
+            total += n;
+            c->last_recv_ms = ev.now_ms;
+            if (!conn_feed(c, recv_buf, n))
+            {
+                conn_close(c);
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        log_debug("客户端 %d 关闭连接，连接终止", c->fd);
+        conn_close(c);
+        return;
+    }
+}
+
+// 创建非阻塞的监听 socket
+static int create_listen_socket()
+{
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        printf("socket 创建失败！\n");
+        exit(1);
+    }
+    int opt = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    {
+        printf("setsockopt 失败！\n");
+        exit(1);
+    }
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(config.port);
+    server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1)
+    {
+        printf("bind 失败！\n");
+        exit(2);
+    }
+    if (listen(sock, SOMAXCONN) == -1)
+    {
+        printf("listen 失败！\n");
+        exit(3);
+    }
+    return sock;
+}
+
+// 把可打开的文件数提高到硬上限，连接表按这个大小分配
+static int raise_fd_limit()
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0)
+    {
+        return 1024;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > 4 * 1024 * 1024)
+    {
+        return 4 * 1024 * 1024;
+    }
+    return (int)limit.rlim_cur;
+}
+
+int event_server_main()
+{
+    signal(SIGPIPE, SIG_IGN);
+
+    stats_init();
+    if (logger_start() != 0)
+    {
+        printf("日志线程启动失败！\n");
+        exit(1);
+    }
+    ev.conns_size = raise_fd_limit();
+    ev.conns = calloc(ev.conns_size, sizeof(struct conn *));
+    ev.next_conn_id = 1;
+    ev.now_ms = heartbeat_now_ms();
+    if (!timer_wheel_init(&ev.wheel, HEARTBEAT_WHEEL_SLOTS, HEARTBEAT_TICK_MS, ev.now_ms))
+    {
+        printf("时间轮分配失败！\n");
+        exit(1);
+    }
+    room_registry_init(&ev.rooms);
+    presence_init();
+    log_info("最大连接数：%d", ev.conns_size);
+    chat_session_prompts_init();
+    if (send_flusher_start() != 0)
+    {
+        printf("发送线程启动失败！\n");
+        exit(1);
+    }
+    if (!server_log_open() || !firehose_open() || !moderation_start())
+    {
+        logger_flush();
+        exit(1);
+    }
+    if (!federation_start(&ev.rooms, deliver))
+    {
+        exit(1);
+    }
+
+    for (int i = 0; i < EVENT_WORKER_COUNT; i++)
+    {
+        struct broadcast_worker *worker = &ev.workers[i];
+        worker->index = i;
+        worker->head = 0;
+        worker->count = 0;
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->not_empty, NULL);
+        if (pthread_create(&worker->thread, NULL, broadcast_worker_thread, worker) != 0)
+        {
+            printf("广播线程创建失败\n");
+            exit(1);
+        }
+    }
+
+    ev.listen_fd = create_listen_socket();
+    ev.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ev.epoll_fd < 0)
+    {
+        printf("epoll 创建失败！\n");
+        exit(1);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = ev.listen_fd;
+    epoll_ctl(ev.epoll_fd, EPOLL_CTL_ADD, ev.listen_fd, &event);
+    // 本机程序可以改用 Unix domain socket 连接，与 TCP 连接一样处理
+    ev.unix_fd = server_listen_unix(SOCK_NONBLOCK);
+    if (ev.unix_fd >= 0)
+    {
+        event.events = EPOLLIN;
+        event.data.fd = ev.unix_fd;
+        epoll_ctl(ev.epoll_fd, EPOLL_CTL_ADD, ev.unix_fd, &event);
+    }
+    // 节点连接有自己的 epoll，整体作为一个描述符加入事件循环
+    if (federation_fd() >= 0)
+    {
+        event.events = EPOLLIN;
+        event.data.fd = federation_fd();
+        epoll_ctl(ev.epoll_fd, EPOLL_CTL_ADD, federation_fd(), &event);
+    }
+    log_info("开始监听连接请求（epoll 模式）");
+
+    struct epoll_event events[EPOLL_BATCH];
+    while (1)
+    {
+        // 有待发送的在线状态事件、需要重连的节点、心跳检查或暂停读取的连接时，最多等到最早的那个时刻
+        int timeouts[] = {
+            federation_timeout_ms(),
+            timer_wheel_timeout_ms(&ev.wheel, heartbeat_now_ms()),
+            ev.paused != NULL ? BACKLOG_POLL_MS : -1,
+        };
+        int timeout = presence_timeout_ms();
+        for (size_t i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); i++)
+        {
+            if (timeouts[i] >= 0 && (timeout < 0 || timeouts[i] < timeout))
+            {
+                timeout = timeouts[i];
+            }
+        }
+        int n = epoll_wait(ev.epoll_fd, events, EPOLL_BATCH, timeout);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            printf("epoll_wait 失败：%s\n", strerror(errno));
+            break;
+        }
+        ev.now_ms = heartbeat_now_ms();
+        if (presence_timeout_ms() == 0)
+        {
+            // 房间成员只由事件循环增删，摘要和其他提示一样在事件循环中广播
+            presence_flush(broadcast);
+        }
+        if (federation_timeout_ms() == 0)
+        {
+            federation_poll();
+        }
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == ev.listen_fd || fd == ev.unix_fd)
+            {
+                accept_connections(fd);
+                continue;
+            }
+            if (fd == federation_fd())
+            {
+                federation_poll();
+                continue;
+            }
+            struct conn *c = ev.conns[fd];
+            if (c == NULL)
+            {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            {
+                handle_readable(c);
+            }
+        }
+        // 先处理本轮读到的数据，刚发来数据的连接不会被当作超时
+        timer_wheel_advance(&ev.wheel, ev.now_ms, conn_heartbeat);
+        if (ev.backlogged)
+        {
+            resume_paused_connections();
+        }
+    }
+
+    close(ev.epoll_fd);
+    close(ev.listen_fd);
+    if (ev.unix_fd >= 0)
+    {
+        close(ev.unix_fd);
+    }
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef EVENT_SERVER_H
+#define EVENT_SERVER_H
+
+extern int event_server_main();
+
+#endif // EVENT_SERVER_H
@@ -0,0 +1,672 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "packet.h"
+#include "protocol.h"
+#include "send_queue.h"
+#include "logger.h"
+#include "heartbeat.h"
+#include "federation.h"
+
+// 主动发起的连接断开或连接失败后，等待多久重连
+#define LINK_RETRY_MS 1000
+// 每次 epoll_wait 最多取出的事件数
+#define LINK_EPOLL_BATCH 64
+// 去重窗口：每个来源节点记住最大序号之前的多少个序号
+#define DEDUP_WINDOW 64
+
+/**
+ * 房间名集合，房间数不多，顺序查找
+ */
+struct name_set
+{
+    char (*names)[MAX_ROOM_NAME_LEN];
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * 与另一个节点的连接
+ */
+struct link
+{
+    int fd;
+    int peer;                 // 主动发起的连接为 config.peers 中的下标，接受的连接为 -1
+    bool connecting;          // 非阻塞 connect 尚未完成
+    uint32_t node;            // 对端节点编号，收到 PROTO_LINK_HELLO 之前为 0
+    bool primary;             // 向对端节点转发消息使用这条连接（同一节点可能有多条连接）
+    struct send_queue *queue; // 连接建立后创建
+    struct frame_reader reader;
+    struct name_set subscriptions; // 对端订阅的房间
+    struct link *next;
+};
+
+/**
+ * 一个来源节点的去重窗口
+ */
+struct origin_window
+{
+    uint32_t node;
+    uint64_t high; // 收到的最大序号
+    uint64_t bits; // 第 i 位表示序号 high - i 已收到
+};
+
+static struct
+{
+    bool enabled;
+    uint32_t node_id;
+    int epoll_fd;
+    int listen_fd;
+    struct room_registry *registry;
+    void (*deliver)(struct room *room, struct msgbuf *buf);
+    // 保护已建立的连接链表（增删、primary、subscriptions）和本节点的房间集合
+    // 转发消息持读锁，只有 federation_poll 和房间增删持写锁
+    pthread_rwlock_t lock;
+    struct link *links;
+    struct name_set rooms;
+    atomic_uint_fast64_t next_seq;
+
+    // 以下只由调用 federation_poll 的线程访问
+    struct origin_window *origins;
+    size_t origin_count;
+    size_t origin_capacity;
+    uint64_t redial_ms[MAX_PEERS]; // 下次连接的时刻（CLOCK_MONOTONIC），0 表示已连接或正在连接
+} fed = { .epoll_fd = -1, .listen_fd = -1 };
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool name_set_contains(const struct name_set *set, const char *name)
+{
+    for (size_t i = 0; i < set->count; i++)
+    {
+        if (strcmp(set->names[i], name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void name_set_add(struct name_set *set, const char *name)
+{
+    if (name_set_contains(set, name))
+    {
+        return;
+    }
+    if (set->count == set->capacity)
+    {
+        size_t capacity = set->capacity == 0 ? 8 : set->capacity * 2;
+        char (*names)[MAX_ROOM_NAME_LEN] = realloc(set->names, capacity * MAX_ROOM_NAME_LEN);
+        if (names == NULL)
+        {
+            return;
+        }
+        set->names = names;
+        set->capacity = capacity;
+    }
+    strncpy(set->names[set->count], name, MAX_ROOM_NAME_LEN - 1);
+    set->names[set->count][MAX_ROOM_NAME_LEN - 1] = '\0';
+    set->count++;
+}
+
+static void name_set_remove(struct name_set *set, const char *name)
+{
+    for (size_t i = 0; i < set->count; i++)
+    {
+        if (strcmp(set->names[i], name) == 0)
+        {
+            set->count--;
+            memcpy(set->names[i], set->names[set->count], MAX_ROOM_NAME_LEN);
+            return;
+        }
+    }
+}
+
+// 返回 true 表示 (origin, seq) 已经收到过，或者早于去重窗口，按重复处理
+static bool seen_before(uint32_t origin, uint64_t seq)
+{
+    struct origin_window *window = NULL;
+    for (size_t i = 0; i < fed.origin_count; i++)
+    {
+        if (fed.origins[i].node == origin)
+        {
+            window = &fed.origins[i];
+            break;
+        }
+    }
+    if (window == NULL)
+    {
+        if (fed.origin_count == fed.origin_capacity)
+        {
+            size_t capacity = fed.origin_capacity == 0 ? MAX_PEERS : fed.origin_capacity * 2;
+            struct origin_window *origins = realloc(fed.origins, capacity * sizeof(struct origin_window));
+            if (origins == NULL)
+            {
+                return false;
+            }
+            fed.origins = origins;
+            fed.origin_capacity = capacity;
+        }
+        fed.origins[fed.origin_count++] = (struct origin_window){ origin, seq, 1 };
+        return false;
+    }
+
+    if (seq > window->high)
+    {
+        uint64_t shift = seq - window->high;
+        window->bits = shift >= DEDUP_WINDOW ? 0 : window->bits << shift;
+        window->bits |= 1;
+        window->high = seq;
+        return false;
+    }
+    uint64_t offset = window->high - seq;
+    if (offset >= DEDUP_WINDOW)
+    {
+        return true;
+    }
+    uint64_t mask = (uint64_t)1 << offset;
+    if (window->bits & mask)
+    {
+        return true;
+    }
+    window->bits |= mask;
+    return false;
+}
+
+// 房间表的通知：本节点创建或移除了房间，告诉所有连接的节点订阅或取消订阅
+static void room_changed(const char *name, bool created)
+{
+    struct msgbuf *msg = proto_message(created ? PROTO_SUBSCRIBE : PROTO_UNSUBSCRIBE, 0, name, strlen(name));
+    bool need_wake = false;
+    pthread_rwlock_wrlock(&fed.lock);
+    if (created)
+    {
+        name_set_add(&fed.rooms, name);
+    }
+    else
+    {
+        name_set_remove(&fed.rooms, name);
+    }
+    for (struct link *link = fed.links; link != NULL && msg != NULL; link = link->next)
+    {
+        need_wake |= send_queue_push(link->queue, msg);
+    }
+    pthread_rwlock_unlock(&fed.lock);
+    msgbuf_unref(msg);
+    if (need_wake)
+    {
+        send_flusher_wake();
+    }
+}
+
+void federation_forward(struct room *room, struct msgbuf *buf)
+{
+    if (!fed.enabled)
+    {
+        return;
+    }
+    struct msgbuf *forward = NULL;
+    bool need_wake = false;
+    pthread_rwlock_rdlock(&fed.lock);
+    for (struct link *link = fed.links; link != NULL; link = link->next)
+    {
+        if (!link->primary || !name_set_contains(&link->subscriptions, room->name))
+        {
+            continue;
+        }
+        // 只在有节点订阅时编码一次，所有节点共享
+        if (forward == NULL)
+        {
+            uint64_t seq = atomic_fetch_add_explicit(&fed.next_seq, 1, memory_order_relaxed);
+            forward = proto_forward(fed.node_id, seq, buf);
+            if (forward == NULL)
+            {
+                break;
+            }
+        }
+        need_wake |= send_queue_push(link->queue, forward);
+    }
+    pthread_rwlock_unlock(&fed.lock);
+    msgbuf_unref(forward);
+    if (need_wake)
+    {
+        send_flusher_wake();
+    }
+}
+
+static void link_close(struct link *link)
+{
+    if (link->queue != NULL)
+    {
+        pthread_rwlock_wrlock(&fed.lock);
+        struct link **pos = &fed.links;
+        while (*pos != link)
+        {
+            pos = &(*pos)->next;
+        }
+        *pos = link->next;
+        if (link->primary)
+        {
+            // 改用到同一节点的另一条连接转发
+            for (struct link *other = fed.links; other != NULL; other = other->next)
+            {
+                if (other->node == link->node)
+                {
+                    other->primary = true;
+                    break;
+                }
+            }
+        }
+        pthread_rwlock_unlock(&fed.lock);
+    }
+    if (link->node != 0)
+    {
+        log_info("与节点 %u 的连接断开", link->node);
+    }
+
+    epoll_ctl(fed.epoll_fd, EPOLL_CTL_DEL, link->fd, NULL);
+    if (link->queue != NULL)
+    {
+        frame_reader_destroy(&link->reader);
+        // socket 由发送队列在发送线程也用完后关闭
+        send_queue_close(link->queue);
+    }
+    else
+    {
+        close(link->fd);
+    }
+    if (link->peer >= 0)
+    {
+        fed.redial_ms[link->peer] = now_ms() + LINK_RETRY_MS;
+    }
+    free(link->subscriptions.names);
+    free(link);
+}
+
+// 连接建立：发送握手和本节点的房间，之后开始接收
+static bool link_established(struct link *link)
+{
+    int opt = 1;
+    setsockopt(link->fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    // 对端节点所在的机器断电、断网时由 TCP keepalive 发现
+    heartbeat_set_socket_options(link->fd);
+    // 对端节点接收过慢时断开，重连后重新订阅
+    link->queue = send_queue_create(link->fd, config.send_queue_capacity, SLOW_CLIENT_DISCONNECT);
+    if (link->queue == NULL)
+    {
+        return false;
+    }
+    send_queue_set_version(link->queue, PACKET_V2);
+    if (!frame_reader_init(&link->reader, link->fd,
+                           config.max_message_size + PROTO_CHAT_OVERHEAD + PROTO_FORWARD_OVERHEAD))
+    {
+        send_queue_close(link->queue);
+        link->queue = NULL;
+        return false;
+    }
+    link->reader.version = PACKET_V2;
+    link->connecting = false;
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = link };
+    epoll_ctl(fed.epoll_fd, EPOLL_CTL_MOD, link->fd, &event);
+
+    struct msgbuf *hello = proto_link_hello(fed.node_id);
+    pthread_rwlock_wrlock(&fed.lock);
+    link->next = fed.links;
+    fed.links = link;
+    send_queue_push(link->queue, hello);
+    for (size_t i = 0; i < fed.rooms.count; i++)
+    {
+        struct msgbuf *subscribe = proto_message(PROTO_SUBSCRIBE, 0, fed.rooms.names[i], strlen(fed.rooms.names[i]));
+        if (subscribe != NULL)
+        {
+            send_queue_push(link->queue, subscribe);
+            msgbuf_unref(subscribe);
+        }
+    }
+    pthread_rwlock_unlock(&fed.lock);
+    msgbuf_unref(hello);
+    send_flusher_wake();
+    return true;
+}
+
+// 连接 config.peers[peer]
+static void dial(int peer)
+{
+    fed.redial_ms[peer] = 0;
+    char host[64];
+    const char *colon = strrchr(config.peers[peer], ':');
+    size_t host_len = colon - config.peers[peer];
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(colon + 1));
+    if (host_len >= sizeof(host))
+    {
+        host_len = sizeof(host) - 1;
+    }
+    memcpy(host, config.peers[peer], host_len);
+    host[host_len] = '\0';
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1)
+    {
+        log_warn("无效的节点地址 %s", config.peers[peer]);
+        return;
+    }
+
+    struct link *link = calloc(1, sizeof(struct link));
+    if (link == NULL)
+    {
+        fed.redial_ms[peer] = now_ms() + LINK_RETRY_MS;
+        return;
+    }
+    link->peer = peer;
+    link->connecting = true;
+    link->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (link->fd < 0)
+    {
+        free(link);
+        fed.redial_ms[peer] = now_ms() + LINK_RETRY_MS;
+        return;
+    }
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = link };
+    epoll_ctl(fed.epoll_fd, EPOLL_CTL_ADD, link->fd, &event);
+    if (connect(link->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS)
+    {
+        link_close(link);
+    }
+}
+
+static void accept_links()
+{
+    while (1)
+    {
+        int fd = accept4(fed.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            return;
+        }
+        struct link *link = calloc(1, sizeof(struct link));
+        if (link == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        link->fd = fd;
+        link->peer = -1;
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = link };
+        epoll_ctl(fed.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        if (!link_established(link))
+        {
+            link_close(link);
+        }
+    }
+}
+
+// 收到其他节点转发的聊天消息
+static void handle_forward(const struct proto_frame *frame)
+{
+    if (seen_before(frame->sender, frame->seq))
+    {
+        return;
+    }
+    struct proto_frame chat;
+    if (!proto_decode(frame->text, frame->text_len, &chat) || chat.type != PROTO_CHAT
+        || chat.room_len >= MAX_ROOM_NAME_LEN)
+    {
+        return;
+    }
+    char room_name[MAX_ROOM_NAME_LEN];
+    memcpy(room_name, chat.room, chat.room_len);
+    room_name[chat.room_len] = '\0';
+    // 本节点已经没有这个房间（取消订阅的消息还在路上），丢弃
+    struct room *room = room_find(fed.registry, room_name);
+    if (room == NULL)
+    {
+        return;
+    }
+    // 复制一份，序号由本节点的房间历史分配
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, frame->text_len);
+    if (buf != NULL)
+    {
+        memcpy(msgbuf_data(buf), frame->text, frame->text_len);
+        fed.deliver(room, buf);
+    }
+    room_unref(room);
+}
+
+// 处理连接上收到的一帧，返回 false 表示需要断开
+static bool handle_frame(struct link *link, const char *msg, size_t len)
+{
+    struct proto_frame frame;
+    if (!proto_decode(msg, len, &frame))
+    {
+        return false;
+    }
+    switch (frame.type)
+    {
+    case PROTO_LINK_HELLO:
+        if (frame.sender == fed.node_id || frame.sender == 0)
+        {
+            log_warn("节点编号 %u 无效或与本节点相同，断开连接", frame.sender);
+            return false;
+        }
+        pthread_rwlock_wrlock(&fed.lock);
+        link->node = frame.sender;
+        link->primary = true;
+        for (struct link *other = fed.links; other != NULL; other = other->next)
+        {
+            if (other != link && other->node == link->node && other->primary)
+            {
+                link->primary = false;
+                break;
+            }
+        }
+        pthread_rwlock_unlock(&fed.lock);
+        log_info("与节点 %u 建立连接%s", link->node, link->primary ? "" : "（备用）");
+        return true;
+    case PROTO_SUBSCRIBE:
+    case PROTO_UNSUBSCRIBE:
+        // 房间名在消息末尾，frame_reader 保证以 '\0' 结尾
+        if (!room_name_valid(frame.text))
+        {
+            return true;
+        }
+        pthread_rwlock_wrlock(&fed.lock);
+        if (frame.type == PROTO_SUBSCRIBE)
+        {
+            name_set_add(&link->subscriptions, frame.text);
+        }
+        else
+        {
+            name_set_remove(&link->subscriptions, frame.text);
+        }
+        pthread_rwlock_unlock(&fed.lock);
+        return true;
+    case PROTO_FORWARD:
+        if (link->node != 0)
+        {
+            handle_forward(&frame);
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+static void handle_event(struct link *link, uint32_t events)
+{
+    if (link->connecting)
+    {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        getsockopt(link->fd, SOL_SOCKET, SO_ERROR, &error, &error_len);
+        if (error != 0 || (events & (EPOLLERR | EPOLLHUP)) || !link_established(link))
+        {
+            link_close(link);
+        }
+        return;
+    }
+
+    ssize_t received = frame_reader_fill(&link->reader);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+    {
+        link_close(link);
+        return;
+    }
+    char *msg;
+    size_t len;
+    int ret;
+    while ((ret = frame_reader_next(&link->reader, &msg, &len)) > 0)
+    {
+        if (!handle_frame(link, msg, len))
+        {
+            link_close(link);
+            return;
+        }
+    }
+    if (ret == -3)
+    {
+        log_error("内存不足，无法接收节点 %u 的消息，断开连接", link->node);
+        link_close(link);
+    }
+    else if (ret < 0)
+    {
+        log_warn("节点 %u 发送的数据格式错误，断开连接", link->node);
+        link_close(link);
+    }
+}
+
+void federation_poll()
+{
+    if (!fed.enabled)
+    {
+        return;
+    }
+    struct epoll_event events[LINK_EPOLL_BATCH];
+    int n = epoll_wait(fed.epoll_fd, events, LINK_EPOLL_BATCH, 0);
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.ptr == NULL)
+        {
+            accept_links();
+        }
+        else
+        {
+            handle_event(events[i].data.ptr, events[i].events);
+        }
+    }
+
+    uint64_t now = now_ms();
+    for (size_t i = 0; i < config.peer_count; i++)
+    {
+        if (fed.redial_ms[i] != 0 && fed.redial_ms[i] <= now)
+        {
+            dial((int)i);
+        }
+    }
+}
+
+int federation_timeout_ms()
+{
+    int timeout = -1;
+    uint64_t now = now_ms();
+    for (size_t i = 0; i < config.peer_count && fed.enabled; i++)
+    {
+        if (fed.redial_ms[i] != 0)
+        {
+            int wait = fed.redial_ms[i] > now ? (int)(fed.redial_ms[i] - now) : 0;
+            if (timeout < 0 || wait < timeout)
+            {
+                timeout = wait;
+            }
+        }
+    }
+    return timeout;
+}
+
+int federation_fd()
+{
+    return fed.enabled ? fed.epoll_fd : -1;
+}
+
+static int create_link_listener()
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.link_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool federation_start(struct room_registry *registry, void (*deliver)(struct room *room, struct msgbuf *buf))
+{
+    if (config.link_port == 0 && config.peer_count == 0)
+    {
+        return true;
+    }
+    fed.node_id = config.node_id != 0 ? config.node_id : (uint32_t)config.port;
+    fed.registry = registry;
+    fed.deliver = deliver;
+    pthread_rwlock_init(&fed.lock, NULL);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    atomic_init(&fed.next_seq, (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+
+    fed.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (fed.epoll_fd < 0)
+    {
+        printf("节点连接的 epoll 创建失败\n");
+        return false;
+    }
+    if (config.link_port != 0)
+    {
+        fed.listen_fd = create_link_listener();
+        if (fed.listen_fd < 0)
+        {
+            printf("节点连接端口 %d 监听失败\n", config.link_port);
+            return false;
+        }
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+        epoll_ctl(fed.epoll_fd, EPOLL_CTL_ADD, fed.listen_fd, &event);
+    }
+    // 第一次 federation_poll 时连接所有节点
+    for (size_t i = 0; i < config.peer_count; i++)
+    {
+        fed.redial_ms[i] = 1;
+    }
+    registry->on_change = room_changed;
+    fed.enabled = true;
+    log_info("节点 %u 已启动，节点连接端口 %d，%zu 个对等节点", fed.node_id, config.link_port, config.peer_count);
+    return true;
+}
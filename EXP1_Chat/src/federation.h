@@ -0,0 +1,47 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include <stdbool.h>
+#include "msgbuf.h"
+#include "room.h"
+
+/**
+ * 多节点集群
+ *
+ * 多个服务端进程（节点，可以在不同端口或不同主机上）通过节点间的连接共享房间。
+ * 节点间的连接使用 v2 帧（类型见 protocol.h）：
+ *   握手时双方发送 PROTO_LINK_HELLO 交换节点编号，并为本节点现有的每个房间发送 PROTO_SUBSCRIBE；
+ *   之后房间创建、移除时发送 PROTO_SUBSCRIBE、PROTO_UNSUBSCRIBE，对端只转发本节点订阅了的房间的消息；
+ *   本节点用户发送的聊天消息包装为 PROTO_FORWARD，带上本节点编号和本节点的转发序号，
+ *   每个订阅了该房间的节点只发送一次（由对端节点再广播给它的用户），而不是每个远程用户一次。
+ * 收到的消息按 (来源节点, 序号) 去重：每个来源节点保留最大序号和它之前 64 个序号的位图，
+ * 两个节点之间同时存在多条连接、连接切换时都不会重复显示。
+ * 转发序号从启动时的 UNIX 微秒时间开始递增，节点重启后不会与重启前的序号重复。
+ *
+ * 节点只转发本节点用户的消息，不再转发收到的消息，因此每两个节点之间都要有连接
+ * （一方用 --peer 连接另一方的 --link-port 即可，双方都配置时多出的连接作为备用）。
+ * 主动发起的连接断开后每秒重连一次。
+ *
+ * 连接的读取在 federation_poll 中完成，发送使用与客户端相同的发送队列和发送线程。
+ */
+
+/**
+ * 按配置启动：监听 config.link_port，连接 config.peers 中的节点，没有配置时不启用，返回 true
+ * 收到其他节点转发的消息时，找到本节点的同名房间，调用 deliver 记入历史并广播（deliver 负责释放 buf）
+ * 需要在房间表初始化、发送线程启动之后调用
+ */
+bool federation_start(struct room_registry *registry, void (*deliver)(struct room *room, struct msgbuf *buf));
+/**
+ * 把本节点用户在 room 中发送的聊天消息（v2 格式）转发给订阅了该房间的节点，不释放 buf，可以在任何线程调用
+ */
+void federation_forward(struct room *room, struct msgbuf *buf);
+// 节点间连接的 epoll 描述符，可读时调用 federation_poll；未启用时返回 -1
+int federation_fd();
+/**
+ * 处理节点间连接上的事件（不阻塞）和到期的重连，deliver 在调用线程中执行
+ */
+void federation_poll();
+// 距离下一次重连的毫秒数，没有需要重连的节点时返回 -1
+int federation_timeout_ms();
+
+#endif // FEDERATION_H
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_SSSE3 1
+#endif
+#include "filter.h"
+
+// 预过滤的分组数，每组对应 pshufb 结果中的一位
+#define TEDDY_BUCKETS 8
+/**
+ * 关键词开头的不同双字节超过这个数时不用预过滤：候选位置太密，频繁地在预过滤和自动机之间切换反而比
+ * 直接逐字节运行自动机慢。汉字的 UTF-8 前两个字节只有几百种组合，几十个汉字关键词就能让大部分汉字成为候选。
+ * 单字节关键词按 16 个计算
+ */
+#define PREFILTER_MAX_PAIRS 48
+
+typedef size_t (*next_candidate_fn)(const struct filter *filter, const uint8_t *text, size_t len, size_t i);
+
+struct filter
+{
+    // 自动机：字节 -> 字节类，状态 * class_count + 字节类 -> 下一个状态，状态 0 为初始状态
+    uint8_t classes[256];
+    size_t class_count;
+    uint32_t *next;
+    uint8_t *accepting;       // 到达该状态时已匹配到某个关键词（包括经失败链接可达的）
+    size_t state_count;
+    size_t pattern_count;
+
+    // 预过滤：第一、二个字节的低、高半字节所属的组
+    _Alignas(16) uint8_t lo1[16];
+    _Alignas(16) uint8_t hi1[16];
+    _Alignas(16) uint8_t lo2[16];
+    _Alignas(16) uint8_t hi2[16];
+    uint64_t pairs[65536 / 64];  // 关键词开头的双字节（小写后）的精确位图
+    uint64_t singles[256 / 64];  // 单字节关键词
+    next_candidate_fn next_candidate; // NULL 表示不用预过滤
+};
+
+static inline uint8_t fold(uint8_t b)
+{
+    return b >= 'A' && b <= 'Z' ? b + ('a' - 'A') : b;
+}
+
+static inline bool bit_test(const uint64_t *bits, size_t i)
+{
+    return bits[i >> 6] >> (i & 63) & 1;
+}
+
+static inline void bit_set(uint64_t *bits, size_t i)
+{
+    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+// 把（小写后的）字节 b 的两个半字节记入组 bit，字母同时记入大写形式
+static void add_nibbles(uint8_t *lo, uint8_t *hi, uint8_t b, uint8_t bit)
+{
+    lo[b & 15] |= bit;
+    hi[b >> 4] |= bit;
+    if (b >= 'a' && b <= 'z')
+    {
+        uint8_t upper = b - ('a' - 'A');
+        lo[upper & 15] |= bit;
+        hi[upper >> 4] |= bit;
+    }
+}
+
+// 位置 i 是否可能是某个关键词的开头（精确判断前两个字节）
+static inline bool is_candidate(const struct filter *filter, const uint8_t *text, size_t len, size_t i)
+{
+    uint8_t b0 = fold(text[i]);
+    if (bit_test(filter->singles, b0))
+    {
+        return true;
+    }
+    return i + 1 < len && bit_test(filter->pairs, (size_t)b0 << 8 | fold(text[i + 1]));
+}
+
+static size_t next_candidate_scalar(const struct filter *filter, const uint8_t *text, size_t len, size_t i)
+{
+    for (; i < len; i++)
+    {
+        if (is_candidate(filter, text, len, i))
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef FILTER_SSSE3
+__attribute__((target("ssse3")))
+static size_t next_candidate_ssse3(const struct filter *filter, const uint8_t *text, size_t len, size_t i)
+{
+    const __m128i lo1 = _mm_load_si128((const __m128i *)filter->lo1);
+    const __m128i hi1 = _mm_load_si128((const __m128i *)filter->hi1);
+    const __m128i lo2 = _mm_load_si128((const __m128i *)filter->lo2);
+    const __m128i hi2 = _mm_load_si128((const __m128i *)filter->hi2);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    // 每次检查 16 个位置，第二个字节从 i + 1 开始读，因此要留出 17 个字节
+    while (i + 17 <= len)
+    {
+        __m128i first = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i second = _mm_loadu_si128((const __m128i *)(text + i + 1));
+        __m128i m1 = _mm_and_si128(_mm_shuffle_epi8(lo1, _mm_and_si128(first, nibble)),
+                                   _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(first, 4), nibble)));
+        __m128i m2 = _mm_and_si128(_mm_shuffle_epi8(lo2, _mm_and_si128(second, nibble)),
+                                   _mm_shuffle_epi8(hi2, _mm_and_si128(_mm_srli_epi16(second, 4), nibble)));
+        // 两个字节有共同的组的位置，组内可能有半字节组合出来的误报，逐个精确确认
+        unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(m1, m2), zero)) & 0xffff;
+        while (mask != 0)
+        {
+            size_t pos = i + __builtin_ctz(mask);
+            if (is_candidate(filter, text, len, pos))
+            {
+                return pos;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+    return next_candidate_scalar(filter, text, len, i);
+}
+#endif
+
+struct filter *filter_create(const char *const *patterns, const size_t *lens, size_t count)
+{
+    struct filter *filter = calloc(1, sizeof(struct filter));
+    if (filter == NULL)
+    {
+        return NULL;
+    }
+
+    // 1. 字节类：关键词中出现过的字节各一类，其余字节为第 0 类，大写字母与小写同类
+    bool used[256] = {false};
+    size_t total = 0;
+    size_t distinct_pairs = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t j = 0; j < lens[i]; j++)
+        {
+            used[fold((uint8_t)patterns[i][j])] = true;
+        }
+        total += lens[i];
+    }
+    filter->class_count = 1;
+    for (int b = 0; b < 256; b++)
+    {
+        if (used[b])
+        {
+            filter->classes[b] = (uint8_t)filter->class_count++;
+        }
+    }
+    for (int b = 'A'; b <= 'Z'; b++)
+    {
+        filter->classes[b] = filter->classes[b + ('a' - 'A')];
+    }
+
+    // 2. 字典树，状态数不超过关键词总字节数 + 1
+    size_t classes = filter->class_count;
+    size_t capacity = total + 1;
+    filter->next = calloc(capacity * classes, sizeof(uint32_t));
+    filter->accepting = calloc(capacity, 1);
+    uint32_t *fail = malloc(capacity * sizeof(uint32_t));
+    uint32_t *queue = malloc(capacity * sizeof(uint32_t));
+    if (filter->next == NULL || filter->accepting == NULL || fail == NULL || queue == NULL)
+    {
+        free(fail);
+        free(queue);
+        filter_free(filter);
+        return NULL;
+    }
+    filter->state_count = 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t *p = (const uint8_t *)patterns[i];
+        if (lens[i] == 0)
+        {
+            continue;
+        }
+        uint32_t state = 0;
+        for (size_t j = 0; j < lens[i]; j++)
+        {
+            uint32_t *edge = &filter->next[state * classes + filter->classes[p[j]]];
+            if (*edge == 0)
+            {
+                *edge = (uint32_t)filter->state_count++;
+            }
+            state = *edge;
+        }
+        filter->accepting[state] = 1;
+        filter->pattern_count++;
+
+        // 预过滤表：组号由前两个字节散列得到，单字节关键词的第二个字节可以是任意值
+        uint8_t b0 = fold(p[0]);
+        uint8_t b1 = lens[i] > 1 ? fold(p[1]) : 0;
+        uint8_t bit = (uint8_t)(1u << ((b0 * 31u + b1) % TEDDY_BUCKETS));
+        add_nibbles(filter->lo1, filter->hi1, b0, bit);
+        if (lens[i] == 1)
+        {
+            distinct_pairs += bit_test(filter->singles, b0) ? 0 : 16;
+            bit_set(filter->singles, b0);
+            for (int n = 0; n < 16; n++)
+            {
+                filter->lo2[n] |= bit;
+                filter->hi2[n] |= bit;
+            }
+        }
+        else
+        {
+            distinct_pairs += !bit_test(filter->pairs, (size_t)b0 << 8 | b1);
+            bit_set(filter->pairs, (size_t)b0 << 8 | b1);
+            add_nibbles(filter->lo2, filter->hi2, b1, bit);
+        }
+    }
+
+    // 3. 按层次计算失败链接，同时把缺少的转移补成失败状态的转移，得到 DFA
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t c = 0; c < classes; c++)
+    {
+        uint32_t child = filter->next[c];
+        if (child != 0)
+        {
+            fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail)
+    {
+        uint32_t state = queue[head++];
+        uint32_t link = fail[state];
+        // 失败状态的层次更浅，已经处理过，它的 accepting 已包含整条失败链
+        filter->accepting[state] |= filter->accepting[link];
+        for (size_t c = 0; c < classes; c++)
+        {
+            uint32_t *edge = &filter->next[state * classes + c];
+            if (*edge != 0)
+            {
+                fail[*edge] = filter->next[link * classes + c];
+                queue[tail++] = *edge;
+            }
+            else
+            {
+                *edge = filter->next[link * classes + c];
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+
+    uint32_t *shrunk = realloc(filter->next, filter->state_count * classes * sizeof(uint32_t));
+    if (shrunk != NULL)
+    {
+        filter->next = shrunk;
+    }
+    if (distinct_pairs <= PREFILTER_MAX_PAIRS)
+    {
+        filter->next_candidate = next_candidate_scalar;
+#ifdef FILTER_SSSE3
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            filter->next_candidate = next_candidate_ssse3;
+        }
+#endif
+    }
+    return filter;
+}
+
+struct filter *filter_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+    char **patterns = NULL;
+    size_t *lens = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t len;
+    bool ok = true;
+    while ((len = getline(&line, &line_capacity, file)) >= 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#')
+        {
+            continue;
+        }
+        if (count == capacity)
+        {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            char **more_patterns = realloc(patterns, capacity * sizeof(char *));
+            size_t *more_lens = more_patterns != NULL ? realloc(lens, capacity * sizeof(size_t)) : NULL;
+            if (more_patterns != NULL)
+            {
+                patterns = more_patterns;
+            }
+            if (more_lens == NULL)
+            {
+                ok = false;
+                break;
+            }
+            lens = more_lens;
+        }
+        patterns[count] = strndup(line, len);
+        if (patterns[count] == NULL)
+        {
+            ok = false;
+            break;
+        }
+        lens[count++] = (size_t)len;
+    }
+    free(line);
+    fclose(file);
+
+    struct filter *filter = ok ? filter_create((const char *const *)patterns, lens, count) : NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        free(patterns[i]);
+    }
+    free(patterns);
+    free(lens);
+    if (filter == NULL)
+    {
+        errno = ENOMEM;
+    }
+    return filter;
+}
+
+void filter_free(struct filter *filter)
+{
+    if (filter != NULL)
+    {
+        free(filter->next);
+        free(filter->accepting);
+        free(filter);
+    }
+}
+
+size_t filter_pattern_count(const struct filter *filter)
+{
+    return filter->pattern_count;
+}
+
+/**
+ * 从 *pos 开始运行自动机，匹配到关键词时返回 true
+ * 回到初始状态（之后的匹配只能从下一个位置开始）时停下，*pos 为下一个位置
+ */
+static bool run_dfa(const struct filter *filter, const uint8_t *text, size_t len, size_t *pos)
+{
+    const size_t classes = filter->class_count;
+    uint32_t state = 0;
+    size_t i = *pos;
+    while (i < len)
+    {
+        state = filter->next[state * classes + filter->classes[text[i++]]];
+        if (filter->accepting[state])
+        {
+            return true;
+        }
+        if (state == 0)
+        {
+            break;
+        }
+    }
+    *pos = i;
+    return false;
+}
+
+bool filter_match(const struct filter *filter, const char *text, size_t len)
+{
+    if (filter->pattern_count == 0)
+    {
+        return false;
+    }
+    if (filter->next_candidate == NULL)
+    {
+        return filter_match_dfa(filter, text, len);
+    }
+    const uint8_t *bytes = (const uint8_t *)text;
+    size_t i = 0;
+    while ((i = filter->next_candidate(filter, bytes, len, i)) < len)
+    {
+        if (run_dfa(filter, bytes, len, &i))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool filter_match_dfa(const struct filter *filter, const char *text, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *)text;
+    const size_t classes = filter->class_count;
+    uint32_t state = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        state = filter->next[state * classes + filter->classes[bytes[i]]];
+        if (filter->accepting[state])
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 多模式关键词匹配（违禁词过滤）
+ *
+ * 所有关键词编译成一个 Aho-Corasick 自动机，按 UTF-8 字节匹配，ASCII 字母不区分大小写。
+ * 自动机展开为完整的状态转移表（DFA），每个字节只查一次表；关键词中没有出现过的字节归为同一类，
+ * 表的列数是关键词中不同字节的个数，而不是 256。
+ *
+ * 大部分消息不含任何关键词，因此先用 SIMD 预过滤（Teddy 算法的简化版）：关键词按前两个字节分成 8 组，
+ * 每次用 pshufb 查 16 个位置的第一、二个字节的高低半字节属于哪些组，两个字节都命中同一组的位置才是候选，
+ * 再用精确的双字节位图确认。只有从候选位置开始才运行自动机，自动机回到初始状态（没有匹配到一半的关键词）
+ * 后又回到预过滤，因此正常的文本几乎全程以 16 字节一步的速度扫描。不支持 SSSE3 的机器上逐字节预过滤。
+ * 关键词很多、候选位置太密时预过滤得不偿失，此时 filter_match 直接运行自动机。
+ *
+ * 编译后的 filter 只读，可以在多个线程中同时使用。
+ */
+
+struct filter;
+
+/**
+ * 编译关键词，空关键词被忽略；内存不足时返回 NULL
+ */
+struct filter *filter_create(const char *const *patterns, const size_t *lens, size_t count);
+/**
+ * 从文件加载关键词：每行一个，忽略空行和以 '#' 开头的行；失败时返回 NULL（errno 为原因）
+ */
+struct filter *filter_load(const char *path);
+void filter_free(struct filter *filter);
+// 关键词个数
+size_t filter_pattern_count(const struct filter *filter);
+
+// 判断文本中是否出现任意一个关键词
+bool filter_match(const struct filter *filter, const char *text, size_t len);
+// 不经过预过滤，只用自动机逐字节扫描，用于对比测试
+bool filter_match_dfa(const struct filter *filter, const char *text, size_t len);
+
+#endif // FILTER_H
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "config.h"
+#include "stats.h"
+#include "logger.h"
+#include "firehose.h"
+
+// 订阅者发现环为空时休眠的时间，只有空闲时才有系统调用
+#define FIREHOSE_IDLE_NS 1000000
+
+static struct
+{
+    pthread_mutex_t lock;       // 服务端内部的多个线程追加时串行化
+    struct firehose_ring *ring; // NULL 表示未启用
+    uint64_t cached_tail;       // 上次读到的 tail，空间不够时才重新读取订阅者的缓存行
+} firehose = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static size_t align_up(size_t n)
+{
+    return (n + FIREHOSE_ALIGN - 1) & ~(size_t)(FIREHOSE_ALIGN - 1);
+}
+
+bool firehose_open()
+{
+    if (config.firehose_path == NULL)
+    {
+        return true;
+    }
+    size_t capacity = FIREHOSE_ALIGN;
+    while (capacity < config.firehose_size)
+    {
+        capacity *= 2;
+    }
+    size_t size = sizeof(struct firehose_ring) + capacity;
+    // 复用而不是删除重建：服务端重启时仍在运行的订阅者映射的是同一个文件，能发现环被清空。
+    // 不用 O_TRUNC，直接设置为新的大小，订阅者不会在文件被截为 0 字节时访问映射而收到 SIGBUS
+    int fd = open(config.firehose_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        log_error("无法创建共享内存文件 %s：%s", config.firehose_path, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)size) < 0)
+    {
+        log_error("无法设置共享内存文件 %s 的大小：%s", config.firehose_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    struct firehose_ring *ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED)
+    {
+        log_error("无法映射共享内存文件 %s：%s", config.firehose_path, strerror(errno));
+        return false;
+    }
+    // 文件中可能还是上次运行留下的环：先清除 magic，订阅者停止读取，再清空 head 和 tail
+    ring->magic = 0;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+    ring->capacity = capacity;
+    // 订阅者看到 magic 时其他字段已经写好
+    atomic_thread_fence(memory_order_release);
+    ring->magic = FIREHOSE_MAGIC;
+    firehose.ring = ring;
+    log_info("共享内存消息流：%s（%zu 字节）", config.firehose_path, capacity);
+    return true;
+}
+
+void firehose_publish(const char *room, const struct msgbuf *buf)
+{
+    struct firehose_ring *ring = firehose.ring;
+    if (ring == NULL || buf == NULL)
+    {
+        return;
+    }
+    size_t room_len = strlen(room);
+    size_t size = align_up(sizeof(struct firehose_record) + room_len + buf->len);
+
+    pthread_mutex_lock(&firehose.lock);
+    // head 只由这里写入
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t offset = head & (ring->capacity - 1);
+    // 环末尾放不下时用一条填充记录跳到开头，记录都按 FIREHOSE_ALIGN 对齐，末尾至少能放下填充记录的头
+    size_t padding = ring->capacity - offset < size ? ring->capacity - offset : 0;
+    if (head + padding + size - firehose.cached_tail > ring->capacity)
+    {
+        firehose.cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head + padding + size - firehose.cached_tail > ring->capacity)
+        {
+            pthread_mutex_unlock(&firehose.lock);
+            stats_add(STAT_FIREHOSE_DROPPED, 1);
+            return;
+        }
+    }
+    if (padding > 0)
+    {
+        struct firehose_record *pad = (struct firehose_record *)(ring->data + offset);
+        *pad = (struct firehose_record){.size = (uint32_t)padding, .type = FIREHOSE_PADDING};
+        head += padding;
+        offset = 0;
+    }
+    struct firehose_record *record = (struct firehose_record *)(ring->data + offset);
+    *record = (struct firehose_record){
+        .size = (uint32_t)size,
+        .type = FIREHOSE_MESSAGE,
+        .room_len = (uint16_t)room_len,
+        .text_len = (uint32_t)buf->len,
+    };
+    char *p = (char *)(record + 1);
+    memcpy(p, room, room_len);
+    memcpy(p + room_len, msgbuf_payload(buf), buf->len);
+    // 记录写完后才让订阅者看到
+    atomic_store_explicit(&ring->head, head + size, memory_order_release);
+    pthread_mutex_unlock(&firehose.lock);
+}
+
+int firehose_tail(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        printf("无法打开共享内存文件 %s：%s\n", path, strerror(errno));
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    struct firehose_ring *ring = size >= sizeof(struct firehose_ring)
+                                     ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                                     : MAP_FAILED;
+    close(fd);
+    if (ring == MAP_FAILED || ring->magic != FIREHOSE_MAGIC || sizeof(struct firehose_ring) + ring->capacity != size)
+    {
+        printf("%s 不是服务端创建的共享内存消息流\n", path);
+        return 1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t mask = ring->capacity - 1;
+
+    // 从当前位置开始，不读取订阅之前的消息
+    uint64_t tail = atomic_load_explicit(&ring->head, memory_order_acquire);
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    while (1)
+    {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        // 服务端重启时重新初始化文件，magic 为 0 期间环还不能使用
+        bool restarting = ring->magic != FIREHOSE_MAGIC;
+        if (head == tail || restarting)
+        {
+            fflush(stdout);
+            struct timespec idle = {0, FIREHOSE_IDLE_NS};
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        if (sizeof(struct firehose_ring) + ring->capacity != size)
+        {
+            printf("共享内存消息流的大小已被服务端修改，请重新订阅\n");
+            return 1;
+        }
+        if (head < tail)
+        {
+            // 服务端重启，环从头开始
+            tail = head;
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+            continue;
+        }
+        // 一次读完已发布的所有记录，最后才发布 tail
+        while (tail < head)
+        {
+            const struct firehose_record *record = (const struct firehose_record *)(ring->data + (tail & mask));
+            if (record->size < sizeof(struct firehose_record) || record->size > head - tail
+                || sizeof(struct firehose_record) + record->room_len + (uint64_t)record->text_len > record->size)
+            {
+                // 记录损坏，丢弃已发布的部分
+                tail = head;
+                break;
+            }
+            if (record->type == FIREHOSE_MESSAGE)
+            {
+                const char *room = (const char *)(record + 1);
+                // 消息文本以换行结尾
+                printf("[%.*s] %.*s", (int)record->room_len, room, (int)record->text_len, room + record->room_len);
+            }
+            tail += record->size;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    }
+}
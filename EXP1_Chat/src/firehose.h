@@ -0,0 +1,66 @@
+#ifndef FIREHOSE_H
+#define FIREHOSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "msgbuf.h"
+
+/**
+ * 共享内存消息流（firehose）
+ *
+ * 与服务端在同一台机器上、需要接收所有房间全部聊天消息的程序（记录、审核、桥接）
+ * 不必作为客户端逐条 recv：服务端把每条聊天消息追加到一个映射到文件（通常在 /dev/shm 下）的环形缓冲区中，
+ * 订阅者映射同一个文件直接读取，双方都不需要为每条消息做系统调用。
+ *
+ * 环是单生产者单消费者的：服务端内部的多个线程追加时用锁串行化，只有一个订阅者进程读取。
+ * head、tail 是只增不减的字节位置，分别只由服务端和订阅者写入，放在不同的缓存行上；
+ * 服务端写完一条记录后才发布新的 head，订阅者读完后才发布新的 tail。
+ * 订阅者没有运行或跟不上、环中放不下新消息时，服务端丢弃这条消息并计入运行统计，不等待订阅者。
+ *
+ * 每条记录为 [struct firehose_record] + [房间名] + [v1 格式的消息文本]，按 FIREHOSE_ALIGN 字节对齐；
+ * 环末尾放不下一条记录时写一条 FIREHOSE_PADDING 记录，从环的开头继续。
+ */
+
+#define FIREHOSE_MAGIC 0x45534f4845524946ULL // "FIREHOSE"
+#define FIREHOSE_ALIGN 16
+
+enum firehose_record_type
+{
+    FIREHOSE_MESSAGE = 1,
+    FIREHOSE_PADDING = 2
+};
+
+struct firehose_record
+{
+    uint32_t size;      // 整条记录占用的字节数（含记录头和对齐）
+    uint16_t type;      // enum firehose_record_type
+    uint16_t room_len;
+    uint32_t text_len;
+    uint32_t reserved;
+};
+
+// 映射文件开头的环头，之后是 capacity 字节的数据区
+struct firehose_ring
+{
+    uint64_t magic;
+    uint64_t capacity;   // 数据区字节数，2 的幂
+    _Alignas(64) _Atomic uint64_t head; // 服务端已写入的位置
+    _Alignas(64) _Atomic uint64_t tail; // 订阅者已读完的位置
+    _Alignas(64) char data[];
+};
+
+/**
+ * 配置了 --firehose 时创建（或重新初始化）共享内存文件并映射，失败时记录原因并返回 false
+ */
+bool firehose_open();
+/**
+ * 追加一条 v1 格式的聊天消息，环已满或未启用时什么也不做，可以在任何线程调用
+ */
+void firehose_publish(const char *room, const struct msgbuf *buf);
+/**
+ * 作为订阅者映射 path，从当前位置开始把收到的消息逐行打印为 "[房间] 消息"，不会返回（出错时返回非 0）
+ */
+int firehose_tail(const char *path);
+
+#endif // FIREHOSE_H
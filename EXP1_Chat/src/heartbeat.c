@@ -0,0 +1,60 @@
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "config.h"
+#include "protocol.h"
+#include "heartbeat.h"
+
+// TCP keepalive 的探测次数，探测间隔按超时时间平分
+#define KEEPALIVE_PROBES 3
+
+uint64_t heartbeat_now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void heartbeat_set_socket_options(int sock)
+{
+    if (config.heartbeat_interval_ms == 0)
+    {
+        return;
+    }
+    int one = 1;
+    int idle = config.heartbeat_interval_ms / 1000;
+    int interval = (config.heartbeat_timeout_ms - config.heartbeat_interval_ms) / 1000 / KEEPALIVE_PROBES;
+    int probes = KEEPALIVE_PROBES;
+    unsigned timeout = config.heartbeat_timeout_ms;
+    idle = idle > 0 ? idle : 1;
+    interval = interval > 0 ? interval : 1;
+    // 选项设置失败（如内核不支持 TCP_USER_TIMEOUT）时仍有应用层心跳，忽略错误
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    setsockopt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout));
+}
+
+enum heartbeat_action heartbeat_check(uint64_t last_recv_ms, uint64_t now_ms, uint64_t *next_ms)
+{
+    uint64_t idle = now_ms > last_recv_ms ? now_ms - last_recv_ms : 0;
+    if (idle >= config.heartbeat_timeout_ms)
+    {
+        return HEARTBEAT_EVICT;
+    }
+    if (idle >= config.heartbeat_interval_ms)
+    {
+        // 每个空闲周期只发一次 PING，之后等到超时；期间收到数据会在超时检查时发现
+        *next_ms = last_recv_ms + config.heartbeat_timeout_ms;
+        return HEARTBEAT_PING;
+    }
+    *next_ms = last_recv_ms + config.heartbeat_interval_ms;
+    return HEARTBEAT_WAIT;
+}
+
+struct msgbuf *heartbeat_ping(uint64_t now_ms)
+{
+    return proto_message(PROTO_PING, now_ms, NULL, 0);
+}
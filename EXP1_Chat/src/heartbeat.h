@@ -0,0 +1,45 @@
+#ifndef HEARTBEAT_H
+#define HEARTBEAT_H
+
+#include <stdint.h>
+#include "msgbuf.h"
+
+/**
+ * 连接心跳
+ *
+ * 客户端合上笔记本、断网时 TCP 连接不会自动断开，会话会一直留在房间里，
+ * 每次广播都把消息放进它的发送队列，直到内核放弃重传。这里用两层检查在有限时间内清理这些连接：
+ *   应用层：v2 连接超过 config.heartbeat_interval_ms 没有收到任何数据时，服务端发送 PROTO_PING，
+ *           客户端回复 PROTO_PONG；超过 config.heartbeat_timeout_ms 仍没有收到数据就断开连接。
+ *           v1 客户端不认识 PING，不做应用层检查。
+ *   TCP 层：所有连接都打开 keepalive（空闲 heartbeat_interval_ms 后开始探测），并设置 TCP_USER_TIMEOUT，
+ *           发出的数据超过 heartbeat_timeout_ms 没有被确认时内核直接断开连接，发送线程随之关闭队列。
+ * 每个连接的下一次检查时刻挂在时间轮上（见 timer_wheel.h），由事件循环或一个心跳线程统一处理，
+ * 不需要每个连接一个定时器线程。heartbeat_interval_ms 为 0 时不启用。
+ */
+
+// 时间轮的刻度和槽数，一圈为 102.4 秒，更远的检查时刻在之后几圈处理
+#define HEARTBEAT_TICK_MS 100
+#define HEARTBEAT_WHEEL_SLOTS 1024
+
+enum heartbeat_action
+{
+    HEARTBEAT_WAIT,  // 最近收到过数据，到 *next_ms 再检查
+    HEARTBEAT_PING,  // 发送 PING，到 *next_ms 再检查
+    HEARTBEAT_EVICT  // 超时，断开连接
+};
+
+// 心跳使用的时钟（CLOCK_MONOTONIC 毫秒）
+uint64_t heartbeat_now_ms();
+/**
+ * 按配置为连接打开 TCP keepalive 并设置 TCP_USER_TIMEOUT，未启用心跳时什么也不做
+ */
+void heartbeat_set_socket_options(int sock);
+/**
+ * 根据最后一次收到数据的时刻决定对连接的处理，*next_ms 为下一次检查的时刻
+ */
+enum heartbeat_action heartbeat_check(uint64_t last_recv_ms, uint64_t now_ms, uint64_t *next_ms);
+// 创建一个 PING 帧，带上发送时刻，客户端原样放在 PONG 中
+struct msgbuf *heartbeat_ping(uint64_t now_ms);
+
+#endif // HEARTBEAT_H
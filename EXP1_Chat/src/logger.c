@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "stats.h"
+#include "logger.h"
+
+// 日志线程一次 writev 最多写出的行数（每行两个 iovec：行首和内容）
+#define LOG_WRITE_BATCH 256
+// 行首："HH:MM:SS.mmm [级别] "
+#define LOG_PREFIX_MAX 32
+
+struct log_entry
+{
+    enum log_level level;
+    struct timespec time;
+    size_t len;
+    char text[LOG_LINE_MAX];
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t drained; // 队列中的日志已全部写出
+    bool started;
+    // 环形队列，只有日志线程出队；日志线程写出期间 [head, head + count) 的项不会被覆盖
+    struct log_entry entries[LOG_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+} logger = {.lock = PTHREAD_MUTEX_INITIALIZER, .not_empty = PTHREAD_COND_INITIALIZER, .drained = PTHREAD_COND_INITIALIZER};
+
+static const char *level_names[] = {"调试", "信息", "警告", "错误"};
+
+bool logger_parse_level(const char *str, int *level)
+{
+    static const char *options[] = {"debug", "info", "warn", "error"};
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(str, options[i]) == 0)
+        {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 格式化行首，返回长度
+static size_t format_prefix(const struct log_entry *entry, char *out)
+{
+    struct tm tm;
+    localtime_r(&entry->time.tv_sec, &tm);
+    return snprintf(out, LOG_PREFIX_MAX, "%02d:%02d:%02d.%03ld [%s] ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                    entry->time.tv_nsec / 1000000, level_names[entry->level]);
+}
+
+// 写出一批日志，写到标准输出，不经过 stdio
+static void write_entries(struct log_entry **entries, size_t n)
+{
+    char prefixes[LOG_WRITE_BATCH][LOG_PREFIX_MAX];
+    struct iovec iov[LOG_WRITE_BATCH * 2];
+    for (size_t i = 0; i < n; i++)
+    {
+        iov[i * 2].iov_base = prefixes[i];
+        iov[i * 2].iov_len = format_prefix(entries[i], prefixes[i]);
+        iov[i * 2 + 1].iov_base = entries[i]->text;
+        iov[i * 2 + 1].iov_len = entries[i]->len;
+    }
+    // 写日志失败时没有别处可以报告，忽略
+    ssize_t ret = writev(STDOUT_FILENO, iov, (int)n * 2);
+    (void)ret;
+}
+
+static void *logger_thread(void *arg)
+{
+    (void)arg;
+    struct log_entry *batch[LOG_WRITE_BATCH];
+    while (1)
+    {
+        pthread_mutex_lock(&logger.lock);
+        while (logger.count == 0)
+        {
+            pthread_cond_wait(&logger.not_empty, &logger.lock);
+        }
+        size_t n = logger.count < LOG_WRITE_BATCH ? logger.count : LOG_WRITE_BATCH;
+        for (size_t i = 0; i < n; i++)
+        {
+            batch[i] = &logger.entries[(logger.head + i) % LOG_QUEUE_SIZE];
+        }
+        pthread_mutex_unlock(&logger.lock);
+
+        write_entries(batch, n);
+
+        pthread_mutex_lock(&logger.lock);
+        logger.head = (logger.head + n) % LOG_QUEUE_SIZE;
+        logger.count -= n;
+        if (logger.count == 0)
+        {
+            pthread_cond_broadcast(&logger.drained);
+        }
+        pthread_mutex_unlock(&logger.lock);
+    }
+    return NULL;
+}
+
+int logger_start()
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, logger_thread, NULL) != 0)
+    {
+        return -1;
+    }
+    pthread_detach(thread);
+    pthread_mutex_lock(&logger.lock);
+    logger.started = true;
+    pthread_mutex_unlock(&logger.lock);
+    return 0;
+}
+
+void logger_flush()
+{
+    pthread_mutex_lock(&logger.lock);
+    while (logger.started && logger.count > 0)
+    {
+        pthread_cond_wait(&logger.drained, &logger.lock);
+    }
+    pthread_mutex_unlock(&logger.lock);
+}
+
+void logger_write(enum log_level level, const char *format, ...)
+{
+    // 在锁外格式化，锁内只复制
+    struct log_entry line;
+    line.level = level;
+    clock_gettime(CLOCK_REALTIME, &line.time);
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line.text, LOG_LINE_MAX - 1, format, args);
+    va_end(args);
+    if (len < 0)
+    {
+        return;
+    }
+    line.len = (size_t)len < LOG_LINE_MAX - 2 ? (size_t)len : LOG_LINE_MAX - 2;
+    line.text[line.len++] = '\n';
+
+    pthread_mutex_lock(&logger.lock);
+    if (!logger.started)
+    {
+        // 日志线程启动之前（启动阶段的日志），直接写出
+        struct log_entry *entry = &line;
+        write_entries(&entry, 1);
+        pthread_mutex_unlock(&logger.lock);
+        return;
+    }
+    if (logger.count == LOG_QUEUE_SIZE)
+    {
+        pthread_mutex_unlock(&logger.lock);
+        stats_add(STAT_LOG_DROPPED, 1);
+        return;
+    }
+    struct log_entry *entry = &logger.entries[(logger.head + logger.count) % LOG_QUEUE_SIZE];
+    entry->level = line.level;
+    entry->time = line.time;
+    entry->len = line.len;
+    memcpy(entry->text, line.text, line.len);
+    if (logger.count++ == 0)
+    {
+        pthread_cond_signal(&logger.not_empty);
+    }
+    pthread_mutex_unlock(&logger.lock);
+}
@@ -0,0 +1,55 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdbool.h>
+#include "config.h"
+
+/**
+ * 服务端运行日志（不是聊天记录，聊天记录见 chat_log.h）
+ *
+ * 日志分级，低于 config.log_level 的日志在调用处就被跳过，不格式化参数。
+ * 输出是异步的：调用线程只把格式化好的一行放入日志队列，由日志线程批量 writev 到标准输出，
+ * 不经过 stdio 的锁，也不会因为终端或管道写得慢而阻塞会话线程和事件循环。
+ * 队列满时丢弃新的日志行并计数（见 /stats）。
+ * 默认级别为 info：连接、设置名字、每条消息等高频事件是 debug 级别，默认不输出。
+ */
+
+enum log_level
+{
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR
+};
+
+// 每行日志的最大字节数，超过时截断
+#define LOG_LINE_MAX 512
+// 日志队列最多容纳的行数
+#define LOG_QUEUE_SIZE 1024
+
+// 解析 debug/info/warn/error，失败返回 false
+bool logger_parse_level(const char *str, int *level);
+/**
+ * 启动日志线程，返回 0 表示成功；启动之前的日志直接同步写出
+ */
+int logger_start();
+// 等待队列中的日志全部写出，启动失败退出进程之前调用
+void logger_flush();
+// 格式化一行日志放入队列（末尾自动加换行），调用者应通过下面的宏调用
+void logger_write(enum log_level level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_AT(level, ...)                   \
+    do                                       \
+    {                                        \
+        if ((int)(level) >= config.log_level) \
+        {                                    \
+            logger_write(level, __VA_ARGS__); \
+        }                                    \
+    } while (0)
+
+#define log_debug(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define log_info(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_warn(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_error(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif // LOGGER_H
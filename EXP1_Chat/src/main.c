@@ -1,18 +1,35 @@
 #include <stdio.h>
 #include <string.h>
+#include "config.h"
 #include "server.h"
 #include "client.h"
+#include "event_server.h"
+#include "chat_log.h"
+#include "firehose.h"
 
 void print_usage()
 {
     printf("用法：\n");
     printf("chat --client\t启动客户端\n");
     printf("chat --server\t启动服务端\n");
+    printf("chat --event-server\t启动服务端（epoll 事件驱动模式）\n");
+    printf("chat --dump-log 目录 [序号|@UNIX时间]\t打印服务端保存的聊天记录\n");
+    printf("chat --firehose-tail 路径\t从服务端的共享内存消息流中读取之后的所有聊天消息\n");
+    printf("前三个命令后面可以跟选项：\n");
+    config_print_usage();
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 2)
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "--dump-log") == 0)
+    {
+        return chat_log_dump(argv[2], argc == 4 ? argv[3] : NULL);
+    }
+    if (argc == 3 && strcmp(argv[1], "--firehose-tail") == 0)
+    {
+        return firehose_tail(argv[2]);
+    }
+    if (argc < 2 || !config_parse_args(argc, argv, 2))
     {
         print_usage();
         return 0;
@@ -25,6 +42,10 @@ int main(int argc, char** argv)
     {
         return server_main();
     }
+    else if (strcmp(argv[1], "--event-server") == 0)
+    {
+        return event_server_main();
+    }
     else
     {
         print_usage();
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "stats.h"
+#include "logger.h"
+#include "filter.h"
+#include "moderation.h"
+
+// 检查词表文件是否被修改的间隔
+#define FILTER_RELOAD_INTERVAL_MS 1000
+// 替换词表后等待旧的检查结束时，每次检查之间休眠的时间
+#define GRACE_POLL_NS 100000
+
+/**
+ * 每个检查消息的线程一个 epoch 槽，只由本线程写入
+ * active 为进入检查时的全局 epoch，0 表示不在检查中
+ */
+struct reader_slot
+{
+    _Atomic unsigned long long active;
+    struct reader_slot *next;
+} __attribute__((aligned(64)));
+
+static _Thread_local struct reader_slot *local_slot;
+
+static struct
+{
+    _Atomic(struct filter *) current; // NULL 表示不过滤
+    atomic_ullong epoch;
+    pthread_mutex_t lock;             // 保护槽列表
+    pthread_key_t key;                // 线程退出时移除它的槽
+    struct reader_slot *slots;
+    struct stat loaded;               // 当前词表文件的状态，用于发现修改
+} moderation = {.epoch = 1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+static void remove_slot(void *arg)
+{
+    struct reader_slot *slot = arg;
+    pthread_mutex_lock(&moderation.lock);
+    struct reader_slot **p = &moderation.slots;
+    while (*p != slot)
+    {
+        p = &(*p)->next;
+    }
+    *p = slot->next;
+    pthread_mutex_unlock(&moderation.lock);
+    free(slot);
+}
+
+static struct reader_slot *register_slot()
+{
+    struct reader_slot *slot = aligned_alloc(64, sizeof(struct reader_slot));
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&slot->active, 0);
+    pthread_mutex_lock(&moderation.lock);
+    slot->next = moderation.slots;
+    moderation.slots = slot;
+    pthread_mutex_unlock(&moderation.lock);
+    pthread_setspecific(moderation.key, slot);
+    local_slot = slot;
+    return slot;
+}
+
+bool moderation_allows(const char *text, size_t len)
+{
+    if (atomic_load_explicit(&moderation.current, memory_order_relaxed) == NULL)
+    {
+        return true;
+    }
+    struct reader_slot *slot = local_slot != NULL ? local_slot : register_slot();
+    if (slot == NULL)
+    {
+        // 内存不足时无法安全地使用词表，不检查
+        return true;
+    }
+    // 先登记 epoch 再读取词表指针，都是 seq_cst；替换者先换掉指针再读取各线程的 active，也都是 seq_cst，
+    // 所以替换者读到 active 为 0 时，这里一定会读到新词表（换成 acquire 读取时弱序 CPU 上不成立）
+    atomic_store(&slot->active, atomic_load(&moderation.epoch));
+    struct filter *filter = atomic_load(&moderation.current);
+    bool matched = filter != NULL && filter_match(filter, text, len);
+    atomic_store_explicit(&slot->active, 0, memory_order_release);
+    if (matched)
+    {
+        stats_add(STAT_FILTERED, 1);
+    }
+    return !matched;
+}
+
+// 替换当前词表，等所有在替换之前开始的检查结束后释放旧词表
+static void replace_filter(struct filter *filter)
+{
+    struct filter *old = atomic_exchange(&moderation.current, filter);
+    unsigned long long target = atomic_fetch_add(&moderation.epoch, 1) + 1;
+    pthread_mutex_lock(&moderation.lock);
+    for (struct reader_slot *slot = moderation.slots; slot != NULL; slot = slot->next)
+    {
+        unsigned long long active;
+        // 必须是 seq_cst，与检查线程的"写 active、读 current"配对，见 moderation_allows
+        while ((active = atomic_load(&slot->active)) != 0 && active < target)
+        {
+            struct timespec pause = {0, GRACE_POLL_NS};
+            nanosleep(&pause, NULL);
+        }
+    }
+    pthread_mutex_unlock(&moderation.lock);
+    filter_free(old);
+}
+
+static bool file_changed(const struct stat *a, const struct stat *b)
+{
+    return a->st_ino != b->st_ino || a->st_size != b->st_size || a->st_mtim.tv_sec != b->st_mtim.tv_sec
+           || a->st_mtim.tv_nsec != b->st_mtim.tv_nsec;
+}
+
+// 定时检查词表文件，修改后重新编译并替换；编译失败时继续使用旧词表
+static void *reload_thread(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        struct timespec interval = {FILTER_RELOAD_INTERVAL_MS / 1000, FILTER_RELOAD_INTERVAL_MS % 1000 * 1000000};
+        nanosleep(&interval, NULL);
+        struct stat st;
+        if (stat(config.filter_path, &st) < 0 || !file_changed(&st, &moderation.loaded))
+        {
+            continue;
+        }
+        moderation.loaded = st;
+        struct filter *filter = filter_load(config.filter_path);
+        if (filter == NULL)
+        {
+            log_warn("违禁词表 %s 加载失败：%s，继续使用旧词表", config.filter_path, strerror(errno));
+            continue;
+        }
+        replace_filter(filter);
+        log_info("违禁词表已更新：%zu 个关键词", filter_pattern_count(filter));
+    }
+    return NULL;
+}
+
+bool moderation_start()
+{
+    if (config.filter_path == NULL)
+    {
+        return true;
+    }
+    pthread_key_create(&moderation.key, remove_slot);
+    if (stat(config.filter_path, &moderation.loaded) < 0)
+    {
+        log_error("无法读取违禁词表 %s：%s", config.filter_path, strerror(errno));
+        return false;
+    }
+    struct filter *filter = filter_load(config.filter_path);
+    if (filter == NULL)
+    {
+        log_error("违禁词表 %s 加载失败：%s", config.filter_path, strerror(errno));
+        return false;
+    }
+    atomic_store(&moderation.current, filter);
+    log_info("违禁词表：%s（%zu 个关键词）", config.filter_path, filter_pattern_count(filter));
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reload_thread, NULL) != 0)
+    {
+        log_error("违禁词表重新加载线程启动失败");
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
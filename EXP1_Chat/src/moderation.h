@@ -0,0 +1,25 @@
+#ifndef MODERATION_H
+#define MODERATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * 聊天内容审核
+ *
+ * 配置了 --filter 时，每条聊天消息在广播之前用违禁词表（见 filter.h）检查一遍，命中的消息不发送。
+ * 词表文件修改后由一个后台线程重新编译，编译好后原子地替换当前使用的词表（RCU）：
+ * 检查消息的线程不加锁，只在进入、离开检查时各写一次本线程的 epoch 槽；
+ * 替换后的旧词表要等所有在替换之前开始的检查结束后才释放。
+ */
+
+/**
+ * 配置了 --filter 时加载词表并启动重新加载线程，失败时打印原因并返回 false
+ */
+bool moderation_start();
+/**
+ * 消息是否允许发送（没有配置词表或没有命中任何违禁词），可以在任何线程调用
+ */
+bool moderation_allows(const char *text, size_t len);
+
+#endif // MODERATION_H
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <netinet/in.h>
+#include "packet.h"
+#include "msgbuf.h"
+
+// msgbuf_printf 首次分配的消息内容空间，普通聊天消息一次格式化即可完成
+#define PRINTF_INITIAL_SIZE 256
+
+static void write_header(struct msgbuf *buf, size_t len)
+{
+    uint32_t net_len = htonl((uint32_t)len);
+    memcpy(buf->frame, &net_len, sizeof(net_len));
+    buf->len = len;
+    buf->version = PACKET_V1;
+    buf->header_len = MSGBUF_HEADER_SIZE;
+    atomic_init(&buf->alt, NULL);
+    atomic_init(&buf->compressed, NULL);
+}
+
+struct msgbuf *msgbuf_create(const char *text, size_t len)
+{
+    struct msgbuf *buf = malloc(sizeof(struct msgbuf) + MSGBUF_HEADER_SIZE + len);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&buf->refs, 1);
+    write_header(buf, len);
+    memcpy(buf->frame + MSGBUF_HEADER_SIZE, text, len);
+    return buf;
+}
+
+struct msgbuf *msgbuf_alloc(uint8_t version, size_t len)
+{
+    if (version == PACKET_V1)
+    {
+        struct msgbuf *buf = malloc(sizeof(struct msgbuf) + MSGBUF_HEADER_SIZE + len);
+        if (buf != NULL)
+        {
+            atomic_init(&buf->refs, 1);
+            write_header(buf, len);
+        }
+        return buf;
+    }
+
+    char header[VARINT_MAX_LEN];
+    size_t header_len = varint_encode(len, header);
+    struct msgbuf *buf = malloc(sizeof(struct msgbuf) + header_len + len);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    atomic_init(&buf->refs, 1);
+    atomic_init(&buf->alt, NULL);
+    atomic_init(&buf->compressed, NULL);
+    memcpy(buf->frame, header, header_len);
+    buf->len = len;
+    buf->version = version;
+    buf->header_len = (uint8_t)header_len;
+    return buf;
+}
+
+struct msgbuf *msgbuf_printf(size_t max_len, const char *format, ...)
+{
+    size_t capacity = max_len < PRINTF_INITIAL_SIZE ? max_len : PRINTF_INITIAL_SIZE;
+    // 多分配 1 字节给 vsnprintf 写入的 '\0'，它不计入消息内容
+    struct msgbuf *buf = malloc(sizeof(struct msgbuf) + MSGBUF_HEADER_SIZE + capacity + 1);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf->frame + MSGBUF_HEADER_SIZE, capacity + 1, format, args);
+    va_end(args);
+    if (n < 0)
+    {
+        free(buf);
+        return NULL;
+    }
+
+    size_t len = (size_t)n;
+    if (len > capacity && capacity < max_len)
+    {
+        // 初始空间不够，按实际长度（不超过 max_len）重新格式化
+        capacity = len < max_len ? len : max_len;
+        struct msgbuf *bigger = realloc(buf, sizeof(struct msgbuf) + MSGBUF_HEADER_SIZE + capacity + 1);
+        if (bigger == NULL)
+        {
+            free(buf);
+            return NULL;
+        }
+        buf = bigger;
+        va_start(args, format);
+        vsnprintf(buf->frame + MSGBUF_HEADER_SIZE, capacity + 1, format, args);
+        va_end(args);
+    }
+    if (len > capacity)
+    {
+        len = capacity;
+    }
+
+    atomic_init(&buf->refs, 1);
+    write_header(buf, len);
+    return buf;
+}
+
+struct msgbuf *msgbuf_ref(struct msgbuf *buf)
+{
+    atomic_fetch_add_explicit(&buf->refs, 1, memory_order_relaxed);
+    return buf;
+}
+
+void msgbuf_unref(struct msgbuf *buf)
+{
+    if (buf != NULL && atomic_fetch_sub_explicit(&buf->refs, 1, memory_order_acq_rel) == 1)
+    {
+        msgbuf_unref(atomic_load_explicit(&buf->alt, memory_order_acquire));
+        struct msgbuf *compressed = atomic_load_explicit(&buf->compressed, memory_order_acquire);
+        if (compressed != buf)
+        {
+            msgbuf_unref(compressed);
+        }
+        free(buf);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef MSGBUF_H
+#define MSGBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * 引用计数的消息缓冲区
+ * 缓冲区中直接存放编码好的帧：[4字节长度] + [消息内容]，发送时整帧一次写出。
+ * 一条广播消息只创建、格式化一次，所有接收者的发送队列共享同一个 msgbuf，
+ * 每个队列持有一个引用，最后一个引用释放时才 free。
+ * 创建后内容不再修改，因此多个线程可以同时读取。
+ *
+ * 帧可以是 v1 格式（4 字节长度）或 v2 格式（varint 长度 + 类型和字段，见 protocol.h）。
+ * 同一条消息要发给另一种协议的连接时，由 proto_encoding 转换一次并挂在 alt 上，
+ * 之后所有该协议的接收者共享转换结果。发给接收压缩帧的连接时，压缩结果同样只创建一次，挂在 compressed 上（见 compress.h）。
+ */
+struct msgbuf
+{
+    atomic_int refs;
+    size_t len;          // 消息内容长度
+    uint8_t version;     // 帧格式（PACKET_V1 或 PACKET_V2）
+    uint8_t header_len;  // 长度前缀的字节数
+    _Atomic(struct msgbuf *) alt; // 另一种格式的同一条消息，持有一个引用，NULL 表示还没有转换过
+    _Atomic(struct msgbuf *) compressed; // 压缩后的同一条消息，持有一个引用；NULL 表示还没有压缩过，指向自己表示不压缩
+    char frame[];        // 帧：长度前缀 + 消息内容（不含 '\0'）
+};
+
+// v1 帧长度前缀的字节数
+#define MSGBUF_HEADER_SIZE 4
+
+// 用消息内容创建一帧，引用计数为 1
+struct msgbuf *msgbuf_create(const char *text, size_t len);
+/**
+ * 创建一个 version 格式、内容长度为 len 的帧，长度前缀已写好，内容由调用者通过 msgbuf_data 填写
+ * 填写完成、交给其他线程之前不能共享
+ */
+struct msgbuf *msgbuf_alloc(uint8_t version, size_t len);
+/**
+ * 直接把格式化结果写入帧中，省去中间缓冲区和再次计算长度
+ * 消息内容超过 max_len 字节时截断（与 snprintf 一致）
+ */
+struct msgbuf *msgbuf_printf(size_t max_len, const char *format, ...) __attribute__((format(printf, 2, 3)));
+struct msgbuf *msgbuf_ref(struct msgbuf *buf);
+void msgbuf_unref(struct msgbuf *buf);
+
+static inline const char *msgbuf_payload(const struct msgbuf *buf)
+{
+    return buf->frame + buf->header_len;
+}
+
+static inline char *msgbuf_data(struct msgbuf *buf)
+{
+    return buf->frame + buf->header_len;
+}
+
+static inline size_t msgbuf_frame_len(const struct msgbuf *buf)
+{
+    return buf->header_len + buf->len;
+}
+
+#endif // MSGBUF_H
@@ -1,17 +1,145 @@
 /**
  * 网络传输注意事项：
- * 收发数据的数据包格式为 [4字节长度] + [消息内容]
+ * 收发数据的数据包格式为 [4字节长度] + [消息内容]，协商使用协议 v2 后为 [varint 长度] + [消息内容]
  * 发送消息的时候不应该在末尾带上字符串结束符 '\0'
  * 接收到消息后应该在末尾添加字符串结束符，recv_buf[len] = '\0'
  */
 
 #include "packet.h"
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
+// send_frames 每次 writev 最多写出的消息数（每条消息占两个 iovec）
+#define SEND_FRAMES_BATCH 64
+
+/**
+ * 把 iov 中前 written 字节标记为已发送：跳过写完的 iovec，调整写了一部分的那个
+ * 返回剩余的 iovec 个数，*iov 指向第一个未写完的 iovec
+ */
+static int advance_iov(struct iovec **iov, int iovcnt, size_t written)
+{
+    struct iovec *cur = *iov;
+    while (iovcnt > 0 && written >= cur->iov_len) {
+        written -= cur->iov_len;
+        cur++;
+        iovcnt--;
+    }
+    if (iovcnt > 0) {
+        cur->iov_base = (char *)cur->iov_base + written;
+        cur->iov_len -= written;
+    }
+    *iov = cur;
+    return iovcnt;
+}
+
+/**
+ * 一次 writev 发送多条带长度前缀的消息
+ * 每条消息的长度前缀和内容作为相邻的两个 iovec，整批只需一次系统调用，
+ * 也避免了先发 4 字节长度、再发内容时 Nagle 算法与延迟确认叠加造成的等待。
+ * 部分写入时从断点继续，直到全部写完
+ * 返回发送的消息内容部分总长度，-1 表示失败
+ */
+ssize_t send_frames(int sock, const struct frame_out *frames, size_t count)
+{
+    if (frames == NULL || count == 0) {
+        return -1;
+    }
+
+    uint32_t headers[SEND_FRAMES_BATCH];
+    struct iovec iov[SEND_FRAMES_BATCH * 2];
+    size_t total = 0;
+
+    for (size_t start = 0; start < count; start += SEND_FRAMES_BATCH) {
+        size_t batch = count - start < SEND_FRAMES_BATCH ? count - start : SEND_FRAMES_BATCH;
+        for (size_t i = 0; i < batch; i++) {
+            const struct frame_out *frame = &frames[start + i];
+            if (frame->buf == NULL || frame->len == 0 || frame->len > UINT32_MAX) {
+                return -1;
+            }
+            headers[i] = htonl((uint32_t)frame->len);
+            iov[i * 2].iov_base = &headers[i];
+            iov[i * 2].iov_len = sizeof(headers[i]);
+            iov[i * 2 + 1].iov_base = (void *)frame->buf;
+            iov[i * 2 + 1].iov_len = frame->len;
+            total += frame->len;
+        }
+
+        struct iovec *pending = iov;
+        int iovcnt = (int)batch * 2;
+        while (iovcnt > 0) {
+            ssize_t written = writev(sock, pending, iovcnt);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            iovcnt = advance_iov(&pending, iovcnt, (size_t)written);
+        }
+    }
+
+    return (ssize_t)total;
+}
+
+size_t varint_encode(uint64_t value, char *out)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char)value;
+    return n;
+}
+
+bool varint_decode(const char **p, const char *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *p + shift / 7 < end; shift += 7) {
+        unsigned char byte = (unsigned char)(*p)[shift / 7];
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *p += shift / 7 + 1;
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+int frame_header_parse(int version, const char *data, size_t available, size_t *header_len, size_t *msg_len)
+{
+    if (version == PACKET_V1) {
+        if (available < sizeof(uint32_t)) {
+            return 0;
+        }
+        uint32_t net_len;
+        memcpy(&net_len, data, sizeof(net_len));
+        *header_len = sizeof(net_len);
+        *msg_len = ntohl(net_len);
+        return 1;
+    }
+
+    const char *p = data;
+    uint64_t value;
+    if (!varint_decode(&p, data + available, &value)) {
+        // 已有 VARINT_MAX_LEN 个字节仍未结束，说明前缀无效
+        return available >= VARINT_MAX_LEN ? -1 : 0;
+    }
+    if ((size_t)(p - data) > VARINT_MAX_LEN || value > UINT32_MAX) {
+        return -1;
+    }
+    *header_len = p - data;
+    *msg_len = value;
+    return 1;
+}
+
 /**
  * 发送带长度前缀的消息
  * 返回发送的消息内容部分长度，-1 表示失败
@@ -22,24 +150,59 @@ ssize_t send_msg(int sock, const char *buf, size_t len)
         return -1;
     }
 
-    // 1. 发送消息长度（4字节，网络字节序）
-    uint32_t net_len = htonl((uint32_t)len);
-    ssize_t sent = send(sock, &net_len, sizeof(net_len), 0);
-    if (sent != sizeof(net_len)) {
+    struct frame_out frame = { buf, len };
+    return send_frames(sock, &frame, 1);
+}
+
+ssize_t send_msg_v2(int sock, const char *buf, size_t len)
+{
+    if (buf == NULL || len == 0 || len > UINT32_MAX) {
         return -1;
     }
 
-    // 2. 发送消息内容
-    sent = send(sock, buf, len, 0);
-    if (sent != (ssize_t)len) {
-        return -1;
+    char header[VARINT_MAX_LEN];
+    struct iovec iov[2] = {
+        { header, varint_encode(len, header) },
+        { (void *)buf, len },
+    };
+    struct iovec *pending = iov;
+    int iovcnt = 2;
+    while (iovcnt > 0) {
+        ssize_t written = writev(sock, pending, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        iovcnt = advance_iov(&pending, iovcnt, (size_t)written);
     }
+    return (ssize_t)len;
+}
 
-    return len;
+// 循环 recv 直到收满 len 字节，返回值含义同 recv_msg
+static ssize_t recv_full(int sock, char *buf, size_t len)
+{
+    size_t total_received = 0;
+    while (total_received < len) {
+        ssize_t received = recv(sock, buf + total_received, len - total_received, 0);
+        if (received == 0) {
+            return 0;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total_received += received;
+    }
+    return (ssize_t)total_received;
 }
 
 /**
- * 接收带长度前缀的消息
+ * 接收带长度前缀的消息（不带缓冲，每条消息至少两次 recv）
+ * 长连接上应使用 frame_reader
  * 返回接收到的消息内容部分长度，0 代表连接终止，-1 代表失败
  */
 ssize_t recv_msg(int sock, char *buf, size_t max_len)
@@ -48,17 +211,11 @@ ssize_t recv_msg(int sock, char *buf, size_t max_len)
         return -1;
     }
 
-    // 1. 先接收消息长度（4字节）
+    // 1. 先接收消息长度（4字节），长度前缀也可能被拆到多个 TCP 段中
     uint32_t net_len = 0;
-    ssize_t received = recv(sock, &net_len, sizeof(net_len), 0);
-
-    if (received == 0) {
-        // 连接已关闭
-        return 0;
-    }
-    if (received != sizeof(net_len)) {
-        // 接收长度头失败
-        return -1;
+    ssize_t received = recv_full(sock, (char *)&net_len, sizeof(net_len));
+    if (received <= 0) {
+        return received;
     }
 
     // 2. 将网络字节序转换为主机字节序
@@ -71,23 +228,147 @@ ssize_t recv_msg(int sock, char *buf, size_t max_len)
     }
 
     // 3. 接收消息内容（循环接收直到完整）
-    size_t total_received = 0;
-    char *ptr = (char *)buf;
+    return recv_full(sock, buf, msg_len);
+}
 
-    while (total_received < msg_len) {
-        received = recv(sock, ptr + total_received, msg_len - total_received, 0);
+bool frame_reader_init(struct frame_reader *reader, int sock, size_t max_len)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->sock = sock;
+    reader->max_len = max_len;
+    reader->version = PACKET_V1;
+    reader->capacity = FRAME_READER_INITIAL_SIZE;
+    reader->buf = malloc(reader->capacity + 1);
+    return reader->buf != NULL;
+}
 
-        if (received == 0) {
-            // 连接在接收过程中关闭
-            return 0;
+void frame_reader_destroy(struct frame_reader *reader)
+{
+    free(reader->buf);
+    reader->buf = NULL;
+}
+
+// 恢复上一条消息末尾被 '\0' 覆盖的字节（它是下一条消息的开头）
+static void frame_reader_restore(struct frame_reader *reader)
+{
+    if (reader->saved_pos != NULL) {
+        *reader->saved_pos = reader->saved;
+        reader->saved_pos = NULL;
+    }
+}
+
+ssize_t frame_reader_fill(struct frame_reader *reader)
+{
+    frame_reader_restore(reader);
+
+    // 把未处理的数据（不完整的消息）移到缓冲区开头，腾出后面的空间
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    if (reader->end == 0 && reader->capacity > FRAME_READER_INITIAL_SIZE) {
+        // 缓冲区为容纳大消息扩大过，处理完后缩回初始大小，不让空闲连接长期占用大块内存
+        char *smaller = realloc(reader->buf, FRAME_READER_INITIAL_SIZE + 1);
+        if (smaller != NULL) {
+            reader->buf = smaller;
+            reader->capacity = FRAME_READER_INITIAL_SIZE;
         }
-        if (received < 0) {
-            // 接收失败
+    }
+    if (reader->end == reader->capacity) {
+        // 正常情况下 frame_reader_next 已经按消息长度扩大了缓冲区，这里只是保证有空间可读
+        size_t capacity = reader->capacity * 2;
+        char *bigger = realloc(reader->buf, capacity + 1);
+        if (bigger == NULL) {
             return -1;
         }
+        reader->buf = bigger;
+        reader->capacity = capacity;
+    }
 
-        total_received += received;
+    ssize_t received = recv(reader->sock, reader->buf + reader->end, reader->capacity - reader->end, 0);
+    if (received > 0) {
+        reader->end += received;
     }
+    return received;
+}
 
-    return (ssize_t)total_received;
+// 丢弃缓冲区中属于被跳过消息的字节，返回 true 表示已跳过完毕
+static bool frame_reader_discard(struct frame_reader *reader)
+{
+    size_t available = reader->end - reader->start;
+    size_t n = reader->discard < available ? reader->discard : available;
+    reader->start += n;
+    reader->discard -= n;
+    if (reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+    }
+    return reader->discard == 0;
+}
+
+int frame_reader_next(struct frame_reader *reader, char **msg, size_t *len)
+{
+    frame_reader_restore(reader);
+    if (reader->discard > 0 && !frame_reader_discard(reader)) {
+        return 0;
+    }
+
+    while (reader->end > reader->start) {
+        size_t header_len;
+        size_t msg_len;
+        int ret = frame_header_parse(reader->version, reader->buf + reader->start, reader->end - reader->start,
+                                     &header_len, &msg_len);
+        if (ret <= 0) {
+            return ret < 0 ? -2 : 0;
+        }
+        if (msg_len > reader->max_len) {
+            return -1;
+        }
+
+        size_t frame_len = header_len + msg_len;
+        if (reader->end - reader->start < frame_len) {
+            // 消息还不完整，缓冲区放不下整条消息时先扩大，下次 fill 直接读入剩余部分
+            if (frame_len > reader->capacity) {
+                char *bigger = realloc(reader->buf, frame_len + 1);
+                if (bigger == NULL) {
+                    return -3;
+                }
+                reader->buf = bigger;
+                reader->capacity = frame_len;
+            }
+            return 0;
+        }
+
+        char *payload = reader->buf + reader->start + header_len;
+        reader->start += frame_len;
+        if (reader->start == reader->end) {
+            // 缓冲区中的数据已全部处理，下次 fill 从头开始，省去 memmove
+            reader->start = 0;
+            reader->end = 0;
+        }
+        if (msg_len == 0) {
+            continue;
+        }
+
+        // 用 '\0' 结束消息，被覆盖的字节（下一条消息的开头）在下次调用时恢复
+        reader->saved_pos = payload + msg_len;
+        reader->saved = *reader->saved_pos;
+        *reader->saved_pos = '\0';
+        *msg = payload;
+        *len = msg_len;
+        return 1;
+    }
+    return 0;
+}
+
+size_t frame_reader_skip(struct frame_reader *reader)
+{
+    size_t header_len;
+    size_t msg_len;
+    frame_header_parse(reader->version, reader->buf + reader->start, reader->end - reader->start,
+                       &header_len, &msg_len);
+    reader->discard = header_len + msg_len;
+    frame_reader_discard(reader);
+    return msg_len;
 }
@@ -1,10 +1,93 @@
 #ifndef PACKET_H
 #define PACKET_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <unistd.h>
 
+// 帧格式版本：v1 为 [4字节长度（网络字节序）] + [内容]，v2 为 [varint 长度] + [内容]（内容格式见 protocol.h）
+#define PACKET_V1 1
+#define PACKET_V2 2
+// varint 编码的 32 位长度最多占用的字节数
+#define VARINT_MAX_LEN 5
+
+/**
+ * 待发送的一条消息（只含消息内容，长度前缀由 send_frames 生成）
+ */
+struct frame_out
+{
+    const char *buf;
+    size_t len;
+};
+
+/**
+ * 带缓冲的拼帧读取器，每个连接一个
+ * 一次 recv 尽量多读，缓冲区中可能有多条完整的消息，逐条取出；
+ * 不完整的消息留在缓冲区中，下次读到更多数据后继续拼接，长度前缀被 TCP 拆开也没有问题。
+ * 消息一般远小于缓冲区，一次 recv 就能读到一批消息，平均每条消息不到一次系统调用。
+ */
+struct frame_reader
+{
+    int sock;
+    char *buf;
+    size_t capacity;  // buf 能存放的数据字节数（另外多分配 1 字节用于 '\0'）
+    size_t start;     // 第一个未处理的字节
+    size_t end;       // 已读入数据的结束位置
+    size_t max_len;   // 单条消息内容的最大长度
+    int version;      // 帧格式版本，初始为 PACKET_V1，协商后可以切换
+    size_t discard;   // 被跳过的过长消息还未读到的字节数
+    char *saved_pos;  // 上一条消息末尾被 '\0' 覆盖的位置，NULL 表示没有
+    char saved;       // 被覆盖的原字节
+};
+
+// frame_reader 缓冲区的初始大小，放不下一条消息时按需扩大，大消息处理完后再缩回
+#define FRAME_READER_INITIAL_SIZE 4096
+
+/**
+ * varint 编码（每字节 7 位，低位在前，最高位表示后面还有字节）
+ * varint_encode 返回写入的字节数；varint_decode 成功时前移 *p，数据不完整或超过 64 位时返回 false
+ */
+size_t varint_encode(uint64_t value, char *out);
+bool varint_decode(const char **p, const char *end, uint64_t *value);
+/**
+ * 解析缓冲区开头 version 格式的长度前缀
+ * 返回 1 表示成功，*header_len 为前缀字节数，*msg_len 为消息内容长度；
+ * 返回 0 表示前缀还不完整；返回 -1 表示前缀无效（v2 长度超过 32 位）
+ */
+int frame_header_parse(int version, const char *data, size_t available, size_t *header_len, size_t *msg_len);
+
+bool frame_reader_init(struct frame_reader *reader, int sock, size_t max_len);
+void frame_reader_destroy(struct frame_reader *reader);
+/**
+ * 调用一次 recv，把读到的数据追加到缓冲区
+ * 返回读到的字节数，0 表示连接已关闭，-1 表示失败（errno 由 recv 设置，非阻塞 socket 可能为 EAGAIN）
+ * 之前 frame_reader_next 返回的消息指针随之失效
+ */
+ssize_t frame_reader_fill(struct frame_reader *reader);
+/**
+ * 从缓冲区中取出下一条完整的消息，不做系统调用
+ * 返回 1 表示取到一条消息，*msg 指向缓冲区内的消息内容（已以 '\0' 结尾），*len 为其长度；
+ * 返回 0 表示缓冲区中没有完整的消息，需要再 frame_reader_fill；
+ * 返回 -1 表示消息长度超过 max_len，此时可以断开连接，
+ * 或者调用 frame_reader_skip 丢弃这条消息后继续；
+ * 返回 -2 表示长度前缀无效，数据流已无法同步，只能断开连接；
+ * 返回 -3 表示内存不足，无法为这条消息扩大缓冲区，也只能断开连接
+ * 两次调用之间可以修改 reader->version，之后的消息按新格式解析
+ * 长度为 0 的消息会被跳过
+ */
+int frame_reader_next(struct frame_reader *reader, char **msg, size_t *len);
+/**
+ * 丢弃 frame_reader_next 刚报告过长的那条消息，返回其内容长度
+ * 消息内容不会被缓存：已读入的部分直接丢掉，尚未到达的部分在之后的读取中跳过，
+ * 数据流从下一条消息的长度前缀处恢复同步
+ */
+size_t frame_reader_skip(struct frame_reader *reader);
+
+ssize_t send_frames(int sock, const struct frame_out *frames, size_t count);
 ssize_t send_msg(int sock, const char *buf, size_t len);
+// 用 v2 格式（varint 长度前缀）发送一条消息
+ssize_t send_msg_v2(int sock, const char *buf, size_t len);
 ssize_t recv_msg(int sock, char *buf, size_t max_len);
 
 #endif
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "config.h"
+#include "protocol.h"
+#include "presence.h"
+
+#define INITIAL_ENTRIES 8
+
+// 一个名字在本周期内的变化
+struct presence_entry
+{
+    char name[MAX_NAME_LEN];
+    uint32_t hash;
+    int joins;   // 进入次数减去离开次数
+    bool typing;
+};
+
+// 一个房间待发送的事件，按名字合并
+struct presence_batch
+{
+    struct room *room; // 持有房间的引用
+    struct presence_entry *entries;
+    size_t count;
+    size_t capacity;
+    // 按名字查找 entries 的开放寻址哈希表，大小为 capacity 的 2 倍，存放下标 + 1，0 表示空位
+    uint32_t *index;
+    struct presence_batch *next;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t pending;       // 有了待发送的事件
+    struct presence_batch *dirty; // 有待发送事件的房间
+    uint64_t deadline_ms;         // 本周期的第一个事件到达时确定的发送时刻（CLOCK_MONOTONIC）
+} presence;
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void presence_init()
+{
+    pthread_mutex_init(&presence.lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&presence.pending, &attr);
+    pthread_condattr_destroy(&attr);
+    presence.dirty = NULL;
+}
+
+// 把名字放入哈希表中的空位，调用者需持有 presence.lock
+static void index_insert_locked(struct presence_batch *batch, size_t entry)
+{
+    size_t mask = batch->capacity * 2 - 1;
+    size_t i = batch->entries[entry].hash & mask;
+    while (batch->index[i] != 0)
+    {
+        i = (i + 1) & mask;
+    }
+    batch->index[i] = (uint32_t)entry + 1;
+}
+
+// 项数组满时扩大一倍并重建哈希表，调用者需持有 presence.lock
+static bool grow_locked(struct presence_batch *batch)
+{
+    size_t capacity = batch->capacity == 0 ? INITIAL_ENTRIES : batch->capacity * 2;
+    struct presence_entry *entries = realloc(batch->entries, capacity * sizeof(struct presence_entry));
+    if (entries == NULL)
+    {
+        return false;
+    }
+    batch->entries = entries;
+    uint32_t *index = calloc(capacity * 2, sizeof(uint32_t));
+    if (index == NULL)
+    {
+        return false;
+    }
+    free(batch->index);
+    batch->index = index;
+    batch->capacity = capacity;
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        index_insert_locked(batch, i);
+    }
+    return true;
+}
+
+// 查找名字对应的项，不存在时添加，内存不足时返回 NULL，调用者需持有 presence.lock
+static struct presence_entry *find_entry_locked(struct presence_batch *batch, const char *name)
+{
+    uint32_t hash = room_name_hash(name);
+    if (batch->capacity > 0)
+    {
+        size_t mask = batch->capacity * 2 - 1;
+        for (size_t i = hash & mask; batch->index[i] != 0; i = (i + 1) & mask)
+        {
+            struct presence_entry *entry = &batch->entries[batch->index[i] - 1];
+            if (entry->hash == hash && strcmp(entry->name, name) == 0)
+            {
+                return entry;
+            }
+        }
+    }
+    if (batch->count == batch->capacity && !grow_locked(batch))
+    {
+        return NULL;
+    }
+
+    struct presence_entry *entry = &batch->entries[batch->count];
+    strncpy(entry->name, name, MAX_NAME_LEN - 1);
+    entry->name[MAX_NAME_LEN - 1] = '\0';
+    entry->hash = hash;
+    entry->joins = 0;
+    entry->typing = false;
+    index_insert_locked(batch, batch->count);
+    batch->count++;
+    return entry;
+}
+
+void presence_post(struct room *room, enum presence_event event, const char *name)
+{
+    pthread_mutex_lock(&presence.lock);
+    struct presence_batch *batch = room->presence;
+    if (batch == NULL)
+    {
+        batch = calloc(1, sizeof(struct presence_batch));
+        if (batch == NULL)
+        {
+            pthread_mutex_unlock(&presence.lock);
+            return;
+        }
+        batch->room = room_ref(room);
+        room->presence = batch;
+        if (presence.dirty == NULL)
+        {
+            // 本周期的第一个事件，到期后把所有房间的事件一起发出
+            presence.deadline_ms = now_ms() + config.presence_interval_ms;
+            pthread_cond_signal(&presence.pending);
+        }
+        batch->next = presence.dirty;
+        presence.dirty = batch;
+    }
+
+    struct presence_entry *entry = find_entry_locked(batch, name);
+    if (entry != NULL)
+    {
+        switch (event)
+        {
+        case PRESENCE_JOIN:
+            entry->joins++;
+            break;
+        case PRESENCE_LEAVE:
+            entry->joins--;
+            entry->typing = false;
+            break;
+        case PRESENCE_TYPING:
+            entry->typing = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&presence.lock);
+}
+
+// 在名字列表中记录一个名字，超过 PRESENCE_MAX_NAMES 的只计数
+static void add_name(struct proto_names *list, const char **names, const char *name)
+{
+    if (list->count < PRESENCE_MAX_NAMES)
+    {
+        names[list->count++] = name;
+    }
+    list->total++;
+}
+
+// 生成一个房间的摘要，没有需要通知的变化时返回 NULL
+static struct msgbuf *build_digest(struct presence_batch *batch)
+{
+    const char *names[PROTO_PRESENCE_LISTS][PRESENCE_MAX_NAMES];
+    struct proto_names lists[PROTO_PRESENCE_LISTS] = {0};
+    for (int i = 0; i < PROTO_PRESENCE_LISTS; i++)
+    {
+        lists[i].names = names[i];
+    }
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        struct presence_entry *entry = &batch->entries[i];
+        if (entry->joins > 0)
+        {
+            add_name(&lists[PROTO_PRESENCE_JOINED], names[PROTO_PRESENCE_JOINED], entry->name);
+        }
+        else if (entry->joins < 0)
+        {
+            add_name(&lists[PROTO_PRESENCE_LEFT], names[PROTO_PRESENCE_LEFT], entry->name);
+        }
+        if (entry->typing)
+        {
+            add_name(&lists[PROTO_PRESENCE_TYPING], names[PROTO_PRESENCE_TYPING], entry->name);
+        }
+    }
+    if (lists[PROTO_PRESENCE_JOINED].total == 0 && lists[PROTO_PRESENCE_LEFT].total == 0
+        && lists[PROTO_PRESENCE_TYPING].total == 0)
+    {
+        return NULL;
+    }
+
+    struct room *room = batch->room;
+    pthread_rwlock_rdlock(&room->lock);
+    size_t members = room->count;
+    pthread_rwlock_unlock(&room->lock);
+    return proto_presence(room->name, members, lists);
+}
+
+void presence_flush(void (*emit)(struct room *room, struct msgbuf *buf))
+{
+    // 取出所有待发送的房间，之后的事件进入下一个周期
+    pthread_mutex_lock(&presence.lock);
+    struct presence_batch *batch = presence.dirty;
+    presence.dirty = NULL;
+    for (struct presence_batch *b = batch; b != NULL; b = b->next)
+    {
+        b->room->presence = NULL;
+    }
+    pthread_mutex_unlock(&presence.lock);
+
+    while (batch != NULL)
+    {
+        struct presence_batch *next = batch->next;
+        struct msgbuf *digest = build_digest(batch);
+        if (digest != NULL)
+        {
+            emit(batch->room, digest);
+        }
+        room_unref(batch->room);
+        free(batch->entries);
+        free(batch->index);
+        free(batch);
+        batch = next;
+    }
+}
+
+int presence_timeout_ms()
+{
+    pthread_mutex_lock(&presence.lock);
+    int timeout = -1;
+    if (presence.dirty != NULL)
+    {
+        uint64_t now = now_ms();
+        timeout = presence.deadline_ms > now ? (int)(presence.deadline_ms - now) : 0;
+    }
+    pthread_mutex_unlock(&presence.lock);
+    return timeout;
+}
+
+void presence_wait()
+{
+    pthread_mutex_lock(&presence.lock);
+    while (presence.dirty == NULL)
+    {
+        pthread_cond_wait(&presence.pending, &presence.lock);
+    }
+    struct timespec deadline = {
+        .tv_sec = presence.deadline_ms / 1000,
+        .tv_nsec = (presence.deadline_ms % 1000) * 1000000,
+    };
+    while (now_ms() < presence.deadline_ms)
+    {
+        pthread_cond_timedwait(&presence.pending, &presence.lock, &deadline);
+    }
+    pthread_mutex_unlock(&presence.lock);
+}
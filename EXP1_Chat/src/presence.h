@@ -0,0 +1,43 @@
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <stdbool.h>
+#include "msgbuf.h"
+#include "room.h"
+
+/**
+ * 在线状态摘要
+ *
+ * 进出房间、正在输入等事件不再立即向房间广播一条提示，而是先记入房间的待发送事件，
+ * 每隔 config.presence_interval_ms 为每个有变化的房间生成一条 PROTO_PRESENCE 摘要，只包含成员列表的增减：
+ * 同一个名字在一个周期内的进入和离开相互抵消（断线后马上重连的用户不会出现在摘要中），
+ * 每个名字列表最多列出 PRESENCE_MAX_NAMES 个名字，其余只给出人数。
+ * 大量用户同时重连时，每个房间每个周期只广播一条摘要，代价与人数成正比，而不是每个事件都发给所有人。
+ */
+
+enum presence_event
+{
+    PRESENCE_JOIN,
+    PRESENCE_LEAVE,
+    PRESENCE_TYPING
+};
+
+void presence_init();
+/**
+ * 记录房间中的一个事件，可以在任何线程调用
+ * 有待发送的事件期间持有房间的引用，成员离开后房间被移除也不影响
+ */
+void presence_post(struct room *room, enum presence_event event, const char *name);
+/**
+ * 为每个有待发送事件的房间生成摘要，交给 emit 广播（emit 负责释放 buf 的引用）
+ * 调用者保证 emit 可以在当前线程使用
+ */
+void presence_flush(void (*emit)(struct room *room, struct msgbuf *buf));
+/**
+ * 距离下一次应调用 presence_flush 的毫秒数，没有待发送的事件时返回 -1，可以直接作为 epoll_wait 的超时
+ */
+int presence_timeout_ms();
+// 阻塞到下一次应调用 presence_flush 的时刻，用于单独的摘要线程
+void presence_wait();
+
+#endif // PRESENCE_H
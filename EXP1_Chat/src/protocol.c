@@ -0,0 +1,479 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "protocol.h"
+
+static void put_u32(char *p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p[i] = (char)(value >> (8 * i));
+    }
+}
+
+static void put_u64(char *p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        p[i] = (char)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const char *p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= (uint32_t)(unsigned char)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const char *p)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        value |= (uint64_t)(unsigned char)p[i] << (8 * i);
+    }
+    return value;
+}
+
+// 读取 varint 长度加上该长度的字符串
+static bool get_string(const char **p, const char *end, const char **str, size_t *len)
+{
+    uint64_t n;
+    if (!varint_decode(p, end, &n) || n > (uint64_t)(end - *p))
+    {
+        return false;
+    }
+    *str = *p;
+    *len = n;
+    *p += n;
+    return true;
+}
+
+bool proto_is_hello(const char *msg, size_t len)
+{
+    return len == PROTO_HELLO_LEN && memcmp(msg, PROTO_HELLO, PROTO_HELLO_LEN) == 0;
+}
+
+bool proto_decode(const char *body, size_t len, struct proto_frame *frame)
+{
+    if (len == 0)
+    {
+        return false;
+    }
+    memset(frame, 0, sizeof(*frame));
+    frame->type = (uint8_t)body[0];
+    const char *p = body + 1;
+    const char *end = body + len;
+
+    switch (frame->type)
+    {
+    case PROTO_TEXT:
+    case PROTO_NAME:
+    case PROTO_LEAVE:
+    case PROTO_TYPING:
+        break;
+    case PROTO_CHAT:
+        if (end - p < 20)
+        {
+            return false;
+        }
+        frame->sender = get_u32(p);
+        frame->seq = get_u64(p + 4);
+        frame->timestamp_us = get_u64(p + 12);
+        p += 20;
+        if (!get_string(&p, end, &frame->name, &frame->name_len) || !get_string(&p, end, &frame->room, &frame->room_len))
+        {
+            return false;
+        }
+        break;
+    case PROTO_JOIN:
+    case PROTO_PING:
+    case PROTO_PONG:
+        if (end - p < 8)
+        {
+            return false;
+        }
+        frame->seq = get_u64(p);
+        p += 8;
+        break;
+    case PROTO_SUBSCRIBE:
+    case PROTO_UNSUBSCRIBE:
+    case PROTO_COMPRESSION:
+        break;
+    case PROTO_DEFLATE:
+        if (!varint_decode(&p, end, &frame->count))
+        {
+            return false;
+        }
+        break;
+    case PROTO_LINK_HELLO:
+        if (end - p < 4)
+        {
+            return false;
+        }
+        frame->sender = get_u32(p);
+        p += 4;
+        break;
+    case PROTO_FORWARD:
+        if (end - p < 12)
+        {
+            return false;
+        }
+        frame->sender = get_u32(p);
+        frame->seq = get_u64(p + 4);
+        p += 12;
+        break;
+    case PROTO_BATCH:
+        if (!varint_decode(&p, end, &frame->count))
+        {
+            return false;
+        }
+        break;
+    case PROTO_PRESENCE:
+        if (!get_string(&p, end, &frame->room, &frame->room_len) || !varint_decode(&p, end, &frame->count))
+        {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+    frame->text = p;
+    frame->text_len = end - p;
+    return true;
+}
+
+bool proto_batch_next(const char **p, const char *end, const char **body, size_t *len)
+{
+    return get_string(p, end, body, len);
+}
+
+// 类型之后是否有 u64 的序号或令牌字段
+static bool has_seq(uint8_t type)
+{
+    return type == PROTO_JOIN || type == PROTO_PING || type == PROTO_PONG;
+}
+
+size_t proto_encode(char *out, uint8_t type, uint64_t seq, const char *text, size_t len)
+{
+    size_t n = 0;
+    out[n++] = (char)type;
+    if (has_seq(type))
+    {
+        put_u64(out + n, seq);
+        n += 8;
+    }
+    if (len > 0)
+    {
+        memcpy(out + n, text, len);
+        n += len;
+    }
+    return n;
+}
+
+struct msgbuf *proto_message(uint8_t type, uint64_t seq, const char *text, size_t len)
+{
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, 1 + (has_seq(type) ? 8 : 0) + len);
+    if (buf != NULL)
+    {
+        proto_encode(msgbuf_data(buf), type, seq, text, len);
+    }
+    return buf;
+}
+
+struct msgbuf *proto_chat(uint32_t sender, const char *name, const char *room, const char *text, size_t len)
+{
+    size_t name_len = strlen(name);
+    size_t room_len = strlen(room);
+    char name_header[VARINT_MAX_LEN];
+    char room_header[VARINT_MAX_LEN];
+    size_t name_header_len = varint_encode(name_len, name_header);
+    size_t room_header_len = varint_encode(room_len, room_header);
+
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, 21 + name_header_len + name_len + room_header_len + room_len + len);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    char *p = msgbuf_data(buf);
+    *p++ = PROTO_CHAT;
+    put_u32(p, sender);
+    put_u64(p + 4, 0);
+    put_u64(p + 12, (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+    p += 20;
+    memcpy(p, name_header, name_header_len);
+    p += name_header_len;
+    memcpy(p, name, name_len);
+    p += name_len;
+    memcpy(p, room_header, room_header_len);
+    p += room_header_len;
+    memcpy(p, room, room_len);
+    p += room_len;
+    memcpy(p, text, len);
+    return buf;
+}
+
+void proto_set_seq(struct msgbuf *buf, uint64_t seq)
+{
+    if (buf->version == PACKET_V2 && buf->len > PROTO_CHAT_SEQ_OFFSET + 8 && msgbuf_payload(buf)[0] == PROTO_CHAT)
+    {
+        put_u64(msgbuf_data(buf) + PROTO_CHAT_SEQ_OFFSET, seq);
+    }
+}
+
+// v2 帧转为 v1 文本：聊天消息按 v1 的格式 "[用户名] 内容\n" 显示
+static struct msgbuf *to_v1(const struct msgbuf *buf)
+{
+    struct proto_frame frame;
+    if (!proto_decode(msgbuf_payload(buf), buf->len, &frame))
+    {
+        return NULL;
+    }
+    if (frame.type == PROTO_CHAT)
+    {
+        return msgbuf_printf(frame.text_len + frame.name_len + 4, "[%.*s] %.*s\n", (int)frame.name_len, frame.name,
+                             (int)frame.text_len, frame.text);
+    }
+    if (frame.type == PROTO_TEXT)
+    {
+        return msgbuf_create(frame.text, frame.text_len);
+    }
+    if (frame.type == PROTO_PRESENCE)
+    {
+        // v1 客户端只显示进出房间，只有正在输入的摘要不发给它们
+        char text[PROTO_PRESENCE_TEXT_LEN];
+        size_t len = proto_presence_text(&frame, false, text);
+        return len > 0 ? msgbuf_create(text, len) : NULL;
+    }
+    return NULL;
+}
+
+// v1 文本转为 v2 的 TEXT 帧
+static struct msgbuf *to_v2(const struct msgbuf *buf)
+{
+    return proto_message(PROTO_TEXT, 0, msgbuf_payload(buf), buf->len);
+}
+
+struct msgbuf *proto_encoding(struct msgbuf *buf, int version)
+{
+    if (buf->version == version)
+    {
+        return buf;
+    }
+    struct msgbuf *alt = atomic_load_explicit(&buf->alt, memory_order_acquire);
+    if (alt != NULL)
+    {
+        return alt;
+    }
+
+    struct msgbuf *converted = version == PACKET_V1 ? to_v1(buf) : to_v2(buf);
+    if (converted == NULL)
+    {
+        return NULL;
+    }
+    // 多个线程同时转换时只保留先完成的一个
+    struct msgbuf *expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(&buf->alt, &expected, converted, memory_order_acq_rel,
+                                                 memory_order_acquire))
+    {
+        msgbuf_unref(converted);
+        return expected;
+    }
+    return converted;
+}
+
+struct msgbuf *proto_batch(struct msgbuf *const *bufs, size_t count)
+{
+    struct msgbuf **items = malloc((count > 0 ? count : 1) * sizeof(struct msgbuf *));
+    if (items == NULL)
+    {
+        return NULL;
+    }
+    char count_header[VARINT_MAX_LEN];
+    size_t total = 1 + varint_encode(count, count_header);
+    for (size_t i = 0; i < count; i++)
+    {
+        items[i] = proto_encoding(bufs[i], PACKET_V2);
+        if (items[i] == NULL)
+        {
+            free(items);
+            return NULL;
+        }
+        // 每条消息的 v2 帧本身就是 [varint 长度] + [内容]，直接拼接
+        total += msgbuf_frame_len(items[i]);
+    }
+
+    struct msgbuf *batch = msgbuf_alloc(PACKET_V2, total);
+    if (batch == NULL)
+    {
+        free(items);
+        return NULL;
+    }
+    char *p = msgbuf_data(batch);
+    *p++ = PROTO_BATCH;
+    p += varint_encode(count, p);
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(p, items[i]->frame, msgbuf_frame_len(items[i]));
+        p += msgbuf_frame_len(items[i]);
+    }
+    free(items);
+    return batch;
+}
+
+// varint 编码 value 占用的字节数
+static size_t varint_size(uint64_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+struct msgbuf *proto_presence(const char *room, uint64_t members, const struct proto_names lists[PROTO_PRESENCE_LISTS])
+{
+    size_t room_len = strlen(room);
+    size_t total = 1 + varint_size(room_len) + room_len + varint_size(members);
+    for (int i = 0; i < PROTO_PRESENCE_LISTS; i++)
+    {
+        total += varint_size(lists[i].total) + varint_size(lists[i].count);
+        for (size_t j = 0; j < lists[i].count; j++)
+        {
+            size_t len = strlen(lists[i].names[j]);
+            total += varint_size(len) + len;
+        }
+    }
+
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, total);
+    if (buf == NULL)
+    {
+        return NULL;
+    }
+    char *p = msgbuf_data(buf);
+    *p++ = PROTO_PRESENCE;
+    p += varint_encode(room_len, p);
+    memcpy(p, room, room_len);
+    p += room_len;
+    p += varint_encode(members, p);
+    for (int i = 0; i < PROTO_PRESENCE_LISTS; i++)
+    {
+        p += varint_encode(lists[i].total, p);
+        p += varint_encode(lists[i].count, p);
+        for (size_t j = 0; j < lists[i].count; j++)
+        {
+            size_t len = strlen(lists[i].names[j]);
+            p += varint_encode(len, p);
+            memcpy(p, lists[i].names[j], len);
+            p += len;
+        }
+    }
+    return buf;
+}
+
+// 在 out 的 *len 处追加格式化的文本，超出 size 时截断
+static void append_text(char *out, size_t size, size_t *len, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+static void append_text(char *out, size_t size, size_t *len, const char *format, ...)
+{
+    if (*len + 1 >= size)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out + *len, size - *len, format, args);
+    va_end(args);
+    if (n > 0)
+    {
+        *len += (size_t)n < size - *len ? (size_t)n : size - *len - 1;
+    }
+}
+
+size_t proto_presence_text(const struct proto_frame *frame, bool typing, char *out)
+{
+    static const char *const formats[PROTO_PRESENCE_LISTS] = {
+        "进入房间 %.*s", "离开房间 %.*s", "正在输入……",
+    };
+    const char *p = frame->text;
+    const char *end = frame->text + frame->text_len;
+    size_t len = 0;
+    for (int i = 0; i < PROTO_PRESENCE_LISTS; i++)
+    {
+        uint64_t total;
+        uint64_t count;
+        if (!varint_decode(&p, end, &total) || !varint_decode(&p, end, &count))
+        {
+            break;
+        }
+        bool show = total > 0 && (typing || i != PROTO_PRESENCE_TYPING);
+        if (show)
+        {
+            append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, "用户 ");
+        }
+        for (uint64_t j = 0; j < count; j++)
+        {
+            const char *name;
+            size_t name_len;
+            if (!get_string(&p, end, &name, &name_len))
+            {
+                return len;
+            }
+            if (show)
+            {
+                append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, "%s%.*s", j > 0 ? "、" : "", (int)name_len, name);
+            }
+        }
+        if (show)
+        {
+            if (total > count)
+            {
+                append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, " 等 %llu 人", (unsigned long long)total);
+            }
+            else
+            {
+                append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, " ");
+            }
+            append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, formats[i], (int)frame->room_len, frame->room);
+            append_text(out, PROTO_PRESENCE_TEXT_LEN, &len, "\n");
+        }
+    }
+    return len;
+}
+
+struct msgbuf *proto_link_hello(uint32_t node)
+{
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, 5);
+    if (buf != NULL)
+    {
+        char *p = msgbuf_data(buf);
+        p[0] = PROTO_LINK_HELLO;
+        put_u32(p + 1, node);
+    }
+    return buf;
+}
+
+struct msgbuf *proto_forward(uint32_t origin, uint64_t seq, const struct msgbuf *chat)
+{
+    struct msgbuf *buf = msgbuf_alloc(PACKET_V2, PROTO_FORWARD_OVERHEAD + chat->len);
+    if (buf != NULL)
+    {
+        char *p = msgbuf_data(buf);
+        p[0] = PROTO_FORWARD;
+        put_u32(p + 1, origin);
+        put_u64(p + 5, seq);
+        memcpy(p + PROTO_FORWARD_OVERHEAD, msgbuf_payload(chat), chat->len);
+    }
+    return buf;
+}
@@ -0,0 +1,171 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "packet.h"
+#include "msgbuf.h"
+
+/**
+ * 协议 v2
+ *
+ * v1 的每帧是一段 UTF-8 文本，名字、进出房间等控制信息都靠服务端根据会话状态推断，
+ * 聊天消息由服务端格式化成 "[用户名] 内容\n" 再发给每个人。
+ * v2 的帧为 [varint 长度] + [1 字节类型] + [字段]，定长整数为小端序：
+ *   PROTO_TEXT   其余字节为文本：服务端的提示和通知，客户端发送的聊天内容或命令
+ *   PROTO_CHAT   聊天消息：发送者编号 u32，房间内序号 u64，时间 u64（UNIX 微秒），
+ *                varint 名字长度 + 名字，varint 房间名长度 + 房间名，其余字节为消息内容
+ *   PROTO_NAME   设置名字，其余字节为名字；服务端接受名字后也用它回复最终的名字
+ *   PROTO_JOIN   进入房间：起始序号 u64（只补发之后的历史），其余字节为房间名
+ *   PROTO_LEAVE  回到大厅，没有字段
+ *   PROTO_BATCH  varint 条数，之后每条为 [varint 长度] + [类型和字段]，用于一次补发多条历史消息
+ *   PROTO_PRESENCE 在线状态摘要：varint 房间名长度 + 房间名，varint 房间当前人数，
+ *                之后依次为进入、离开、正在输入三个名字列表，每个列表为 varint 总人数、varint 列出的人数，
+ *                再跟列出的名字（varint 长度 + 名字）
+ *   PROTO_TYPING 客户端通知服务端用户正在输入，没有字段
+ *   PROTO_PING   心跳请求：令牌 u64（发送方的时间），收到后用 PROTO_PONG 原样回复令牌（见 heartbeat.h）
+ *   PROTO_PONG   心跳应答：令牌 u64
+ *   PROTO_COMPRESSION 客户端请求接收压缩帧，其余字节为算法编号；服务端支持时原样回复（见 compress.h）
+ *   PROTO_DEFLATE 压缩帧：varint 原帧内容长度，其余字节为原帧内容（类型和字段）的压缩数据
+ * 以下类型只用于服务端节点之间的连接（见 federation.h）：
+ *   PROTO_LINK_HELLO  节点握手：节点编号 u32
+ *   PROTO_SUBSCRIBE   订阅房间（本节点有成员），其余字节为房间名
+ *   PROTO_UNSUBSCRIBE 取消订阅，其余字节为房间名
+ *   PROTO_FORWARD     转发聊天消息：来源节点 u32，来源节点的序号 u64，其余字节为 PROTO_CHAT 消息
+ * 服务端转发聊天消息时不再格式化文本，由客户端按字段显示。
+ *
+ * 协商：客户端连接后先用 v1 帧发送 PROTO_HELLO（以 '\0' 开头，不会是合法的名字），
+ * 支持 v2 的服务端用 v1 帧回复同样的内容，之后双方都使用 v2 帧；
+ * 旧服务端会当作空名字回复错误提示，客户端继续使用 v1。不发送 PROTO_HELLO 的旧客户端不受影响。
+ * 一个房间中可以同时有两种协议的成员，消息在放入发送队列时转换为接收者的格式（见 proto_encoding）。
+ */
+
+#define PROTO_HELLO "\0CHAT/2"
+#define PROTO_HELLO_LEN 7
+
+enum proto_type
+{
+    PROTO_TEXT = 1,
+    PROTO_CHAT = 2,
+    PROTO_NAME = 3,
+    PROTO_JOIN = 4,
+    PROTO_LEAVE = 5,
+    PROTO_BATCH = 6,
+    PROTO_PRESENCE = 7,
+    PROTO_TYPING = 8,
+    PROTO_LINK_HELLO = 9,
+    PROTO_SUBSCRIBE = 10,
+    PROTO_UNSUBSCRIBE = 11,
+    PROTO_FORWARD = 12,
+    PROTO_PING = 13,
+    PROTO_PONG = 14,
+    PROTO_COMPRESSION = 15,
+    PROTO_DEFLATE = 16
+};
+
+// PROTO_PRESENCE 中名字列表的顺序
+enum proto_presence_list
+{
+    PROTO_PRESENCE_JOINED,
+    PROTO_PRESENCE_LEFT,
+    PROTO_PRESENCE_TYPING,
+    PROTO_PRESENCE_LISTS
+};
+
+// PROTO_CHAT 中序号字段的偏移（从类型字节开始算）
+#define PROTO_CHAT_SEQ_OFFSET 5
+// proto_encode 生成的帧内容比文本多出的最大字节数
+#define PROTO_MAX_OVERHEAD 16
+// 聊天消息比消息内容多出的最大字节数（定长字段、名字和房间名）
+#define PROTO_CHAT_OVERHEAD (21 + 2 * VARINT_MAX_LEN + MAX_NAME_LEN + MAX_ROOM_NAME_LEN)
+
+// PROTO_FORWARD 比其中的聊天消息多出的字节数
+#define PROTO_FORWARD_OVERHEAD 13
+// PROTO_PRESENCE 摘要转为文本的最大长度
+#define PROTO_PRESENCE_TEXT_LEN (PROTO_PRESENCE_LISTS * (PRESENCE_MAX_NAMES * (MAX_NAME_LEN + 3) + MAX_ROOM_NAME_LEN + 64))
+
+/**
+ * 解码后的一帧，指针指向原缓冲区
+ * text 对 TEXT、NAME 为文本，对 CHAT 为消息内容，对 JOIN、SUBSCRIBE、UNSUBSCRIBE 为房间名，
+ * 对 BATCH 为各条消息的起始位置，对 PRESENCE 为名字列表的起始位置，对 FORWARD 为其中的聊天消息，
+ * 对 COMPRESSION 为算法编号，对 DEFLATE 为压缩数据
+ */
+struct proto_frame
+{
+    uint8_t type;
+    uint32_t sender;       // CHAT 的发送者，LINK_HELLO 的节点编号，FORWARD 的来源节点
+    uint64_t seq;          // CHAT 的序号，JOIN 的起始序号，FORWARD 的来源节点序号，PING、PONG 的令牌
+    uint64_t timestamp_us;
+    uint64_t count;        // BATCH 的条数，PRESENCE 的房间人数，DEFLATE 的原帧内容长度
+    const char *name;
+    size_t name_len;
+    const char *room;
+    size_t room_len;
+    const char *text;
+    size_t text_len;
+};
+
+// 判断一条 v1 消息是否为协商请求（或应答）
+bool proto_is_hello(const char *msg, size_t len);
+/**
+ * 解码一帧的内容（不含长度前缀），格式错误时返回 false
+ */
+bool proto_decode(const char *body, size_t len, struct proto_frame *frame);
+/**
+ * 依次取出 BATCH 中的各条消息：*p 初始为 frame.text，end 为 frame.text + frame.text_len
+ * 成功时 *body、*len 为一条消息的内容并前移 *p
+ */
+bool proto_batch_next(const char **p, const char *end, const char **body, size_t *len);
+
+/**
+ * 客户端编码一帧（TEXT、NAME、JOIN、LEAVE、TYPING、PING、PONG、COMPRESSION），out 至少要有 len + PROTO_MAX_OVERHEAD 字节
+ * 返回帧内容的长度（不含长度前缀）
+ */
+size_t proto_encode(char *out, uint8_t type, uint64_t seq, const char *text, size_t len);
+
+// 创建一个只有文本字段的 v2 帧（TEXT、NAME、JOIN、LEAVE、PING、PONG、COMPRESSION）
+struct msgbuf *proto_message(uint8_t type, uint64_t seq, const char *text, size_t len);
+/**
+ * 服务端创建一条 v2 聊天消息，序号在记入房间历史时由 proto_set_seq 填写
+ */
+struct msgbuf *proto_chat(uint32_t sender, const char *name, const char *room, const char *text, size_t len);
+/**
+ * 填写聊天消息的序号，只能在消息被共享之前（记入历史、广播之前）调用，其他消息不受影响
+ */
+void proto_set_seq(struct msgbuf *buf, uint64_t seq);
+/**
+ * 取得 buf 的 version 格式：格式相同时返回 buf 本身，否则返回（必要时创建）转换结果
+ * 返回的指针不增加引用，在 buf 释放前有效；无法转换时返回 NULL
+ */
+struct msgbuf *proto_encoding(struct msgbuf *buf, int version);
+/**
+ * 把多条消息（任意格式）打包为一个 v2 BATCH 帧
+ */
+struct msgbuf *proto_batch(struct msgbuf *const *bufs, size_t count);
+
+/**
+ * PROTO_PRESENCE 中的一个名字列表：共 total 人，只列出 names 中的前 count 个
+ */
+struct proto_names
+{
+    uint64_t total;
+    size_t count;
+    const char *const *names;
+};
+
+// 创建在线状态摘要，lists 按 enum proto_presence_list 的顺序
+struct msgbuf *proto_presence(const char *room, uint64_t members, const struct proto_names lists[PROTO_PRESENCE_LISTS]);
+/**
+ * 把解码后的在线状态摘要转为显示的文本（每个非空列表一行），typing 为 false 时不包含正在输入的列表
+ * 返回文本长度，out 至少要有 PROTO_PRESENCE_TEXT_LEN 字节
+ */
+size_t proto_presence_text(const struct proto_frame *frame, bool typing, char *out);
+
+// 创建节点握手消息
+struct msgbuf *proto_link_hello(uint32_t node);
+// 把一条 v2 聊天消息包装为转发给其他节点的 PROTO_FORWARD
+struct msgbuf *proto_forward(uint32_t origin, uint64_t seq, const struct msgbuf *chat);
+
+#endif // PROTOCOL_H
@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "protocol.h"
+#include "stats.h"
+#include "room.h"
+
+#define INITIAL_BUCKETS 64
+#define INITIAL_MEMBERS 8
+
+uint32_t room_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p != '\0'; p++)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void room_registry_init(struct room_registry *registry)
+{
+    pthread_mutex_init(&registry->lock, NULL);
+    registry->bucket_count = INITIAL_BUCKETS;
+    registry->buckets = calloc(registry->bucket_count, sizeof(struct room *));
+    registry->room_count = 0;
+    registry->on_change = NULL;
+}
+
+bool room_name_valid(const char *name)
+{
+    size_t len = strnlen(name, MAX_ROOM_NAME_LEN);
+    if (len == 0 || len >= MAX_ROOM_NAME_LEN)
+    {
+        return false;
+    }
+    // 不允许空白字符，/join 命令中房间名后面可以跟序号
+    for (size_t i = 0; i < len; i++)
+    {
+        if (isspace((unsigned char)name[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool room_parse_seq(const char *str, uint64_t *seq)
+{
+    while (*str == ' ')
+    {
+        str++;
+    }
+    *seq = 0;
+    if (*str == '\0')
+    {
+        return true;
+    }
+    char *end;
+    *seq = strtoull(str, &end, 10);
+    return end != str && *end == '\0';
+}
+
+bool room_parse_args(const char *args, char *name, uint64_t *since)
+{
+    while (*args == ' ')
+    {
+        args++;
+    }
+    size_t name_len = strcspn(args, " ");
+    if (name_len > 0)
+    {
+        if (name_len >= MAX_ROOM_NAME_LEN)
+        {
+            return false;
+        }
+        memcpy(name, args, name_len);
+        name[name_len] = '\0';
+        if (!room_name_valid(name))
+        {
+            return false;
+        }
+    }
+
+    return room_parse_seq(args + name_len, since);
+}
+
+struct msgbuf *room_replay_notice(const struct room_replay *replay, uint64_t since)
+{
+    if (replay->count > 0)
+    {
+        return msgbuf_printf(MAX_PROMPT_LEN, "—— 以上是 %zu 条历史消息（序号 %llu-%llu）%s——\n",
+                             replay->count, (unsigned long long)replay->first_seq,
+                             (unsigned long long)replay->last_seq,
+                             replay->truncated ? "，更早的消息已不在历史中" : "");
+    }
+    if (since > 0)
+    {
+        return msgbuf_printf(MAX_PROMPT_LEN, "没有序号 %llu 之后的新消息（最新序号 %llu）\n",
+                             (unsigned long long)since, (unsigned long long)replay->last_seq);
+    }
+    return NULL;
+}
+
+struct room *room_ref(struct room *room)
+{
+    atomic_fetch_add_explicit(&room->refs, 1, memory_order_relaxed);
+    return room;
+}
+
+void room_unref(struct room *room)
+{
+    if (atomic_fetch_sub_explicit(&room->refs, 1, memory_order_acq_rel) == 1)
+    {
+        for (size_t i = 0; i < room->history_count; i++)
+        {
+            msgbuf_unref(room->history[(room->history_head + i) % config.history_size]);
+        }
+        free(room->history);
+        pthread_mutex_destroy(&room->history_lock);
+        pthread_rwlock_destroy(&room->lock);
+        free(room->queues);
+        free(room->members);
+        free(room);
+    }
+}
+
+// 查找房间，调用者需持有 registry->lock
+static struct room *find_locked(struct room_registry *registry, const char *name, uint32_t hash)
+{
+    struct room *room = registry->buckets[hash & (registry->bucket_count - 1)];
+    while (room != NULL && (room->hash != hash || strcmp(room->name, name) != 0))
+    {
+        room = room->next;
+    }
+    return room;
+}
+
+// 房间数超过桶数时把桶数翻倍，调用者需持有 registry->lock
+static void grow_buckets_locked(struct room_registry *registry)
+{
+    size_t new_count = registry->bucket_count * 2;
+    struct room **new_buckets = calloc(new_count, sizeof(struct room *));
+    if (new_buckets == NULL)
+    {
+        // 扩容失败只会让链表变长，不影响正确性
+        return;
+    }
+    for (size_t i = 0; i < registry->bucket_count; i++)
+    {
+        struct room *room = registry->buckets[i];
+        while (room != NULL)
+        {
+            struct room *next = room->next;
+            size_t bucket = room->hash & (new_count - 1);
+            room->next = new_buckets[bucket];
+            new_buckets[bucket] = room;
+            room = next;
+        }
+    }
+    free(registry->buckets);
+    registry->buckets = new_buckets;
+    registry->bucket_count = new_count;
+}
+
+// 创建房间并加入房间表，调用者需持有 registry->lock
+static struct room *create_locked(struct room_registry *registry, const char *name, uint32_t hash)
+{
+    struct room *room = calloc(1, sizeof(struct room));
+    if (room == NULL)
+    {
+        return NULL;
+    }
+    strncpy(room->name, name, MAX_ROOM_NAME_LEN - 1);
+    room->hash = hash;
+    // 房间表持有一个引用
+    atomic_init(&room->refs, 1);
+    pthread_rwlock_init(&room->lock, NULL);
+    pthread_mutex_init(&room->history_lock, NULL);
+    if (config.history_size > 0)
+    {
+        room->history = calloc(config.history_size, sizeof(struct msgbuf *));
+        if (room->history == NULL)
+        {
+            pthread_mutex_destroy(&room->history_lock);
+            pthread_rwlock_destroy(&room->lock);
+            free(room);
+            return NULL;
+        }
+    }
+
+    if (registry->room_count >= registry->bucket_count)
+    {
+        grow_buckets_locked(registry);
+    }
+    size_t bucket = hash & (registry->bucket_count - 1);
+    room->next = registry->buckets[bucket];
+    registry->buckets[bucket] = room;
+    registry->room_count++;
+    if (registry->on_change != NULL)
+    {
+        registry->on_change(room->name, true);
+    }
+    return room;
+}
+
+// 把房间从房间表中移除并释放房间表的引用，调用者需持有 registry->lock
+static void remove_locked(struct room_registry *registry, struct room *room)
+{
+    struct room **link = &registry->buckets[room->hash & (registry->bucket_count - 1)];
+    while (*link != room)
+    {
+        link = &(*link)->next;
+    }
+    *link = room->next;
+    registry->room_count--;
+    if (registry->on_change != NULL)
+    {
+        registry->on_change(room->name, false);
+    }
+    room_unref(room);
+}
+
+// 丢弃最旧的一条历史消息，调用者需持有 history_lock
+static void drop_oldest_locked(struct room *room)
+{
+    struct msgbuf *oldest = room->history[room->history_head];
+    room->history_bytes -= msgbuf_frame_len(oldest);
+    msgbuf_unref(oldest);
+    room->history_head = (room->history_head + 1) % config.history_size;
+    room->history_count--;
+}
+
+uint64_t room_record(struct room *room, struct msgbuf *buf)
+{
+    pthread_mutex_lock(&room->history_lock);
+    uint64_t seq = ++room->last_seq;
+    // 此时消息还没有发给任何人，可以把序号写进 v2 聊天消息
+    proto_set_seq(buf, seq);
+    if (config.history_size > 0)
+    {
+        if (room->history_count == config.history_size)
+        {
+            drop_oldest_locked(room);
+        }
+        room->history[(room->history_head + room->history_count) % config.history_size] = msgbuf_ref(buf);
+        room->history_count++;
+        room->history_bytes += msgbuf_frame_len(buf);
+        while (room->history_bytes > ROOM_HISTORY_MAX_BYTES && room->history_count > 1)
+        {
+            drop_oldest_locked(room);
+        }
+    }
+    pthread_mutex_unlock(&room->history_lock);
+    return seq;
+}
+
+// 把 bufs 中的消息打包为一个 BATCH 帧放入队列（只有一条时直接放入）
+static bool push_batch(struct send_queue *queue, struct msgbuf **bufs, size_t count)
+{
+    if (count == 1)
+    {
+        return send_queue_push(queue, bufs[0]);
+    }
+    struct msgbuf *batch = proto_batch(bufs, count);
+    if (batch == NULL)
+    {
+        return false;
+    }
+    bool need_wake = send_queue_push(queue, batch);
+    msgbuf_unref(batch);
+    return need_wake;
+}
+
+// v2 成员的历史消息打包为 BATCH 帧补发，每个 BATCH 不超过消息长度上限，调用者需持有 history_lock
+static bool push_batched_locked(struct room *room, struct send_queue *queue, size_t skip, size_t count)
+{
+    struct msgbuf **bufs = malloc(count * sizeof(struct msgbuf *));
+    if (bufs == NULL)
+    {
+        return false;
+    }
+    bool need_wake = false;
+    size_t n = 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        struct msgbuf *buf = room->history[(room->history_head + skip + i) % config.history_size];
+        struct msgbuf *encoded = proto_encoding(buf, PACKET_V2);
+        size_t len = encoded != NULL ? msgbuf_frame_len(encoded) : 0;
+        if (n > 0 && bytes + len + PROTO_MAX_OVERHEAD > config.max_message_size)
+        {
+            need_wake |= push_batch(queue, bufs, n);
+            n = 0;
+            bytes = 0;
+        }
+        bufs[n++] = buf;
+        bytes += len;
+    }
+    if (n > 0)
+    {
+        need_wake |= push_batch(queue, bufs, n);
+    }
+    free(bufs);
+    return need_wake;
+}
+
+// 把序号大于 since 的历史消息放入成员的发送队列
+static void replay_history(struct room *room, struct room_member *member, uint64_t since, struct room_replay *replay)
+{
+    bool need_wake = false;
+    pthread_mutex_lock(&room->history_lock);
+    // 历史中最旧一条的序号
+    uint64_t oldest = room->last_seq - room->history_count + 1;
+    uint64_t first = since + 1 > oldest ? since + 1 : oldest;
+    size_t count = first <= room->last_seq ? (size_t)(room->last_seq - first + 1) : 0;
+    size_t skip = room->history_count - count;
+    if (member->queue->version == PACKET_V2 && count > 1)
+    {
+        need_wake = push_batched_locked(room, member->queue, skip, count);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            need_wake |= send_queue_push(member->queue,
+                                         room->history[(room->history_head + skip + i) % config.history_size]);
+        }
+    }
+    member->since = room->last_seq;
+
+    replay->count = count;
+    replay->first_seq = first;
+    replay->last_seq = room->last_seq;
+    replay->truncated = since > 0 && since + 1 < oldest;
+    pthread_mutex_unlock(&room->history_lock);
+
+    if (need_wake)
+    {
+        send_flusher_wake();
+    }
+}
+
+void room_replay_history(struct room *room, struct room_member *member, uint64_t since, struct room_replay *replay)
+{
+    // 持有写锁，补发期间不会插入新的实时消息
+    pthread_rwlock_wrlock(&room->lock);
+    replay_history(room, member, since, replay);
+    pthread_rwlock_unlock(&room->lock);
+}
+
+struct room *room_join(struct room_registry *registry, const char *name, struct room_member *member,
+                       uint64_t since, struct room_replay *replay)
+{
+    uint32_t hash = room_name_hash(name);
+    pthread_mutex_lock(&registry->lock);
+    struct room *room = find_locked(registry, name, hash);
+    if (room == NULL)
+    {
+        room = create_locked(registry, name, hash);
+        if (room == NULL)
+        {
+            pthread_mutex_unlock(&registry->lock);
+            return NULL;
+        }
+    }
+
+    pthread_rwlock_wrlock(&room->lock);
+    if (room->count == room->capacity)
+    {
+        size_t new_capacity = room->capacity == 0 ? INITIAL_MEMBERS : room->capacity * 2;
+        struct send_queue **new_queues = realloc(room->queues, new_capacity * sizeof(struct send_queue *));
+        if (new_queues != NULL)
+        {
+            room->queues = new_queues;
+        }
+        struct room_member **new_members = realloc(room->members, new_capacity * sizeof(struct room_member *));
+        if (new_members != NULL)
+        {
+            room->members = new_members;
+        }
+        if (new_queues == NULL || new_members == NULL)
+        {
+            bool empty = room->count == 0;
+            pthread_rwlock_unlock(&room->lock);
+            if (empty && strcmp(room->name, DEFAULT_ROOM) != 0)
+            {
+                remove_locked(registry, room);
+            }
+            pthread_mutex_unlock(&registry->lock);
+            return NULL;
+        }
+        room->capacity = new_capacity;
+    }
+    member->index = room->count;
+    room->queues[room->count] = member->queue;
+    room->members[room->count] = member;
+    room->count++;
+    room->shard_members[member->shard]++;
+    replay_history(room, member, since, replay);
+    pthread_rwlock_unlock(&room->lock);
+
+    pthread_mutex_unlock(&registry->lock);
+    return room;
+}
+
+struct room *room_find(struct room_registry *registry, const char *name)
+{
+    uint32_t hash = room_name_hash(name);
+    pthread_mutex_lock(&registry->lock);
+    struct room *room = find_locked(registry, name, hash);
+    if (room != NULL)
+    {
+        room_ref(room);
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return room;
+}
+
+void room_leave(struct room_registry *registry, struct room *room, struct room_member *member)
+{
+    pthread_mutex_lock(&registry->lock);
+
+    pthread_rwlock_wrlock(&room->lock);
+    // 用最后一个成员填补空位，保持数组紧凑
+    size_t last = room->count - 1;
+    if (member->index != last)
+    {
+        room->queues[member->index] = room->queues[last];
+        room->members[member->index] = room->members[last];
+        room->members[member->index]->index = member->index;
+    }
+    room->count--;
+    room->shard_members[member->shard]--;
+    bool empty = room->count == 0;
+    pthread_rwlock_unlock(&room->lock);
+
+    if (empty && strcmp(room->name, DEFAULT_ROOM) != 0)
+    {
+        remove_locked(registry, room);
+    }
+    pthread_mutex_unlock(&registry->lock);
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 调用者需持有房间的读锁，放入所有成员队列的耗时计入广播耗时统计
+static bool broadcast_locked(struct room *room, struct msgbuf *buf, uint64_t seq, int shard)
+{
+    uint64_t begin = now_ns();
+    bool need_wake = false;
+    for (size_t i = 0; i < room->count; i++)
+    {
+        struct room_member *member = room->members[i];
+        if (shard != ROOM_ALL_SHARDS && member->shard != shard)
+        {
+            continue;
+        }
+        // 在消息记入历史之后、广播之前加入的成员已经通过历史收到了它
+        if (seq != 0 && member->since >= seq)
+        {
+            continue;
+        }
+        need_wake |= send_queue_push(room->queues[i], buf);
+    }
+    stats_record_broadcast(now_ns() - begin);
+    return need_wake;
+}
+
+bool room_broadcast_shard(struct room *room, struct msgbuf *buf, uint64_t seq, int shard)
+{
+    pthread_rwlock_rdlock(&room->lock);
+    bool need_wake = broadcast_locked(room, buf, seq, shard);
+    pthread_rwlock_unlock(&room->lock);
+    return need_wake;
+}
+
+bool room_broadcast(struct room *room, struct msgbuf *buf)
+{
+    return room_broadcast_shard(room, buf, 0, ROOM_ALL_SHARDS);
+}
+
+bool room_publish(struct room *room, struct msgbuf *buf)
+{
+    // 记入历史和广播都在读锁内完成，与加入房间（写锁）互斥
+    pthread_rwlock_rdlock(&room->lock);
+    uint64_t seq = room_record(room, buf);
+    bool need_wake = broadcast_locked(room, buf, seq, ROOM_ALL_SHARDS);
+    pthread_rwlock_unlock(&room->lock);
+    return need_wake;
+}
+
+struct msgbuf *room_list(struct room_registry *registry, size_t limit)
+{
+    pthread_mutex_lock(&registry->lock);
+    // 每行是房间名加上人数，首尾各有一行说明
+    size_t shown = registry->room_count < limit ? registry->room_count : limit;
+    size_t capacity = 128 + shown * (MAX_ROOM_NAME_LEN + 48);
+    char *text = malloc(capacity);
+    if (text == NULL)
+    {
+        pthread_mutex_unlock(&registry->lock);
+        return NULL;
+    }
+
+    size_t len = snprintf(text, capacity, "共有 %zu 个房间：\n", registry->room_count);
+    size_t listed = 0;
+    for (size_t i = 0; i < registry->bucket_count && listed < shown; i++)
+    {
+        for (struct room *room = registry->buckets[i]; room != NULL && listed < shown; room = room->next)
+        {
+            // 成员数只在持有 registry->lock 时修改，这里不需要房间锁
+            len += snprintf(text + len, capacity - len, "  %s（%zu 人）\n", room->name, room->count);
+            listed++;
+        }
+    }
+    if (listed < registry->room_count)
+    {
+        len += snprintf(text + len, capacity - len, "  ……\n");
+    }
+    pthread_mutex_unlock(&registry->lock);
+
+    struct msgbuf *buf = msgbuf_create(text, len < capacity ? len : capacity - 1);
+    free(text);
+    return buf;
+}
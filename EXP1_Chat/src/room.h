@@ -0,0 +1,145 @@
+#ifndef ROOM_H
+#define ROOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "config.h"
+#include "msgbuf.h"
+#include "send_queue.h"
+
+struct presence_batch;
+
+/**
+ * 房间成员，由会话持有，记录成员在房间成员数组中的位置
+ */
+struct room_member
+{
+    struct send_queue *queue;
+    size_t index;   // 在所属房间 queues 数组中的下标，其他成员离开时可能改变
+    uint64_t since; // 加入时已通过历史补发到的序号，序号不大于它的聊天消息不再实时发送
+    int shard;      // 负责向它广播的线程编号（0 到 ROOM_MAX_SHARDS - 1），加入房间前设置，在房间中不变
+};
+
+// 分担广播的线程数上限
+#define ROOM_MAX_SHARDS 8
+// room_broadcast_shard 的 shard 参数：放入所有成员的队列
+#define ROOM_ALL_SHARDS (-1)
+
+/**
+ * 聊天室房间
+ * 成员的发送队列连续存放在 queues 数组中，广播时只遍历本房间的成员，
+ * 代价与房间人数成正比，与服务器总人数无关。
+ * 每个房间有自己的读写锁，不同房间的广播互不影响。
+ */
+struct room
+{
+    char name[MAX_ROOM_NAME_LEN];
+    uint32_t hash;
+    atomic_int refs;
+    pthread_rwlock_t lock;        // 保护成员数组：广播持读锁，加入、离开持写锁
+    struct send_queue **queues;   // 成员的发送队列
+    struct room_member **members; // 与 queues 一一对应，删除成员时用来更新被移动成员的下标
+    size_t count;
+    size_t capacity;
+    size_t shard_members[ROOM_MAX_SHARDS]; // 每个广播线程负责的成员数
+    struct room *next;            // 同一个哈希桶中的下一个房间
+
+    // 最近的聊天消息，环形缓冲区，最多 config.history_size 条
+    pthread_mutex_t history_lock;
+    struct msgbuf **history;
+    size_t history_head;          // 最旧一条的位置
+    size_t history_count;
+    size_t history_bytes;         // 历史消息占用的字节数，超过 ROOM_HISTORY_MAX_BYTES 时丢弃最旧的
+    uint64_t last_seq;            // 最新一条聊天消息的序号，从 1 开始，0 表示还没有消息
+
+    // 还没有发出的在线状态事件，由 presence.c 在自己的锁内维护
+    struct presence_batch *presence;
+};
+
+/**
+ * 补发历史消息的结果
+ */
+struct room_replay
+{
+    size_t count;      // 补发的消息数
+    uint64_t first_seq; // 补发的第一条消息的序号
+    uint64_t last_seq;  // 房间最新的序号，客户端重连时可以用它请求之后的消息
+    bool truncated;    // 请求的消息中有一部分已不在历史中
+};
+
+/**
+ * 房间表，按房间名的哈希值分桶
+ * 加入、离开房间和列出房间时持有 lock，广播只需要房间自己的锁。
+ * 房间在第一个成员加入时创建，最后一个成员离开时从表中移除（大厅除外）。
+ */
+struct room_registry
+{
+    pthread_mutex_t lock;
+    struct room **buckets;
+    size_t bucket_count; // 2 的幂
+    size_t room_count;
+    // 房间创建（created 为 true）或移除时调用，调用时持有 lock，为 NULL 时不通知
+    void (*on_change)(const char *name, bool created);
+};
+
+void room_registry_init(struct room_registry *registry);
+/**
+ * 把成员加入指定名字的房间，房间不存在时创建
+ * 加入的同时把序号大于 since 的历史消息放入成员的发送队列（since 为 0 时补发全部历史），
+ * 补发与加入在同一次加锁中完成，之后的消息一定排在历史消息后面，不重复也不遗漏
+ * 返回所在的房间，内存不足时返回 NULL
+ * 返回的指针在成员离开房间前一直有效
+ */
+struct room *room_join(struct room_registry *registry, const char *name, struct room_member *member,
+                       uint64_t since, struct room_replay *replay);
+// 查找房间并增加引用，用完后 room_unref，房间不存在时返回 NULL
+struct room *room_find(struct room_registry *registry, const char *name);
+// 成员离开房间，房间空了就移除（大厅除外）
+void room_leave(struct room_registry *registry, struct room *room, struct room_member *member);
+// 把序号大于 since 的历史消息再发给一个成员（since 为 0 时补发全部历史）
+void room_replay_history(struct room *room, struct room_member *member, uint64_t since, struct room_replay *replay);
+/**
+ * 把消息放入房间所有成员的发送队列（不释放 buf），不记入历史，用于进出房间等提示
+ * 返回 true 表示需要调用 send_flusher_wake
+ */
+bool room_broadcast(struct room *room, struct msgbuf *buf);
+// 把聊天消息记入历史并广播，返回值同 room_broadcast
+bool room_publish(struct room *room, struct msgbuf *buf);
+// 只把聊天消息记入历史，返回分配的序号，由调用者随后用 room_broadcast_shard 广播
+uint64_t room_record(struct room *room, struct msgbuf *buf);
+/**
+ * 把消息放入房间中 shard 编号为 shard 的成员的发送队列（ROOM_ALL_SHARDS 为所有成员），用于多个线程分担一次广播
+ * 按成员加入时确定的编号而不是数组下标划分：有成员离开时被移动的成员仍由同一个线程负责，
+ * 每个成员的消息总由同一个线程按顺序放入，不会重复、遗漏或乱序
+ * seq 为消息的序号（不记入历史的消息为 0），已经通过历史补发过这条消息的成员会被跳过
+ */
+bool room_broadcast_shard(struct room *room, struct msgbuf *buf, uint64_t seq, int shard);
+/**
+ * 生成房间列表消息，最多列出 limit 个房间
+ */
+struct msgbuf *room_list(struct room_registry *registry, size_t limit);
+
+// 在房间被广播线程异步使用期间保持其不被释放
+struct room *room_ref(struct room *room);
+void room_unref(struct room *room);
+
+// 名字的 FNV-1a 哈希
+uint32_t room_name_hash(const char *name);
+// 房间名是否合法（非空、不含空白字符、不超过长度上限）
+bool room_name_valid(const char *name);
+// 解析可选的序号参数（前面可以有空格），为空时 *seq 为 0，格式错误时返回 false
+bool room_parse_seq(const char *str, uint64_t *seq);
+/**
+ * 解析 "房间名 [序号]" 形式的命令参数，房间名为空时不修改 name
+ * 房间名不合法或序号格式错误时返回 false
+ */
+bool room_parse_args(const char *args, char *name, uint64_t *since);
+/**
+ * 生成补发历史消息后发给用户的说明（补发了多少条、最新序号），没有需要说明的内容时返回 NULL
+ */
+struct msgbuf *room_replay_notice(const struct room_replay *replay, uint64_t since);
+
+#endif // ROOM_H
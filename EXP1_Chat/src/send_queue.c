@@ -0,0 +1,405 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "protocol.h"
+#include "compress.h"
+#include "stats.h"
+#include "logger.h"
+#include "send_queue.h"
+
+// 一次 sendmsg 最多合并的消息数（每条消息是一个连续的帧，对应一个 iovec）
+#define MAX_BATCH_MESSAGES 256
+// 发送线程连续处理同一个队列的最大轮数，超过后排到待发送列表末尾，保证公平
+#define MAX_FLUSH_ROUNDS 16
+#define MAX_EVENTS 64
+
+static struct
+{
+    int epoll_fd;
+    int event_fd;
+    atomic_bool wake_pending;
+    pthread_mutex_t lock;
+    // 待发送的队列（单链表，新队列追加到末尾）
+    struct send_queue *ready_head;
+    struct send_queue *ready_tail;
+} flusher = {.epoll_fd = -1, .event_fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+struct send_queue *send_queue_create(int sock, size_t capacity, enum slow_client_policy policy)
+{
+    struct send_queue *queue = calloc(1, sizeof(struct send_queue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->ring = calloc(capacity, sizeof(struct msgbuf *));
+    if (queue->ring == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->sock = sock;
+    atomic_init(&queue->refs, 1);
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->capacity = capacity;
+    queue->policy = policy;
+    queue->version = PACKET_V1;
+    queue->compress = false;
+    return queue;
+}
+
+static void send_queue_unref(struct send_queue *queue)
+{
+    if (atomic_fetch_sub_explicit(&queue->refs, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    // 关闭描述符时内核会自动把它从发送线程的 epoll 中移除
+    close(queue->sock);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->ring);
+    free(queue);
+}
+
+// 取出队列中的全部消息，调用者需持有锁，返回取出的条数
+static size_t take_all_locked(struct send_queue *queue, struct msgbuf **out)
+{
+    size_t n = queue->count;
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] = queue->ring[(queue->head + i) % queue->capacity];
+    }
+    queue->head = 0;
+    queue->count = 0;
+    queue->offset = 0;
+    return n;
+}
+
+// 把队列追加到待发送列表，调用者需持有队列的锁
+static void schedule_locked(struct send_queue *queue)
+{
+    queue->next_ready = NULL;
+    pthread_mutex_lock(&flusher.lock);
+    if (flusher.ready_tail == NULL)
+    {
+        flusher.ready_head = queue;
+    }
+    else
+    {
+        flusher.ready_tail->next_ready = queue;
+    }
+    flusher.ready_tail = queue;
+    pthread_mutex_unlock(&flusher.lock);
+}
+
+bool send_queue_push(struct send_queue *queue, struct msgbuf *buf)
+{
+    // 同一条消息只为每种格式转换一次，所有同格式的接收者共享
+    buf = proto_encoding(buf, queue->version);
+    if (buf == NULL)
+    {
+        return false;
+    }
+    // 压缩结果同样挂在消息上，所有接收压缩帧的成员共享
+    if (queue->compress)
+    {
+        buf = compress_encoding(buf);
+    }
+    pthread_mutex_lock(&queue->lock);
+    if (queue->closed)
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+    // 入队者在房间的锁内或广播线程中，不能等待：队列满就立即按策略处理，不管发送线程是否只是暂时没跟上
+    if (queue->count == queue->capacity)
+    {
+        if (queue->policy == SLOW_CLIENT_DROP)
+        {
+            stats_add(STAT_DROPPED, 1);
+        }
+        else
+        {
+            // 队列满时一定已交给发送线程，由发送线程丢弃剩余消息；shutdown 让会话线程的 recv 返回
+            log_info("客户端 %d 接收过慢，断开连接", queue->sock);
+            stats_add(STAT_SLOW_DISCONNECTS, 1);
+            queue->closed = true;
+            shutdown(queue->sock, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    queue->ring[(queue->head + queue->count) % queue->capacity] = msgbuf_ref(buf);
+    queue->count++;
+    stats_add(STAT_ENQUEUED, 1);
+
+    bool need_wake = false;
+    if (!queue->scheduled)
+    {
+        queue->scheduled = true;
+        // 发送线程持有的引用
+        atomic_fetch_add_explicit(&queue->refs, 1, memory_order_relaxed);
+        schedule_locked(queue);
+        need_wake = true;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return need_wake;
+}
+
+void send_queue_set_version(struct send_queue *queue, int version)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->version = version;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void send_queue_set_compression(struct send_queue *queue, bool compress)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->compress = compress;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void send_queue_close(struct send_queue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    // 队列已交给发送线程时，剩余消息由发送线程丢弃；否则队列一定为空
+    pthread_mutex_unlock(&queue->lock);
+    // 唤醒可能在等待可写的发送线程
+    shutdown(queue->sock, SHUT_RDWR);
+    send_queue_unref(queue);
+}
+
+void send_flusher_wake()
+{
+    // 发送线程被唤醒前，多次调用只写一次 eventfd
+    if (!atomic_exchange(&flusher.wake_pending, true))
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(flusher.event_fd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+// 等待 socket 可写后继续发送，发送线程继续持有队列的引用
+static void wait_writable(struct send_queue *queue)
+{
+    struct epoll_event event;
+    event.events = EPOLLOUT | EPOLLONESHOT;
+    event.data.ptr = queue;
+    if (queue->registered)
+    {
+        epoll_ctl(flusher.epoll_fd, EPOLL_CTL_MOD, queue->sock, &event);
+    }
+    else
+    {
+        queue->registered = true;
+        epoll_ctl(flusher.epoll_fd, EPOLL_CTL_ADD, queue->sock, &event);
+    }
+}
+
+// 结束对队列的处理：丢弃剩余消息（如果已关闭），释放发送线程持有的引用
+static void finish_queue(struct send_queue *queue)
+{
+    struct msgbuf **discarded = NULL;
+    size_t n = 0;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0)
+    {
+        discarded = malloc(queue->count * sizeof(struct msgbuf *));
+        if (discarded != NULL)
+        {
+            n = take_all_locked(queue, discarded);
+        }
+    }
+    queue->scheduled = false;
+    pthread_mutex_unlock(&queue->lock);
+    for (size_t i = 0; i < n; i++)
+    {
+        msgbuf_unref(discarded[i]);
+    }
+    free(discarded);
+    send_queue_unref(queue);
+}
+
+// 发送队列中的消息，直到队列为空、socket 不可写或处理轮数用完
+static void flush_queue(struct send_queue *queue)
+{
+    for (int round = 0; round < MAX_FLUSH_ROUNDS; round++)
+    {
+        struct iovec iov[MAX_BATCH_MESSAGES];
+        struct msgbuf *batch[MAX_BATCH_MESSAGES];
+        size_t iov_count = 0;
+        size_t total = 0;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->closed || queue->count == 0)
+        {
+            if (queue->count == 0 && !queue->closed)
+            {
+                queue->scheduled = false;
+                pthread_mutex_unlock(&queue->lock);
+                send_queue_unref(queue);
+                return;
+            }
+            pthread_mutex_unlock(&queue->lock);
+            finish_queue(queue);
+            return;
+        }
+        // 只有发送线程会出队，入队只写 count 之后的槽位，所以解锁后读取这些消息是安全的
+        size_t n = queue->count < MAX_BATCH_MESSAGES ? queue->count : MAX_BATCH_MESSAGES;
+        size_t offset = queue->offset;
+        for (size_t i = 0; i < n; i++)
+        {
+            batch[i] = queue->ring[(queue->head + i) % queue->capacity];
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t skip = i == 0 ? offset : 0;
+            iov[iov_count].iov_base = batch[i]->frame + skip;
+            iov[iov_count].iov_len = msgbuf_frame_len(batch[i]) - skip;
+            total += iov[iov_count].iov_len;
+            iov_count++;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_count;
+        ssize_t sent = sendmsg(queue->sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                wait_writable(queue);
+                return;
+            }
+            // 连接已断开：丢弃剩余消息，shutdown 让会话线程的 recv 返回
+            pthread_mutex_lock(&queue->lock);
+            queue->closed = true;
+            pthread_mutex_unlock(&queue->lock);
+            shutdown(queue->sock, SHUT_RDWR);
+            finish_queue(queue);
+            return;
+        }
+
+        // 出队已完整发送的消息
+        size_t done = 0;
+        size_t remaining = sent + offset;
+        pthread_mutex_lock(&queue->lock);
+        while (done < n && remaining >= msgbuf_frame_len(batch[done]))
+        {
+            remaining -= msgbuf_frame_len(batch[done]);
+            done++;
+        }
+        queue->head = (queue->head + done) % queue->capacity;
+        queue->count -= done;
+        queue->offset = remaining;
+        pthread_mutex_unlock(&queue->lock);
+
+        stats_add(STAT_BYTES_OUT, sent);
+        stats_add(STAT_MESSAGES_OUT, done);
+        for (size_t i = 0; i < done; i++)
+        {
+            msgbuf_unref(batch[i]);
+        }
+
+        if ((size_t)sent < total)
+        {
+            // 只写出了一部分，socket 发送缓冲区已满
+            wait_writable(queue);
+            return;
+        }
+    }
+
+    // 轮数用完，排到待发送列表末尾
+    pthread_mutex_lock(&queue->lock);
+    schedule_locked(queue);
+    pthread_mutex_unlock(&queue->lock);
+    send_flusher_wake();
+}
+
+static void *send_flusher_thread(void *arg)
+{
+    (void)arg;
+    struct epoll_event events[MAX_EVENTS];
+    while (1)
+    {
+        int n = epoll_wait(flusher.epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            log_error("发送线程 epoll_wait 失败：%s", strerror(errno));
+            return NULL;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                uint64_t value;
+                ssize_t ret = read(flusher.event_fd, &value, sizeof(value));
+                (void)ret;
+                atomic_store(&flusher.wake_pending, false);
+                continue;
+            }
+            // socket 可写（或已出错），继续发送
+            flush_queue(events[i].data.ptr);
+        }
+
+        // 处理新交给发送线程的队列
+        pthread_mutex_lock(&flusher.lock);
+        struct send_queue *queue = flusher.ready_head;
+        flusher.ready_head = NULL;
+        flusher.ready_tail = NULL;
+        pthread_mutex_unlock(&flusher.lock);
+        while (queue != NULL)
+        {
+            struct send_queue *next = queue->next_ready;
+            flush_queue(queue);
+            queue = next;
+        }
+    }
+    return NULL;
+}
+
+int send_flusher_start()
+{
+    flusher.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    flusher.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (flusher.epoll_fd < 0 || flusher.event_fd < 0)
+    {
+        return -1;
+    }
+    atomic_init(&flusher.wake_pending, false);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(flusher.epoll_fd, EPOLL_CTL_ADD, flusher.event_fd, &event) < 0)
+    {
+        return -1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, send_flusher_thread, NULL) != 0)
+    {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
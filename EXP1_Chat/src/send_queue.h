@@ -0,0 +1,82 @@
+#ifndef SEND_QUEUE_H
+#define SEND_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "msgbuf.h"
+
+/**
+ * 接收过慢的客户端（发送队列已满）的处理策略
+ */
+enum slow_client_policy
+{
+    SLOW_CLIENT_DROP,      // 丢弃新消息，连接保留
+    SLOW_CLIENT_DISCONNECT // 断开连接
+};
+
+/**
+ * 每个会话一个的有界发送队列
+ *
+ * 队列是 msgbuf 指针的环形缓冲区，入队只做加锁和引用计数，不做系统调用，
+ * 因此广播时可以在会话表的锁内把消息放进所有人的队列。
+ * 实际发送由发送线程（send_flusher）完成：非阻塞地用一次 sendmsg 把队列中的多条消息一起写出，
+ * 写不完的部分等 socket 可写时继续发送，一个卡住的客户端不会影响其他人。
+ *
+ * 队列有引用计数：会话持有一个引用，在发送线程的待发送列表中或等待可写时发送线程持有一个引用。
+ * 最后一个引用释放时关闭 socket，因此会话结束时不会关闭正在被发送线程使用的描述符。
+ *
+ * 入队从不等待：队列满时立即按 slow_client_policy 处理，一个不读数据的客户端不会拖住房间的广播。
+ * 队列长度（--queue-capacity）就是留给发送线程追赶的余量。
+ * 入队、发送、丢弃的消息数计入运行统计（见 stats.h）。
+ */
+struct send_queue
+{
+    int sock;
+    atomic_int refs;
+    pthread_mutex_t lock;
+    struct msgbuf **ring;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    size_t offset;     // 队首消息已发送的字节数（含长度前缀）
+    bool scheduled;    // 已交给发送线程（在待发送列表中或等待可写），此时队列一定非空
+    bool registered;   // sock 已加入发送线程的 epoll
+    bool closed;       // 会话已结束或连接已断开，不再接受新消息
+    enum slow_client_policy policy;
+    int version;       // 连接使用的帧格式，入队时把消息转换为该格式
+    bool compress;     // 客户端接收压缩帧，入队时换成压缩后的帧（见 compress.h）
+    struct send_queue *next_ready;
+};
+
+struct send_queue *send_queue_create(int sock, size_t capacity, enum slow_client_policy policy);
+/**
+ * 把消息放入队列（增加 buf 的引用），不做系统调用
+ * 返回 true 表示队列刚交给发送线程，调用者在放完一批消息后需要调用一次 send_flusher_wake
+ */
+bool send_queue_push(struct send_queue *queue, struct msgbuf *buf);
+/**
+ * 切换连接的帧格式（协商协议版本时），之后入队的消息按新格式发送，已入队的不变
+ * 调用者需保证此时没有其他线程向该队列放入消息（连接还没有进入任何房间）
+ */
+void send_queue_set_version(struct send_queue *queue, int version);
+/**
+ * 开始向连接发送压缩帧（客户端请求压缩时），与 send_queue_set_version 一样，调用时连接还没有进入任何房间
+ */
+void send_queue_set_compression(struct send_queue *queue, bool compress);
+/**
+ * 会话结束时调用：丢弃未发送的消息，释放会话持有的引用
+ */
+void send_queue_close(struct send_queue *queue);
+
+/**
+ * 启动发送线程，返回 0 表示成功
+ */
+int send_flusher_start();
+/**
+ * 唤醒发送线程处理新交给它的队列，同一批入队只需调用一次
+ */
+void send_flusher_wake();
+
+#endif // SEND_QUEUE_H
@@ -2,264 +2,414 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include <stdbool.h>
-#include <ctype.h>
+#include <stddef.h>
+#include <poll.h>
 #include "config.h"
 #include "packet.h"
+#include "session.h"
+#include "msgbuf.h"
+#include "send_queue.h"
+#include "room.h"
+#include "chat_log.h"
+#include "protocol.h"
+#include "presence.h"
+#include "federation.h"
+#include "stats.h"
+#include "logger.h"
+#include "timer_wheel.h"
+#include "heartbeat.h"
+#include "firehose.h"
+#include "moderation.h"
+#include "chat_session.h"
+#include "server.h"
 
-static __thread char send_buf[MAX_BUFF_SIZE] = {0};
-static __thread char recv_buf[MAX_BUFF_SIZE] = {0};
+// 活跃会话表
+static struct session_table session_table;
+// 房间表
+static struct room_registry room_registry;
+// 下一个会话编号
+static atomic_uint next_session_id = 1;
 
-struct list_node
+// 会话线程的参数
+struct session_args
 {
     int sock;
-    char name[MAX_NAME_LEN]; // 用户名
-    struct list_node *next;
+    struct send_queue *queue;
 };
 
-struct session_list_struct
+// 向房间内所有客户端发送消息，并释放调用者持有的 buf 引用
+// 每个接收者只是把同一个 buf 的指针放入发送队列，在房间的读锁内不做任何系统调用
+void broadcast_message(struct room* room, struct msgbuf* buf)
 {
-    struct list_node *first;
-    pthread_rwlock_t rwlock; // 用于保证线程安全的读写锁
-} session_list;
-
-// 创建新节点，并将所有参数设为空
-struct list_node *session_list_create_node()
-{
-    struct list_node *new_node = malloc(sizeof(struct list_node));
-    new_node->sock = -1;
-    new_node->next = NULL;
-    memset(new_node->name, 0, sizeof(new_node->name));
-    return new_node;
-}
-
-// 初始化 session_list
-void session_list_init()
-{
-    session_list.first = NULL;
-    pthread_rwlock_init(&session_list.rwlock, NULL);
+    if (buf == NULL)
+    {
+        return;
+    }
+    if (room != NULL && room_broadcast(room, buf))
+    {
+        send_flusher_wake();
+    }
+    msgbuf_unref(buf);
 }
 
-// 向 session_list 插入值
-void session_list_insert(int sock)
+// 把聊天消息记入本节点的房间历史并广播，释放调用者持有的 buf 引用
+// 其他节点转发来的消息也由它发给本节点的用户
+static void deliver_message(struct room* room, struct msgbuf* buf)
 {
-    pthread_rwlock_wrlock(&session_list.rwlock);
-    if (session_list.first == NULL)
+    if (buf == NULL)
     {
-        session_list.first = session_list_create_node();
-        session_list.first->sock = sock;
-        session_list.first->next = NULL;
+        return;
     }
-    else
+    // 聊天记录和共享内存消息流保存 v1 格式的文本
+    struct msgbuf *text = proto_encoding(buf, PACKET_V1);
+    chat_log_append(room->name, text);
+    firehose_publish(room->name, text);
+    if (room_publish(room, buf))
     {
-        struct list_node *pos = session_list.first;
-        while (pos->next != NULL)
-        {
-            pos = pos->next;
-        }
-        pos->next = session_list_create_node();
-        pos->next->sock = sock;
-        pos->next->next = NULL;
+        send_flusher_wake();
     }
-    pthread_rwlock_unlock(&session_list.rwlock);
+    msgbuf_unref(buf);
 }
 
-// 从 session_list 中删除值
-// 若删除成功，返回 true。若没找到，返回 false。
-bool session_list_remove(int sock)
+// 向房间发送本节点用户的聊天消息：转发给订阅了该房间的其他节点，再记入房间历史并广播
+void publish_message(struct room* room, struct msgbuf* buf)
 {
-    pthread_rwlock_wrlock(&session_list.rwlock);
-    struct list_node *pos = session_list.first;
-    if (pos == NULL)
+    if (buf != NULL)
     {
-        pthread_rwlock_unlock(&session_list.rwlock);
-        return false;
+        federation_forward(room, buf);
     }
-    // 第一个节点匹配的情况
-    if (pos->sock == sock)
+    deliver_message(room, buf);
+}
+
+bool server_log_open()
+{
+    if (config.log_dir == NULL)
     {
-        session_list.first = pos->next;
-        free(pos);
-        pthread_rwlock_unlock(&session_list.rwlock);
         return true;
     }
-    // 不断往后扫描
-    while (pos->next != NULL)
-    {
-        if (pos->next->sock == sock)
-        {
-            struct list_node *to_delete = pos->next;
-            pos->next = pos->next->next;
-            free(to_delete);
-            pthread_rwlock_unlock(&session_list.rwlock);
-            return true;
-        }
-        pos = pos->next;
-    }
-    pthread_rwlock_unlock(&session_list.rwlock);
-    return false;
+    struct chat_log_options options = {
+        .dir = config.log_dir,
+        .segment_size = config.log_segment_size,
+        .sync_batch = config.log_sync_batch,
+        .sync_interval_ms = config.log_sync_interval_ms,
+        .retention_segments = config.log_retention_segments,
+    };
+    return chat_log_open(&options) == 0;
 }
 
-// 为一个会话设置用户名
-bool session_list_set_name(int sock, const char* name)
+int server_listen_unix(int flags)
 {
-    pthread_rwlock_wrlock(&session_list.rwlock);
-    struct list_node *pos = session_list.first;
-    while (pos != NULL && pos->sock != sock)
+    if (config.unix_socket == NULL)
     {
-        pos = pos->next;
+        return -1;
     }
-    if (pos->sock == sock)
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(config.unix_socket) >= sizeof(addr.sun_path))
     {
-        strncpy(pos->name, name, MAX_NAME_LEN);
-        pthread_rwlock_unlock(&session_list.rwlock);
-        return true;
+        printf("本机 socket 路径 %s 过长\n", config.unix_socket);
+        exit(1);
     }
-    else
+    strcpy(addr.sun_path, config.unix_socket);
+    // 只删除 socket 文件，不会误删同名的普通文件
+    struct stat st;
+    if (lstat(config.unix_socket, &st) == 0 && S_ISSOCK(st.st_mode))
     {
-        pthread_rwlock_unlock(&session_list.rwlock);
-        return false;
+        unlink(config.unix_socket);
     }
-}
 
-// 获取一个会话的名字，如果会话不存在，返回 NULL
-const char* session_list_get_name(int sock)
-{
-    pthread_rwlock_rdlock(&session_list.rwlock);
-    struct list_node *pos = session_list.first;
-    while (pos != NULL && pos->sock != sock)
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if (sock < 0)
     {
-        pos = pos->next;
+        printf("本机 socket 创建失败！\n");
+        exit(1);
     }
-    if (pos->sock == sock)
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1)
     {
-        pthread_rwlock_unlock(&session_list.rwlock);
-        return pos->name;
+        printf("本机 socket 绑定 %s 失败：%s\n", config.unix_socket, strerror(errno));
+        exit(2);
     }
-    else
+    if (listen(sock, SOMAXCONN) == -1)
     {
-        pthread_rwlock_unlock(&session_list.rwlock);
-        return "NULL";
+        printf("本机 socket listen 失败！\n");
+        exit(3);
     }
+    log_info("在本机 socket %s 上监听连接请求", config.unix_socket);
+    return sock;
 }
 
-// 判断字符串是否全为空白字符
-bool is_blank(const char* str, size_t buff_max_size)
+// 会话线程的状态
+struct session_state
 {
-    size_t len = strnlen(str, buff_max_size);
-    for (size_t i = 0; i < len; i++)
+    // 协议和命令的处理状态（名字、所在房间等）
+    struct chat_session session;
+    struct frame_reader *reader;
+    // 心跳：v2 会话的下一次检查挂在 heartbeats.wheel 上，由心跳线程处理
+    struct timer heartbeat;
+    _Atomic uint64_t last_recv_ms; // 最后一次收到数据的时刻，由会话线程更新
+};
+
+// 所有会话的心跳检查，一个线程处理，不必每个会话各自计时
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t armed; // 时间轮上有了定时器
+    struct timer_wheel wheel;
+    uint64_t now_ms;      // 本次处理的时刻，供到期回调使用
+} heartbeats = {.lock = PTHREAD_MUTEX_INITIALIZER, .armed = PTHREAD_COND_INITIALIZER};
+
+// 协商改用 v2 帧：之后的消息按 v2 格式拼帧，v2 客户端会回复 PING，开始心跳检查
+static void session_upgraded(struct chat_session *session)
+{
+    struct session_state *state = (struct session_state *)((char *)session - offsetof(struct session_state, session));
+    state->reader->version = PACKET_V2;
+    if (config.heartbeat_interval_ms != 0)
     {
-        if (!isblank(str[i]))
-        {
-            return false;
-        }
+        pthread_mutex_lock(&heartbeats.lock);
+        timer_wheel_schedule(&heartbeats.wheel, &state->heartbeat,
+                             atomic_load(&state->last_recv_ms) + config.heartbeat_interval_ms);
+        pthread_cond_signal(&heartbeats.armed);
+        pthread_mutex_unlock(&heartbeats.lock);
     }
-    return true;
 }
 
-// 向所有客户端 socket 发送消息
-void broadcast_message(const char* message)
+// 名字记入会话表
+static void session_name_set(struct chat_session *session)
 {
-    pthread_rwlock_rdlock(&session_list.rwlock);
-    struct list_node* pos = session_list.first;
-    while (pos != NULL)
-    {
-        send_msg(pos->sock, message, strnlen(message, MAX_BUFF_SIZE));
-        pos = pos->next;
-    }
-    pthread_rwlock_unlock(&session_list.rwlock);
+    session_table_set_name(&session_table, session->fd, session->name);
 }
 
+static const struct chat_session_ops session_ops = {
+    .rooms = &room_registry,
+    .publish = publish_message,
+    .upgraded = session_upgraded,
+    .name_set = session_name_set,
+};
+
 // 为一个会话服务的线程
-void *session_thread(void *sock_ptr)
+void *session_thread(void *arg)
 {
-    int sock = *(int *)sock_ptr;
-    free(sock_ptr);
-    // 用户是否已设置名称
-    bool set_name = false;
-    static char* welcome_msg = "\n欢迎来到聊天室！\n";
-    static char* name_prompt = "请输入你的名字：";
-    static char* name_too_long_msg = "名字过长，请重新输入\n";
-    static char* name_is_empty_msg = "名字不能为空\n";
-    static char* successful_msg = "设置成功！\n";
-    send_msg(sock, welcome_msg, strlen(welcome_msg));
-    send_msg(sock, name_prompt, strlen(name_prompt));
+    struct session_args *args = arg;
+    struct session_state state = {0};
+    chat_session_init(&state.session, &session_ops, args->sock,
+                      atomic_fetch_add_explicit(&next_session_id, 1, memory_order_relaxed), args->queue);
+    atomic_init(&state.last_recv_ms, heartbeat_now_ms());
+    free(args);
+    int sock = state.session.fd;
 
-    while (1)
+    // 本会话的读缓冲区，一次 recv 可以读到多条消息
+    struct frame_reader reader;
+    if (!frame_reader_init(&reader, sock, config.max_message_size))
     {
-        ssize_t recv_len;
-        recv_len = recv_msg(sock, recv_buf, MAX_BUFF_SIZE - 1);
+        log_error("客户端 %d 读缓冲区分配失败", sock);
+        stats_add(STAT_DISCONNECTS, 1);
+        session_table_remove(&session_table, sock);
+        send_queue_close(state.session.queue);
+        return NULL;
+    }
+    state.reader = &reader;
+    chat_session_start(&state.session);
 
-        if (recv_len == -1)
-        {
-            printf("客户端 %d 数据接收失败\n", sock);
-        }
-        else if (recv_len == 0)
+    bool running = true;
+    while (running)
+    {
+        ssize_t received = frame_reader_fill(&reader);
+        if (received <= 0)
         {
-            printf("客户端 %d 关闭连接，连接终止\n", sock);
-            // 广播用户退出消息
-            if (set_name)
+            if (received < 0 && errno == EINTR)
             {
-                snprintf(send_buf, MAX_BUFF_SIZE, "用户 %s 退出聊天室\n", session_list_get_name(sock));
+                continue;
+            }
+            if (received == 0)
+            {
+                log_debug("客户端 %d 关闭连接，连接终止", sock);
+            }
+            else
+            {
+                log_debug("客户端 %d 数据接收失败，连接终止", sock);
             }
-            broadcast_message(send_buf);
             break;
         }
-        // 若 set_name 为 false 则将收到的字符串设为用户名
-        recv_buf[recv_len] = '\0';
-        if (!set_name)
+        atomic_store_explicit(&state.last_recv_ms, heartbeat_now_ms(), memory_order_relaxed);
+
+        // 处理本次读到的所有完整消息
+        char *msg;
+        size_t len;
+        int ret;
+        while ((ret = frame_reader_next(&reader, &msg, &len)) != 0)
         {
-            // 名字过长
-            if (strnlen(recv_buf, MAX_BUFF_SIZE) > MAX_NAME_LEN - 1)
+            if (ret > 0)
             {
-                send_msg(sock, name_too_long_msg, strlen(name_too_long_msg));
-                send_msg(sock, name_prompt, strlen(name_prompt));
+                chat_session_handle_message(&state.session, msg, len);
                 continue;
             }
-            // 名字字符串全为空白字符
-            if (is_blank(recv_buf, MAX_BUFF_SIZE))
+            if (ret == -2)
             {
-                send_msg(sock, name_is_empty_msg, strlen(name_is_empty_msg));
-                send_msg(sock, name_prompt, strlen(name_prompt));
-                continue;
+                log_warn("客户端 %d 发送的数据格式错误，连接终止", sock);
+                running = false;
+                break;
             }
-            // 设置名字
-            session_list_set_name(sock, recv_buf);
-            set_name = true;
-            printf("客户端 %d 设置了名字 %s\n", sock, recv_buf);
-            send_msg(sock, successful_msg, strlen(successful_msg));
-            // 广播用户加入聊天室的消息
-            snprintf(send_buf, MAX_BUFF_SIZE, "用户 %s 加入聊天室\n", recv_buf);
-            broadcast_message(send_buf);
-            continue;
+            if (ret == -3)
+            {
+                log_error("内存不足，无法接收客户端 %d 的消息（%zu 字节），连接终止", sock, len);
+                running = false;
+                break;
+            }
+            if (config.disconnect_oversize)
+            {
+                log_info("客户端 %d 发送的消息过长，连接终止", sock);
+                running = false;
+                break;
+            }
+            // 丢弃这条消息，数据流从下一条消息处继续
+            size_t skipped = frame_reader_skip(&reader);
+            log_info("客户端 %d 发送的消息过长（%zu 字节），已丢弃", sock, skipped);
+            chat_session_message_too_long(&state.session);
         }
+    }
+
+    // 停止心跳检查，之后心跳线程不会再访问本会话
+    pthread_mutex_lock(&heartbeats.lock);
+    timer_wheel_cancel(&heartbeats.wheel, &state.heartbeat);
+    pthread_mutex_unlock(&heartbeats.lock);
+
+    // 离开所在房间，退出消息随下一次在线状态摘要发出
+    chat_session_leave_room(&state.session);
+
+    // 连接关闭后的操作
+    stats_add(STAT_DISCONNECTS, 1);
+    frame_reader_destroy(&reader);
+    if (!session_table_remove(&session_table, sock))
+    {
+        log_error("从会话表移除会话 %d 失败", sock);
+    }
+    // 先从会话表移除，不会再有新消息进入队列；socket 在发送线程也用完后才关闭，
+    // 避免描述符被新连接复用后收到旧会话的消息
+    send_queue_close(state.session.queue);
+    return NULL;
+}
+
+// 在线状态摘要线程：每个周期把各房间积累的进出房间、正在输入事件合并为一条摘要广播
+static void *presence_thread(void *arg)
+{
+    (void)arg;
+    while (1)
+    {
+        presence_wait();
+        presence_flush(broadcast_message);
+    }
+    return NULL;
+}
+
+// 会话的心跳检查到期，在心跳线程中持有 heartbeats.lock 调用
+static void session_heartbeat(struct timer *timer)
+{
+    struct session_state *state = (struct session_state *)((char *)timer - offsetof(struct session_state, heartbeat));
+    uint64_t next_ms;
+    switch (heartbeat_check(atomic_load(&state->last_recv_ms), heartbeats.now_ms, &next_ms))
+    {
+    case HEARTBEAT_EVICT:
+        // 让会话线程的 recv 返回，由会话线程清理
+        log_info("客户端 %d 超过 %u 毫秒没有响应，断开连接", state->session.fd, config.heartbeat_timeout_ms);
+        stats_add(STAT_EVICTIONS, 1);
+        shutdown(state->session.fd, SHUT_RDWR);
+        return;
+    case HEARTBEAT_PING:
+    {
+        struct msgbuf *ping = heartbeat_ping(heartbeats.now_ms);
+        chat_session_send(&state->session, ping);
+        msgbuf_unref(ping);
+        break;
+    }
+    case HEARTBEAT_WAIT:
+        break;
+    }
+    timer_wheel_schedule(&heartbeats.wheel, timer, next_ms);
+}
 
-        // 服务端打印消息
-        if (set_name)
+// 心跳线程：每个刻度处理一次时间轮，没有需要检查的会话时休眠
+static void *heartbeat_thread(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&heartbeats.lock);
+    while (1)
+    {
+        int timeout = timer_wheel_timeout_ms(&heartbeats.wheel, heartbeat_now_ms());
+        if (timeout < 0)
         {
-            const char* name = session_list_get_name(sock);
-            printf("客户端 %d 昵称 %s 发送消息：%s\n", sock, name, recv_buf);
+            pthread_cond_wait(&heartbeats.armed, &heartbeats.lock);
+            continue;
         }
-        else
+        if (timeout > 0)
         {
-            printf("客户端 %d 发送消息：%s\n", sock, recv_buf);
+            pthread_mutex_unlock(&heartbeats.lock);
+            struct timespec delay = {.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L};
+            nanosleep(&delay, NULL);
+            pthread_mutex_lock(&heartbeats.lock);
         }
-        
-        // 广播消息 [用户名] 消息内容\n
-        char* tmp_buf = malloc(MAX_BUFF_SIZE);
-        snprintf(tmp_buf, MAX_BUFF_SIZE, "[%s] %s\n", session_list_get_name(sock), recv_buf);
-        broadcast_message(tmp_buf);
-        free(tmp_buf);
+        heartbeats.now_ms = heartbeat_now_ms();
+        timer_wheel_advance(&heartbeats.wheel, heartbeats.now_ms, session_heartbeat);
     }
+    return NULL;
+}
 
-    // 连接关闭后的操作
-    if (!session_list_remove(sock))
+// 节点连接线程：处理其他节点的连接和转发来的消息
+static void *federation_thread(void *arg)
+{
+    (void)arg;
+    struct pollfd fd = { .fd = federation_fd(), .events = POLLIN };
+    while (1)
     {
-        printf("从 session_list 移除元素 %d 失败\n", sock);
+        poll(&fd, 1, federation_timeout_ms());
+        federation_poll();
+    }
+    return NULL;
+}
+
+// 接受一个连接并为它创建会话线程
+static void accept_session(int listen_sock)
+{
+    int client_sock = accept(listen_sock, NULL, NULL);
+    if (client_sock < 0)
+    {
+        return;
+    }
+    log_debug("已接受连接 %d", client_sock);
+    heartbeat_set_socket_options(client_sock);
+    struct send_queue *queue = send_queue_create(client_sock, config.send_queue_capacity,
+                                                 config.disconnect_slow_clients ? SLOW_CLIENT_DISCONNECT : SLOW_CLIENT_DROP);
+    if (queue == NULL)
+    {
+        close(client_sock);
+        return;
+    }
+    stats_add(STAT_CONNECTIONS, 1);
+    session_table_insert(&session_table, client_sock, queue);
+    // 创建线程并传入 sock 和发送队列
+    pthread_t session_thread_handle;
+    struct session_args *args = malloc(sizeof(struct session_args));
+    args->sock = client_sock;
+    args->queue = queue;
+    if (pthread_create(&session_thread_handle, NULL, session_thread, args) == 0)
+    {
+        pthread_detach(session_thread_handle);
+    }
+    else
+    {
+        log_error("会话服务线程创建失败");
+        stats_add(STAT_DISCONNECTS, 1);
+        free(args);
+        session_table_remove(&session_table, client_sock);
+        send_queue_close(queue);
     }
 }
 
@@ -268,7 +418,62 @@ int server_main()
     int server_sock = -1;
     struct sockaddr_in server_addr;
 
-    session_list_init();
+    stats_init();
+    if (logger_start() != 0)
+    {
+        printf("日志线程启动失败！\n");
+        exit(1);
+    }
+    session_table_init(&session_table);
+    room_registry_init(&room_registry);
+    presence_init();
+    chat_session_prompts_init();
+    if (send_flusher_start() != 0)
+    {
+        printf("发送线程启动失败！\n");
+        exit(1);
+    }
+    pthread_t presence_thread_handle;
+    if (pthread_create(&presence_thread_handle, NULL, presence_thread, NULL) != 0)
+    {
+        printf("在线状态摘要线程启动失败！\n");
+        exit(1);
+    }
+    pthread_detach(presence_thread_handle);
+    if (!timer_wheel_init(&heartbeats.wheel, HEARTBEAT_WHEEL_SLOTS, HEARTBEAT_TICK_MS, heartbeat_now_ms()))
+    {
+        printf("时间轮分配失败！\n");
+        exit(1);
+    }
+    pthread_t heartbeat_thread_handle;
+    if (config.heartbeat_interval_ms != 0)
+    {
+        if (pthread_create(&heartbeat_thread_handle, NULL, heartbeat_thread, NULL) != 0)
+        {
+            printf("心跳线程启动失败！\n");
+            exit(1);
+        }
+        pthread_detach(heartbeat_thread_handle);
+    }
+    if (!federation_start(&room_registry, deliver_message))
+    {
+        exit(1);
+    }
+    if (federation_fd() >= 0)
+    {
+        pthread_t federation_thread_handle;
+        if (pthread_create(&federation_thread_handle, NULL, federation_thread, NULL) != 0)
+        {
+            printf("节点连接线程启动失败！\n");
+            exit(1);
+        }
+        pthread_detach(federation_thread_handle);
+    }
+    if (!server_log_open() || !firehose_open() || !moderation_start())
+    {
+        logger_flush();
+        exit(1);
+    }
 
     // 1. 创建 socket
     server_sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -277,7 +482,7 @@ int server_main()
         printf("socket 创建失败！\n");
         exit(1);
     }
-    printf("socket 创建成功\n");
+    log_info("socket 创建成功");
 
     // 设置 SO_REUSEADDR 选项，允许地址重用
     // 这样服务器终止后可以立即重新启动，不必等待 TIME_WAIT 结束
@@ -293,14 +498,14 @@ int server_main()
     server_addr.sin_family = AF_INET;
     // 使用 htons 和 htonl 的作用是转换字节序
     // x86 使用小端序，而网络传输标准使用大端序
-    server_addr.sin_port = htons(SERVER_PORT);
+    server_addr.sin_port = htons(config.port);
     server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
     if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1)
     {
         printf("bind 失败！\n");
         exit(2);
     }
-    printf("bind 成功\n");
+    log_info("bind 成功");
 
     // 3. 开始监听
     if (listen(server_sock, 10) == -1)
@@ -308,24 +513,26 @@ int server_main()
         printf("listen 失败！\n");
         exit(3);
     }
-    printf("开始监听连接请求\n");
+    log_info("开始监听连接请求");
 
+    // 本机程序可以改用 Unix domain socket 连接，不经过 TCP 协议栈；两个监听 socket 用 poll 等待
+    struct pollfd listeners[2] = {
+        {.fd = server_sock, .events = POLLIN},
+        {.fd = server_listen_unix(SOCK_NONBLOCK), .events = POLLIN},
+    };
+    nfds_t listener_count = listeners[1].fd >= 0 ? 2 : 1;
     while (1)
     {
-        int client_sock = accept(server_sock, NULL, NULL);
-        printf("已接受连接 %d\n", client_sock);
-        session_list_insert(client_sock);
-        // 创建线程并传入 sock 参数
-        pthread_t session_thread_handle;
-        int *sock_arg = malloc(sizeof(int));
-        *sock_arg = client_sock;
-        if (pthread_create(&session_thread_handle, NULL, session_thread, sock_arg) == 0)
+        if (poll(listeners, listener_count, -1) < 0)
         {
-            pthread_detach(session_thread_handle);
+            continue;
         }
-        else
+        for (nfds_t i = 0; i < listener_count; i++)
         {
-            printf("会话服务线程创建失败\n");
+            if (listeners[i].revents & POLLIN)
+            {
+                accept_session(listeners[i].fd);
+            }
         }
     }
 
@@ -1,6 +1,17 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 extern int server_main();
 
+// 配置了 --log-dir 时打开聊天记录，失败返回 false
+bool server_log_open();
+/**
+ * 配置了 --unix-socket 时创建本机监听 socket（flags 如 SOCK_NONBLOCK 附加在类型上），未配置时返回 -1
+ * 路径上已有的 socket 文件（上次运行留下的）先删除；失败时打印原因并退出
+ */
+int server_listen_unix(int flags);
+
 #endif // SERVER_H
\ No newline at end of file
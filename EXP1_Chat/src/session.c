@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+
+#define INITIAL_CAPACITY 64
+
+void session_table_init(struct session_table *table)
+{
+    table->entries = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    table->index = NULL;
+    table->index_size = 0;
+    pthread_rwlock_init(&table->rwlock, NULL);
+}
+
+// 查找会话在 entries 中的位置，不存在时返回 NULL，调用者需持有锁
+static struct session *find_locked(struct session_table *table, int sock)
+{
+    if (sock < 0 || (size_t)sock >= table->index_size || table->index[sock] == 0)
+    {
+        return NULL;
+    }
+    return &table->entries[table->index[sock] - 1];
+}
+
+// 确保 index 能容纳 sock，调用者需持有写锁
+static bool reserve_index_locked(struct session_table *table, int sock)
+{
+    if ((size_t)sock < table->index_size)
+    {
+        return true;
+    }
+    size_t new_size = table->index_size == 0 ? INITIAL_CAPACITY : table->index_size;
+    while (new_size <= (size_t)sock)
+    {
+        new_size *= 2;
+    }
+    size_t *new_index = realloc(table->index, new_size * sizeof(size_t));
+    if (new_index == NULL)
+    {
+        return false;
+    }
+    memset(new_index + table->index_size, 0, (new_size - table->index_size) * sizeof(size_t));
+    table->index = new_index;
+    table->index_size = new_size;
+    return true;
+}
+
+bool session_table_insert(struct session_table *table, int sock, struct send_queue *queue)
+{
+    if (sock < 0)
+    {
+        return false;
+    }
+    pthread_rwlock_wrlock(&table->rwlock);
+    if (!reserve_index_locked(table, sock) || table->index[sock] != 0)
+    {
+        pthread_rwlock_unlock(&table->rwlock);
+        return false;
+    }
+    if (table->count == table->capacity)
+    {
+        size_t new_capacity = table->capacity == 0 ? INITIAL_CAPACITY : table->capacity * 2;
+        struct session *new_entries = realloc(table->entries, new_capacity * sizeof(struct session));
+        if (new_entries == NULL)
+        {
+            pthread_rwlock_unlock(&table->rwlock);
+            return false;
+        }
+        table->entries = new_entries;
+        table->capacity = new_capacity;
+    }
+    struct session *entry = &table->entries[table->count];
+    entry->sock = sock;
+    entry->queue = queue;
+    memset(entry->name, 0, sizeof(entry->name));
+    table->count++;
+    table->index[sock] = table->count;
+    pthread_rwlock_unlock(&table->rwlock);
+    return true;
+}
+
+bool session_table_remove(struct session_table *table, int sock)
+{
+    pthread_rwlock_wrlock(&table->rwlock);
+    struct session *entry = find_locked(table, sock);
+    if (entry == NULL)
+    {
+        pthread_rwlock_unlock(&table->rwlock);
+        return false;
+    }
+    // 用最后一个会话填补空位
+    struct session *last = &table->entries[table->count - 1];
+    if (entry != last)
+    {
+        *entry = *last;
+        table->index[entry->sock] = entry - table->entries + 1;
+    }
+    table->index[sock] = 0;
+    table->count--;
+    pthread_rwlock_unlock(&table->rwlock);
+    return true;
+}
+
+bool session_table_set_name(struct session_table *table, int sock, const char *name)
+{
+    pthread_rwlock_wrlock(&table->rwlock);
+    struct session *entry = find_locked(table, sock);
+    if (entry != NULL)
+    {
+        strncpy(entry->name, name, MAX_NAME_LEN - 1);
+        entry->name[MAX_NAME_LEN - 1] = '\0';
+    }
+    pthread_rwlock_unlock(&table->rwlock);
+    return entry != NULL;
+}
+
+bool session_table_get_name(struct session_table *table, int sock, char *buf, size_t buf_size)
+{
+    pthread_rwlock_rdlock(&table->rwlock);
+    struct session *entry = find_locked(table, sock);
+    if (entry != NULL && buf_size > 0)
+    {
+        strncpy(buf, entry->name, buf_size - 1);
+        buf[buf_size - 1] = '\0';
+    }
+    pthread_rwlock_unlock(&table->rwlock);
+    return entry != NULL;
+}
+
+size_t session_table_count(struct session_table *table)
+{
+    pthread_rwlock_rdlock(&table->rwlock);
+    size_t count = table->count;
+    pthread_rwlock_unlock(&table->rwlock);
+    return count;
+}
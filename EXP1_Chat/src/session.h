@@ -0,0 +1,46 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "config.h"
+#include "send_queue.h"
+
+struct session
+{
+    int sock;
+    char name[MAX_NAME_LEN]; // 用户名，未设置时为空串
+    struct send_queue *queue; // 发送队列，所有发给该会话的消息都经过它
+};
+
+/**
+ * 会话表
+ * 会话连续存放在 entries 数组中，遍历（广播）时顺序访问，对缓存友好；
+ * index 按 socket 描述符索引，记录会话在 entries 中的位置，插入、删除、查找都是 O(1)。
+ * 删除时把最后一个会话移到被删除的位置，保持数组紧凑。
+ */
+struct session_table
+{
+    struct session *entries;
+    size_t count;
+    size_t capacity;
+    // index[sock] 为会话在 entries 中的下标 + 1，0 表示不存在
+    size_t *index;
+    size_t index_size;
+    pthread_rwlock_t rwlock; // 用于保证线程安全的读写锁
+};
+
+void session_table_init(struct session_table *table);
+// 插入会话，已存在或内存不足时返回 false
+bool session_table_insert(struct session_table *table, int sock, struct send_queue *queue);
+// 删除会话，若删除成功，返回 true。若没找到，返回 false。
+bool session_table_remove(struct session_table *table, int sock);
+// 为一个会话设置用户名
+bool session_table_set_name(struct session_table *table, int sock, const char *name);
+// 把会话的名字复制到 buf，会话不存在时返回 false
+bool session_table_get_name(struct session_table *table, int sock, char *buf, size_t buf_size);
+// 会话总数
+size_t session_table_count(struct session_table *table);
+
+#endif // SESSION_H
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "chat_log.h"
+#include "config.h"
+#include "stats.h"
+
+_Thread_local struct stats_shard *stats_local;
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_key_t key;     // 线程退出时把计数并入 retired
+    pthread_once_t once;
+    struct stats_shard *shards; // 仍在运行的线程的计数器
+    struct stats_shard retired; // 已退出的线程的计数之和
+    struct stats_shard fallback;
+    time_t started;
+} stats = {.lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT};
+
+static void add_shard(struct stats_snapshot *out, struct stats_shard *shard)
+{
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        out->counters[i] += atomic_load_explicit(&shard->counters[i], memory_order_relaxed);
+    }
+    for (int i = 0; i < STAT_LATENCY_BUCKETS; i++)
+    {
+        out->latency[i] += atomic_load_explicit(&shard->latency[i], memory_order_relaxed);
+    }
+    unsigned long long max = atomic_load_explicit(&shard->latency_max_ns, memory_order_relaxed);
+    if (max > out->latency_max_ns)
+    {
+        out->latency_max_ns = max;
+    }
+}
+
+// 线程退出时调用：计数并入 retired，从列表中移除
+static void retire_shard(void *arg)
+{
+    struct stats_shard *shard = arg;
+    struct stats_snapshot sum = {0};
+    add_shard(&sum, shard);
+
+    pthread_mutex_lock(&stats.lock);
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        stats_bump(&stats.retired.counters[i], sum.counters[i]);
+    }
+    for (int i = 0; i < STAT_LATENCY_BUCKETS; i++)
+    {
+        stats_bump(&stats.retired.latency[i], sum.latency[i]);
+    }
+    if (sum.latency_max_ns > atomic_load_explicit(&stats.retired.latency_max_ns, memory_order_relaxed))
+    {
+        atomic_store_explicit(&stats.retired.latency_max_ns, sum.latency_max_ns, memory_order_relaxed);
+    }
+    struct stats_shard **p = &stats.shards;
+    while (*p != shard)
+    {
+        p = &(*p)->next;
+    }
+    *p = shard->next;
+    pthread_mutex_unlock(&stats.lock);
+    free(shard);
+}
+
+static void stats_init_once()
+{
+    pthread_key_create(&stats.key, retire_shard);
+    stats.started = time(NULL);
+}
+
+void stats_init()
+{
+    pthread_once(&stats.once, stats_init_once);
+}
+
+struct stats_shard *stats_register()
+{
+    pthread_once(&stats.once, stats_init_once);
+    struct stats_shard *shard = aligned_alloc(64, sizeof(struct stats_shard));
+    if (shard == NULL)
+    {
+        stats_local = &stats.fallback;
+        return stats_local;
+    }
+    for (int i = 0; i < STAT_COUNTERS; i++)
+    {
+        atomic_init(&shard->counters[i], 0);
+    }
+    for (int i = 0; i < STAT_LATENCY_BUCKETS; i++)
+    {
+        atomic_init(&shard->latency[i], 0);
+    }
+    atomic_init(&shard->latency_max_ns, 0);
+
+    pthread_mutex_lock(&stats.lock);
+    shard->next = stats.shards;
+    stats.shards = shard;
+    pthread_mutex_unlock(&stats.lock);
+    pthread_setspecific(stats.key, shard);
+    stats_local = shard;
+    return shard;
+}
+
+void stats_record_broadcast(uint64_t ns)
+{
+    struct stats_shard *shard = stats_this_thread();
+    int bucket = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+    if (bucket >= STAT_LATENCY_BUCKETS)
+    {
+        bucket = STAT_LATENCY_BUCKETS - 1;
+    }
+    stats_bump(&shard->counters[STAT_BROADCASTS], 1);
+    stats_bump(&shard->latency[bucket], 1);
+    if (ns > atomic_load_explicit(&shard->latency_max_ns, memory_order_relaxed))
+    {
+        atomic_store_explicit(&shard->latency_max_ns, ns, memory_order_relaxed);
+    }
+}
+
+void stats_snapshot(struct stats_snapshot *out)
+{
+    pthread_once(&stats.once, stats_init_once);
+    *out = (struct stats_snapshot){0};
+    pthread_mutex_lock(&stats.lock);
+    add_shard(out, &stats.retired);
+    add_shard(out, &stats.fallback);
+    for (struct stats_shard *shard = stats.shards; shard != NULL; shard = shard->next)
+    {
+        add_shard(out, shard);
+    }
+    pthread_mutex_unlock(&stats.lock);
+}
+
+// 直方图中第 percent% 的广播所在桶的上界（微秒，不超过最长耗时），没有广播时返回 0
+static double latency_percentile_us(const struct stats_snapshot *s, double percent)
+{
+    unsigned long long total = s->counters[STAT_BROADCASTS];
+    if (total == 0)
+    {
+        return 0;
+    }
+    unsigned long long rank = (unsigned long long)(total * percent / 100);
+    unsigned long long seen = 0;
+    for (int i = 0; i < STAT_LATENCY_BUCKETS; i++)
+    {
+        seen += s->latency[i];
+        if (seen > rank && (1ULL << (i + 1)) < s->latency_max_ns)
+        {
+            return (double)(1ULL << (i + 1)) / 1000;
+        }
+        if (seen > rank)
+        {
+            break;
+        }
+    }
+    return s->latency_max_ns / 1000.0;
+}
+
+struct msgbuf *stats_report()
+{
+    struct stats_snapshot s;
+    stats_snapshot(&s);
+    struct chat_log_stats log;
+    chat_log_get_stats(&log);
+    const unsigned long long *c = s.counters;
+    return msgbuf_printf(MAX_PROMPT_LEN * 4,
+                         "服务端统计（已运行 %lld 秒）：\n"
+                         "  连接：累计 %llu 个，当前 %llu 个\n"
+                         "  收到消息 %llu 条，%llu 字节\n"
+                         "  发出消息 %llu 条（入队 %llu 条），%llu 字节\n"
+                         "  发送队列已满：丢弃 %llu 条消息，断开 %llu 个连接\n"
+                         "  心跳超时断开 %llu 个连接\n"
+                         "  广播 %llu 次，耗时 p50 ≤ %.1f 微秒，p99 ≤ %.1f 微秒，最长 %.1f 微秒\n"
+                         "  日志队列已满丢弃 %llu 行，聊天记录积压丢弃 %llu 条\n"
+                         "  压缩 %llu 帧，%llu 字节压缩为 %llu 字节（%.1f%%），平均每帧耗时 %.1f 微秒\n"
+                         "  共享内存消息流已满丢弃 %llu 条\n"
+                         "  违禁词拦截 %llu 条消息\n"
+                         "  广播任务队列已满丢弃 %llu 次广播\n",
+                         (long long)(time(NULL) - stats.started),
+                         c[STAT_CONNECTIONS], c[STAT_CONNECTIONS] - c[STAT_DISCONNECTS],
+                         c[STAT_MESSAGES_IN], c[STAT_BYTES_IN],
+                         c[STAT_MESSAGES_OUT], c[STAT_ENQUEUED], c[STAT_BYTES_OUT],
+                         c[STAT_DROPPED], c[STAT_SLOW_DISCONNECTS],
+                         c[STAT_EVICTIONS],
+                         c[STAT_BROADCASTS], latency_percentile_us(&s, 50), latency_percentile_us(&s, 99),
+                         s.latency_max_ns / 1000.0,
+                         c[STAT_LOG_DROPPED], log.dropped,
+                         c[STAT_COMPRESSED], c[STAT_COMPRESS_BYTES_IN], c[STAT_COMPRESS_BYTES_OUT],
+                         c[STAT_COMPRESS_BYTES_IN] > 0 ? 100.0 * c[STAT_COMPRESS_BYTES_OUT] / c[STAT_COMPRESS_BYTES_IN] : 100.0,
+                         c[STAT_COMPRESSED] > 0 ? c[STAT_COMPRESS_NS] / 1000.0 / c[STAT_COMPRESSED] : 0.0,
+                         c[STAT_FIREHOSE_DROPPED],
+                         c[STAT_FILTERED], c[STAT_BROADCAST_DROPPED]);
+}
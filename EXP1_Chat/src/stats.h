@@ -0,0 +1,90 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "msgbuf.h"
+
+/**
+ * 服务端运行统计
+ *
+ * 每个线程有自己的一组计数器（第一次计数时分配并登记），只有这个线程写入：
+ * 计数是普通的读、加、写（relaxed 原子操作，不加锁，也不是带 lock 前缀的读改写指令），
+ * 各线程的计数器在不同的缓存行上，高频计数时线程之间没有争用。
+ * 查看统计时（/stats 命令）才把所有线程的计数器加起来；线程退出时它的计数并入一个汇总项。
+ */
+
+enum stat_counter
+{
+    STAT_CONNECTIONS,      // 接受的连接数
+    STAT_DISCONNECTS,      // 关闭的连接数
+    STAT_MESSAGES_IN,      // 收到的消息数
+    STAT_BYTES_IN,         // 收到的消息内容字节数
+    STAT_ENQUEUED,         // 放入发送队列的消息数
+    STAT_MESSAGES_OUT,     // 完整发送的消息数
+    STAT_BYTES_OUT,        // 发送的字节数（含长度前缀）
+    STAT_DROPPED,          // 因发送队列已满丢弃的消息数
+    STAT_SLOW_DISCONNECTS, // 因发送队列已满断开的连接数
+    STAT_EVICTIONS,        // 因心跳超时断开的连接数
+    STAT_BROADCASTS,       // 向房间成员广播的次数（大房间由几个广播线程分担时各计一次）
+    STAT_LOG_DROPPED,      // 因日志队列已满丢弃的日志行数
+    STAT_COMPRESSED,       // 尝试压缩的帧数（每条消息最多一次，与接收者人数无关）
+    STAT_COMPRESS_BYTES_IN,  // 压缩前的帧内容字节数
+    STAT_COMPRESS_BYTES_OUT, // 压缩后的帧内容字节数（没有变小、按原样发送的按原长度计）
+    STAT_COMPRESS_NS,      // 压缩耗时（纳秒）
+    STAT_FIREHOSE_DROPPED, // 共享内存消息流已满（订阅者跟不上或没有运行）丢弃的消息数
+    STAT_FILTERED,         // 命中违禁词没有发送的消息数
+    STAT_BROADCAST_DROPPED, // 事件驱动模式中广播线程的任务队列已满丢弃的广播数（每个广播线程各计一次）
+    STAT_COUNTERS
+};
+
+// 广播耗时直方图：第 i 个桶统计 [2^i, 2^(i+1)) 纳秒的广播，第 0 个桶包括不到 1 纳秒的
+#define STAT_LATENCY_BUCKETS 40
+
+struct stats_shard
+{
+    _Atomic unsigned long long counters[STAT_COUNTERS];
+    _Atomic unsigned long long latency[STAT_LATENCY_BUCKETS];
+    _Atomic unsigned long long latency_max_ns;
+    struct stats_shard *next;
+} __attribute__((aligned(64)));
+
+// 汇总后的统计
+struct stats_snapshot
+{
+    unsigned long long counters[STAT_COUNTERS];
+    unsigned long long latency[STAT_LATENCY_BUCKETS];
+    unsigned long long latency_max_ns;
+};
+
+// 服务端启动时调用，记录启动时间
+void stats_init();
+// 当前线程的计数器，第一次计数前为 NULL
+extern _Thread_local struct stats_shard *stats_local;
+// 为当前线程分配并登记计数器，内存不足时返回所有线程共用的备用项（计数可能不准确）
+struct stats_shard *stats_register();
+
+static inline struct stats_shard *stats_this_thread()
+{
+    return stats_local != NULL ? stats_local : stats_register();
+}
+
+// 只有所属线程写入，读、加、写之间不会被其他写入打断
+static inline void stats_bump(_Atomic unsigned long long *counter, unsigned long long value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline void stats_add(enum stat_counter counter, unsigned long long value)
+{
+    stats_bump(&stats_this_thread()->counters[counter], value);
+}
+
+// 记录一次广播的耗时（纳秒）
+void stats_record_broadcast(uint64_t ns);
+// 把所有线程的计数加起来，计数在读取过程中仍可能增加，各项之间不保证是同一时刻的值
+void stats_snapshot(struct stats_snapshot *out);
+// 生成 /stats 命令的文本报告
+struct msgbuf *stats_report();
+
+#endif // STATS_H
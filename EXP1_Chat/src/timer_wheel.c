@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include "timer_wheel.h"
+
+bool timer_wheel_init(struct timer_wheel *wheel, size_t slots, unsigned tick_ms, uint64_t now_ms)
+{
+    size_t count = 1;
+    while (count < slots)
+    {
+        count *= 2;
+    }
+    wheel->slots = calloc(count, sizeof(struct timer *));
+    if (wheel->slots == NULL)
+    {
+        return false;
+    }
+    wheel->mask = count - 1;
+    wheel->tick_ms = tick_ms;
+    wheel->current = now_ms / tick_ms;
+    wheel->armed = 0;
+    return true;
+}
+
+static void unlink_timer(struct timer_wheel *wheel, struct timer *timer)
+{
+    if (timer->prev != NULL)
+    {
+        timer->prev->next = timer->next;
+    }
+    else
+    {
+        wheel->slots[timer->expires & wheel->mask] = timer->next;
+    }
+    if (timer->next != NULL)
+    {
+        timer->next->prev = timer->prev;
+    }
+    timer->armed = false;
+    wheel->armed--;
+}
+
+void timer_wheel_schedule(struct timer_wheel *wheel, struct timer *timer, uint64_t deadline_ms)
+{
+    if (timer->armed)
+    {
+        unlink_timer(wheel, timer);
+    }
+    // 向上取整到刻度，已经过去的时刻在下一个刻度处理
+    uint64_t expires = (deadline_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (expires <= wheel->current)
+    {
+        expires = wheel->current + 1;
+    }
+    timer->expires = expires;
+    struct timer **slot = &wheel->slots[expires & wheel->mask];
+    timer->prev = NULL;
+    timer->next = *slot;
+    if (*slot != NULL)
+    {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    timer->armed = true;
+    wheel->armed++;
+}
+
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer *timer)
+{
+    if (timer->armed)
+    {
+        unlink_timer(wheel, timer);
+    }
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now_ms, void (*expire)(struct timer *timer))
+{
+    uint64_t target = now_ms / wheel->tick_ms;
+    if (target <= wheel->current)
+    {
+        return;
+    }
+    // 落后超过一圈时只需把每个槽检查一遍
+    uint64_t first = wheel->current + 1;
+    if (target - wheel->current > wheel->mask + 1)
+    {
+        first = target - wheel->mask;
+    }
+    struct timer *expired = NULL;
+    for (uint64_t tick = first; tick <= target; tick++)
+    {
+        struct timer *timer = wheel->slots[tick & wheel->mask];
+        while (timer != NULL)
+        {
+            struct timer *next = timer->next;
+            if (timer->expires <= target)
+            {
+                unlink_timer(wheel, timer);
+                timer->next = expired;
+                expired = timer;
+            }
+            timer = next;
+        }
+    }
+    wheel->current = target;
+
+    // 回调可能释放定时器，先取出 next
+    while (expired != NULL)
+    {
+        struct timer *next = expired->next;
+        expire(expired);
+        expired = next;
+    }
+}
+
+int timer_wheel_timeout_ms(const struct timer_wheel *wheel, uint64_t now_ms)
+{
+    if (wheel->armed == 0)
+    {
+        return -1;
+    }
+    uint64_t next = (wheel->current + 1) * wheel->tick_ms;
+    return next > now_ms ? (int)(next - now_ms) : 0;
+}
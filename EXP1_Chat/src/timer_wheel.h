@@ -0,0 +1,52 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 哈希时间轮
+ *
+ * 时间按 tick_ms 分成刻度，定时器挂在到期刻度对应的槽（刻度 % 槽数）的双向链表上，
+ * 添加、取消都是 O(1)；每过一个刻度只检查一个槽，到期刻度在之后几圈的定时器留在槽中。
+ * 定时器嵌在使用者的结构体中，不单独分配内存。
+ * 不加锁，由使用者保证只在一个线程中使用（或在同一把锁内）。
+ */
+
+struct timer
+{
+    uint64_t expires;   // 到期的刻度
+    struct timer *prev;
+    struct timer *next;
+    bool armed;         // 是否在轮上
+};
+
+struct timer_wheel
+{
+    struct timer **slots;
+    size_t mask;         // 槽数 - 1，槽数为 2 的幂
+    unsigned tick_ms;
+    uint64_t current;    // 已处理到的刻度
+    size_t armed;        // 轮上的定时器数
+};
+
+/**
+ * slots 为槽数（向上取整为 2 的幂），now_ms 为当前时间，内存不足时返回 false
+ */
+bool timer_wheel_init(struct timer_wheel *wheel, size_t slots, unsigned tick_ms, uint64_t now_ms);
+/**
+ * 设置定时器在 deadline_ms 到期（精度为一个刻度，不会提前），已在轮上时先取下
+ */
+void timer_wheel_schedule(struct timer_wheel *wheel, struct timer *timer, uint64_t deadline_ms);
+// 取下定时器，不在轮上时什么也不做
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer *timer);
+/**
+ * 处理 now_ms 之前到期的定时器：先全部从轮上取下，再逐个调用 expire
+ * expire 中可以重新 schedule 这个定时器，也可以释放它所在的结构体
+ */
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t now_ms, void (*expire)(struct timer *timer));
+// 距离下一个刻度的毫秒数，轮上没有定时器时返回 -1，可以直接作为 epoll_wait 的超时
+int timer_wheel_timeout_ms(const struct timer_wheel *wheel, uint64_t now_ms);
+
+#endif // TIMER_WHEEL_H
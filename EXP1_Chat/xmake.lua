@@ -3,15 +3,43 @@ add_rules("mode.debug", "mode.release")
 target("Client")
     set_kind("binary")
     add_files("src/*.c")
-    add_syslinks("readline", "pthread")
+    add_syslinks("readline", "pthread", "z")
     set_runargs("--client")
 
 target("Server")
     set_kind("binary")
     add_files("src/*.c")
-    add_syslinks("readline", "pthread")
+    add_syslinks("readline", "pthread", "z")
     set_runargs("--server")
 
+target("EventServer")
+    set_kind("binary")
+    add_files("src/*.c")
+    add_syslinks("readline", "pthread", "z")
+    set_runargs("--event-server")
+
+target("PacketBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/packet_bench.c", "src/packet.c")
+    add_syslinks("pthread")
+
+target("LogBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/log_bench.c", "src/chat_log.c", "src/msgbuf.c", "src/packet.c")
+    add_syslinks("pthread")
+
+target("ChatBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/chat_bench.c", "src/packet.c")
+
+target("FilterBench")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/filter_bench.c", "src/filter.c")
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --
@@ -0,0 +1,18 @@
+#include <ApiHandlers.h>
+#include <string>
+
+using std::string;
+using std::string_view;
+
+void registerApiHandlers(Router& router) {
+    // 健康检查接口
+    router.get("/health", [](const HttpRequestView&, ResponseWriter& writer) {
+        writer.writeResponse(200, "OK", "{\"status\":\"ok\"}", "application/json");
+    });
+
+    // 测试 POST 接口，接受 application/x-www-form-urlencoded 表单
+    router.post("/testPostApi", [](const HttpRequestView& request, ResponseWriter& writer) {
+        string content = "Hello " + request.formValue("name") + "!";
+        writer.writeResponse(200, "OK", content, "text/plain");
+    });
+}
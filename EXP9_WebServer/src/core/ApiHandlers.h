@@ -0,0 +1,11 @@
+#ifndef API_HANDLERS_H
+#define API_HANDLERS_H
+
+#include <Router.h>
+
+/**
+ * 注册服务器内置的接口处理函数
+ */
+void registerApiHandlers(Router& router);
+
+#endif
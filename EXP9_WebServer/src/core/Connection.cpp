@@ -0,0 +1,227 @@
+#include <Connection.h>
+#include <TlsContext.h>
+#include <FileMapCache.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+#include <limits.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <cstdint>
+#include <openssl/err.h>
+
+Connection::Connection(int sock) : sock(sock) {}
+
+Connection::Connection(int sock, SSL* ssl) : sock(sock), ssl(ssl) {}
+
+Connection::~Connection() {
+    if (ssl != nullptr) {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
+}
+
+bool Connection::handshake(std::string& error) {
+    if (ssl == nullptr) {
+        return true;
+    }
+    ERR_clear_error();
+    int result = SSL_accept(ssl);
+    if (result != 1) {
+        int code = SSL_get_error(ssl, result);
+        if (code == SSL_ERROR_SYSCALL) {
+            error = errno != 0 ? strerror(errno) : "连接被对端关闭";
+        } else {
+            error = takeOpensslErrors();
+        }
+        // 握手失败时不能再发送 close_notify
+        SSL_set_quiet_shutdown(ssl, 1);
+        return false;
+    }
+    return true;
+}
+
+ssize_t Connection::read(char* buf, size_t length) {
+    if (ssl == nullptr) {
+        return recv(sock, buf, length, 0);
+    }
+    ERR_clear_error();
+    int result = SSL_read(ssl, buf, (int)std::min(length, (size_t)INT32_MAX));
+    if (result > 0) {
+        return result;
+    }
+    int code = SSL_get_error(ssl, result);
+    if (code == SSL_ERROR_ZERO_RETURN) {
+        return 0;
+    }
+    if (code == SSL_ERROR_SYSCALL && errno == 0) {
+        // 对端未发送 close_notify 直接断开
+        SSL_set_quiet_shutdown(ssl, 1);
+        return 0;
+    }
+    if (code != SSL_ERROR_SYSCALL) {
+        SSL_set_quiet_shutdown(ssl, 1);
+        errno = EPROTO;
+    }
+    return -1;
+}
+
+bool Connection::waitReadable(int timeoutMs) {
+    if (ssl != nullptr && SSL_pending(ssl) > 0) {
+        return true;
+    }
+    pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeoutMs) > 0;
+}
+
+ssize_t Connection::write(const char* data, size_t length) {
+    if (ssl == nullptr) {
+        return send(sock, data, length, MSG_NOSIGNAL);
+    }
+    ERR_clear_error();
+    int result = SSL_write(ssl, data, (int)std::min(length, (size_t)INT32_MAX));
+    if (result > 0) {
+        return result;
+    }
+    SSL_set_quiet_shutdown(ssl, 1);
+    if (SSL_get_error(ssl, result) != SSL_ERROR_SYSCALL) {
+        errno = EPROTO;
+    }
+    return -1;
+}
+
+bool Connection::writeAll(const char* data, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t n = write(data + sent, length - sent);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+bool Connection::writevAll(iovec* iov, int count) {
+    while (count > 0) {
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = std::min(count, IOV_MAX);
+        ssize_t n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // 跳过已写完的段，写了一部分的段从断点继续
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+bool Connection::writeMapped(const FileMapping& mapping, size_t offset, size_t length) {
+    if (offset > mapping.size() || length > mapping.size() - offset) {
+        errno = EINVAL;
+        return false;
+    }
+    if (ssl == nullptr) {
+        return writeAll(mapping.data() + offset, length);
+    }
+    // 一个 TLS 记录的大小
+    char buffer[16 * 1024];
+    while (length > 0) {
+        size_t chunk = std::min(length, sizeof(buffer));
+        if (!FileMapCache::guardedCopy(mapping, offset, chunk, buffer)) {
+            errno = EFAULT;
+            return false;
+        }
+        if (!writeAll(buffer, chunk)) {
+            return false;
+        }
+        offset += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+bool Connection::canSendFile() const {
+    if (ssl == nullptr) {
+        return true;
+    }
+#ifdef SSL_OP_ENABLE_KTLS
+    return BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    return false;
+#endif
+}
+
+bool Connection::sendFile(int fileFd, off_t offset, size_t count) {
+    size_t sent = 0;
+    while (sent < count) {
+        ssize_t n;
+        if (ssl == nullptr) {
+            n = sendfile(sock, fileFd, &offset, count - sent);
+        } else {
+#ifdef SSL_OP_ENABLE_KTLS
+            // 内核完成加密，数据不经过用户态
+            n = SSL_sendfile(ssl, fileFd, offset, count - sent, 0);
+            if (n > 0) {
+                offset += n;
+            }
+#else
+            errno = ENOTSUP;
+            n = -1;
+#endif
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            // 文件在发送过程中被截断
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+void Connection::abort() {
+    if (ssl != nullptr) {
+        SSL_set_quiet_shutdown(ssl, 1);
+    }
+    shutdown(sock, SHUT_RDWR);
+}
+
+std::string Connection::alpnProtocol() const {
+    if (ssl == nullptr) {
+        return {};
+    }
+    const unsigned char* data = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(ssl, &data, &length);
+    return std::string((const char*)data, length);
+}
+
+bool Connection::isSessionReused() const {
+    return ssl != nullptr && SSL_session_reused(ssl);
+}
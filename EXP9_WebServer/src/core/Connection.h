@@ -0,0 +1,93 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <openssl/ssl.h>
+
+class FileMapping;
+
+/**
+ * 客户端连接的读写封装，屏蔽明文 socket 与 TLS 的差异
+ * 不负责关闭 socket，socket 仍由 HttpServerWorker 关闭
+ */
+class Connection {
+    public:
+        /**
+         * 明文连接
+         */
+        explicit Connection(int sock);
+        /**
+         * TLS 连接，接管 ssl 的所有权
+         */
+        Connection(int sock, SSL* ssl);
+        ~Connection();
+        Connection(const Connection&) = delete;
+        Connection& operator=(const Connection&) = delete;
+
+        /**
+         * 完成 TLS 握手（明文连接直接返回 true），失败时写入错误描述
+         */
+        bool handshake(std::string& error);
+        /**
+         * 读取数据，返回读取的字节数，0 表示对端关闭，-1 表示失败（errno 有效，超时为 EAGAIN）
+         */
+        ssize_t read(char* buf, size_t length);
+        /**
+         * 等待连接可读，timeoutMs 为 0 时立即返回。TLS 层已解密但尚未读取的数据也算可读
+         */
+        bool waitReadable(int timeoutMs);
+        /**
+         * 写出一次，返回写出的字节数，-1 表示失败
+         */
+        ssize_t write(const char* data, size_t length);
+        /**
+         * 循环写出全部数据，返回是否成功
+         */
+        bool writeAll(const char* data, size_t length);
+        /**
+         * 用 sendmsg 聚集写出多段数据，部分写入时从断点继续，返回是否全部写出。
+         * 只用于明文连接；各段可以直接指向文件映射区，文件被截断时返回 false（errno 为 EFAULT）
+         */
+        bool writevAll(iovec* iov, int count);
+        /**
+         * 循环写出文件映射区 [offset, offset + length)，返回是否成功，文件被截断时失败而不会使进程崩溃。
+         * 明文连接直接把映射区交给 send（内核访问到被截断的页时返回 EFAULT，不产生 SIGBUS）；
+         * TLS 连接在用户态加密，先在 SIGBUS 保护下按块复制到栈上的缓冲区，再交给 SSL_write
+         */
+        bool writeMapped(const FileMapping& mapping, size_t offset, size_t length);
+        /**
+         * 是否可以用 sendFile 零拷贝发送文件
+         * 明文连接总是可以；TLS 连接只有在内核接管了发送方向的加密（kTLS）时可以
+         */
+        bool canSendFile() const;
+        /**
+         * 从文件描述符零拷贝发送 [offset, offset + count)，返回是否全部发送成功
+         */
+        bool sendFile(int fileFd, off_t offset, size_t count);
+
+        /**
+         * 响应被中途打断（例如文件被截断）后调用，之后关闭连接时不再发送 TLS close_notify
+         */
+        void abort();
+
+        bool isTls() const {
+            return ssl != nullptr;
+        }
+        /**
+         * 握手协商出的 ALPN 协议，未协商时为空串
+         */
+        std::string alpnProtocol() const;
+        /**
+         * TLS 会话是否是恢复的会话
+         */
+        bool isSessionReused() const;
+
+    private:
+        int sock;
+        SSL* ssl = nullptr;
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include <FileMapCache.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <string.h>
+
+namespace {
+
+// 当前线程正在保护的映射区及跳转点
+thread_local sigjmp_buf* sigbusJump = nullptr;
+thread_local const char* guardedBegin = nullptr;
+thread_local const char* guardedEnd = nullptr;
+
+struct sigaction previousSigbusAction;
+std::once_flag sigbusHandlerOnce;
+
+void sigbusHandler(int sig, siginfo_t* info, void* context) {
+    const char* addr = (const char*)info->si_addr;
+    if (sigbusJump != nullptr && addr >= guardedBegin && addr < guardedEnd) {
+        siglongjmp(*sigbusJump, 1);
+    }
+    // 不是映射区引起的 SIGBUS，交还给原来的处理方式
+    if (previousSigbusAction.sa_flags & SA_SIGINFO) {
+        previousSigbusAction.sa_sigaction(sig, info, context);
+    } else if (previousSigbusAction.sa_handler != SIG_IGN && previousSigbusAction.sa_handler != SIG_DFL) {
+        previousSigbusAction.sa_handler(sig);
+    } else {
+        signal(SIGBUS, SIG_DFL);
+        raise(SIGBUS);
+    }
+}
+
+void installSigbusHandler() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = sigbusHandler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &previousSigbusAction);
+}
+
+}  // namespace
+
+FileMapping::FileMapping(const char* data, size_t size, dev_t device, ino_t inode, timespec mtime)
+    : mappedData(data), mappedSize(size), device(device), inode(inode), mtime(mtime) {}
+
+FileMapping::~FileMapping() {
+    munmap((void*)mappedData, mappedSize);
+}
+
+bool FileMapping::matches(const struct stat& st) const {
+    return st.st_dev == device && st.st_ino == inode && (size_t)st.st_size == mappedSize && st.st_mtim.tv_sec == mtime.tv_sec &&
+           st.st_mtim.tv_nsec == mtime.tv_nsec;
+}
+
+FileMapCache::FileMapCache(size_t maxMappedBytes, size_t minFileSize, size_t maxFileSize)
+    : maxMappedBytes(maxMappedBytes), minFileSize(minFileSize), maxFileSize(maxFileSize) {
+    std::call_once(sigbusHandlerOnce, installSigbusHandler);
+}
+
+std::shared_ptr<const FileMapping> FileMapCache::acquire(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    if ((size_t)st.st_size < minFileSize || (size_t)st.st_size > maxFileSize) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        auto it = index.find(path);
+        if (it != index.end()) {
+            if (it->second->mapping->matches(st)) {
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->mapping;
+            }
+            // 文件已经变化，丢弃旧映射（正在使用它的响应仍持有引用）
+            mappedBytes -= it->second->mapping->size();
+            lru.erase(it->second);
+            index.erase(it);
+        }
+    }
+
+    // 映射在锁外进行，MAP_POPULATE 会同步读入整个文件
+    std::shared_ptr<const FileMapping> mapping = mapFile(path, st);
+    if (!mapping) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> locker(mutex);
+    auto it = index.find(path);
+    if (it != index.end()) {
+        // 其他线程已经映射了同一文件
+        if (it->second->mapping->matches(st)) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->mapping;
+        }
+        mappedBytes -= it->second->mapping->size();
+        lru.erase(it->second);
+        index.erase(it);
+    }
+    lru.push_front(CacheEntry{path, mapping});
+    index[path] = lru.begin();
+    mappedBytes += mapping->size();
+    evictLocked();
+    return mapping;
+}
+
+void FileMapCache::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> locker(mutex);
+    auto it = index.find(path);
+    if (it != index.end()) {
+        mappedBytes -= it->second->mapping->size();
+        lru.erase(it->second);
+        index.erase(it);
+    }
+}
+
+std::shared_ptr<const FileMapping> FileMapCache::mapFile(const std::string& path, const struct stat& st) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    // 打开后再检查一次，确保映射的是 stat 看到的那个文件
+    struct stat opened;
+    if (fstat(fd, &opened) < 0 || opened.st_ino != st.st_ino || opened.st_size != st.st_size) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, opened.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    madvise(data, opened.st_size, MADV_WILLNEED);
+    return std::make_shared<const FileMapping>((const char*)data, (size_t)opened.st_size, opened.st_dev, opened.st_ino, opened.st_mtim);
+}
+
+void FileMapCache::evictLocked() {
+    // 保留最近使用的一项，即使它本身超过预算
+    while (mappedBytes > maxMappedBytes && lru.size() > 1) {
+        CacheEntry& victim = lru.back();
+        mappedBytes -= victim.mapping->size();
+        index.erase(victim.path);
+        lru.pop_back();
+    }
+}
+
+bool FileMapCache::guardedCopy(const FileMapping& mapping, size_t offset, size_t length, char* out) {
+    if (offset > mapping.size() || length > mapping.size() - offset) {
+        return false;
+    }
+    sigjmp_buf jump;
+    if (sigsetjmp(jump, 1) != 0) {
+        sigbusJump = nullptr;
+        return false;
+    }
+    sigbusJump = &jump;
+    guardedBegin = mapping.data();
+    guardedEnd = mapping.data() + mapping.size();
+    memcpy(out, mapping.data() + offset, length);
+    sigbusJump = nullptr;
+    return true;
+}
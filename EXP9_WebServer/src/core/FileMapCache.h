@@ -0,0 +1,89 @@
+#ifndef FILE_MAP_CACHE_H
+#define FILE_MAP_CACHE_H
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/**
+ * 一个只读的文件内存映射，析构时解除映射
+ * 通过 shared_ptr 在多个并发响应之间共享，被缓存淘汰后仍可安全使用到最后一个响应结束
+ */
+class FileMapping {
+    public:
+        FileMapping(const char* data, size_t size, dev_t device, ino_t inode, timespec mtime);
+        ~FileMapping();
+        FileMapping(const FileMapping&) = delete;
+        FileMapping& operator=(const FileMapping&) = delete;
+
+        const char* data() const {
+            return mappedData;
+        }
+        size_t size() const {
+            return mappedSize;
+        }
+        /**
+         * 判断映射是否仍对应磁盘上的同一个文件版本
+         */
+        bool matches(const struct stat& st) const;
+
+    private:
+        const char* mappedData;
+        size_t mappedSize;
+        dev_t device;
+        ino_t inode;
+        timespec mtime;
+};
+
+/**
+ * 中等大小热点文件的内存映射缓存
+ *
+ * 大小在 [minFileSize, maxFileSize] 范围内的文件会被映射一次（MAP_POPULATE 预读），
+ * 之后的请求直接从映射区发送，省去每次 QFile::readAll 的分配和复制。
+ * 文件修改时间、大小或 inode 变化时重新映射；映射总量超过 maxMappedBytes 时按 LRU 淘汰。
+ */
+class FileMapCache {
+    public:
+        explicit FileMapCache(size_t maxMappedBytes = 512 * 1024 * 1024, size_t minFileSize = 256 * 1024, size_t maxFileSize = 128 * 1024 * 1024);
+        /**
+         * 获取文件的映射，文件大小不在缓存范围内或映射失败时返回 nullptr
+         */
+        std::shared_ptr<const FileMapping> acquire(const std::string& path);
+        /**
+         * 将文件移出缓存（例如发送时发现文件已被截断）
+         */
+        void invalidate(const std::string& path);
+
+        /**
+         * 在 SIGBUS 保护下把映射区 [offset, offset + length) 复制到 out，文件被截断时返回 false 而不会使进程崩溃。
+         * 保护范围内只有 memcpy，SIGBUS 时跳出不会越过 C++ 析构或 OpenSSL 等库内部的状态更新；
+         * 需要在用户态读取映射区的写出方式（TLS 加密）应先按块复制出来再写出
+         */
+        static bool guardedCopy(const FileMapping& mapping, size_t offset, size_t length, char* out);
+
+    private:
+        struct CacheEntry {
+            std::string path;
+            std::shared_ptr<const FileMapping> mapping;
+        };
+
+        size_t maxMappedBytes;
+        size_t minFileSize;
+        size_t maxFileSize;
+        size_t mappedBytes = 0;
+        std::mutex mutex;
+        // 链表头部为最近使用
+        std::list<CacheEntry> lru;
+        std::unordered_map<std::string, std::list<CacheEntry>::iterator> index;
+
+        static std::shared_ptr<const FileMapping> mapFile(const std::string& path, const struct stat& st);
+        void evictLocked();
+};
+
+#endif
@@ -0,0 +1,448 @@
+#include <Hpack.h>
+
+namespace {
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t length;
+};
+
+// RFC 7541 附录 B 的 Huffman 编码表，下标为符号，256 为 EOS
+const HuffmanCode HUFFMAN_TABLE[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// RFC 7541 附录 A 的静态表
+const HpackHeader STATIC_TABLE[HpackTable::STATIC_TABLE_SIZE] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+/**
+ * Huffman 解码树，按位行走，叶子节点保存符号
+ */
+struct HuffmanTree {
+    struct Node {
+        int16_t children[2] = {-1, -1};
+        int16_t symbol = -1;
+    };
+    std::vector<Node> nodes;
+
+    HuffmanTree() {
+        nodes.emplace_back();
+        for (int symbol = 0; symbol < 257; symbol++) {
+            const HuffmanCode& code = HUFFMAN_TABLE[symbol];
+            int node = 0;
+            for (int bit = code.length - 1; bit >= 0; bit--) {
+                int direction = (code.code >> bit) & 1;
+                if (nodes[node].children[direction] < 0) {
+                    nodes[node].children[direction] = (int16_t)nodes.size();
+                    nodes.emplace_back();
+                }
+                node = nodes[node].children[direction];
+            }
+            nodes[node].symbol = (int16_t)symbol;
+        }
+    }
+};
+
+const HuffmanTree& huffmanTree() {
+    static const HuffmanTree tree;
+    return tree;
+}
+
+/**
+ * 每次都变化的字段不加入动态表，避免把有用的字段挤出去
+ */
+bool shouldIndex(std::string_view name) {
+    return name != "content-length" && name != ":path" && name != "etag" && name != "set-cookie" && name != "authorization";
+}
+
+}  // namespace
+
+namespace hpack {
+
+void encodeInteger(uint64_t value, int prefixBits, uint8_t firstByte, std::string& out) {
+    uint64_t maxPrefix = (1u << prefixBits) - 1;
+    if (value < maxPrefix) {
+        out.push_back((char)(firstByte | value));
+        return;
+    }
+    out.push_back((char)(firstByte | maxPrefix));
+    value -= maxPrefix;
+    while (value >= 128) {
+        out.push_back((char)(value % 128 + 128));
+        value /= 128;
+    }
+    out.push_back((char)value);
+}
+
+bool decodeInteger(const uint8_t* data, size_t length, size_t& pos, int prefixBits, uint64_t& value) {
+    if (pos >= length) {
+        return false;
+    }
+    uint64_t maxPrefix = (1u << prefixBits) - 1;
+    value = data[pos++] & maxPrefix;
+    if (value < maxPrefix) {
+        return true;
+    }
+    int shift = 0;
+    while (pos < length) {
+        uint8_t byte = data[pos++];
+        // 超过 2^32 的整数在 HTTP/2 中没有意义，视为错误
+        if (shift > 28) {
+            return false;
+        }
+        value += (uint64_t)(byte & 127) << shift;
+        shift += 7;
+        if ((byte & 128) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t huffmanEncodedLength(std::string_view input) {
+    size_t bits = 0;
+    for (unsigned char c : input) {
+        bits += HUFFMAN_TABLE[c].length;
+    }
+    return (bits + 7) / 8;
+}
+
+void huffmanEncode(std::string_view input, std::string& out) {
+    uint64_t buffer = 0;
+    int bits = 0;
+    for (unsigned char c : input) {
+        const HuffmanCode& code = HUFFMAN_TABLE[c];
+        buffer = (buffer << code.length) | code.code;
+        bits += code.length;
+        while (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(buffer >> bits));
+        }
+    }
+    // 用 EOS 的高位（全 1）填充最后一个字节
+    if (bits > 0) {
+        out.push_back((char)((buffer << (8 - bits)) | (0xff >> bits)));
+    }
+}
+
+bool huffmanDecode(const uint8_t* data, size_t length, std::string& out) {
+    const HuffmanTree& tree = huffmanTree();
+    int node = 0;
+    // 自上一个符号以来读入的位数及是否全为 1，用于校验填充
+    int pendingBits = 0;
+    bool allOnes = true;
+    for (size_t i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            int direction = (data[i] >> bit) & 1;
+            node = tree.nodes[node].children[direction];
+            if (node < 0) {
+                return false;
+            }
+            pendingBits++;
+            allOnes = allOnes && direction == 1;
+            int symbol = tree.nodes[node].symbol;
+            if (symbol >= 0) {
+                if (symbol == 256) {
+                    return false;   // 字符串中不允许出现 EOS
+                }
+                out.push_back((char)symbol);
+                node = 0;
+                pendingBits = 0;
+                allOnes = true;
+            }
+        }
+    }
+    // 填充必须是不超过 7 位的 EOS 前缀
+    return pendingBits <= 7 && allOnes;
+}
+
+}  // namespace hpack
+
+namespace {
+
+bool decodeString(const uint8_t* data, size_t length, size_t& pos, std::string& out) {
+    if (pos >= length) {
+        return false;
+    }
+    bool huffman = data[pos] & 0x80;
+    uint64_t stringLength;
+    if (!hpack::decodeInteger(data, length, pos, 7, stringLength) || stringLength > length - pos) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!hpack::huffmanDecode(data + pos, stringLength, out)) {
+            return false;
+        }
+    } else {
+        out.assign((const char*)data + pos, stringLength);
+    }
+    pos += stringLength;
+    return true;
+}
+
+void encodeString(std::string_view value, std::string& out) {
+    size_t huffmanLength = hpack::huffmanEncodedLength(value);
+    if (huffmanLength < value.size()) {
+        hpack::encodeInteger(huffmanLength, 7, 0x80, out);
+        hpack::huffmanEncode(value, out);
+    } else {
+        hpack::encodeInteger(value.size(), 7, 0, out);
+        out.append(value);
+    }
+}
+
+}  // namespace
+
+const HpackHeader* HpackTable::get(size_t index) const {
+    if (index == 0) {
+        return nullptr;
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        return &STATIC_TABLE[index - 1];
+    }
+    index -= STATIC_TABLE_SIZE + 1;
+    return index < entries.size() ? &entries[index] : nullptr;
+}
+
+void HpackTable::add(std::string_view name, std::string_view value) {
+    size_t size = entrySize(name, value);
+    // 比整个表还大的字段会清空表且不被加入（RFC 7541 4.4 节）
+    if (size > maxSize) {
+        evict(0);
+        return;
+    }
+    evict(maxSize - size);
+    entries.push_front(HpackHeader{std::string(name), std::string(value)});
+    currentSize += size;
+}
+
+void HpackTable::setMaxSize(size_t size) {
+    maxSize = size;
+    evict(maxSize);
+}
+
+void HpackTable::evict(size_t limit) {
+    while (currentSize > limit && !entries.empty()) {
+        currentSize -= entrySize(entries.back().name, entries.back().value);
+        entries.pop_back();
+    }
+}
+
+size_t HpackTable::find(std::string_view name, std::string_view value, size_t& nameIndex) const {
+    nameIndex = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+        if (STATIC_TABLE[i].name == name) {
+            if (STATIC_TABLE[i].value == value) {
+                return i + 1;
+            }
+            if (nameIndex == 0) {
+                nameIndex = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].name == name) {
+            if (entries[i].value == value) {
+                return STATIC_TABLE_SIZE + 1 + i;
+            }
+            if (nameIndex == 0) {
+                nameIndex = STATIC_TABLE_SIZE + 1 + i;
+            }
+        }
+    }
+    return 0;
+}
+
+bool HpackDecoder::decode(const uint8_t* data, size_t length, std::vector<HpackHeader>& headers) {
+    size_t pos = 0;
+    bool fieldSeen = false;
+    while (pos < length) {
+        uint8_t byte = data[pos];
+        uint64_t index;
+        if (byte & 0x80) {
+            // 索引字段
+            if (!hpack::decodeInteger(data, length, pos, 7, index)) {
+                return false;
+            }
+            const HpackHeader* header = table.get(index);
+            if (header == nullptr) {
+                return false;
+            }
+            headers.push_back(*header);
+            fieldSeen = true;
+        } else if ((byte & 0xe0) == 0x20) {
+            // 动态表大小更新，只能出现在头部块开头
+            if (fieldSeen || !hpack::decodeInteger(data, length, pos, 5, index) || index > maxAllowedSize) {
+                return false;
+            }
+            table.setMaxSize(index);
+        } else {
+            // 字面量字段：01 增量索引（6 位前缀），0000 不索引，0001 永不索引（4 位前缀）
+            bool incremental = (byte & 0xc0) == 0x40;
+            if (!hpack::decodeInteger(data, length, pos, incremental ? 6 : 4, index)) {
+                return false;
+            }
+            HpackHeader header;
+            if (index == 0) {
+                if (!decodeString(data, length, pos, header.name)) {
+                    return false;
+                }
+            } else {
+                const HpackHeader* nameHeader = table.get(index);
+                if (nameHeader == nullptr) {
+                    return false;
+                }
+                header.name = nameHeader->name;
+            }
+            if (!decodeString(data, length, pos, header.value)) {
+                return false;
+            }
+            if (incremental) {
+                table.add(header.name, header.value);
+            }
+            headers.push_back(std::move(header));
+            fieldSeen = true;
+        }
+    }
+    return true;
+}
+
+void HpackEncoder::setMaxTableSize(size_t size) {
+    // 动态表不需要超过默认大小
+    pendingSize = size < HpackTable::DEFAULT_MAX_SIZE ? size : HpackTable::DEFAULT_MAX_SIZE;
+    pendingSizeUpdate = true;
+}
+
+void HpackEncoder::encode(const std::vector<HpackHeader>& headers, std::string& out) {
+    if (pendingSizeUpdate) {
+        table.setMaxSize(pendingSize);
+        hpack::encodeInteger(pendingSize, 5, 0x20, out);
+        pendingSizeUpdate = false;
+    }
+    for (const HpackHeader& header : headers) {
+        size_t nameIndex;
+        size_t index = table.find(header.name, header.value, nameIndex);
+        if (index != 0) {
+            hpack::encodeInteger(index, 7, 0x80, out);
+            continue;
+        }
+        bool indexing = shouldIndex(header.name) && HpackTable::entrySize(header.name, header.value) <= table.getMaxSize() / 2;
+        if (indexing) {
+            hpack::encodeInteger(nameIndex, 6, 0x40, out);
+        } else {
+            hpack::encodeInteger(nameIndex, 4, 0x00, out);
+        }
+        if (nameIndex == 0) {
+            encodeString(header.name, out);
+        }
+        encodeString(header.value, out);
+        if (indexing) {
+            table.add(header.name, header.value);
+        }
+    }
+}
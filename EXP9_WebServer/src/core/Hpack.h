@@ -0,0 +1,121 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * 一个头部字段，HTTP/2 要求字段名为小写
+ */
+struct HpackHeader {
+    std::string name;
+    std::string value;
+};
+
+/**
+ * HPACK 索引表：1~61 为所有连接共享的静态表，62 之后为本连接的动态表（新加入的在前）
+ */
+class HpackTable {
+    public:
+        static constexpr size_t STATIC_TABLE_SIZE = 61;
+        static constexpr size_t DEFAULT_MAX_SIZE = 4096;
+
+        /**
+         * 按 1 起始的索引获取字段，越界返回 nullptr
+         */
+        const HpackHeader* get(size_t index) const;
+        /**
+         * 加入动态表，必要时淘汰最旧的字段
+         */
+        void add(std::string_view name, std::string_view value);
+        /**
+         * 修改动态表容量并淘汰超出部分
+         */
+        void setMaxSize(size_t size);
+        size_t getMaxSize() const {
+            return maxSize;
+        }
+        /**
+         * 查找字段：返回完全匹配的索引，没有时通过 nameIndex 返回只匹配名字的索引（0 表示没有）
+         */
+        size_t find(std::string_view name, std::string_view value, size_t& nameIndex) const;
+
+        /**
+         * 字段占用的表空间（RFC 7541 4.1 节）
+         */
+        static size_t entrySize(std::string_view name, std::string_view value) {
+            return name.size() + value.size() + 32;
+        }
+
+    private:
+        std::deque<HpackHeader> entries;
+        size_t currentSize = 0;
+        size_t maxSize = DEFAULT_MAX_SIZE;
+
+        void evict(size_t limit);
+};
+
+/**
+ * HPACK 解码器，每个连接一个
+ */
+class HpackDecoder {
+    public:
+        /**
+         * 解码一个完整的头部块并追加到 headers，格式错误时返回 false（应以 COMPRESSION_ERROR 关闭连接）
+         */
+        bool decode(const uint8_t* data, size_t length, std::vector<HpackHeader>& headers);
+        /**
+         * 本端通过 SETTINGS_HEADER_TABLE_SIZE 通告的上限，对端的动态表大小更新不能超过它
+         */
+        void setMaxAllowedTableSize(size_t size) {
+            maxAllowedSize = size;
+        }
+
+    private:
+        HpackTable table;
+        size_t maxAllowedSize = HpackTable::DEFAULT_MAX_SIZE;
+};
+
+/**
+ * HPACK 编码器，每个连接一个
+ * 完全匹配静态表或动态表的字段编码为索引，其余字段（除 content-length 等每次都变化的字段）加入动态表，
+ * 字符串在 Huffman 编码更短时使用 Huffman 编码
+ */
+class HpackEncoder {
+    public:
+        void encode(const std::vector<HpackHeader>& headers, std::string& out);
+        /**
+         * 对端通过 SETTINGS_HEADER_TABLE_SIZE 修改了动态表上限，下一个头部块开头会发出大小更新
+         */
+        void setMaxTableSize(size_t size);
+
+    private:
+        HpackTable table;
+        bool pendingSizeUpdate = false;
+        size_t pendingSize = HpackTable::DEFAULT_MAX_SIZE;
+};
+
+namespace hpack {
+
+/**
+ * 编码整数，prefixBits 为前缀位数，firstByte 为第一个字节中前缀之外的标志位
+ */
+void encodeInteger(uint64_t value, int prefixBits, uint8_t firstByte, std::string& out);
+/**
+ * 解码整数，成功时移动 pos
+ */
+bool decodeInteger(const uint8_t* data, size_t length, size_t& pos, int prefixBits, uint64_t& value);
+/**
+ * Huffman 编码与解码
+ */
+void huffmanEncode(std::string_view input, std::string& out);
+size_t huffmanEncodedLength(std::string_view input);
+bool huffmanDecode(const uint8_t* data, size_t length, std::string& out);
+
+}  // namespace hpack
+
+#endif
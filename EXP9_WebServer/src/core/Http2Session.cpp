@@ -0,0 +1,769 @@
+#include <Http2Session.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// 帧类型
+enum FrameType : uint8_t {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9,
+};
+
+// 帧标志
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+// 错误码
+constexpr uint32_t NO_ERROR = 0x0;
+constexpr uint32_t PROTOCOL_ERROR = 0x1;
+constexpr uint32_t INTERNAL_ERROR = 0x2;
+constexpr uint32_t FLOW_CONTROL_ERROR = 0x3;
+constexpr uint32_t STREAM_CLOSED = 0x5;
+constexpr uint32_t FRAME_SIZE_ERROR = 0x6;
+constexpr uint32_t REFUSED_STREAM = 0x7;
+constexpr uint32_t CANCEL = 0x8;
+constexpr uint32_t COMPRESSION_ERROR = 0x9;
+
+// 设置项
+constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+// 本端参数
+constexpr uint32_t MAX_CONCURRENT_STREAMS = 100;
+constexpr uint32_t LOCAL_MAX_FRAME_SIZE = 16384;
+constexpr uint32_t MAX_HEADER_LIST_SIZE = 64 * 1024;
+constexpr size_t MAX_REQUEST_BODY = 16 * 1024 * 1024;
+constexpr int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+// 每轮调度最多写入输出缓冲区的字节数，写完后检查一次有没有新的输入
+constexpr size_t OUTPUT_BATCH = 256 * 1024;
+
+uint32_t readUint32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void appendUint32(std::string& out, uint32_t value) {
+    out.push_back((char)(value >> 24));
+    out.push_back((char)(value >> 16));
+    out.push_back((char)(value >> 8));
+    out.push_back((char)value);
+}
+
+void appendSetting(std::string& out, uint16_t id, uint32_t value) {
+    out.push_back((char)(id >> 8));
+    out.push_back((char)id);
+    appendUint32(out, value);
+}
+
+/**
+ * 解码 HTTP2-Settings 头部（base64url，无填充）
+ */
+bool base64UrlDecode(std::string_view input, std::string& out) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : input) {
+        int value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '-' || c == '+') {
+            value = 62;
+        } else if (c == '_' || c == '/') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        buffer = (buffer << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(buffer >> bits));
+        }
+    }
+    return true;
+}
+
+/**
+ * 解析 RFC 9218 的 priority 头部，例如 "u=1, i"
+ */
+void parsePriority(std::string_view value, int& urgency, bool& incremental) {
+    incremental = false;
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && item.back() == ' ') {
+            item.remove_suffix(1);
+        }
+        if (item.size() == 3 && item.substr(0, 2) == "u=" && item[2] >= '0' && item[2] <= '7') {
+            urgency = item[2] - '0';
+        } else if (item == "i" || item == "i=?1") {
+            incremental = true;
+        } else if (item == "i=?0") {
+            incremental = false;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        value.remove_prefix(comma + 1);
+    }
+}
+
+}  // namespace
+
+std::string_view Http2Session::Request::header(std::string_view name) const {
+    for (const HpackHeader& h : headers) {
+        if (h.name == name) {
+            return h.value;
+        }
+    }
+    return {};
+}
+
+Http2Session::Http2Session(Connection& connection, RequestHandler handler) : connection(connection), handler(std::move(handler)) {}
+
+void Http2Session::run(std::string_view received, std::string_view upgradeSettings, const std::function<void()>& onUpgradeStream) {
+    // 服务端连接前言：SETTINGS 帧
+    std::string settings;
+    appendSetting(settings, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    appendSetting(settings, SETTINGS_ENABLE_PUSH, 0);
+    appendSetting(settings, SETTINGS_MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST_SIZE);
+    writeFrame(FRAME_SETTINGS, 0, 0, settings);
+    input.assign(received);
+
+    // h2c 升级：HTTP2-Settings 视为客户端的第一个 SETTINGS，升级请求成为流 1
+    if (onUpgradeStream) {
+        std::string payload;
+        if (!base64UrlDecode(upgradeSettings, payload) || payload.size() % 6 != 0) {
+            goAway(PROTOCOL_ERROR);
+            flush();
+            return;
+        }
+        for (size_t i = 0; i < payload.size(); i += 6) {
+            const uint8_t* p = (const uint8_t*)payload.data() + i;
+            if (!applySetting((uint16_t)(p[0] << 8 | p[1]), readUint32(p + 2))) {
+                flush();
+                return;
+            }
+        }
+        Stream& stream = streams[1];
+        stream.id = 1;
+        stream.remoteClosed = true;
+        stream.sendWindow = peerInitialWindowSize;
+        lastStreamId = 1;
+        onUpgradeStream();
+    }
+
+    char buf[16384];
+    while (!closed) {
+        if (!processInput()) {
+            break;
+        }
+        scheduleData();
+        if (!flush()) {
+            return;
+        }
+        if (goingAway && streams.empty()) {
+            break;
+        }
+        // 还有数据可发时不阻塞在读取上
+        if (hasSendableData() && !connection.waitReadable(0)) {
+            continue;
+        }
+        ssize_t n = connection.read(buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        input.append(buf, n);
+    }
+    if (!closed) {
+        goAway(NO_ERROR);
+    }
+    flush();
+}
+
+bool Http2Session::processInput() {
+    if (!prefaceReceived) {
+        size_t n = std::min(input.size(), CLIENT_PREFACE.size());
+        if (std::string_view(input).substr(0, n) != CLIENT_PREFACE.substr(0, n)) {
+            goAway(PROTOCOL_ERROR);
+            return false;
+        }
+        if (n < CLIENT_PREFACE.size()) {
+            return true;
+        }
+        prefaceReceived = true;
+        input.erase(0, CLIENT_PREFACE.size());
+    }
+
+    size_t pos = 0;
+    bool ok = true;
+    while (input.size() - pos >= 9) {
+        const uint8_t* header = (const uint8_t*)input.data() + pos;
+        uint32_t length = (uint32_t)header[0] << 16 | (uint32_t)header[1] << 8 | header[2];
+        uint8_t type = header[3];
+        uint8_t flags = header[4];
+        int32_t streamId = (int32_t)(readUint32(header + 5) & 0x7fffffff);
+        if (length > LOCAL_MAX_FRAME_SIZE) {
+            goAway(FRAME_SIZE_ERROR);
+            ok = false;
+            break;
+        }
+        if (input.size() - pos < 9 + length) {
+            break;
+        }
+        if (!processFrame(type, flags, streamId, header + 9, length)) {
+            ok = false;
+            break;
+        }
+        pos += 9 + length;
+    }
+    input.erase(0, pos);
+    return ok;
+}
+
+bool Http2Session::processFrame(uint8_t type, uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length) {
+    // 头部块必须连续，中间不能插入其他帧
+    if (headerBlockStream != 0 && (type != FRAME_CONTINUATION || streamId != headerBlockStream)) {
+        goAway(PROTOCOL_ERROR);
+        return false;
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            return handleData(flags, streamId, payload, length);
+        case FRAME_HEADERS:
+            return handleHeaders(flags, streamId, payload, length);
+        case FRAME_PRIORITY: {
+            if (streamId == 0) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            if (length != 5) {
+                resetStream(streamId, FRAME_SIZE_ERROR);
+                return true;
+            }
+            auto it = streams.find(streamId);
+            if (it != streams.end()) {
+                it->second.weight = payload[4] + 1;
+            }
+            return true;
+        }
+        case FRAME_RST_STREAM:
+            if (streamId == 0) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            if (length != 4) {
+                goAway(FRAME_SIZE_ERROR);
+                return false;
+            }
+            streams.erase(streamId);
+            return true;
+        case FRAME_SETTINGS:
+            if (streamId != 0) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            return handleSettings(flags, payload, length);
+        case FRAME_PUSH_PROMISE:
+            // 客户端不能推送
+            goAway(PROTOCOL_ERROR);
+            return false;
+        case FRAME_PING:
+            if (streamId != 0) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            if (length != 8) {
+                goAway(FRAME_SIZE_ERROR);
+                return false;
+            }
+            if ((flags & FLAG_ACK) == 0) {
+                writeFrame(FRAME_PING, FLAG_ACK, 0, std::string_view((const char*)payload, length));
+            }
+            return true;
+        case FRAME_GOAWAY:
+            // 不再接受新流，处理完已有的流后关闭
+            goingAway = true;
+            return true;
+        case FRAME_WINDOW_UPDATE:
+            return handleWindowUpdate(streamId, payload, length);
+        case FRAME_CONTINUATION:
+            if (headerBlockStream == 0) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            headerBlock.append((const char*)payload, length);
+            if (headerBlock.size() > MAX_HEADER_LIST_SIZE) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            if (flags & FLAG_END_HEADERS) {
+                return handleHeaderBlockComplete();
+            }
+            return true;
+        default:
+            // 未知类型的帧必须忽略
+            return true;
+    }
+}
+
+bool Http2Session::handleHeaders(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length) {
+    if (streamId == 0 || streamId % 2 == 0) {
+        goAway(PROTOCOL_ERROR);
+        return false;
+    }
+    uint32_t pos = 0;
+    uint32_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1) {
+            goAway(FRAME_SIZE_ERROR);
+            return false;
+        }
+        padding = payload[0];
+        pos = 1;
+    }
+    headerBlockWeight = -1;
+    if (flags & FLAG_PRIORITY) {
+        if (length < pos + 5) {
+            goAway(FRAME_SIZE_ERROR);
+            return false;
+        }
+        headerBlockWeight = payload[pos + 4] + 1;
+        pos += 5;
+    }
+    if (padding > length - pos) {
+        goAway(PROTOCOL_ERROR);
+        return false;
+    }
+    headerBlockStream = streamId;
+    headerBlockEndStream = flags & FLAG_END_STREAM;
+    headerBlock.assign((const char*)payload + pos, length - pos - padding);
+    if (flags & FLAG_END_HEADERS) {
+        return handleHeaderBlockComplete();
+    }
+    return true;
+}
+
+bool Http2Session::handleHeaderBlockComplete() {
+    int32_t streamId = headerBlockStream;
+    headerBlockStream = 0;
+
+    // 即使要拒绝这个流也必须解码，保持动态表与对端同步
+    std::vector<HpackHeader> headers;
+    if (!decoder.decode((const uint8_t*)headerBlock.data(), headerBlock.size(), headers)) {
+        goAway(COMPRESSION_ERROR);
+        return false;
+    }
+    headerBlock.clear();
+
+    auto it = streams.find(streamId);
+    if (it != streams.end()) {
+        // 已有流上的 HEADERS 是请求尾部（trailers），必须结束流
+        Stream& stream = it->second;
+        if (stream.remoteClosed) {
+            resetStream(streamId, STREAM_CLOSED);
+            return true;
+        }
+        if (!headerBlockEndStream) {
+            goAway(PROTOCOL_ERROR);
+            return false;
+        }
+        stream.remoteClosed = true;
+        dispatchRequest(stream);
+        return true;
+    }
+
+    if (streamId <= lastStreamId) {
+        goAway(STREAM_CLOSED);
+        return false;
+    }
+    lastStreamId = streamId;
+    if (goingAway || streams.size() >= MAX_CONCURRENT_STREAMS) {
+        resetStream(streamId, REFUSED_STREAM);
+        return true;
+    }
+
+    Stream& stream = streams[streamId];
+    stream.id = streamId;
+    stream.headers = std::move(headers);
+    stream.sendWindow = peerInitialWindowSize;
+    stream.virtualTime = virtualClock;
+    if (headerBlockWeight > 0) {
+        stream.weight = headerBlockWeight;
+    }
+    for (const HpackHeader& h : stream.headers) {
+        if (h.name == "priority") {
+            parsePriority(h.value, stream.urgency, stream.incremental);
+        }
+    }
+    stream.remoteClosed = headerBlockEndStream;
+    if (stream.remoteClosed) {
+        dispatchRequest(stream);
+    }
+    return true;
+}
+
+bool Http2Session::handleData(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length) {
+    if (streamId == 0) {
+        goAway(PROTOCOL_ERROR);
+        return false;
+    }
+    uint32_t pos = 0;
+    uint32_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1) {
+            goAway(FRAME_SIZE_ERROR);
+            return false;
+        }
+        padding = payload[0];
+        pos = 1;
+    }
+    if (padding > length - pos) {
+        goAway(PROTOCOL_ERROR);
+        return false;
+    }
+
+    // 整个帧（含填充）都计入流量控制，连接级窗口立即归还
+    std::string increment;
+    appendUint32(increment, length);
+    if (length > 0) {
+        writeFrame(FRAME_WINDOW_UPDATE, 0, 0, increment);
+    }
+
+    auto it = streams.find(streamId);
+    if (it == streams.end() || it->second.remoteClosed) {
+        resetStream(streamId, STREAM_CLOSED);
+        return true;
+    }
+    Stream& stream = it->second;
+    stream.body.append((const char*)payload + pos, length - pos - padding);
+    if (stream.body.size() > MAX_REQUEST_BODY) {
+        resetStream(streamId, CANCEL);
+        streams.erase(it);
+        return true;
+    }
+    if (flags & FLAG_END_STREAM) {
+        stream.remoteClosed = true;
+        dispatchRequest(stream);
+    } else if (length > 0) {
+        writeFrame(FRAME_WINDOW_UPDATE, 0, streamId, increment);
+    }
+    return true;
+}
+
+bool Http2Session::handleSettings(uint8_t flags, const uint8_t* payload, uint32_t length) {
+    if (flags & FLAG_ACK) {
+        if (length != 0) {
+            goAway(FRAME_SIZE_ERROR);
+            return false;
+        }
+        return true;
+    }
+    if (length % 6 != 0) {
+        goAway(FRAME_SIZE_ERROR);
+        return false;
+    }
+    for (uint32_t i = 0; i < length; i += 6) {
+        if (!applySetting((uint16_t)(payload[i] << 8 | payload[i + 1]), readUint32(payload + i + 2))) {
+            return false;
+        }
+    }
+    writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, {});
+    return true;
+}
+
+bool Http2Session::applySetting(uint16_t id, uint32_t value) {
+    switch (id) {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.setMaxTableSize(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > MAX_WINDOW_SIZE) {
+                goAway(FLOW_CONTROL_ERROR);
+                return false;
+            }
+            // 初始窗口变化时，所有流的发送窗口按差值调整（可能变为负数）
+            int64_t delta = (int64_t)value - peerInitialWindowSize;
+            for (auto& [id, stream] : streams) {
+                stream.sendWindow += delta;
+                if (stream.sendWindow > MAX_WINDOW_SIZE) {
+                    goAway(FLOW_CONTROL_ERROR);
+                    return false;
+                }
+            }
+            peerInitialWindowSize = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < 16384 || value > 16777215) {
+                goAway(PROTOCOL_ERROR);
+                return false;
+            }
+            peerMaxFrameSize = value;
+            break;
+        default:
+            // 未知设置项必须忽略
+            break;
+    }
+    return true;
+}
+
+bool Http2Session::handleWindowUpdate(int32_t streamId, const uint8_t* payload, uint32_t length) {
+    if (length != 4) {
+        goAway(FRAME_SIZE_ERROR);
+        return false;
+    }
+    int64_t increment = readUint32(payload) & 0x7fffffff;
+    if (streamId == 0) {
+        if (increment == 0) {
+            goAway(PROTOCOL_ERROR);
+            return false;
+        }
+        connectionSendWindow += increment;
+        if (connectionSendWindow > MAX_WINDOW_SIZE) {
+            goAway(FLOW_CONTROL_ERROR);
+            return false;
+        }
+        return true;
+    }
+    auto it = streams.find(streamId);
+    if (it == streams.end()) {
+        return true;   // 已关闭的流，忽略
+    }
+    if (increment == 0) {
+        resetStream(streamId, PROTOCOL_ERROR);
+        streams.erase(it);
+        return true;
+    }
+    it->second.sendWindow += increment;
+    if (it->second.sendWindow > MAX_WINDOW_SIZE) {
+        resetStream(streamId, FLOW_CONTROL_ERROR);
+        streams.erase(it);
+    }
+    return true;
+}
+
+void Http2Session::dispatchRequest(Stream& stream) {
+    Request request;
+    request.streamId = stream.id;
+    request.headers = std::move(stream.headers);
+    request.body = std::move(stream.body);
+    if (request.header(":method").empty() || request.header(":path").empty()) {
+        resetStream(stream.id, PROTOCOL_ERROR);
+        streams.erase(stream.id);
+        return;
+    }
+    handler(request);
+    // 处理函数没有提交响应时返回 500
+    auto it = streams.find(request.streamId);
+    if (it != streams.end() && !it->second.responding) {
+        Response response;
+        response.status = 500;
+        submitResponse(request.streamId, std::move(response));
+    }
+}
+
+void Http2Session::submitResponse(int32_t streamId, Response response) {
+    auto it = streams.find(streamId);
+    if (it == streams.end() || it->second.responding) {
+        return;
+    }
+    Stream& stream = it->second;
+
+    std::vector<HpackHeader> headers;
+    headers.reserve(response.headers.size() + 1);
+    headers.push_back(HpackHeader{":status", std::to_string(response.status)});
+    for (HpackHeader& h : response.headers) {
+        headers.push_back(std::move(h));
+    }
+    std::string block;
+    encoder.encode(headers, block);
+
+    size_t bodySize = response.mapping ? response.mapping->size() : response.body.size();
+    bool endStream = response.headOnly || bodySize == 0;
+
+    // 头部块超过对端帧大小上限时拆分为 HEADERS + CONTINUATION，连续写出
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t chunk = std::min(block.size() - offset, (size_t)peerMaxFrameSize);
+        bool last = offset + chunk == block.size();
+        uint8_t flags = (last ? FLAG_END_HEADERS : 0) | (first && endStream ? FLAG_END_STREAM : 0);
+        writeFrame(first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, streamId, std::string_view(block).substr(offset, chunk));
+        offset += chunk;
+        first = false;
+    } while (offset < block.size());
+
+    if (endStream) {
+        finishStream(stream);
+        return;
+    }
+    stream.responding = true;
+    stream.responseBody = std::move(response.body);
+    stream.mapping = std::move(response.mapping);
+    stream.sentBytes = 0;
+    stream.totalBytes = bodySize;
+}
+
+Http2Session::Stream* Http2Session::pickStream() {
+    if (connectionSendWindow <= 0) {
+        return nullptr;
+    }
+    Stream* best = nullptr;
+    // streams 按流 ID 升序遍历
+    for (auto& [id, stream] : streams) {
+        if (!stream.responding || stream.sendWindow <= 0 || stream.sentBytes >= stream.totalBytes) {
+            continue;
+        }
+        if (best == nullptr || stream.urgency < best->urgency) {
+            best = &stream;
+        } else if (stream.urgency == best->urgency) {
+            // 非增量的流优先，且按流 ID 顺序；增量的流之间按虚拟时间轮转
+            if (best->incremental && (!stream.incremental || stream.virtualTime < best->virtualTime)) {
+                best = &stream;
+            }
+        }
+    }
+    return best;
+}
+
+bool Http2Session::hasSendableData() {
+    return pickStream() != nullptr;
+}
+
+void Http2Session::scheduleData() {
+    while (output.size() + mappedOutputBytes < OUTPUT_BATCH) {
+        Stream* stream = pickStream();
+        if (stream == nullptr) {
+            break;
+        }
+        size_t remaining = stream->totalBytes - stream->sentBytes;
+        size_t chunk = std::min({remaining, (size_t)stream->sendWindow, (size_t)connectionSendWindow, (size_t)peerMaxFrameSize});
+        bool end = chunk == remaining;
+
+        size_t frameStart = output.size();
+        writeFrameHeader((uint32_t)chunk, FRAME_DATA, end ? FLAG_END_STREAM : 0, stream->id);
+        if (stream->mapping && !connection.isTls()) {
+            // 内容留在映射区，flush 时直接从映射区写出；文件被截断时 writev 返回 EFAULT
+            mappedOutput.push_back(MappedOutput{output.size(), stream->mapping, stream->sentBytes, chunk});
+            mappedOutputBytes += chunk;
+        } else if (stream->mapping) {
+            // TLS 在用户态加密，SSL_write 之前总要读取一次明文，在 SIGBUS 保护下复制到输出缓冲区
+            size_t payloadStart = output.size();
+            output.resize(payloadStart + chunk);
+            if (!FileMapCache::guardedCopy(*stream->mapping, stream->sentBytes, chunk, output.data() + payloadStart)) {
+                // 文件在发送过程中被截断，撤销这一帧并重置流
+                output.resize(frameStart);
+                int32_t id = stream->id;
+                resetStream(id, INTERNAL_ERROR);
+                streams.erase(id);
+                continue;
+            }
+        } else {
+            output.append(stream->responseBody, stream->sentBytes, chunk);
+        }
+
+        stream->sentBytes += chunk;
+        stream->sendWindow -= chunk;
+        connectionSendWindow -= chunk;
+        // 权重越大，虚拟时间增长越慢，获得的带宽份额越大
+        virtualClock = std::max(virtualClock, stream->virtualTime);
+        stream->virtualTime += chunk * 256 / stream->weight;
+        if (end) {
+            finishStream(*stream);
+        }
+    }
+}
+
+void Http2Session::finishStream(Stream& stream) {
+    // 只有请求已接收完整的流才会开始响应，响应发完即可关闭
+    streams.erase(stream.id);
+}
+
+void Http2Session::writeFrameHeader(uint32_t length, uint8_t type, uint8_t flags, int32_t streamId) {
+    output.push_back((char)(length >> 16));
+    output.push_back((char)(length >> 8));
+    output.push_back((char)length);
+    output.push_back((char)type);
+    output.push_back((char)flags);
+    appendUint32(output, (uint32_t)streamId & 0x7fffffff);
+}
+
+void Http2Session::writeFrame(uint8_t type, uint8_t flags, int32_t streamId, std::string_view payload) {
+    writeFrameHeader((uint32_t)payload.size(), type, flags, streamId);
+    output.append(payload);
+}
+
+void Http2Session::resetStream(int32_t streamId, uint32_t errorCode) {
+    std::string payload;
+    appendUint32(payload, errorCode);
+    writeFrame(FRAME_RST_STREAM, 0, streamId, payload);
+}
+
+void Http2Session::goAway(uint32_t errorCode) {
+    std::string payload;
+    appendUint32(payload, (uint32_t)lastStreamId);
+    appendUint32(payload, errorCode);
+    writeFrame(FRAME_GOAWAY, 0, 0, payload);
+    closed = true;
+}
+
+bool Http2Session::flush() {
+    if (output.empty()) {
+        return true;
+    }
+    if (mappedOutput.empty()) {
+        bool ok = connection.writeAll(output.data(), output.size());
+        output.clear();
+        return ok;
+    }
+    // 帧头和其他帧在 output 中，映射区的 DATA 内容按记录的位置插在它们之间
+    std::vector<iovec> iov;
+    iov.reserve(mappedOutput.size() * 2 + 1);
+    size_t position = 0;
+    for (const MappedOutput& mapped : mappedOutput) {
+        iov.push_back(iovec{output.data() + position, mapped.position - position});
+        iov.push_back(iovec{(void*)(mapped.mapping->data() + mapped.offset), mapped.length});
+        position = mapped.position;
+    }
+    iov.push_back(iovec{output.data() + position, output.size() - position});
+    bool ok = connection.writevAll(iov.data(), (int)iov.size());
+    if (!ok) {
+        // 文件在发送过程中被截断（EFAULT）或连接出错，DATA 帧可能只写出了一部分，只能关闭连接
+        connection.abort();
+    }
+    mappedOutput.clear();
+    mappedOutputBytes = 0;
+    output.clear();
+    return ok;
+}
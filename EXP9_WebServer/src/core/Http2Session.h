@@ -0,0 +1,152 @@
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <Hpack.h>
+#include <Connection.h>
+#include <FileMapCache.h>
+
+/**
+ * 一个 HTTP/2 连接（RFC 9113），在 ServerTask 的线程中运行
+ *
+ * - 同一连接上的多个流并发：请求在头部（和请求体）接收完整后立即交给 RequestHandler 处理，
+ *   响应进入发送队列，由调度器把各个流的 DATA 帧交错发送
+ * - 头部使用 HPACK 压缩，静态表为所有连接共享，动态表每连接一个
+ * - 发送方向遵守连接级和流级流量控制窗口，接收方向每收到 DATA 帧立即归还窗口
+ * - 调度：优先级高（urgency 小）的流先发送；同一优先级中，非增量（RFC 9218 priority 头的 i 参数为假）的流
+ *   按流 ID 顺序逐个发完，增量的流按权重（PRIORITY 帧）交错发送
+ */
+class Http2Session {
+    public:
+        /**
+         * 一个完整的请求，headers 中包含 :method、:path 等伪头部
+         */
+        struct Request {
+            int32_t streamId = 0;
+            std::vector<HpackHeader> headers;
+            std::string body;
+
+            /**
+             * 获取头部字段的值，不存在时返回空串
+             */
+            std::string_view header(std::string_view name) const;
+        };
+
+        /**
+         * 响应，响应体来自 body 或文件映射 mapping（二者取一）
+         * headOnly 为 true 时只发送头部（HEAD 请求）
+         */
+        struct Response {
+            int status = 200;
+            std::vector<HpackHeader> headers;
+            std::string body;
+            std::shared_ptr<const FileMapping> mapping;
+            bool headOnly = false;
+        };
+
+        using RequestHandler = std::function<void(const Request& request)>;
+
+        /**
+         * 客户端连接前言
+         */
+        static constexpr std::string_view CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+        Http2Session(Connection& connection, RequestHandler handler);
+        /**
+         * 运行会话直到连接关闭。received 为切换到 HTTP/2 之前已经读到的数据（应以连接前言开头）。
+         * h2c 升级时 upgradeSettings 为 HTTP2-Settings 头部的值，会话发出 SETTINGS 后调用 onUpgradeStream
+         * 处理升级请求（作为流 1 的请求，响应通过 submitResponse(1, ...) 提交）
+         */
+        void run(std::string_view received, std::string_view upgradeSettings = {}, const std::function<void()>& onUpgradeStream = nullptr);
+        /**
+         * 提交一个流的响应，只能在 RequestHandler 或 onUpgradeStream 中调用
+         */
+        void submitResponse(int32_t streamId, Response response);
+
+    private:
+        struct Stream {
+            int32_t id = 0;
+            // 对端已发送 END_STREAM
+            bool remoteClosed = false;
+            std::vector<HpackHeader> headers;
+            std::string body;
+            int64_t sendWindow = 0;
+            // 优先级：urgency 0~7，越小越优先
+            int urgency = 3;
+            bool incremental = true;
+            int weight = 16;
+            // 按权重交错发送时的虚拟时间
+            uint64_t virtualTime = 0;
+            // 响应发送状态
+            bool responding = false;
+            std::string responseBody;
+            std::shared_ptr<const FileMapping> mapping;
+            size_t sentBytes = 0;
+            size_t totalBytes = 0;
+        };
+
+        Connection& connection;
+        RequestHandler handler;
+        HpackDecoder decoder;
+        HpackEncoder encoder;
+        std::map<int32_t, Stream> streams;
+        std::string input;
+        std::string output;
+        /**
+         * 明文连接上来自文件映射的 DATA 内容不复制到 output，只记录它应插入 output 的位置，
+         * flush 时与 output 的各段一起用一次 writev 直接从映射区写出
+         */
+        struct MappedOutput {
+            size_t position;
+            std::shared_ptr<const FileMapping> mapping;
+            size_t offset;
+            size_t length;
+        };
+        std::vector<MappedOutput> mappedOutput;
+        size_t mappedOutputBytes = 0;
+        bool prefaceReceived = false;
+        // 正在接收的头部块（HEADERS + CONTINUATION）
+        int32_t headerBlockStream = 0;
+        bool headerBlockEndStream = false;
+        // HEADERS 帧中 PRIORITY 标志携带的权重，-1 表示没有
+        int headerBlockWeight = -1;
+        std::string headerBlock;
+        int32_t lastStreamId = 0;
+        bool goingAway = false;
+        bool closed = false;
+        // 发送方向的流量控制和对端设置
+        int64_t connectionSendWindow = 65535;
+        int64_t peerInitialWindowSize = 65535;
+        uint32_t peerMaxFrameSize = 16384;
+        uint64_t virtualClock = 0;
+
+        bool processInput();
+        bool processFrame(uint8_t type, uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length);
+        bool handleHeaders(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length);
+        bool handleHeaderBlockComplete();
+        bool handleData(uint8_t flags, int32_t streamId, const uint8_t* payload, uint32_t length);
+        bool handleSettings(uint8_t flags, const uint8_t* payload, uint32_t length);
+        bool applySetting(uint16_t id, uint32_t value);
+        bool handleWindowUpdate(int32_t streamId, const uint8_t* payload, uint32_t length);
+        void dispatchRequest(Stream& stream);
+        /**
+         * 按优先级发送 DATA 帧，直到窗口耗尽、没有数据或输出缓冲区已满
+         */
+        void scheduleData();
+        Stream* pickStream();
+        bool hasSendableData();
+        void finishStream(Stream& stream);
+        void writeFrame(uint8_t type, uint8_t flags, int32_t streamId, std::string_view payload);
+        void writeFrameHeader(uint32_t length, uint8_t type, uint8_t flags, int32_t streamId);
+        void resetStream(int32_t streamId, uint32_t errorCode);
+        void goAway(uint32_t errorCode);
+        bool flush();
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include <HttpServerWorker.h>
 #include <ServerTask.h>
+#include <ApiHandlers.h>
 #include <sys/socket.h>
 #include <errno.h>
 #include <netinet/in.h>
@@ -17,10 +18,33 @@ HttpServerWorker::HttpServerWorker(QObject* parent) : QObject(parent) {
     this->threadPool->setExpiryTimeout(30000);
 
     qDebug() << "线程池已创建";
+
+    // 注册并编译接口路由
+    registerApiHandlers(context.router);
+    context.router.compile();
+}
+
+void HttpServerWorker::configureTls(QString certFile, QString keyFile, QString cipherList) {
+    tlsConfig.certFile = certFile.toStdString();
+    tlsConfig.keyFile = keyFile.toStdString();
+    tlsConfig.cipherList = cipherList.toStdString();
 }
 
 bool HttpServerWorker::startServer(QString rootPath, int port) {
     this->rootDir = rootPath;
+    // 初始化 HTTPS
+    context.tls.reset();
+    if (!tlsConfig.certFile.empty()) {
+        auto tls = std::make_unique<TlsContext>();
+        std::string error;
+        if (!tls->init(tlsConfig, error)) {
+            emit logMessage("HTTPS 初始化失败：" + QString::fromStdString(error));
+            stopServer();
+            return false;
+        }
+        context.tls = std::move(tls);
+        emit logMessage("已启用 HTTPS");
+    }
     // 创建 socket
     this->serverSock = socket(AF_INET, SOCK_STREAM, 0);
     if (serverSock < 0) {
@@ -152,20 +176,21 @@ void HttpServerWorker::processServerLoop() {
             // 达到最大连接数拒绝连接
             if (getActiveConnectionCount() > 100) {
                 qDebug() << "达到最大连接数量，拒绝连接：" << clientInfo;
-                QString errorResponse =
-                    "HTTP/1.1 503 Service Unavailable\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Content-Length: 133\r\n"
-                    "\r\n"
-                    "<html><head><meta charset=\"UTF-8\"></head><body><h1>503 Service Unavailable</h1>"
-                    "<p>服务器繁忙，请稍后重试</p></body></html>";
-                send(clientSock, errorResponse.toUtf8().constData(), errorResponse.toUtf8().length(), 0);
-                close(clientSock);
+                rejectConnection(clientSock, 503, "Service Unavailable", "服务器繁忙，请稍后重试");
+                continue;
+            }
+
+            // 单个客户端的并发连接数超限
+            uint32_t clientIp = ntohl(clientAddr.sin_addr.s_addr);
+            RateLimiter::ConnectionSlot connectionSlot;
+            if (!context.rateLimiter.acquireConnection(clientIp, connectionSlot)) {
+                qDebug() << "客户端连接数超限，拒绝连接：" << clientInfo;
+                rejectConnection(clientSock, 429, "Too Many Requests", "连接数过多，请稍后重试");
                 continue;
             }
 
             // 创建任务处理客户端请求
-            ServerTask *task = new ServerTask(clientSock, rootDir, clientInfo);
+            ServerTask *task = new ServerTask(clientSock, rootDir, clientInfo, clientIp, connectionSlot, &context);
             // 连接信号和槽
             connect(task, &ServerTask::taskFinished, this, &HttpServerWorker::serverTaskFinished);
             connect(task, &ServerTask::logMessage, this, &HttpServerWorker::serverTaskLogMessage);
@@ -183,6 +208,31 @@ void HttpServerWorker::processServerLoop() {
     stopServer();
 }
 
+void HttpServerWorker::rejectConnection(int clientSock, int code, QString description, QString message) {
+    // HTTPS 连接尚未握手，无法发送错误页面
+    if (context.tls) {
+        close(clientSock);
+        return;
+    }
+    QByteArray body = QString("<html><head><meta charset=\"UTF-8\"></head><body><h1>%1 %2</h1><p>%3</p></body></html>")
+                          .arg(code)
+                          .arg(description)
+                          .arg(message)
+                          .toUtf8();
+    QByteArray response = QString("HTTP/1.1 %1 %2\r\n"
+                                  "Content-Type: text/html\r\n"
+                                  "Content-Length: %3\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n")
+                              .arg(code)
+                              .arg(description)
+                              .arg(body.size())
+                              .toUtf8();
+    response.append(body);
+    send(clientSock, response.constData(), response.size(), 0);
+    close(clientSock);
+}
+
 void HttpServerWorker::serverTaskLogMessage(QString message) {
     emit logMessage(message);
 }
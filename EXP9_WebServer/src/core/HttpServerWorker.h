@@ -6,6 +6,7 @@
 #include <QThreadPool>
 #include <QSet>
 #include <QMutex>
+#include <ServerContext.h>
 
 using std::atomic_bool;
 
@@ -29,6 +30,11 @@ class HttpServerWorker : public QObject {
          * 停止服务器
          */
         void stopServer();
+        /**
+         * 设置 HTTPS 参数，需在 startServer 之前调用，certFile 为空表示使用明文 HTTP
+         * cipherList 为空时使用 OpenSSL 默认密码套件
+         */
+        void configureTls(QString certFile, QString keyFile, QString cipherList);
 
     signals:
         /**
@@ -68,11 +74,19 @@ class HttpServerWorker : public QObject {
         QSet<int> activeConnections;
         // 确保 activeConnections 线程安全
         QMutex activeConnectionsMutex;
+        // 路由表、限流器等由 ServerTask 共享的状态
+        ServerContext context;
+        // HTTPS 参数，certFile 为空表示不启用
+        TlsConfig tlsConfig;
 
         /**
          * 获取活跃连接数
          */
         int getActiveConnectionCount();
+        /**
+         * 向客户端发送错误页面后关闭连接
+         */
+        void rejectConnection(int clientSock, int code, QString description, QString message);
         /**
          * 增加活跃连接
          */
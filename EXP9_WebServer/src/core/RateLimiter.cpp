@@ -0,0 +1,185 @@
+#include <RateLimiter.h>
+#include <climits>
+
+namespace {
+
+uint64_t packBucket(uint32_t timeMs, int32_t tokens) {
+    return ((uint64_t)timeMs << 32) | (uint32_t)tokens;
+}
+
+uint32_t bucketTime(uint64_t bucket) {
+    return (uint32_t)(bucket >> 32);
+}
+
+int32_t bucketTokens(uint64_t bucket) {
+    return (int32_t)(uint32_t)bucket;
+}
+
+/**
+ * 32 位整数哈希（murmur3 finalizer），IP 地址低位分布不均，需要打散
+ */
+uint32_t hashIp(uint32_t ip) {
+    ip ^= ip >> 16;
+    ip *= 0x85ebca6b;
+    ip ^= ip >> 13;
+    ip *= 0xc2b2ae35;
+    ip ^= ip >> 16;
+    return ip;
+}
+
+uint32_t roundUpPowerOfTwo(uint32_t n) {
+    uint32_t result = 1;
+    while (result < n) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}  // namespace
+
+RateLimiter::RateLimiter(RateLimiterConfig config, uint32_t shardCount, uint32_t slotsPerShard) : config(config) {
+    // 分片数和槽位数取 2 的幂，用位运算代替取模
+    this->shardCount = roundUpPowerOfTwo(shardCount);
+    this->slotsPerShard = roundUpPowerOfTwo(slotsPerShard < MAX_PROBE ? MAX_PROBE : slotsPerShard);
+    this->slots = std::make_unique<Entry[]>((size_t)this->shardCount * this->slotsPerShard);
+    this->startTime = std::chrono::steady_clock::now();
+}
+
+uint32_t RateLimiter::nowMs() const {
+    auto elapsed = std::chrono::steady_clock::now() - startTime;
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+void RateLimiter::resetEntry(Entry* entry, uint32_t now) {
+    entry->requestBucket.store(packBucket(now, (int32_t)(config.requestBurst * 1000)), std::memory_order_relaxed);
+    entry->byteBucket.store(packBucket(now, (int32_t)config.byteBurst), std::memory_order_relaxed);
+    entry->lastSeen.store(now / 1000, std::memory_order_relaxed);
+}
+
+RateLimiter::Entry* RateLimiter::findEntry(uint32_t ip, bool create) {
+    uint64_t key = (uint64_t)ip + 1;
+    uint32_t hash = hashIp(ip);
+    // 高位选分片，低位选分片内的起始槽位
+    Entry* shard = &slots[(size_t)(hash >> 16 & (shardCount - 1)) * slotsPerShard];
+    uint32_t mask = slotsPerShard - 1;
+    uint32_t now = nowMs();
+    uint32_t nowSec = now / 1000;
+
+    while (true) {
+        Entry* candidate = nullptr;
+        uint64_t candidateKey = 0;
+        for (uint32_t i = 0; i < MAX_PROBE; i++) {
+            Entry* entry = &shard[(hash + i) & mask];
+            uint64_t current = entry->key.load(std::memory_order_acquire);
+            if (current == key) {
+                entry->lastSeen.store(nowSec, std::memory_order_relaxed);
+                return entry;
+            }
+            if (current == 0) {
+                // 表项从不被清空，遇到空槽说明后面不会再有该 key
+                if (candidate == nullptr) {
+                    candidate = entry;
+                    candidateKey = 0;
+                }
+                break;
+            }
+            // 记录第一个可以回收的过期表项
+            if (candidate == nullptr && nowSec - entry->lastSeen.load(std::memory_order_relaxed) > config.idleExpirySeconds &&
+                entry->connections.load(std::memory_order_relaxed) == 0) {
+                candidate = entry;
+                candidateKey = current;
+            }
+        }
+
+        if (!create || candidate == nullptr) {
+            return nullptr;
+        }
+        // 抢占空槽或过期槽，失败说明有其他线程同时插入，重新查找
+        if (candidate->key.compare_exchange_strong(candidateKey, key, std::memory_order_acq_rel)) {
+            resetEntry(candidate, now);
+            return candidate;
+        }
+    }
+}
+
+bool RateLimiter::takeTokens(std::atomic<uint64_t>& bucket, uint32_t now, uint64_t ratePerSecond, int64_t burst, int64_t cost, int64_t floor) {
+    uint64_t old = bucket.load(std::memory_order_relaxed);
+    while (true) {
+        uint32_t elapsed = now - bucketTime(old);
+        // 其他线程用更新的时间戳写入过，不再补充
+        if (elapsed > INT32_MAX) {
+            elapsed = 0;
+        }
+        int64_t tokens = bucketTokens(old) + (int64_t)elapsed * (int64_t)ratePerSecond / 1000;
+        if (tokens > burst) {
+            tokens = burst;
+        }
+        if (tokens - cost < floor) {
+            return false;
+        }
+        tokens -= cost;
+        if (tokens < INT32_MIN) {
+            tokens = INT32_MIN;
+        }
+        uint64_t updated = packBucket(elapsed == 0 ? bucketTime(old) : now, (int32_t)tokens);
+        if (updated == old || bucket.compare_exchange_weak(old, updated, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+bool RateLimiter::acquireConnection(uint32_t ip, ConnectionSlot& slot) {
+    slot.entry = nullptr;
+    while (true) {
+        Entry* entry = findEntry(ip, true);
+        if (entry == nullptr) {
+            return true;
+        }
+        int32_t count = entry->connections.fetch_add(1, std::memory_order_acq_rel);
+        // 计数期间表项被回收给了其他客户端，撤销后重试
+        if (entry->key.load(std::memory_order_acquire) != (uint64_t)ip + 1) {
+            entry->connections.fetch_sub(1, std::memory_order_acq_rel);
+            continue;
+        }
+        if (count >= config.maxConnectionsPerClient) {
+            entry->connections.fetch_sub(1, std::memory_order_acq_rel);
+            return false;
+        }
+        slot.entry = entry;
+        return true;
+    }
+}
+
+void RateLimiter::releaseConnection(ConnectionSlot& slot) {
+    Entry* entry = slot.entry;
+    if (entry == nullptr) {
+        return;
+    }
+    slot.entry = nullptr;
+    // 有名额的表项不会被回收，计数至少是自己占用的 1；仍然拒绝减到负数，否则该 IP 的上限会被永久抬高
+    int32_t count = entry->connections.load(std::memory_order_relaxed);
+    while (count > 0 && !entry->connections.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+    }
+}
+
+bool RateLimiter::allowRequest(uint32_t ip) {
+    Entry* entry = findEntry(ip, true);
+    if (entry == nullptr) {
+        return true;
+    }
+    uint32_t now = nowMs();
+    // 带宽透支的客户端先拒绝，等令牌补回到非负
+    if (!takeTokens(entry->byteBucket, now, config.bytesPerSecond, config.byteBurst, 0, 0)) {
+        return false;
+    }
+    return takeTokens(entry->requestBucket, now, (uint64_t)config.requestsPerSecond * 1000, (int64_t)config.requestBurst * 1000, 1000, 0);
+}
+
+void RateLimiter::consumeBytes(uint32_t ip, uint64_t bytes) {
+    Entry* entry = findEntry(ip, false);
+    if (entry == nullptr) {
+        return;
+    }
+    int64_t cost = bytes > INT32_MAX ? INT32_MAX : (int64_t)bytes;
+    takeTokens(entry->byteBucket, nowMs(), config.bytesPerSecond, config.byteBurst, cost, INT64_MIN);
+}
@@ -0,0 +1,106 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <chrono>
+
+/**
+ * 限流参数
+ */
+struct RateLimiterConfig {
+    // 每个客户端每秒请求数及突发上限
+    uint32_t requestsPerSecond = 50;
+    uint32_t requestBurst = 100;
+    // 每个客户端每秒响应字节数及突发上限
+    uint32_t bytesPerSecond = 8 * 1024 * 1024;
+    uint32_t byteBurst = 32 * 1024 * 1024;
+    // 每个客户端的最大并发连接数
+    int32_t maxConnectionsPerClient = 16;
+    // 客户端空闲多少秒后其表项可被回收
+    uint32_t idleExpirySeconds = 60;
+};
+
+/**
+ * 按客户端 IP 的令牌桶限流器
+ *
+ * 表项保存在分片的开放寻址哈希表中，每个分片是一段独立的槽位数组，
+ * 插入、查找、令牌扣减都只使用原子操作（CAS），不加锁。
+ * 表项不主动删除：空闲超时且没有活跃连接的表项会在插入新客户端时被就地复用（惰性过期），
+ * 因此无论有多少个不同的客户端，每次检查的开销都只和探测长度有关。
+ *
+ * 限流是近似的：并发复用表项时可能短暂地把旧客户端的令牌计到新客户端上。
+ * 哈希表探测窗口全部被占满时放行请求（fail open）。
+ */
+class RateLimiter {
+    struct Entry;
+
+    public:
+        /**
+         * acquireConnection 占用的连接名额，记录计数所在的表项，释放时只归还这个表项
+         */
+        class ConnectionSlot {
+            private:
+                friend class RateLimiter;
+                // nullptr 表示没有占用名额（哈希表探测窗口已满时放行的连接）
+                Entry* entry = nullptr;
+        };
+
+        explicit RateLimiter(RateLimiterConfig config = RateLimiterConfig(), uint32_t shardCount = 64, uint32_t slotsPerShard = 2048);
+        /**
+         * 新连接到来时调用，超过单 IP 并发连接上限时返回 false。
+         * 返回 true 时 slot 记录实际占用的名额，哈希表已满放行时不占用名额
+         */
+        bool acquireConnection(uint32_t ip, ConnectionSlot& slot);
+        /**
+         * 连接关闭时调用，归还 acquireConnection 占用的名额（没有占用时什么也不做），之后 slot 不再占用名额
+         */
+        void releaseConnection(ConnectionSlot& slot);
+        /**
+         * 每个请求调用一次，请求速率超限或带宽令牌已透支时返回 false
+         */
+        bool allowRequest(uint32_t ip);
+        /**
+         * 记录已发送的响应字节数，带宽令牌允许透支，透支期间 allowRequest 返回 false
+         */
+        void consumeBytes(uint32_t ip, uint64_t bytes);
+
+    private:
+        /**
+         * 令牌桶打包为 64 位：高 32 位为上次更新的毫秒时间戳，低 32 位为有符号令牌数，
+         * 这样一次 CAS 就能同时更新时间和令牌
+         */
+        struct alignas(64) Entry {
+            // 0 表示空槽，其他值为 IP + 1
+            std::atomic<uint64_t> key{0};
+            std::atomic<int32_t> connections{0};
+            // 最后活跃时间（秒）
+            std::atomic<uint32_t> lastSeen{0};
+            // 请求令牌，单位为千分之一个请求
+            std::atomic<uint64_t> requestBucket{0};
+            // 带宽令牌，单位为字节
+            std::atomic<uint64_t> byteBucket{0};
+        };
+
+        static constexpr uint32_t MAX_PROBE = 16;
+
+        RateLimiterConfig config;
+        uint32_t shardCount;
+        uint32_t slotsPerShard;
+        std::unique_ptr<Entry[]> slots;
+        std::chrono::steady_clock::time_point startTime;
+
+        /**
+         * 查找客户端的表项，create 为 true 时不存在则插入，失败返回 nullptr
+         */
+        Entry* findEntry(uint32_t ip, bool create);
+        void resetEntry(Entry* entry, uint32_t nowMs);
+        /**
+         * 补充令牌后尝试扣减 cost，令牌不足（低于 floor）时不扣减并返回 false
+         */
+        static bool takeTokens(std::atomic<uint64_t>& bucket, uint32_t nowMs, uint64_t ratePerSecond, int64_t burst, int64_t cost, int64_t floor);
+        uint32_t nowMs() const;
+};
+
+#endif
@@ -0,0 +1,349 @@
+#include <Router.h>
+#include <cctype>
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+
+/**
+ * 构建阶段使用的树节点，compile() 后被释放
+ */
+struct Router::BuildNode {
+    string label;
+    std::vector<unique_ptr<BuildNode>> children;
+    unique_ptr<BuildNode> param;
+    unique_ptr<BuildNode> wildcard;
+    string name;
+    int32_t handler = -1;
+};
+
+namespace {
+
+size_t commonPrefix(string_view a, string_view b) {
+    size_t n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) {
+        n++;
+    }
+    return n;
+}
+
+bool equalsIgnoreCase(string_view a, string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+string_view trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * 对 urlencoded 字符串解码，'+' 解码为空格
+ */
+string urlDecode(string_view s) {
+    string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            result.push_back(' ');
+        } else if (s[i] == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0) {
+            result.push_back((char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2])));
+            i += 2;
+        } else {
+            result.push_back(s[i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * 在 urlencoded 表单中查找字段，找到时写入 value 并返回 true
+ */
+bool findFormField(string_view form, string_view name, string& value) {
+    while (!form.empty()) {
+        size_t amp = form.find('&');
+        string_view field = form.substr(0, amp);
+        size_t eq = field.find('=');
+        if (urlDecode(field.substr(0, eq)) == name) {
+            value = eq == string_view::npos ? string() : urlDecode(field.substr(eq + 1));
+            return true;
+        }
+        if (amp == string_view::npos) {
+            break;
+        }
+        form.remove_prefix(amp + 1);
+    }
+    return false;
+}
+
+}  // namespace
+
+string_view RouteParams::get(string_view name) const {
+    for (int i = 0; i < count; i++) {
+        if (params[i].name == name) {
+            return params[i].value;
+        }
+    }
+    return {};
+}
+
+string_view HttpRequestView::header(string_view name) const {
+    string_view rest = headers;
+    while (!rest.empty()) {
+        size_t end = rest.find('\n');
+        string_view line = rest.substr(0, end);
+        size_t colon = line.find(':');
+        if (colon != string_view::npos && equalsIgnoreCase(trim(line.substr(0, colon)), name)) {
+            return trim(line.substr(colon + 1));
+        }
+        if (end == string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(end + 1);
+    }
+    return {};
+}
+
+string HttpRequestView::formValue(string_view name) const {
+    string value;
+    if (findFormField(body, name, value) || findFormField(query, name, value)) {
+        return value;
+    }
+    return {};
+}
+
+Router::Router() = default;
+
+Router::~Router() = default;
+
+Router::BuildNode* Router::insertStatic(BuildNode* node, string_view text) {
+    while (!text.empty()) {
+        BuildNode* next = nullptr;
+        for (auto& child : node->children) {
+            if (child->label[0] == text[0]) {
+                next = child.get();
+                break;
+            }
+        }
+        // 没有共同前缀的子节点，直接新建
+        if (next == nullptr) {
+            auto child = std::make_unique<BuildNode>();
+            child->label = string(text);
+            next = child.get();
+            node->children.push_back(std::move(child));
+            return next;
+        }
+        size_t common = commonPrefix(next->label, text);
+        // 子节点前缀只匹配了一部分，将其分裂为两段
+        if (common < next->label.size()) {
+            auto tail = std::make_unique<BuildNode>();
+            tail->label = next->label.substr(common);
+            tail->children = std::move(next->children);
+            tail->param = std::move(next->param);
+            tail->wildcard = std::move(next->wildcard);
+            tail->name = std::move(next->name);
+            tail->handler = next->handler;
+            next->label.resize(common);
+            next->children.clear();
+            next->children.push_back(std::move(tail));
+            next->name.clear();
+            next->handler = -1;
+        }
+        node = next;
+        text.remove_prefix(common);
+    }
+    return node;
+}
+
+bool Router::addRoute(string_view method, string_view pattern, RouteHandler handler) {
+    if (pattern.empty() || pattern[0] != '/' || !nodes.empty()) {
+        return false;
+    }
+    MethodRoot* root = nullptr;
+    for (auto& m : methods) {
+        if (m.method == method) {
+            root = &m;
+            break;
+        }
+    }
+    if (root == nullptr) {
+        methods.push_back(MethodRoot{string(method), std::make_unique<BuildNode>(), -1});
+        root = &methods.back();
+    }
+
+    BuildNode* node = root->tree.get();
+    size_t pos = 0;
+    while (pos < pattern.size()) {
+        if (pattern[pos] == ':') {
+            size_t end = pattern.find('/', pos);
+            if (end == string_view::npos) {
+                end = pattern.size();
+            }
+            string_view name = pattern.substr(pos + 1, end - pos - 1);
+            if (name.empty()) {
+                return false;
+            }
+            if (!node->param) {
+                node->param = std::make_unique<BuildNode>();
+                node->param->name = string(name);
+            } else if (node->param->name != name) {
+                return false;   // 同一位置的参数名必须一致
+            }
+            node = node->param.get();
+            pos = end;
+        } else if (pattern[pos] == '*') {
+            string_view name = pattern.substr(pos + 1);
+            if (name.empty() || name.find('/') != string_view::npos || node->wildcard) {
+                return false;
+            }
+            node->wildcard = std::make_unique<BuildNode>();
+            node->wildcard->name = string(name);
+            node = node->wildcard.get();
+            pos = pattern.size();
+        } else {
+            size_t end = pattern.find_first_of(":*", pos);
+            if (end == string_view::npos) {
+                end = pattern.size();
+            }
+            node = insertStatic(node, pattern.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+    if (node->handler >= 0) {
+        return false;   // 重复注册
+    }
+    node->handler = (int32_t)handlers.size();
+    handlers.push_back(std::move(handler));
+    return true;
+}
+
+void Router::compile() {
+    nodes.clear();
+    labels.clear();
+    for (auto& m : methods) {
+        m.root = (int32_t)nodes.size();
+        nodes.emplace_back();
+        flatten(m.root, m.tree.get());
+        m.tree.reset();
+    }
+}
+
+void Router::flatten(uint32_t index, const BuildNode* node) {
+    // 注意 nodes 会扩容，这里只通过下标访问
+    nodes[index].labelOffset = (uint32_t)labels.size();
+    nodes[index].labelLength = (uint32_t)node->label.size();
+    labels += node->label;
+    nodes[index].nameOffset = (uint32_t)labels.size();
+    nodes[index].nameLength = (uint32_t)node->name.size();
+    labels += node->name;
+    nodes[index].handler = node->handler;
+
+    uint32_t first = (uint32_t)nodes.size();
+    nodes[index].firstChild = first;
+    nodes[index].childCount = (uint32_t)node->children.size();
+    nodes.resize(nodes.size() + node->children.size());
+    for (size_t i = 0; i < node->children.size(); i++) {
+        flatten(first + (uint32_t)i, node->children[i].get());
+    }
+    if (node->param) {
+        int32_t child = (int32_t)nodes.size();
+        nodes.emplace_back();
+        nodes[index].paramChild = child;
+        flatten(child, node->param.get());
+    }
+    if (node->wildcard) {
+        int32_t child = (int32_t)nodes.size();
+        nodes.emplace_back();
+        nodes[index].wildcardChild = child;
+        flatten(child, node->wildcard.get());
+    }
+}
+
+const RouteHandler* Router::match(string_view method, string_view path, RouteParams& params) const {
+    params.count = 0;
+    for (const auto& m : methods) {
+        if (m.method == method && m.root >= 0) {
+            int32_t handler = matchNode(m.root, path, 0, params);
+            if (handler >= 0) {
+                return &handlers[handler];
+            }
+            break;
+        }
+    }
+    // 没有对应的 HEAD 路由时使用 GET 路由，由调用方省略响应体
+    if (method == "HEAD") {
+        return match("GET", path, params);
+    }
+    return nullptr;
+}
+
+int32_t Router::matchNode(int32_t index, string_view path, size_t pos, RouteParams& params) const {
+    const Node& node = nodes[index];
+    if (pos == path.size() && node.handler >= 0) {
+        return node.handler;
+    }
+
+    // 静态子节点首字节互不相同，最多只有一个候选
+    if (pos < path.size()) {
+        for (uint32_t i = 0; i < node.childCount; i++) {
+            const Node& child = nodes[node.firstChild + i];
+            string_view childLabel = label(child.labelOffset, child.labelLength);
+            if (childLabel[0] != path[pos]) {
+                continue;
+            }
+            if (path.substr(pos, childLabel.size()) == childLabel) {
+                int32_t handler = matchNode(node.firstChild + i, path, pos + childLabel.size(), params);
+                if (handler >= 0) {
+                    return handler;
+                }
+            }
+            break;
+        }
+    }
+
+    // 路径参数匹配到下一个 '/'
+    if (node.paramChild >= 0 && pos < path.size() && path[pos] != '/' && params.count < RouteParams::MAX_PARAMS) {
+        size_t end = path.find('/', pos);
+        if (end == string_view::npos) {
+            end = path.size();
+        }
+        const Node& child = nodes[node.paramChild];
+        int saved = params.count;
+        params.params[params.count++] = {label(child.nameOffset, child.nameLength), path.substr(pos, end - pos)};
+        int32_t handler = matchNode(node.paramChild, path, end, params);
+        if (handler >= 0) {
+            return handler;
+        }
+        params.count = saved;
+    }
+
+    // 通配符匹配剩余部分
+    if (node.wildcardChild >= 0 && params.count < RouteParams::MAX_PARAMS) {
+        const Node& child = nodes[node.wildcardChild];
+        if (child.handler >= 0) {
+            params.params[params.count++] = {label(child.nameOffset, child.nameLength), path.substr(pos)};
+            return child.handler;
+        }
+    }
+    return -1;
+}
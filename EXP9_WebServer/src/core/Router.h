@@ -0,0 +1,147 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+/**
+ * 路径参数表，容量固定，匹配过程中不分配内存
+ * 参数名和参数值都直接指向路由表和请求路径中的字符串
+ */
+class RouteParams {
+    public:
+        static constexpr int MAX_PARAMS = 8;
+        /**
+         * 按名字获取参数值，不存在时返回空串
+         */
+        std::string_view get(std::string_view name) const;
+        int size() const {
+            return count;
+        }
+
+    private:
+        friend class Router;
+        struct Param {
+            std::string_view name;
+            std::string_view value;
+        };
+        Param params[MAX_PARAMS];
+        int count = 0;
+};
+
+/**
+ * HTTP 请求视图，所有字段都指向接收缓冲区，处理函数返回后即失效
+ */
+struct HttpRequestView {
+    std::string_view method;
+    // 请求路径，不含查询字符串
+    std::string_view path;
+    // 查询字符串，不含 '?'
+    std::string_view query;
+    // 请求头部分（不含请求行）
+    std::string_view headers;
+    std::string_view body;
+    RouteParams params;
+
+    /**
+     * 获取请求头字段的值（字段名不区分大小写），不存在时返回空串
+     */
+    std::string_view header(std::string_view name) const;
+    /**
+     * 获取 application/x-www-form-urlencoded 表单字段（先查请求体，再查查询字符串），返回解码后的值
+     */
+    std::string formValue(std::string_view name) const;
+};
+
+/**
+ * 响应写出接口，由具体的连接实现
+ */
+class ResponseWriter {
+    public:
+        virtual ~ResponseWriter() = default;
+        /**
+         * 发送一个完整的响应，返回是否成功
+         */
+        virtual bool writeResponse(int code, std::string_view description, std::string_view body, std::string_view contentType) = 0;
+};
+
+using RouteHandler = std::function<void(const HttpRequestView& request, ResponseWriter& writer)>;
+
+/**
+ * 基于基数树的请求路由表
+ *
+ * 路由模式支持三种片段：
+ * - 静态文本，如 /api/health
+ * - 路径参数 :name，匹配一个非空的路径段（到下一个 '/' 为止）
+ * - 通配符 *name，只能出现在末尾，匹配剩余的全部路径（可为空）
+ *
+ * 匹配优先级为 静态 > 参数 > 通配符。所有路由添加完成后需调用 compile()，
+ * 编译后的路由表保存在连续数组中，match() 只读且不分配内存，可被多个线程同时调用。
+ */
+class Router {
+    public:
+        Router();
+        ~Router();
+        /**
+         * 添加路由，路由模式非法或与已有路由冲突时返回 false
+         */
+        bool addRoute(std::string_view method, std::string_view pattern, RouteHandler handler);
+        bool get(std::string_view pattern, RouteHandler handler) {
+            return addRoute("GET", pattern, std::move(handler));
+        }
+        bool post(std::string_view pattern, RouteHandler handler) {
+            return addRoute("POST", pattern, std::move(handler));
+        }
+        /**
+         * 将构建用的树压平为紧凑数组，之后才能 match()
+         */
+        void compile();
+        /**
+         * 查找路由，成功时填充 params 并返回处理函数，否则返回 nullptr
+         * HEAD 请求没有单独注册的路由时匹配 GET 路由，调用方需省略响应体
+         */
+        const RouteHandler* match(std::string_view method, std::string_view path, RouteParams& params) const;
+
+    private:
+        struct BuildNode;
+        struct Node {
+            // 静态节点的前缀，位于 labels 中
+            uint32_t labelOffset = 0;
+            uint32_t labelLength = 0;
+            // 静态子节点在 nodes 中连续存放
+            uint32_t firstChild = 0;
+            uint32_t childCount = 0;
+            int32_t paramChild = -1;
+            int32_t wildcardChild = -1;
+            // 参数 / 通配符节点的参数名，位于 labels 中
+            uint32_t nameOffset = 0;
+            uint32_t nameLength = 0;
+            int32_t handler = -1;
+        };
+        struct MethodRoot {
+            std::string method;
+            std::unique_ptr<BuildNode> tree;
+            int32_t root = -1;
+        };
+
+        std::vector<MethodRoot> methods;
+        std::vector<RouteHandler> handlers;
+        std::vector<Node> nodes;
+        std::string labels;
+
+        /**
+         * 向节点插入静态前缀，必要时分裂已有节点，返回前缀末端所在的节点
+         */
+        static BuildNode* insertStatic(BuildNode* node, std::string_view text);
+        void flatten(uint32_t index, const BuildNode* node);
+        int32_t matchNode(int32_t index, std::string_view path, size_t pos, RouteParams& params) const;
+        std::string_view label(uint32_t offset, uint32_t length) const {
+            return std::string_view(labels).substr(offset, length);
+        }
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef SERVER_CONTEXT_H
+#define SERVER_CONTEXT_H
+
+#include <Router.h>
+#include <RateLimiter.h>
+#include <FileMapCache.h>
+#include <TlsContext.h>
+#include <memory>
+
+/**
+ * 所有 ServerTask 共享的服务器状态，由 HttpServerWorker 持有
+ */
+struct ServerContext {
+    // 接口路由表，启动前编译完成，之后只读
+    Router router;
+    // 按客户端 IP 的限流器
+    RateLimiter rateLimiter;
+    // 中等大小热点文件的内存映射缓存
+    FileMapCache fileMapCache;
+    // HTTPS 上下文，为空时使用明文 HTTP
+    std::unique_ptr<TlsContext> tls;
+};
+
+#endif
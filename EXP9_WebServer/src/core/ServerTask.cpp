@@ -3,12 +3,19 @@
 #include <QFileInfo>
 #include <QFile>
 #include <sys/socket.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <errno.h>
 
 using std::string;
+using std::string_view;
 
-ServerTask::ServerTask(int clientSock, QString serverRoot, QString clientInfo, QObject* parent) : QObject(parent) {
+ServerTask::ServerTask(int clientSock, QString serverRoot, QString clientInfo, uint32_t clientIp, RateLimiter::ConnectionSlot connectionSlot, ServerContext* context, QObject* parent) : QObject(parent) {
     this->clientSock = clientSock;
+    this->clientIp = clientIp;
+    this->connectionSlot = connectionSlot;
+    this->context = context;
     if (serverRoot.endsWith("/")) {
         serverRoot = serverRoot.left(serverRoot.length() - 1);
     }
@@ -18,11 +25,11 @@ ServerTask::ServerTask(int clientSock, QString serverRoot, QString clientInfo, Q
     setAutoDelete(true);
 }
 
-void ServerTask::run() {
-    char* recvBuf = new char[8192];
-    QByteArray requestData;
-    HttpRequest* httpRequest;
+ServerTask::~ServerTask() {
+    context->rateLimiter.releaseConnection(connectionSlot);
+}
 
+void ServerTask::run() {
     // 设置 30s 接收超时
     timeval timeout;
     timeout.tv_sec = 30;
@@ -31,9 +38,51 @@ void ServerTask::run() {
         qDebug() << "设置 socket 接收超时失败";
     }
 
+    if (setupConnection()) {
+        if (connection->alpnProtocol() == "h2") {
+            // TLS 握手时已通过 ALPN 协商为 HTTP/2
+            serveHttp2(QByteArray());
+        } else {
+            serveRequests();
+        }
+    }
+
+    // 连接关闭
+    connection.reset();
+    // 操作结束
+    emit taskFinished(clientSock);
+}
+
+bool ServerTask::setupConnection() {
+    if (!context->tls) {
+        connection = std::make_unique<Connection>(clientSock);
+        return true;
+    }
+    SSL* ssl = context->tls->createSession(clientSock);
+    if (ssl == nullptr) {
+        qDebug() << "SSL 对象创建失败：" << clientInfo;
+        return false;
+    }
+    connection = std::make_unique<Connection>(clientSock, ssl);
+    string error;
+    if (!connection->handshake(error)) {
+        qDebug() << "TLS 握手失败：" << clientInfo << QString::fromStdString(error);
+        return false;
+    }
+    qDebug() << "TLS 握手完成：" << clientInfo << "ALPN：" << QString::fromStdString(connection->alpnProtocol()) << "会话恢复：" << connection->isSessionReused()
+             << "kTLS 发送：" << connection->canSendFile();
+    return true;
+}
+
+void ServerTask::serveRequests() {
+    const int RECV_BUF_SIZE = 8192;
+    char* recvBuf = new char[RECV_BUF_SIZE];
+    QByteArray requestData;
+    HttpRequest* httpRequest = nullptr;
+
     // 接收客户端发来的数据
     while (true) {
-        int recvlen = recv(clientSock, recvBuf, sizeof(recvBuf), 0);
+        int recvlen = connection->read(recvBuf, RECV_BUF_SIZE);
         if (recvlen < 0) {
             // 检查是否是超时或暂时性错误
             if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
@@ -50,9 +99,25 @@ void ServerTask::run() {
         }
         requestData.append(recvBuf, recvlen);
 
+        // 客户端直接以 HTTP/2 连接前言开头（prior knowledge）
+        if (requestData.startsWith("PRI * HTTP/2.0")) {
+            serveHttp2(requestData);
+            break;
+        }
+
         // 若接收到了完整的 HTTP 请求报文则处理请求
         httpRequest = parseRequest(requestData);
         if (httpRequest) {
+            // 明文连接上的 h2c 升级（TLS 连接只能通过 ALPN 协商）
+            QByteArray upgradeSettings = findHeader(httpRequest, "HTTP2-Settings");
+            if (!connection->isTls() && findHeader(httpRequest, "Upgrade").toLower() == "h2c" && !upgradeSettings.isEmpty()) {
+                const char response[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+                if (connection->writeAll(response, sizeof(response) - 1)) {
+                    serveHttp2(requestData.mid(httpRequest->headerData.size() + 4 + httpRequest->contentLength), httpRequest, upgradeSettings);
+                }
+                break;
+            }
+
             this->keepAlive = httpRequest->keepAlive;
             processHttpRequest(httpRequest);
 
@@ -65,14 +130,62 @@ void ServerTask::run() {
             }
         }
     }
-    
-    // 连接关闭
-    delete recvBuf;
+
+    delete[] recvBuf;
     if (httpRequest) {
         delete httpRequest;
     }
-    // 操作结束
-    emit taskFinished(clientSock);
+}
+
+void ServerTask::serveHttp2(const QByteArray& received, HttpRequest* upgradeRequest, const QByteArray& upgradeSettings) {
+    Http2Session session(*connection, [this](const Http2Session::Request& request) { processHttp2Request(request); });
+    http2 = &session;
+    qDebug() << "切换到 HTTP/2：" << clientInfo;
+
+    std::function<void()> onUpgradeStream;
+    if (upgradeRequest != nullptr) {
+        onUpgradeStream = [this, upgradeRequest]() {
+            http2StreamId = 1;
+            processHttpRequest(upgradeRequest);
+        };
+    }
+    session.run(string_view(received.constData(), received.size()), string_view(upgradeSettings.constData(), upgradeSettings.size()), onUpgradeStream);
+    http2 = nullptr;
+}
+
+void ServerTask::processHttp2Request(const Http2Session::Request& request) {
+    // 转换为 HTTP/1.1 形式的请求头，复用 processHttpRequest 的路由和静态文件逻辑
+    HttpRequest httpRequest;
+    QByteArray headerData;
+    headerData.append(request.header(":method")).append(' ').append(request.header(":path")).append(" HTTP/2");
+    string_view authority = request.header(":authority");
+    if (!authority.empty()) {
+        headerData.append("\r\nHost: ").append(authority);
+    }
+    for (const HpackHeader& h : request.headers) {
+        if (!h.name.starts_with(':')) {
+            headerData.append("\r\n").append(h.name).append(": ").append(h.value);
+        }
+    }
+    httpRequest.headerData = headerData;
+    httpRequest.headerLines = headerData.split('\n');
+    httpRequest.body = QByteArray(request.body.data(), request.body.size());
+    httpRequest.contentLength = request.body.size();
+    httpRequest.keepAlive = true;
+
+    http2StreamId = request.streamId;
+    processHttpRequest(&httpRequest);
+}
+
+QByteArray ServerTask::findHeader(const HttpRequest* request, const QByteArray& name) {
+    for (qsizetype i = 1; i < request->headerLines.size(); i++) {
+        const QByteArray& line = request->headerLines[i];
+        int colon = line.indexOf(':');
+        if (colon != -1 && line.left(colon).trimmed().compare(name, Qt::CaseInsensitive) == 0) {
+            return line.mid(colon + 1).trimmed();
+        }
+    }
+    return QByteArray();
 }
 
 HttpRequest* ServerTask::parseRequest(const QByteArray& data) {
@@ -113,6 +226,7 @@ HttpRequest* ServerTask::parseRequest(const QByteArray& data) {
         HttpRequest* result = new HttpRequest();
         result->body = data.mid(bodyStart, contentLength);
         result->contentLength = contentLength;
+        result->headerData = headerData;
         result->headerLines = headerLines;
         result->keepAlive = keepAlive;
         return result;
@@ -132,8 +246,45 @@ void ServerTask::processHttpRequest(HttpRequest* request) {
         return;
     }
 
-    QString method = firstLineParts[0];
-    QString path = firstLineParts[1];
+    // 请求速率或带宽超限
+    if (!context->rateLimiter.allowRequest(clientIp)) {
+        QByteArray content;
+        content.append("<html><head><meta charset=\"UTF-8\"></head><body><h1>429 Too Many Requests</h1><p>请求过于频繁，请稍后重试</p></body></html>");
+        sendResponse(429, "Too Many Requests", &content, "text/html", "");
+        return;
+    }
+
+    // 分离路径和查询字符串
+    const QByteArray& rawMethod = firstLineParts[0];
+    const QByteArray& target = firstLineParts[1];
+    int queryStart = target.indexOf('?');
+    QByteArray rawPath = queryStart == -1 ? target : target.left(queryStart);
+
+    QString method = rawMethod;
+    QString path = rawPath;
+    headRequest = method == "HEAD";
+
+    // 优先交给接口路由表处理
+    {
+        HttpRequestView view;
+        view.method = string_view(rawMethod.constData(), rawMethod.size());
+        view.path = string_view(rawPath.constData(), rawPath.size());
+        if (queryStart != -1) {
+            view.query = string_view(target.constData() + queryStart + 1, target.size() - queryStart - 1);
+        }
+        int firstLineEnd = request->headerData.indexOf('\n');
+        if (firstLineEnd != -1) {
+            view.headers = string_view(request->headerData.constData() + firstLineEnd + 1, request->headerData.size() - firstLineEnd - 1);
+        }
+        view.body = string_view(request->body.constData(), request->body.size());
+
+        const RouteHandler* handler = context->router.match(view.method, view.path, view.params);
+        if (handler != nullptr) {
+            emit logMessage(QString("已处理来自%1的接口请求，方法：%2，路径：%3").arg(clientInfo).arg(method).arg(path));
+            (*handler)(view, *this);
+            return;
+        }
+    }
 
     if (method == "GET" || method == "HEAD") {
         QString filePath = getFilesystemPath(path);
@@ -157,6 +308,12 @@ void ServerTask::processHttpRequest(HttpRequest* request) {
         QString date = getDate(filePath);
 
         if (method == "GET") {
+            // 中等大小的文件直接从内存映射发送
+            std::shared_ptr<const FileMapping> mapping = context->fileMapCache.acquire(filePath.toStdString());
+            if (mapping) {
+                sendMappedResponse(mapping, filePath, mimeType, date);
+                return;
+            }
             // 读取文件
             QFile file(filePath);
             if (file.open(QIODeviceBase::ReadOnly)) {
@@ -173,30 +330,12 @@ void ServerTask::processHttpRequest(HttpRequest* request) {
         }
         
     } else if (method == "POST") {
-        // 测试 POST 接口
-        if (path == "/testPostApi") {
-            // 读取表单
-            QList<QByteArray> fields = request->body.split('&');
-            QString name;
-            if (fields.size() > 0) {
-                // 找到name字段
-                for (QString field : fields) {
-                    if (field.startsWith("name=")) {
-                        name = field.mid(5, field.size() - 1);
-                        break;
-                    }
-                }
-            }
-            QByteArray content;
-            content.append(QString("Hello %1!").arg(name).toUtf8());
-            sendResponse(200, "OK", &content, "text/plain", "");
-        } else {
-            QByteArray content;
-            content.append(
-                QString("<html><head><meta charset=\"UTF-8\"></head><body><h1>404 Not Found</h1><p>请求的资源 %1 不存在</p></body></html>").arg(path).toUtf8());
-            sendResponse(404, "Not Found", &content, "text/html", "");
-            return;
-        }
+        // 没有匹配的接口
+        QByteArray content;
+        content.append(
+            QString("<html><head><meta charset=\"UTF-8\"></head><body><h1>404 Not Found</h1><p>请求的资源 %1 不存在</p></body></html>").arg(path).toUtf8());
+        sendResponse(404, "Not Found", &content, "text/html", "");
+        return;
     } else {
         QByteArray content;
         content.append(QString("<html><head><meta charset=\"UTF-8\"></head><body><h1>405 Method Not Allowed</h1><p>不支持使用 %1 方法</p></body></html>").arg(method).toUtf8());
@@ -206,17 +345,114 @@ void ServerTask::processHttpRequest(HttpRequest* request) {
     return;
 }
 
-bool ServerTask::sendResponse(int code, QString description, QByteArray* content, QString contentType, QString date, int length) {
+bool ServerTask::writeResponse(int code, string_view description, string_view body, string_view contentType) {
+    QString qDescription = QString::fromUtf8(description.data(), description.size());
+    QString qContentType = QString::fromUtf8(contentType.data(), contentType.size());
+    if (headRequest) {
+        // HEAD 请求匹配到 GET 路由，只发送头部，Content-Length 与 GET 的响应体一致
+        return sendResponse(code, qDescription, nullptr, qContentType, "", body.size());
+    }
+    QByteArray content(body.data(), body.size());
+    return sendResponse(code, qDescription, &content, qContentType, "");
+}
+
+bool ServerTask::sendResponse(int code, QString description, QByteArray* content, QString contentType, QString date, qint64 length) {
+    // Content-Length：普通有响应体的响应用响应体长度，HEAD 方法使用 length 参数，为 0 时也要发送
+    qint64 contentLength = content != nullptr ? content->size() : length;
+    if (http2 != nullptr) {
+        Http2Session::Response response;
+        response.status = code;
+        response.headers.push_back(HpackHeader{"server", "MyCustomServer"});
+        if (contentLength >= 0) {
+            response.headers.push_back(HpackHeader{"content-length", std::to_string(contentLength)});
+        }
+        if (!contentType.isEmpty()) {
+            response.headers.push_back(HpackHeader{"content-type", contentType.toStdString()});
+        }
+        if (!date.isEmpty()) {
+            response.headers.push_back(HpackHeader{"date", date.toStdString()});
+        }
+        if (content != nullptr) {
+            response.body.assign(content->constData(), content->size());
+        } else {
+            response.headOnly = true;
+        }
+        context->rateLimiter.consumeBytes(clientIp, response.body.size());
+        http2->submitResponse(http2StreamId, std::move(response));
+        return true;
+    }
+
+    QByteArray header = buildResponseHeader(code, description, contentLength, contentType, date);
+
+    // 计入带宽令牌
+    context->rateLimiter.consumeBytes(clientIp, header.size() + (content != nullptr ? content->size() : 0));
+
+    // 发送数据
+    if (!connection->writeAll(header.constData(), header.size())) {
+        return false;
+    }
+    if (content != nullptr && content->size() > 0) {
+        return connection->writeAll(content->constData(), content->size());
+    }
+    return true;
+}
+
+bool ServerTask::sendMappedResponse(const std::shared_ptr<const FileMapping>& mapping, QString filePath, QString contentType, QString date) {
+    if (http2 != nullptr) {
+        // 由会话的调度器分块从映射区发送，与其他流交错
+        Http2Session::Response response;
+        response.headers.push_back(HpackHeader{"server", "MyCustomServer"});
+        response.headers.push_back(HpackHeader{"content-length", std::to_string(mapping->size())});
+        response.headers.push_back(HpackHeader{"content-type", contentType.toStdString()});
+        response.headers.push_back(HpackHeader{"date", date.toStdString()});
+        response.mapping = mapping;
+        context->rateLimiter.consumeBytes(clientIp, mapping->size());
+        http2->submitResponse(http2StreamId, std::move(response));
+        return true;
+    }
+    QByteArray header = buildResponseHeader(200, "OK", mapping->size(), contentType, date);
+    context->rateLimiter.consumeBytes(clientIp, header.size() + mapping->size());
+    if (!connection->writeAll(header.constData(), header.size())) {
+        return false;
+    }
+    // kTLS 由内核加密，直接用 SSL_sendfile 零拷贝发送，不经过用户态。
+    // 需要按路径重新打开文件，文件在映射之后被替换或修改时，它与已发出的 Content-Length 不一致，改为从映射区发送
+    int fileFd = -1;
+    if (connection->isTls() && connection->canSendFile()) {
+        fileFd = open(filePath.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fileFd >= 0 && (fstat(fileFd, &st) < 0 || !mapping->matches(st))) {
+            close(fileFd);
+            fileFd = -1;
+        }
+    }
+    bool ok;
+    if (fileFd >= 0) {
+        ok = connection->sendFile(fileFd, 0, mapping->size());
+        close(fileFd);
+    } else {
+        // 响应体直接从映射区发送，不复制到 QByteArray（TLS 在用户态加密时按块复制）
+        ok = connection->writeMapped(*mapping, 0, mapping->size());
+    }
+    if (!ok) {
+        // 文件在发送过程中被截断或连接出错，已发送的响应不完整，只能关闭连接
+        qDebug() << "从文件映射发送失败：" << filePath << strerror(errno);
+        context->fileMapCache.invalidate(filePath.toStdString());
+        this->keepAlive = false;
+        connection->abort();
+    }
+    return ok;
+}
+
+QByteArray ServerTask::buildResponseHeader(int code, QString description, qint64 contentLength, QString contentType, QString date) {
     // 状态行
-    QString statusLine = QString("HTTP/1.1 %1 %2\r\n").arg(code).arg(description);
+    QString header = QString("HTTP/1.1 %1 %2\r\n").arg(code).arg(description);
     // 响应头
-    QString header = QString("Server: MyCustomServer\r\n");
+    header = header.append("Server: MyCustomServer\r\n");
 
     // Content-Length
-    if (content != nullptr) {    // 普通有响应体的响应
-        header = header.append(QString("Content-Length: %1\r\n").arg(content->size()));
-    } else if (length > 0) {    // HEAD 方法
-        header = header.append(QString("Content-Length: %1\r\n").arg(length));
+    if (contentLength >= 0) {
+        header = header.append(QString("Content-Length: %1\r\n").arg(contentLength));
     }
 
     // Content-Type
@@ -237,14 +473,7 @@ bool ServerTask::sendResponse(int code, QString description, QByteArray* content
     }
 
     header = header.append("\r\n");
-
-    // 发送数据
-    send(clientSock, statusLine.toUtf8().constData(), statusLine.toUtf8().size(), 0);
-    send(clientSock, header.toUtf8().constData(), header.toUtf8().size(), 0);
-    if (content != nullptr && content->size() > 0) {
-        send(clientSock, content->constData(), content->size(), 0);
-    }
-    return true;
+    return header.toUtf8();
 }
 
 QString ServerTask::getFilesystemPath(QString requestPath) {
@@ -6,18 +6,24 @@
 #include <QByteArray>
 #include <QRunnable>
 #include <QMimeDatabase>
+#include <memory>
+#include <ServerContext.h>
+#include <Connection.h>
+#include <Http2Session.h>
 
 /**
  * HTTP 请求解析结构体
  */
 typedef struct {
     int contentLength;
+    // 请求头原始数据（不含末尾的空行）
+    QByteArray headerData;
     QList<QByteArray> headerLines;
     QByteArray body;
     bool keepAlive;
 } HttpRequest;
 
-class ServerTask : public QObject, public QRunnable {
+class ServerTask : public QObject, public QRunnable, public ResponseWriter {
     Q_OBJECT
 
     signals:
@@ -25,15 +31,57 @@ class ServerTask : public QObject, public QRunnable {
         void taskFinished(int clientSocket);
 
     public:
-        explicit ServerTask(int clientSock, QString serverRoot, QString clientInfo, QObject *parent = nullptr);
+        explicit ServerTask(int clientSock, QString serverRoot, QString clientInfo, uint32_t clientIp, RateLimiter::ConnectionSlot connectionSlot, ServerContext* context, QObject *parent = nullptr);
+        /**
+         * 归还连接名额。线程池停止时丢弃的任务不会运行，但同样会被析构
+         */
+        ~ServerTask() override;
         void run() override;
+        /**
+         * 供路由处理函数使用的响应写出接口
+         */
+        bool writeResponse(int code, std::string_view description, std::string_view body, std::string_view contentType) override;
 
     private:
         int clientSock;
         QString serverRoot;
         QString clientInfo;
+        // 客户端 IPv4 地址（主机字节序）
+        uint32_t clientIp;
+        // 接受连接时占用的单 IP 连接名额，析构时归还
+        RateLimiter::ConnectionSlot connectionSlot;
+        // 共享的服务器状态，由 HttpServerWorker 持有
+        ServerContext* context;
+        // 连接读写（明文或 TLS），在 run() 中创建
+        std::unique_ptr<Connection> connection;
         const QMimeDatabase mimeDatabase;
         bool keepAlive = false;
+        // 当前请求是否为 HEAD，路由处理函数写出的响应只发送头部
+        bool headRequest = false;
+        // 连接切换到 HTTP/2 后指向当前会话，响应改为提交到 http2StreamId 对应的流
+        Http2Session* http2 = nullptr;
+        int32_t http2StreamId = 0;
+        /**
+         * 创建连接对象并完成 TLS 握手，返回是否成功
+         */
+        bool setupConnection();
+        /**
+         * 循环接收并处理 HTTP/1.1 请求，直到连接关闭
+         */
+        void serveRequests();
+        /**
+         * 以 HTTP/2 处理连接，received 为已读到的数据。
+         * h2c 升级时 upgradeRequest 为升级请求，作为流 1 处理，upgradeSettings 为 HTTP2-Settings 头部的值
+         */
+        void serveHttp2(const QByteArray& received, HttpRequest* upgradeRequest = nullptr, const QByteArray& upgradeSettings = QByteArray());
+        /**
+         * 把 HTTP/2 请求转换为 HttpRequest 后交给 processHttpRequest 处理
+         */
+        void processHttp2Request(const Http2Session::Request& request);
+        /**
+         * 查找请求头字段（不区分大小写），不存在时返回空
+         */
+        static QByteArray findHeader(const HttpRequest* request, const QByteArray& name);
         /**
          * 解析 HTTP 请求，返回解析结果，nullptr 代表请求不完整
          */
@@ -46,8 +94,17 @@ class ServerTask : public QObject, public QRunnable {
          * 发送响应，返回是否成功。content 可为 nullptr。
          * 若 content 为 nullptr，可指定 length 参数（用于 HEAD 方法）
          * 若 content 非 nullptr，忽略 length 参数
+         * 总是发送 Content-Length（包括 0），keep-alive 连接上客户端据此判断响应在哪里结束
+         */
+        bool sendResponse(int code, QString description, QByteArray* content, QString contentType, QString date, qint64 length = 0);
+        /**
+         * 直接从文件映射区发送响应体，返回是否成功
+         */
+        bool sendMappedResponse(const std::shared_ptr<const FileMapping>& mapping, QString filePath, QString contentType, QString date);
+        /**
+         * 生成状态行和响应头，contentLength 小于 0 时不输出 Content-Length
          */
-        bool sendResponse(int code, QString description, QByteArray* content, QString contentType, QString date, int length = 0);
+        QByteArray buildResponseHeader(int code, QString description, qint64 contentLength, QString contentType, QString date);
         /**
          * 从 HTTP 请求路径获取系统文件绝对路径。若返回403代表路径非法，返回404代表找不到文件
          */
@@ -0,0 +1,126 @@
+#include <TlsContext.h>
+#include <openssl/err.h>
+#include <signal.h>
+
+namespace {
+
+// 会话缓存的上下文标识，恢复会话时 OpenSSL 要求与创建时一致
+const unsigned char SESSION_ID_CONTEXT[] = "EXP9_WebServer";
+
+}  // namespace
+
+std::string takeOpensslErrors() {
+    std::string result;
+    unsigned long code;
+    char buf[256];
+    while ((code = ERR_get_error()) != 0) {
+        ERR_error_string_n(code, buf, sizeof(buf));
+        if (!result.empty()) {
+            result += "; ";
+        }
+        result += buf;
+    }
+    return result;
+}
+
+TlsContext::~TlsContext() {
+    if (ctx != nullptr) {
+        SSL_CTX_free(ctx);
+    }
+}
+
+bool TlsContext::init(const TlsConfig& config, std::string& error) {
+    this->config = config;
+    ERR_clear_error();
+
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (ctx == nullptr) {
+        error = "SSL_CTX 创建失败：" + takeOpensslErrors();
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, config.certFile.c_str()) != 1) {
+        error = "加载证书失败：" + takeOpensslErrors();
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, config.keyFile.c_str(), SSL_FILETYPE_PEM) != 1) {
+        error = "加载私钥失败：" + takeOpensslErrors();
+        return false;
+    }
+    if (SSL_CTX_check_private_key(ctx) != 1) {
+        error = "证书与私钥不匹配：" + takeOpensslErrors();
+        return false;
+    }
+
+    // 密码套件
+    if (!config.cipherList.empty() && SSL_CTX_set_cipher_list(ctx, config.cipherList.c_str()) != 1) {
+        error = "密码套件列表无效：" + takeOpensslErrors();
+        return false;
+    }
+    if (!config.cipherSuites.empty() && SSL_CTX_set_ciphersuites(ctx, config.cipherSuites.c_str()) != 1) {
+        error = "TLS 1.3 密码套件列表无效：" + takeOpensslErrors();
+        return false;
+    }
+    SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_RENEGOTIATION);
+
+    // 会话恢复：服务端缓存（会话 ID）+ 会话票据
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    SSL_CTX_sess_set_cache_size(ctx, 20480);
+    SSL_CTX_set_timeout(ctx, 3600);
+    if (config.sessionTickets > 0) {
+        SSL_CTX_set_num_tickets(ctx, config.sessionTickets);
+    } else {
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+        SSL_CTX_set_num_tickets(ctx, 0);
+    }
+
+    // ALPN
+    alpnWire.clear();
+    for (const std::string& protocol : config.alpnProtocols) {
+        if (protocol.empty() || protocol.size() > 255) {
+            error = "ALPN 协议名无效：" + protocol;
+            return false;
+        }
+        alpnWire.push_back((unsigned char)protocol.size());
+        alpnWire.insert(alpnWire.end(), protocol.begin(), protocol.end());
+    }
+    if (!alpnWire.empty()) {
+        SSL_CTX_set_alpn_select_cb(ctx, selectAlpn, this);
+    }
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if (config.enableKtls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
+    // 对端关闭后 SSL_write 写 socket 会触发 SIGPIPE，忽略它并通过返回值处理
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+SSL* TlsContext::createSession(int sock) {
+    SSL* ssl = SSL_new(ctx);
+    if (ssl == nullptr) {
+        return nullptr;
+    }
+    if (SSL_set_fd(ssl, sock) != 1) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    return ssl;
+}
+
+int TlsContext::selectAlpn(SSL* /* ssl */, const unsigned char** out, unsigned char* outLength, const unsigned char* in, unsigned int inLength, void* arg) {
+    TlsContext* self = (TlsContext*)arg;
+    // 服务端优先：按照服务端列表的顺序在客户端列表中查找
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outLength, self->alpnWire.data(), (unsigned int)self->alpnWire.size(), in, inLength) != OPENSSL_NPN_NEGOTIATED) {
+        // 没有共同协议时不使用 ALPN，而不是中断握手
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
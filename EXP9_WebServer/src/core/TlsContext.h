@@ -0,0 +1,67 @@
+#ifndef TLS_CONTEXT_H
+#define TLS_CONTEXT_H
+
+#include <string>
+#include <vector>
+#include <openssl/ssl.h>
+
+/**
+ * HTTPS 参数
+ */
+struct TlsConfig {
+    // PEM 格式的证书链和私钥文件
+    std::string certFile;
+    std::string keyFile;
+    // TLS 1.2 及以下的密码套件列表（OpenSSL 格式），为空时使用 OpenSSL 默认值
+    std::string cipherList;
+    // TLS 1.3 密码套件列表，为空时使用 OpenSSL 默认值
+    std::string cipherSuites;
+    // 按优先级排列的 ALPN 协议
+    std::vector<std::string> alpnProtocols = {"h2", "http/1.1"};
+    // 每次完整握手后下发的会话票据数量，0 表示关闭票据
+    int sessionTickets = 2;
+    // 内核支持时把记录层加解密交给内核（kTLS）
+    bool enableKtls = true;
+};
+
+/**
+ * 服务器端 TLS 上下文，封装 SSL_CTX
+ *
+ * - 会话恢复：同时开启服务端会话缓存和无状态会话票据（票据密钥由 OpenSSL 随机生成，进程内有效）
+ * - ALPN：按 alpnProtocols 的顺序选择第一个客户端也支持的协议
+ * - kTLS：设置 SSL_OP_ENABLE_KTLS，握手完成后若内核接管了发送方向，静态文件可以用 SSL_sendfile 零拷贝发送
+ */
+class TlsContext {
+    public:
+        TlsContext() = default;
+        ~TlsContext();
+        TlsContext(const TlsContext&) = delete;
+        TlsContext& operator=(const TlsContext&) = delete;
+
+        /**
+         * 加载证书、私钥并应用配置，失败时返回 false 并写入错误描述
+         */
+        bool init(const TlsConfig& config, std::string& error);
+        /**
+         * 为一个已接受的连接创建 SSL 对象，调用者负责握手和 SSL_free
+         */
+        SSL* createSession(int sock);
+        const TlsConfig& getConfig() const {
+            return config;
+        }
+
+    private:
+        SSL_CTX* ctx = nullptr;
+        TlsConfig config;
+        // ALPN 协议列表的线路格式（长度前缀）
+        std::vector<unsigned char> alpnWire;
+
+        static int selectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outLength, const unsigned char* in, unsigned int inLength, void* arg);
+};
+
+/**
+ * 取出 OpenSSL 错误队列中的全部错误描述
+ */
+std::string takeOpensslErrors();
+
+#endif
@@ -20,6 +20,7 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWi
     connect(ui->webRootPathBrowseBtn, &QPushButton::clicked, this, &MainWindow::browseServerRootDir);
     connect(ui->startServerBtn, &QPushButton::clicked, this, &MainWindow::onStartServerBtnClicked);
     connect(ui->stopServerBtn, &QPushButton::clicked, this, &MainWindow::onStopServerBtnClicked);
+    connect(ui->enableTlsCheckBox, &QCheckBox::toggled, this, &MainWindow::updateTlsControls);
 }
 
 void MainWindow::browseServerRootDir() {
@@ -66,6 +67,10 @@ void MainWindow::onStartServerBtnClicked() {
 
     QString rootPath = ui->webRootPathLineEdit->text();
     int port = stoi(ui->setverPortLineEdit->text().toStdString());
+    // HTTPS 参数需在启动前设置，排队调用保证先于 startServer 执行
+    QString certFile = ui->enableTlsCheckBox->isChecked() ? ui->tlsCertPathLineEdit->text() : "";
+    QMetaObject::invokeMethod(this->serverWorker, "configureTls", Qt::QueuedConnection, Q_ARG(QString, certFile), Q_ARG(QString, ui->tlsKeyPathLineEdit->text()),
+                              Q_ARG(QString, ui->tlsCipherLineEdit->text()));
     QMetaObject::invokeMethod(this->serverWorker, "startServer", Qt::QueuedConnection, Q_ARG(QString, rootPath), Q_ARG(int, port));
     
     isServerRunning = true;
@@ -89,6 +94,10 @@ void MainWindow::disableControls() {
     ui->webRootPathBrowseBtn->setEnabled(false);
     ui->setverPortLineEdit->setEnabled(false);
     ui->startServerBtn->setEnabled(false);
+    ui->enableTlsCheckBox->setEnabled(false);
+    ui->tlsCertPathLineEdit->setEnabled(false);
+    ui->tlsKeyPathLineEdit->setEnabled(false);
+    ui->tlsCipherLineEdit->setEnabled(false);
 }
 
 void MainWindow::enableControls() {
@@ -96,6 +105,15 @@ void MainWindow::enableControls() {
     ui->webRootPathBrowseBtn->setEnabled(true);
     ui->setverPortLineEdit->setEnabled(true);
     ui->startServerBtn->setEnabled(true);
+    ui->enableTlsCheckBox->setEnabled(true);
+    updateTlsControls();
+}
+
+void MainWindow::updateTlsControls() {
+    bool enabled = ui->enableTlsCheckBox->isChecked();
+    ui->tlsCertPathLineEdit->setEnabled(enabled);
+    ui->tlsKeyPathLineEdit->setEnabled(enabled);
+    ui->tlsCipherLineEdit->setEnabled(enabled);
 }
 
 void MainWindow::onServerStarted() {
@@ -124,6 +142,12 @@ bool MainWindow::validateInput() {
         QMessageBox::information(this, "无法启动服务器", "选择的Web根目录路径不是目录，请重新选择。", QMessageBox::StandardButton::Ok);
         return false;
     }
+    if (ui->enableTlsCheckBox->isChecked()) {
+        if (!exists(ui->tlsCertPathLineEdit->text().toStdString()) || !exists(ui->tlsKeyPathLineEdit->text().toStdString())) {
+            QMessageBox::information(this, "无法启动服务器", "HTTPS 证书或私钥文件不存在，请重新输入。", QMessageBox::StandardButton::Ok);
+            return false;
+        }
+    }
     try {
         int port = stoi(ui->setverPortLineEdit->text().toStdString());
         if (port < 1 || port > 65535) {
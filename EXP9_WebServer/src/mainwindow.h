@@ -23,6 +23,7 @@ class MainWindow : public QMainWindow {
     void onLogMessage(QString message);
     void onServerStarted();
     void onServerStopped();
+    void updateTlsControls();
   
   protected:
     void closeEvent(QCloseEvent* event) override;
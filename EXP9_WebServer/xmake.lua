@@ -5,6 +5,7 @@ set_languages("c++23")
 target("./EXP9_WebServer/")
     add_rules("qt.widgetapp")
     add_packages("qt6core", "qt6widgets", "qt6gui")
+    add_syslinks("ssl", "crypto")
     add_headerfiles("src/**.h")
     add_includedirs("src", "src/core")
     add_files("src/**.cpp")